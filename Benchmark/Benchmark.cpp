@@ -0,0 +1,1528 @@
+#include <iostream>
+#include "../MMFSoundPlayer/MMFSoundPlayer.h"
+#include "../MMFSoundPlayer/HeadlessBackend.h"
+#include "../MMFSoundPlayer/WaveformOverviewGenerator.h"
+#include "../MMFSoundPlayer/LibraryScanner.h"
+#include "../MMFSoundPlayer/SeekIndex.h"
+#include "../MMFSoundPlayer/Resampler.h"
+#include "../MMFSoundPlayer/PlayerPool.h"
+#include "../MMFSoundPlayer/VoiceEngine.h"
+#include "../MMFSoundPlayer/MemoryMappedFile.h"
+#include "../MMFSoundPlayer/MemoryMedia.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Latency and throughput of the player's control surface, on the headless backend (null sink, real-time pacing) with
+generated audio, so runs are comparable between machines and don't depend on audio hardware or files on disk. Also the
+cost of a visualization frame (SpectrumAnalyzer) per FFT size, with the scalar kernels and the best ones of the CPU, and
+the throughput of waveform overview generation in hours of audio per second (on one worker and on all of them, decoding
+files that were just written and so come from the page cache), plus a pass over the same files once they are cached.
+Then smaller scenarios, each reported under "scenarios": the cost of reading the playback position, asking the backend
+against the interpolated clock, and library scan throughput in files per second over a generated folder tree, cold (empty
+index) and rescanned with nothing changed, and the seek index of a VBR MP3: build time, lookup cost and the position error
+of a seek without it (by average bitrate) against one with it, and scrubbing: how long a burst of positions from a dragged
+seek bar takes to settle with coalescing scrubs against issuing every one of them as a seek, and the gain kernels'
+throughput in millions of samples per second, scalar and with the best instruction set, and what a crossfade costs the
+render thread: rendering two files back to back as fast as possible, gapless and crossfading, and the resampler's
+throughput in millions of stereo samples per second per quality preset and conversion, and how a player pool scales to
+many players: players per second created and reused, and memory per player, and the voice engine: how long a trigger
+takes to be heard, and how many voices one core can mix in real time, and reading files through memory mappings against
+buffered reads of a file handle: open time, read throughput and the resident memory a pass through a file leaves behind.
+Last, audio held in memory: how long it takes to hear it played from a MemoryMedia path against writing it to a
+temporary file and playing that.
+
+Usage: Benchmark [--iterations N] [--threads N] [--contention-seconds N] [--overview-minutes N] [--scan-files N] [--pool-players N] [--output file.json]
+The results are written as JSON to the output file (or stdout), latencies in microseconds.
+*/
+
+namespace fs = std::filesystem;
+using namespace MMFSoundPlayerLib;
+using BenchmarkClock = std::chrono::steady_clock;
+
+struct BenchmarkOptions
+{
+	UINT32 Iterations = 200;
+	UINT32 ContentionThreads = 8;
+	UINT32 ContentionSeconds = 2;
+	UINT32 OverviewMinutes = 5;
+	UINT32 ScanFiles = 2000;
+	UINT32 PoolPlayers = 1000;
+	std::string OutputFilePath;
+};
+
+struct LatencySamples
+{
+	std::string Name;
+	std::vector<double> Microseconds = {};
+	UINT32 Failures = 0;
+};
+
+struct ContentionResult
+{
+	UINT32 Threads = 0;
+	double Seconds = 0;
+	UINT64 Operations = 0;
+	UINT64 Failures = 0;
+	LatencySamples Latency;
+};
+
+//One of the smaller scenarios: named values (throughputs, counts, errors, with their unit in the name) and latencies
+struct ScenarioResult
+{
+	std::string Name;
+	std::vector<std::pair<std::string, double>> Values = {};
+	std::vector<LatencySamples> Latencies = {};
+	UINT32 Failures = 0;
+};
+
+struct OverviewResult
+{
+	UINT32 Files = 0;
+	double AudioHours = 0;
+	UINT32 Threads = 0;
+	double SingleThreadSeconds = 0;
+	double AllThreadsSeconds = 0;
+	double Cached_Milliseconds = 0;
+	UINT64 Failures = 0;
+};
+
+//Function declarations
+bool ParseArguments(int argc, char** argv, BenchmarkOptions* outputOptions);
+bool WriteSineWavFile(const fs::path& outputFilePath, UINT32 sampleRate, UINT32 durationSeconds, double frequency);
+bool WriteVbrMpegAudioFile(const fs::path& outputFilePath, UINT32 frameCount, UINT32 encoderDelay, std::vector<UINT64>* outputFrameOffsets);
+HRESULT CreateHeadlessPlayer(MMFSoundPlayer** outputPlayer);
+double MeasureMicroseconds(BenchmarkClock::time_point start);
+void RecordSample(LatencySamples& samples, BenchmarkClock::time_point start, HRESULT hr);
+ContentionResult RunContention(MMFSoundPlayer* player, UINT32 threadCount, UINT32 seconds, UINT64 fileDuration_100NanoSecondUnits);
+std::vector<LatencySamples> MeasureAnalyzer(UINT32 iterations);
+OverviewResult MeasureOverviewGeneration(UINT32 minutesPerFile);
+ScenarioResult MeasurePositionReads(const std::wstring& filePath, UINT32 iterations);
+ScenarioResult MeasureLibraryScan(UINT32 fileCount);
+ScenarioResult MeasureSeekIndex(UINT32 iterations);
+ScenarioResult MeasureScrubbing(const std::wstring& filePath, UINT64 fileDuration, UINT32 iterations);
+ScenarioResult MeasureGainKernels(UINT32 iterations);
+ScenarioResult MeasureCrossfade(const std::wstring filePaths[2], UINT32 iterations);
+ScenarioResult MeasureResampler(UINT32 iterations);
+ScenarioResult MeasurePlayerPool(UINT32 playerCount);
+ScenarioResult MeasureVoiceEngine(UINT32 iterations);
+ScenarioResult MeasureMappedFiles(UINT32 iterations);
+ScenarioResult MeasureMemoryMedia(UINT32 iterations);
+std::string FormatResults(const BenchmarkOptions& options, const std::vector<LatencySamples>& latencies, const ContentionResult& contention, const std::vector<LatencySamples>& analyzerCosts, const OverviewResult& overview, const std::vector<ScenarioResult>& scenarios);
+void AppendLatency(std::ostringstream& output, const LatencySamples& samples);
+
+//Constants
+UINT32 const SampleRate = 48000;
+UINT32 const FileDurationSeconds = 10;
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	if (!ParseArguments(argc, argv, &options))
+	{
+		std::cerr << "Usage: Benchmark [--iterations N] [--threads N] [--contention-seconds N] [--overview-minutes N] [--scan-files N] [--pool-players N] [--output file.json]\n";
+		return 1;
+	}
+
+	//Generate the audio the player switches between
+	fs::path firstFilePath = fs::temp_directory_path() / "MMFSoundPlayerBenchmark_A.wav";
+	fs::path secondFilePath = fs::temp_directory_path() / "MMFSoundPlayerBenchmark_B.wav";
+	if (!WriteSineWavFile(firstFilePath, SampleRate, FileDurationSeconds, 440.0) || !WriteSineWavFile(secondFilePath, SampleRate, FileDurationSeconds, 660.0))
+	{
+		std::cerr << "Failed to generate the benchmark audio\n";
+		return 1;
+	}
+	std::wstring filePaths[2] = { firstFilePath.wstring(), secondFilePath.wstring() };
+	UINT64 fileDuration = FileDurationSeconds * OneSecond_100NanoSecondUnits;
+
+	LatencySamples setFileLatency{ "SetFileIntoPlayer" };
+	LatencySamples playLatency{ "Play" };
+	LatencySamples pauseLatency{ "Pause" };
+	LatencySamples stopLatency{ "Stop" };
+	LatencySamples seekLatency{ "Seek" };
+	LatencySamples trackSwitchLatency{ "TrackSwitch" };
+	LatencySamples shutdownLatency{ "Shutdown" };
+
+	//Transport commands, on one player that stays open
+	MMFSoundPlayer* player = nullptr;
+	HRESULT hr = CreateHeadlessPlayer(&player);
+	if (FAILED(hr))
+	{
+		std::cerr << "Failed to create the media player\n";
+		return 1;
+	}
+	if (FAILED(player->SetFileIntoPlayer(filePaths[0].c_str())))
+	{
+		std::cerr << "Failed to set file into player\n";
+		player->Shutdown();
+		player->Release();
+		return 1;
+	}
+	std::mt19937_64 random(1);
+	std::uniform_int_distribution<UINT64> seekPositions(0, fileDuration - OneSecond_100NanoSecondUnits);
+	for (UINT32 iteration = 0; iteration < options.Iterations; iteration++)
+	{
+		//Pause and resume, stop and restart from the top, then jump somewhere in the file
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		RecordSample(pauseLatency, start, player->Pause());
+		start = BenchmarkClock::now();
+		RecordSample(playLatency, start, player->Play());
+		start = BenchmarkClock::now();
+		RecordSample(stopLatency, start, player->Stop());
+		start = BenchmarkClock::now();
+		RecordSample(playLatency, start, player->Play());
+		start = BenchmarkClock::now();
+		RecordSample(seekLatency, start, player->Seek(seekPositions(random)));
+
+		//Skip to the other file while this one plays (close, open and play)
+		start = BenchmarkClock::now();
+		RecordSample(trackSwitchLatency, start, player->SetFileIntoPlayer(filePaths[(iteration + 1) % 2].c_str()));
+	}
+
+	//Control throughput with every thread issuing commands to the same player
+	ContentionResult contention = RunContention(player, options.ContentionThreads, options.ContentionSeconds, fileDuration);
+	player->Shutdown();
+	player->Release();
+
+	//Opening into a new player, and shutting a playing one down
+	for (UINT32 iteration = 0; iteration < options.Iterations; iteration++)
+	{
+		MMFSoundPlayer* newPlayer = nullptr;
+		hr = CreateHeadlessPlayer(&newPlayer);
+		if (FAILED(hr))
+		{
+			setFileLatency.Failures++;
+			continue;
+		}
+
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		hr = newPlayer->SetFileIntoPlayer(filePaths[iteration % 2].c_str());
+		RecordSample(setFileLatency, start, hr);
+
+		start = BenchmarkClock::now();
+		RecordSample(shutdownLatency, start, newPlayer->Shutdown());
+		newPlayer->Release();
+	}
+
+	//Visualization frames, away from any player
+	std::vector<LatencySamples> analyzerCosts = MeasureAnalyzer(options.Iterations);
+
+	//Waveform overviews of longer files
+	OverviewResult overview = MeasureOverviewGeneration(options.OverviewMinutes);
+
+	//The smaller scenarios
+	std::vector<ScenarioResult> scenarios;
+	scenarios.push_back(MeasurePositionReads(filePaths[0], options.Iterations));
+	scenarios.push_back(MeasureLibraryScan(options.ScanFiles));
+	scenarios.push_back(MeasureSeekIndex(options.Iterations));
+	scenarios.push_back(MeasureScrubbing(filePaths[0], fileDuration, options.Iterations));
+	scenarios.push_back(MeasureGainKernels(options.Iterations));
+	scenarios.push_back(MeasureCrossfade(filePaths, options.Iterations));
+	scenarios.push_back(MeasureResampler(options.Iterations));
+	scenarios.push_back(MeasurePlayerPool(options.PoolPlayers));
+	scenarios.push_back(MeasureVoiceEngine(options.Iterations));
+	scenarios.push_back(MeasureMappedFiles(options.Iterations));
+	scenarios.push_back(MeasureMemoryMedia(options.Iterations));
+	fs::remove(firstFilePath);
+	fs::remove(secondFilePath);
+
+	//Report
+	std::vector<LatencySamples> latencies = { setFileLatency, playLatency, pauseLatency, stopLatency, seekLatency, trackSwitchLatency, shutdownLatency };
+	std::string results = FormatResults(options, latencies, contention, analyzerCosts, overview, scenarios);
+	if (options.OutputFilePath.empty())
+	{
+		std::cout << results;
+	}
+	else
+	{
+		std::ofstream outputFile(options.OutputFilePath, std::ios::binary | std::ios::trunc);
+		outputFile << results;
+		if (!outputFile)
+		{
+			std::cerr << "Failed to write " << options.OutputFilePath << "\n";
+			return 1;
+		}
+	}
+	return 0;
+}
+
+bool ParseArguments(int argc, char** argv, BenchmarkOptions* outputOptions)
+{
+	for (int argument = 1; argument < argc; argument++)
+	{
+		std::string name = argv[argument];
+		if (argument + 1 >= argc)
+		{
+			return false;
+		}
+		std::string value = argv[++argument];
+
+		if (name == "--output")
+		{
+			outputOptions->OutputFilePath = value;
+			continue;
+		}
+		unsigned long number = std::strtoul(value.c_str(), nullptr, 10);
+		if (number == 0)
+		{
+			return false;
+		}
+		if (name == "--iterations")
+		{
+			outputOptions->Iterations = (UINT32)number;
+		}
+		else if (name == "--threads")
+		{
+			outputOptions->ContentionThreads = (UINT32)number;
+		}
+		else if (name == "--contention-seconds")
+		{
+			outputOptions->ContentionSeconds = (UINT32)number;
+		}
+		else if (name == "--overview-minutes")
+		{
+			outputOptions->OverviewMinutes = (UINT32)number;
+		}
+		else if (name == "--scan-files")
+		{
+			outputOptions->ScanFiles = (UINT32)number;
+		}
+		else if (name == "--pool-players")
+		{
+			outputOptions->PoolPlayers = (UINT32)number;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool WriteSineWavFile(const fs::path& outputFilePath, UINT32 sampleRate, UINT32 durationSeconds, double frequency)
+{
+	//16 bit stereo PCM
+	const UINT32 channelCount = 2;
+	const UINT32 bytesPerFrame = channelCount * 2;
+	UINT32 frameCount = sampleRate * durationSeconds;
+	UINT32 dataSize = frameCount * bytesPerFrame;
+
+	std::vector<unsigned char> fileData(44 + (size_t)dataSize);
+	auto writeLittleEndian = [&](size_t offset, UINT32 value, UINT32 byteCount)
+	{
+		for (UINT32 byte = 0; byte < byteCount; byte++)
+		{
+			fileData[offset + byte] = (unsigned char)(value >> (8 * byte));
+		}
+	};
+	memcpy(&fileData[0], "RIFF", 4);
+	writeLittleEndian(4, 36 + dataSize, 4);
+	memcpy(&fileData[8], "WAVEfmt ", 8);
+	writeLittleEndian(16, 16, 4);
+	writeLittleEndian(20, 1, 2);
+	writeLittleEndian(22, channelCount, 2);
+	writeLittleEndian(24, sampleRate, 4);
+	writeLittleEndian(28, sampleRate * bytesPerFrame, 4);
+	writeLittleEndian(32, bytesPerFrame, 2);
+	writeLittleEndian(34, 16, 2);
+	memcpy(&fileData[36], "data", 4);
+	writeLittleEndian(40, dataSize, 4);
+
+	const double twoPi = 6.283185307179586;
+	for (UINT32 frame = 0; frame < frameCount; frame++)
+	{
+		int16_t sample = (int16_t)(std::sin(twoPi * frequency * frame / sampleRate) * 16384.0);
+		for (UINT32 channel = 0; channel < channelCount; channel++)
+		{
+			writeLittleEndian(44 + (size_t)frame * bytesPerFrame + channel * 2, (UINT16)sample, 2);
+		}
+	}
+
+	std::ofstream outputFile(outputFilePath, std::ios::binary | std::ios::trunc);
+	outputFile.write((const char*)fileData.data(), fileData.size());
+	return (bool)outputFile;
+}
+
+bool WriteVbrMpegAudioFile(const fs::path& outputFilePath, UINT32 frameCount, UINT32 encoderDelay, std::vector<UINT64>* outputFrameOffsets)
+{
+	//MPEG-1 Layer III, 44.1 kHz stereo: a Xing/LAME frame with the encoder delay, then frames in runs of different bitrates
+	//(a VBR encoder spends more on loud and dense passages), filler instead of coded audio
+	static const UINT32 bitrateIndexes[] = { 8, 9, 10, 11, 13 };
+	static const UINT32 bitrates_Kbps[] = { 112, 128, 160, 192, 256 };
+	std::vector<unsigned char> fileData;
+	auto appendFrame = [&](UINT32 bitrate, bool isPadded)
+	{
+		UINT32 frameLength = 144 * bitrates_Kbps[bitrate] * 1000 / 44100 + (isPadded ? 1 : 0);
+		size_t frameOffset = fileData.size();
+		fileData.resize(frameOffset + frameLength, 0x55);
+		fileData[frameOffset] = 0xFF;
+		fileData[frameOffset + 1] = 0xFB;
+		fileData[frameOffset + 2] = (unsigned char)((bitrateIndexes[bitrate] << 4) | (isPadded ? 2 : 0));
+		fileData[frameOffset + 3] = 0x00;
+		return frameOffset;
+	};
+
+	size_t xingOffset = appendFrame(1, false) + 4 + 32;
+	memcpy(&fileData[xingOffset], "Xing", 4);
+	memset(&fileData[xingOffset + 4], 0, 4);
+	size_t lameOffset = xingOffset + 8;
+	memcpy(&fileData[lameOffset], "LAME3.100", 9);
+	fileData[lameOffset + 21] = (unsigned char)(encoderDelay >> 4);
+	fileData[lameOffset + 22] = (unsigned char)((encoderDelay & 0x0F) << 4);
+	fileData[lameOffset + 23] = 0;
+
+	outputFrameOffsets->clear();
+	for (UINT32 frame = 0; frame < frameCount; frame++)
+	{
+		outputFrameOffsets->push_back(appendFrame((frame / 1000 * 7 + frame / 3000) % 5, frame % 3 == 0));
+	}
+
+	std::ofstream outputFile(outputFilePath, std::ios::binary | std::ios::trunc);
+	outputFile.write((const char*)fileData.data(), fileData.size());
+	return (bool)outputFile;
+}
+
+HRESULT CreateHeadlessPlayer(MMFSoundPlayer** outputPlayer)
+{
+	//Real-time pacing into a null sink: commands see the same timing they would with audio hardware
+	HeadlessBackendOptions backendOptions;
+	backendOptions.SinkType = HeadlessSinkType::Null;
+	backendOptions.PlaybackSpeed = 1.0;
+
+	IAudioBackend* backend = nullptr;
+	HRESULT hr = HeadlessBackend::CreateInstance(backendOptions, &backend);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	return MMFSoundPlayer::CreateInstance(backend, outputPlayer);
+}
+
+double MeasureMicroseconds(BenchmarkClock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(BenchmarkClock::now() - start).count();
+}
+
+void RecordSample(LatencySamples& samples, BenchmarkClock::time_point start, HRESULT hr)
+{
+	double elapsed = MeasureMicroseconds(start);
+	if (FAILED(hr))
+	{
+		samples.Failures++;
+		return;
+	}
+	samples.Microseconds.push_back(elapsed);
+}
+
+ContentionResult RunContention(MMFSoundPlayer* player, UINT32 threadCount, UINT32 seconds, UINT64 fileDuration_100NanoSecondUnits)
+{
+	ContentionResult result;
+	result.Threads = threadCount;
+	result.Latency.Name = "ContendedCommand";
+
+	//Every thread cycles through pause, play and seek on the same player, commands queue up behind each other
+	std::atomic<bool> isRunning = true;
+	std::atomic<UINT64> operations = 0;
+	std::atomic<UINT64> failures = 0;
+	std::vector<std::vector<double>> threadLatencies(threadCount);
+	std::vector<std::thread> threads;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (UINT32 threadIndex = 0; threadIndex < threadCount; threadIndex++)
+	{
+		threads.emplace_back([&, threadIndex]()
+		{
+			std::mt19937_64 random(threadIndex + 1);
+			std::uniform_int_distribution<UINT64> seekPositions(0, fileDuration_100NanoSecondUnits - OneSecond_100NanoSecondUnits);
+			for (UINT64 operation = 0; isRunning; operation++)
+			{
+				BenchmarkClock::time_point commandStart = BenchmarkClock::now();
+				HRESULT hr = S_OK;
+				switch (operation % 3)
+				{
+				case 0:
+					hr = player->Pause();
+					break;
+				case 1:
+					hr = player->Play();
+					break;
+				default:
+					hr = player->Seek(seekPositions(random));
+					break;
+				}
+				threadLatencies[threadIndex].push_back(MeasureMicroseconds(commandStart));
+				operations++;
+				if (FAILED(hr))
+				{
+					failures++;
+				}
+			}
+		});
+	}
+	std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	isRunning = false;
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	result.Seconds = std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+	result.Operations = operations;
+	result.Failures = failures;
+	for (std::vector<double>& latencies : threadLatencies)
+	{
+		result.Latency.Microseconds.insert(result.Latency.Microseconds.end(), latencies.begin(), latencies.end());
+	}
+	return result;
+}
+
+std::vector<LatencySamples> MeasureAnalyzer(UINT32 iterations)
+{
+	//A frame is a hop of stereo audio coming in (deinterleaved, metered, mixed down) and the spectrum of the latest FftSize samples
+	const UINT32 framesPerSecond = 60;
+	const UINT32 hopFrames = SampleRate / framesPerSecond;
+	std::vector<float> hopSamples((size_t)hopFrames * 2);
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> sampleValues(-1.0f, 1.0f);
+	for (float& sample : hopSamples)
+	{
+		sample = sampleValues(random);
+	}
+
+	std::vector<GainKernels::InstructionSet> instructionSets = { GainKernels::InstructionSet::Scalar };
+	if (GainKernels::GetBestInstructionSet() != GainKernels::InstructionSet::Scalar)
+	{
+		instructionSets.push_back(GainKernels::GetBestInstructionSet());
+	}
+	const char* instructionSetNames[] = { "Scalar", "Sse2", "Avx2", "Neon" };
+
+	std::vector<LatencySamples> analyzerCosts;
+	for (UINT32 fftSize : { 1024u, 2048u, 4096u, 8192u })
+	{
+		for (GainKernels::InstructionSet instructionSet : instructionSets)
+		{
+			LatencySamples costs{ "Fft" + std::to_string(fftSize) + "_" + instructionSetNames[(int)instructionSet] };
+			SpectrumAnalyzer analyzer;
+			SpectrumAnalyzerOptions analyzerOptions;
+			analyzerOptions.FftSize = fftSize;
+			analyzerOptions.FramesPerSecond = framesPerSecond;
+			analyzerOptions.InstructionSet = instructionSet;
+			VisualizationFrame frame;
+			HRESULT hr = analyzer.Initialize(analyzerOptions);
+
+			//The first frames size the frame's vectors and warm the caches
+			for (UINT32 iteration = 0; SUCCEEDED(hr) && iteration < iterations + 10; iteration++)
+			{
+				BenchmarkClock::time_point start = BenchmarkClock::now();
+				hr = analyzer.AddFrames(hopSamples.data(), hopFrames, 2, SampleRate);
+				if (SUCCEEDED(hr))
+				{
+					hr = analyzer.ComputeFrame(&frame);
+				}
+				if (iteration >= 10)
+				{
+					RecordSample(costs, start, hr);
+				}
+			}
+			if (FAILED(hr))
+			{
+				costs.Failures++;
+			}
+			analyzerCosts.push_back(costs);
+		}
+	}
+	return analyzerCosts;
+}
+
+OverviewResult MeasureOverviewGeneration(UINT32 minutesPerFile)
+{
+	//A few files, so the single worker run isn't dominated by one file and the parallel one splits them into chunks
+	const UINT32 fileCount = 4;
+	OverviewResult result;
+	std::vector<std::wstring> filePaths;
+	for (UINT32 file = 0; file < fileCount; file++)
+	{
+		fs::path filePath = fs::temp_directory_path() / ("MMFSoundPlayerBenchmark_Overview" + std::to_string(file) + ".wav");
+		if (!WriteSineWavFile(filePath, SampleRate, minutesPerFile * 60, 220.0 * (file + 1)))
+		{
+			std::cerr << "Failed to generate the overview audio\n";
+			result.Failures++;
+			continue;
+		}
+		filePaths.push_back(filePath.wstring());
+	}
+	result.Files = (UINT32)filePaths.size();
+	result.AudioHours = result.Files * minutesPerFile / 60.0;
+
+	//Every run starts with an empty store, the last one is repeated against the store it filled
+	fs::path storePath = fs::temp_directory_path() / "MMFSoundPlayerBenchmark_Peaks";
+	for (UINT32 threadCount : { 1u, 0u })
+	{
+		fs::remove_all(storePath);
+		WaveformOverviewStore* store = nullptr;
+		if (FAILED(WaveformOverviewStore::CreateInstance(storePath.wstring().c_str(), &store)))
+		{
+			result.Failures++;
+			continue;
+		}
+
+		WaveformOverviewOptions generatorOptions;
+		generatorOptions.ThreadCount = threadCount;
+		WaveformOverviewGenerator generator(store, generatorOptions);
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		HRESULT hr = generator.Generate(filePaths);
+		double seconds = MeasureMicroseconds(start) / 1e6;
+		result.Failures += FAILED(hr) ? 1 : generator.GetProgress().FilesFailed;
+		if (threadCount == 1)
+		{
+			result.SingleThreadSeconds = seconds;
+		}
+		else
+		{
+			result.AllThreadsSeconds = seconds;
+			result.Threads = std::thread::hardware_concurrency();
+
+			start = BenchmarkClock::now();
+			hr = generator.Generate(filePaths);
+			result.Cached_Milliseconds = MeasureMicroseconds(start) / 1e3;
+			if (FAILED(hr) || generator.GetProgress().FilesUnchanged != filePaths.size())
+			{
+				result.Failures++;
+			}
+		}
+		delete store;
+	}
+
+	fs::remove_all(storePath);
+	for (const std::wstring& filePath : filePaths)
+	{
+		fs::remove(filePath);
+	}
+	return result;
+}
+
+ScenarioResult MeasurePositionReads(const std::wstring& filePath, UINT32 iterations)
+{
+	//What a UI polling the position pays per call: asking the backend (a COM round trip to the presentation clock with Media
+	//Foundation) against extrapolating from the last correlation. Both while playing, in batches so the timer doesn't dominate.
+	const UINT32 callsPerBatch = 1000;
+	ScenarioResult result;
+	result.Name = "position_read";
+	MMFSoundPlayer* player = nullptr;
+	if (FAILED(CreateHeadlessPlayer(&player)))
+	{
+		result.Failures++;
+		return result;
+	}
+	HRESULT hr = player->SetFileIntoPlayer(filePath.c_str());
+	if (SUCCEEDED(hr))
+	{
+		hr = player->Play();
+	}
+
+	LatencySamples queriedCosts{ "QueriedBatch" };
+	LatencySamples interpolatedCosts{ "InterpolatedBatch" };
+	volatile UINT64 positionSum = 0;
+	for (UINT32 iteration = 0; SUCCEEDED(hr) && iteration < iterations; iteration++)
+	{
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (UINT32 call = 0; call < callsPerBatch; call++)
+		{
+			positionSum = positionSum + player->GetCurrentPresentationTime_100NanoSecondUnits();
+		}
+		RecordSample(queriedCosts, start, S_OK);
+
+		start = BenchmarkClock::now();
+		for (UINT32 call = 0; call < callsPerBatch; call++)
+		{
+			positionSum = positionSum + player->GetInterpolatedPresentationTime_100NanoSecondUnits();
+		}
+		RecordSample(interpolatedCosts, start, S_OK);
+	}
+	player->Shutdown();
+	player->Release();
+
+	//Per call, from the median batch
+	auto medianNanoseconds = [&](LatencySamples& samples)
+	{
+		if (samples.Microseconds.empty())
+		{
+			return 0.0;
+		}
+		std::nth_element(samples.Microseconds.begin(), samples.Microseconds.begin() + samples.Microseconds.size() / 2, samples.Microseconds.end());
+		return samples.Microseconds[samples.Microseconds.size() / 2] * 1000.0 / callsPerBatch;
+	};
+	result.Values.push_back({ "queried_ns_per_call", medianNanoseconds(queriedCosts) });
+	result.Values.push_back({ "interpolated_ns_per_call", medianNanoseconds(interpolatedCosts) });
+	result.Failures += FAILED(hr) ? 1 : 0;
+	result.Latencies = { queriedCosts, interpolatedCosts };
+	return result;
+}
+
+ScenarioResult MeasureLibraryScan(UINT32 fileCount)
+{
+	//Short low rate files in folders of a hundred, so the tree has some shape and the corpus stays small on disk. They were
+	//just written, so even the cold scan reads them from the page cache: it measures the scanner and the probes, not the disk.
+	const UINT32 filesPerDirectory = 100;
+	ScenarioResult result;
+	result.Name = "library_scan";
+	fs::path corpusPath = fs::temp_directory_path() / "MMFSoundPlayerBenchmark_Library";
+	fs::path indexPath = fs::temp_directory_path() / "MMFSoundPlayerBenchmark_Library.idx";
+	fs::remove_all(corpusPath);
+	fs::remove(indexPath);
+	for (UINT32 file = 0; file < fileCount; file++)
+	{
+		fs::path directoryPath = corpusPath / ("Album" + std::to_string(file / filesPerDirectory));
+		std::error_code error;
+		fs::create_directories(directoryPath, error);
+		if (!WriteSineWavFile(directoryPath / ("Track" + std::to_string(file) + ".wav"), 8000, 1, 440.0))
+		{
+			std::cerr << "Failed to generate the library\n";
+			result.Failures++;
+			fs::remove_all(corpusPath);
+			return result;
+		}
+	}
+
+	MediaMetadataIndex* index = nullptr;
+	if (FAILED(MediaMetadataIndex::CreateInstance(indexPath.wstring().c_str(), &index)))
+	{
+		result.Failures++;
+		fs::remove_all(corpusPath);
+		return result;
+	}
+	for (const char* pass : { "cold", "unchanged" })
+	{
+		LibraryScanner scanner(index);
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		HRESULT hr = scanner.Scan({ corpusPath.wstring() });
+		double seconds = MeasureMicroseconds(start) / 1e6;
+		LibraryScanProgress progress = scanner.GetProgress();
+		UINT64 expectedFiles = strcmp(pass, "cold") == 0 ? progress.FilesProbed : progress.FilesUnchanged;
+		if (FAILED(hr) || progress.FilesFound != fileCount || expectedFiles != fileCount)
+		{
+			result.Failures++;
+		}
+		result.Values.push_back({ std::string(pass) + "_seconds", seconds });
+		result.Values.push_back({ std::string(pass) + "_files_per_second", seconds > 0 ? progress.FilesFound / seconds : 0.0 });
+	}
+	result.Values.insert(result.Values.begin(), { "files", (double)fileCount });
+	delete index;
+
+	fs::remove(indexPath);
+	fs::remove_all(corpusPath);
+	return result;
+}
+
+ScenarioResult MeasureSeekIndex(UINT32 iterations)
+{
+	//About 20 minutes of VBR MP3. The index isn't used by the headless backend (it only plays WAV files), so the error of
+	//a seek without it is what a byte offset from the average bitrate lands on, against the exact frame the index gives.
+	const UINT32 frameCount = 50000;
+	const UINT32 samplesPerFrame = 1152;
+	const UINT32 sampleRate = 44100;
+	const UINT32 encoderDelay = 576;
+	const UINT64 startPadding = encoderDelay + 529;
+	ScenarioResult result;
+	result.Name = "seek_index";
+	fs::path filePath = fs::temp_directory_path() / "MMFSoundPlayerBenchmark_Vbr.mp3";
+	std::vector<UINT64> frameOffsets;
+	std::shared_ptr<SeekIndex> index;
+	if (!WriteVbrMpegAudioFile(filePath, frameCount, encoderDelay, &frameOffsets))
+	{
+		std::cerr << "Failed to generate the MP3 file\n";
+		result.Failures++;
+		return result;
+	}
+
+	LatencySamples buildCosts{ "Build" };
+	for (UINT32 iteration = 0; iteration < std::min<UINT32>(iterations, 20); iteration++)
+	{
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		RecordSample(buildCosts, start, SeekIndex::Build(filePath.wstring().c_str(), &index));
+	}
+	if (index == nullptr || index->GetFrameCount() != frameCount)
+	{
+		result.Failures++;
+		fs::remove(filePath);
+		return result;
+	}
+
+	//Seek targets spread over the file, each looked up in the index and estimated from the average bitrate
+	const UINT32 targetCount = 10000;
+	UINT64 firstFrameOffset = frameOffsets.front();
+	UINT64 audioBytes = frameOffsets.back() - firstFrameOffset;
+	double estimatedErrorSum_Milliseconds = 0;
+	double estimatedErrorMax_Milliseconds = 0;
+	double indexedErrorMax_Milliseconds = 0;
+	volatile UINT64 offsetSum = 0;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	for (UINT32 target = 0; target < targetCount; target++)
+	{
+		offsetSum = offsetSum + index->FindSeekPoint(index->GetSampleCount() * target / targetCount).ByteOffset;
+	}
+	double lookup_Nanoseconds = MeasureMicroseconds(start) * 1000.0 / targetCount;
+	for (UINT32 target = 0; target < targetCount; target++)
+	{
+		UINT64 sample = index->GetSampleCount() * target / targetCount;
+		UINT64 decodedSample = sample + startPadding;
+
+		//With the index: the sample decoding from the seek point's frame and skipping lands on, if that frame is where it says
+		SeekPoint seekPoint = index->FindSeekPoint(sample);
+		double indexedError_Milliseconds = std::abs((double)(seekPoint.FrameIndex * samplesPerFrame + seekPoint.SamplesToSkip) - (double)decodedSample) * 1000.0 / sampleRate;
+		indexedErrorMax_Milliseconds = std::max(indexedErrorMax_Milliseconds, indexedError_Milliseconds);
+		result.Failures += seekPoint.ByteOffset == frameOffsets[seekPoint.FrameIndex] ? 0 : 1;
+
+		//Without it: the frame holding the byte offset in proportion to the time, against the frame of the target
+		UINT64 estimatedOffset = firstFrameOffset + (UINT64)((double)audioBytes * sample / index->GetSampleCount());
+		UINT64 estimatedFrame = (UINT64)(std::upper_bound(frameOffsets.begin(), frameOffsets.end(), estimatedOffset) - frameOffsets.begin()) - 1;
+		double estimatedError_Milliseconds = std::abs((double)estimatedFrame - (double)(decodedSample / samplesPerFrame)) * samplesPerFrame * 1000.0 / sampleRate;
+		estimatedErrorSum_Milliseconds += estimatedError_Milliseconds;
+		estimatedErrorMax_Milliseconds = std::max(estimatedErrorMax_Milliseconds, estimatedError_Milliseconds);
+	}
+
+	std::sort(buildCosts.Microseconds.begin(), buildCosts.Microseconds.end());
+	double build_Milliseconds = buildCosts.Microseconds.empty() ? 0.0 : buildCosts.Microseconds[buildCosts.Microseconds.size() / 2] / 1000.0;
+	result.Values.push_back({ "audio_minutes", (double)frameCount * samplesPerFrame / sampleRate / 60.0 });
+	result.Values.push_back({ "build_ms", build_Milliseconds });
+	result.Values.push_back({ "build_mb_per_second", build_Milliseconds > 0 ? fs::file_size(filePath) / 1e6 / (build_Milliseconds / 1000.0) : 0.0 });
+	result.Values.push_back({ "lookup_ns", lookup_Nanoseconds });
+	result.Values.push_back({ "unindexed_error_ms_mean", estimatedErrorSum_Milliseconds / targetCount });
+	result.Values.push_back({ "unindexed_error_ms_max", estimatedErrorMax_Milliseconds });
+	result.Values.push_back({ "indexed_error_ms_max", indexedErrorMax_Milliseconds });
+	result.Latencies = { buildCosts };
+
+	fs::remove(filePath);
+	return result;
+}
+
+ScenarioResult MeasureScrubbing(const std::wstring& filePath, UINT64 fileDuration, UINT32 iterations)
+{
+	//A drag across the seek bar: positions as fast as the caller produces them, until the last one has been seeked to
+	const UINT32 positionsPerDrag = 200;
+	ScenarioResult result;
+	result.Name = "scrub";
+	MMFSoundPlayer* player = nullptr;
+	if (FAILED(CreateHeadlessPlayer(&player)))
+	{
+		result.Failures++;
+		return result;
+	}
+	if (FAILED(player->SetFileIntoPlayer(filePath.c_str())))
+	{
+		result.Failures++;
+		player->Shutdown();
+		player->Release();
+		return result;
+	}
+
+	LatencySamples scrubSettleTimes{ "ScrubDrag" };
+	LatencySamples seekSettleTimes{ "SeekDrag" };
+	std::atomic<UINT64> issuedCount = 0;
+	for (UINT32 iteration = 0; iteration < std::min<UINT32>(iterations, 50); iteration++)
+	{
+		auto positionOf = [&](UINT32 position)
+		{
+			return fileDuration * position / positionsPerDrag / 2 + fileDuration * (iteration % 2) / 2;
+		};
+
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		std::future<HRESULT> lastScrub;
+		for (UINT32 position = 0; position < positionsPerDrag; position++)
+		{
+			lastScrub = player->ScrubAsync(positionOf(position), [&](HRESULT hr)
+			{
+				issuedCount += hr == S_OK ? 1 : 0;
+			});
+		}
+		RecordSample(scrubSettleTimes, start, lastScrub.get());
+
+		start = BenchmarkClock::now();
+		std::future<HRESULT> lastSeek;
+		for (UINT32 position = 0; position < positionsPerDrag; position++)
+		{
+			lastSeek = player->SeekAsync(positionOf(position));
+		}
+		RecordSample(seekSettleTimes, start, lastSeek.get());
+	}
+	player->Shutdown();
+	player->Release();
+
+	result.Values.push_back({ "positions_per_drag", positionsPerDrag });
+	result.Values.push_back({ "scrubs_issued_per_drag", scrubSettleTimes.Microseconds.empty() ? 0.0 : (double)issuedCount / scrubSettleTimes.Microseconds.size() });
+	result.Latencies = { scrubSettleTimes, seekSettleTimes };
+	result.Failures = scrubSettleTimes.Failures + seekSettleTimes.Failures;
+	return result;
+}
+
+ScenarioResult MeasureGainKernels(UINT32 iterations)
+{
+	//A render period's worth of stereo samples, which stays in the cache like the render thread's buffers do
+	const size_t sampleCount = 4096;
+	ScenarioResult result;
+	result.Name = "gain_kernels";
+	std::vector<float> samples(sampleCount);
+	std::vector<float> gains(sampleCount);
+	std::vector<float> mixSamples(sampleCount);
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> sampleValues(-1.0f, 1.0f);
+	for (size_t sample = 0; sample < sampleCount; sample++)
+	{
+		samples[sample] = sampleValues(random);
+		gains[sample] = 1.0f;
+		mixSamples[sample] = sampleValues(random);
+	}
+
+	std::vector<GainKernels::InstructionSet> instructionSets = { GainKernels::InstructionSet::Scalar };
+	if (GainKernels::GetBestInstructionSet() != GainKernels::InstructionSet::Scalar)
+	{
+		instructionSets.push_back(GainKernels::GetBestInstructionSet());
+	}
+	const char* instructionSetNames[] = { "scalar", "sse2", "avx2", "neon" };
+	const char* kernelNames[] = { "multiply_constant", "multiply_elementwise", "mix_elementwise", "mix_constant" };
+
+	//Gains of one keep the samples from drifting into denormals over the repetitions
+	const UINT32 repetitions = std::max<UINT32>(iterations, 100) * 10;
+	for (int kernel = 0; kernel < 4; kernel++)
+	{
+		for (GainKernels::InstructionSet instructionSet : instructionSets)
+		{
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			for (UINT32 repetition = 0; repetition < repetitions; repetition++)
+			{
+				switch (kernel)
+				{
+				case 0:
+					GainKernels::MultiplyConstant(samples.data(), sampleCount, 1.0f, instructionSet);
+					break;
+				case 1:
+					GainKernels::MultiplyElementwise(samples.data(), gains.data(), sampleCount, instructionSet);
+					break;
+				case 2:
+					GainKernels::MixElementwise(samples.data(), gains.data(), mixSamples.data(), gains.data(), sampleCount, instructionSet);
+					break;
+				case 3:
+					GainKernels::MixConstant(samples.data(), mixSamples.data(), sampleCount, 0.0f, instructionSet);
+					break;
+				}
+			}
+			double seconds = MeasureMicroseconds(start) / 1e6;
+			result.Values.push_back({ std::string(kernelNames[kernel]) + "_" + instructionSetNames[(int)instructionSet] + "_msamples_per_second", seconds > 0 ? (double)repetitions * sampleCount / seconds / 1e6 : 0.0 });
+		}
+	}
+	return result;
+}
+
+ScenarioResult MeasureCrossfade(const std::wstring filePaths[2], UINT32 iterations)
+{
+	//Both files rendered unpaced into the null sink, so the time is all decoding and mixing. The crossfade renders fewer
+	//frames (the files overlap), so the cost is compared per second of audio rendered.
+	const UINT32 crossfadeMilliseconds = 2000;
+	ScenarioResult result;
+	result.Name = "crossfade";
+	LatencySamples gaplessTimes{ "GaplessRender" };
+	LatencySamples crossfadeTimes{ "CrossfadeRender" };
+	for (UINT32 iteration = 0; iteration < std::min<UINT32>(iterations, 20); iteration++)
+	{
+		for (LatencySamples* renderTimes : { &gaplessTimes, &crossfadeTimes })
+		{
+			HeadlessBackendOptions backendOptions;
+			backendOptions.SinkType = HeadlessSinkType::Null;
+			backendOptions.PlaybackSpeed = 0;
+			IAudioBackend* backend = nullptr;
+			MMFSoundPlayer* player = nullptr;
+			HRESULT hr = HeadlessBackend::CreateInstance(backendOptions, &backend);
+			if (SUCCEEDED(hr))
+			{
+				hr = MMFSoundPlayer::CreateInstance(backend, &player);
+			}
+			if (FAILED(hr))
+			{
+				renderTimes->Failures++;
+				continue;
+			}
+
+			//The file is queued before the first one has decoded far, and the wait for the end polls finely
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			hr = player->SetCrossfadeDuration(renderTimes == &crossfadeTimes ? crossfadeMilliseconds : 0);
+			if (SUCCEEDED(hr))
+			{
+				hr = player->SetFileIntoPlayer(filePaths[0].c_str());
+			}
+			if (SUCCEEDED(hr))
+			{
+				hr = player->QueueNextFile(filePaths[1].c_str());
+			}
+			while (SUCCEEDED(hr) && player->GetPlayerState() != PlayerState::PresentationEnd)
+			{
+				if (MeasureMicroseconds(start) > 10e6)
+				{
+					hr = E_FAIL;
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+			RecordSample(*renderTimes, start, hr);
+			player->Shutdown();
+			player->Release();
+		}
+	}
+
+	auto medianMilliseconds = [](LatencySamples& samples)
+	{
+		if (samples.Microseconds.empty())
+		{
+			return 0.0;
+		}
+		std::nth_element(samples.Microseconds.begin(), samples.Microseconds.begin() + samples.Microseconds.size() / 2, samples.Microseconds.end());
+		return samples.Microseconds[samples.Microseconds.size() / 2] / 1000.0;
+	};
+	double gaplessAudioSeconds = 2.0 * FileDurationSeconds;
+	double crossfadeAudioSeconds = gaplessAudioSeconds - crossfadeMilliseconds / 1000.0;
+	result.Values.push_back({ "crossfade_seconds", crossfadeMilliseconds / 1000.0 });
+	result.Values.push_back({ "gapless_render_us_per_audio_second", medianMilliseconds(gaplessTimes) * 1000.0 / gaplessAudioSeconds });
+	result.Values.push_back({ "crossfade_render_us_per_audio_second", medianMilliseconds(crossfadeTimes) * 1000.0 / crossfadeAudioSeconds });
+	result.Latencies = { gaplessTimes, crossfadeTimes };
+	result.Failures = gaplessTimes.Failures + crossfadeTimes.Failures;
+	return result;
+}
+
+ScenarioResult MeasureResampler(UINT32 iterations)
+{
+	//Periods of 100 ms of stereo audio; the common conversions, and one without a row per phase (44100 -> 47999)
+	const UINT32 conversions[][2] = { { 44100, 48000 }, { 48000, 44100 }, { 96000, 48000 }, { 44100, 47999 } };
+	const char* qualityNames[] = { "fast", "balanced", "high" };
+	ScenarioResult result;
+	result.Name = "resampler";
+	std::vector<float> input;
+	std::vector<float> output;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> sampleValues(-1.0f, 1.0f);
+	for (int quality = 0; quality < 3; quality++)
+	{
+		for (const UINT32* conversion : conversions)
+		{
+			UINT32 periodFrames = conversion[0] / 10;
+			input.resize((size_t)periodFrames * 2);
+			for (float& sample : input)
+			{
+				sample = sampleValues(random);
+			}
+
+			//The filter bank is built before the clock starts
+			Resampler resampler;
+			HRESULT hr = resampler.Initialize(conversion[0], conversion[1], 2, (ResamplerQuality)quality);
+			UINT32 outputFrameCount = 0;
+			UINT32 periodCount = std::max<UINT32>(iterations, 50);
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			for (UINT32 period = 0; SUCCEEDED(hr) && period < periodCount; period++)
+			{
+				hr = resampler.Process(input.data(), periodFrames, output, &outputFrameCount);
+			}
+			double seconds = MeasureMicroseconds(start) / 1e6;
+			result.Failures += FAILED(hr) ? 1 : 0;
+			result.Values.push_back({ std::string(qualityNames[quality]) + "_" + std::to_string(conversion[0]) + "_to_" + std::to_string(conversion[1]) + "_msamples_per_second",
+				seconds > 0 ? (double)periodCount * periodFrames * 2 / seconds / 1e6 : 0.0 });
+		}
+	}
+	return result;
+}
+
+ScenarioResult MeasurePlayerPool(UINT32 playerCount)
+{
+	//Every player held at once (a server with a player per channel), then all of them returned and handed out again. Memory
+	//per player is measured at a tenth of them and at all of them, so a fixed cost and a growing one can be told apart.
+	ScenarioResult result;
+	result.Name = "player_pool";
+	PlayerPoolOptions poolOptions;
+	poolOptions.MaxIdlePlayerCount = playerCount;
+	poolOptions.BackendFactory = [](IAudioBackend** outputBackend)
+	{
+		HeadlessBackendOptions backendOptions;
+		backendOptions.SinkType = HeadlessSinkType::Null;
+		return HeadlessBackend::CreateInstance(backendOptions, outputBackend);
+	};
+	PlayerPool* pool = nullptr;
+	if (FAILED(PlayerPool::CreateInstance(poolOptions, &pool)))
+	{
+		result.Failures++;
+		return result;
+	}
+
+	std::vector<MMFSoundPlayer*> players;
+	players.reserve(playerCount);
+	UINT32 checkpointCount = std::max<UINT32>(playerCount / 10, 1);
+	UINT64 baseMemory = GetProcessMemoryBytes();
+	UINT64 checkpointMemory = 0;
+	double createSeconds = 0;
+	double reuseSeconds = 0;
+	double returnSeconds = 0;
+	for (int round = 0; round < 2; round++)
+	{
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (UINT32 player = 0; player < playerCount; player++)
+		{
+			MMFSoundPlayer* acquiredPlayer = nullptr;
+			if (FAILED(pool->Acquire(&acquiredPlayer)))
+			{
+				result.Failures++;
+				continue;
+			}
+			players.push_back(acquiredPlayer);
+			if (round == 0 && players.size() == checkpointCount)
+			{
+				checkpointMemory = GetProcessMemoryBytes();
+			}
+		}
+		(round == 0 ? createSeconds : reuseSeconds) = MeasureMicroseconds(start) / 1e6;
+		if (round == 0)
+		{
+			UINT64 allMemory = GetProcessMemoryBytes();
+			result.Values.push_back({ "players", playerCount });
+			result.Values.push_back({ "kb_per_player_first_tenth", checkpointMemory > baseMemory ? (checkpointMemory - baseMemory) / 1024.0 / checkpointCount : 0.0 });
+			result.Values.push_back({ "kb_per_player_all", allMemory > baseMemory ? (allMemory - baseMemory) / 1024.0 / playerCount : 0.0 });
+		}
+
+		start = BenchmarkClock::now();
+		for (MMFSoundPlayer* player : players)
+		{
+			result.Failures += FAILED(pool->Return(player)) ? 1 : 0;
+		}
+		returnSeconds += MeasureMicroseconds(start) / 1e6;
+		players.clear();
+	}
+
+	PlayerPoolStatistics statistics = pool->GetStatistics();
+	result.Failures += statistics.PlayersCreated == playerCount && statistics.PlayersReused == playerCount ? 0 : 1;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	delete pool;
+	double shutdownSeconds = MeasureMicroseconds(start) / 1e6;
+
+	result.Values.push_back({ "created_per_second", createSeconds > 0 ? playerCount / createSeconds : 0.0 });
+	result.Values.push_back({ "reused_per_second", reuseSeconds > 0 ? playerCount / reuseSeconds : 0.0 });
+	result.Values.push_back({ "returned_per_second", returnSeconds > 0 ? 2.0 * playerCount / returnSeconds : 0.0 });
+	result.Values.push_back({ "shut_down_per_second", shutdownSeconds > 0 ? playerCount / shutdownSeconds : 0.0 });
+	return result;
+}
+
+ScenarioResult MeasureVoiceEngine(UINT32 iterations)
+{
+	//A second long stereo clip at the output rate, so nothing is converted and every voice is still playing when measured
+	ScenarioResult result;
+	result.Name = "voice_engine";
+	std::vector<float> clipSamples((size_t)SampleRate * 2);
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> sampleValues(-0.1f, 0.1f);
+	for (float& sample : clipSamples)
+	{
+		sample = sampleValues(random);
+	}
+	AudioFormat clipFormat;
+	clipFormat.SampleRate = SampleRate;
+	clipFormat.ChannelCount = 2;
+	clipFormat.BitsPerSample = 32;
+	clipFormat.IsFloatingPoint = true;
+
+	//Trigger to output on the engine's own real-time thread: triggers at random points of a period, a few ms apart
+	VoiceEngineOptions engineOptions;
+	engineOptions.SampleRate = SampleRate;
+	VoiceEngine* engine = nullptr;
+	ClipId clip = 0;
+	HRESULT hr = VoiceEngine::CreateInstance(engineOptions, &engine);
+	if (SUCCEEDED(hr))
+	{
+		hr = engine->LoadClipFromMemory(clipSamples.data(), SampleRate, clipFormat, &clip);
+	}
+	if (SUCCEEDED(hr))
+	{
+		hr = engine->Start();
+	}
+	std::uniform_int_distribution<UINT32> triggerIntervals_Microseconds(1000, 4000);
+	for (UINT32 trigger = 0; SUCCEEDED(hr) && trigger < iterations; trigger++)
+	{
+		hr = engine->Trigger(clip, 0.5f);
+		std::this_thread::sleep_for(std::chrono::microseconds(triggerIntervals_Microseconds(random)));
+	}
+	if (engine != nullptr)
+	{
+		engine->Stop();
+		VoiceEngineStatistics statistics = engine->GetStatistics();
+		result.Values.push_back({ "period_ms", engineOptions.PeriodFrames * 1000.0 / SampleRate });
+		result.Values.push_back({ "trigger_latency_ms_average", statistics.AverageTriggerLatency_Nanoseconds / 1e6 });
+		result.Values.push_back({ "trigger_latency_ms_max", statistics.MaxTriggerLatency_Nanoseconds / 1e6 });
+		result.Failures += statistics.TriggersDropped > 0 ? 1 : 0;
+		delete engine;
+	}
+	result.Failures += FAILED(hr) ? 1 : 0;
+
+	//Voices per core: the cost of a period with many voices, pulled on this thread, against the period's duration
+	const UINT32 voiceCount = 256;
+	engineOptions.MaxVoices = voiceCount;
+	engine = nullptr;
+	hr = VoiceEngine::CreateInstance(engineOptions, &engine);
+	if (SUCCEEDED(hr))
+	{
+		hr = engine->LoadClipFromMemory(clipSamples.data(), SampleRate, clipFormat, &clip);
+	}
+	for (UINT32 voice = 0; SUCCEEDED(hr) && voice < voiceCount; voice++)
+	{
+		hr = engine->Trigger(clip, 0.01f);
+	}
+	if (SUCCEEDED(hr))
+	{
+		//The first period starts the voices, the clip outlasts the measured periods
+		std::vector<float> periodFrames((size_t)engineOptions.PeriodFrames * 2);
+		engine->Render(periodFrames.data(), engineOptions.PeriodFrames);
+		const UINT32 periodCount = 100;
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (UINT32 period = 0; period < periodCount; period++)
+		{
+			engine->Render(periodFrames.data(), engineOptions.PeriodFrames);
+		}
+		double periodSeconds = MeasureMicroseconds(start) / 1e6 / periodCount;
+		double periodDuration = (double)engineOptions.PeriodFrames / SampleRate;
+		result.Failures += engine->GetStatistics().ActiveVoices == voiceCount ? 0 : 1;
+		result.Values.push_back({ "mix_us_per_period_256_voices", periodSeconds * 1e6 });
+		result.Values.push_back({ "voices_per_core", periodSeconds > 0 ? voiceCount * periodDuration / periodSeconds : 0.0 });
+	}
+	result.Failures += FAILED(hr) ? 1 : 0;
+	delete engine;
+	return result;
+}
+
+ScenarioResult MeasureMappedFiles(UINT32 iterations)
+{
+	//A two minute file read the way a media source reads it, in blocks of 4096 frames from start to end: copied out of the
+	//mapping with the read-ahead window (as MappedFileByteStream does), and read through a buffered file handle (the path
+	//files took before they were mapped). The file was just written, so both read from the page cache.
+	ScenarioResult result;
+	result.Name = "mapped_files";
+	fs::path filePath = fs::temp_directory_path() / "MMFSoundPlayerBenchmark_Mapped.wav";
+	if (!WriteSineWavFile(filePath, SampleRate, 120, 440.0))
+	{
+		result.Failures++;
+		return result;
+	}
+	std::wstring wideFilePath = filePath.wstring();
+	UINT64 fileSize = fs::file_size(filePath);
+	const UINT64 blockBytes = 4096 * 4;
+	std::vector<unsigned char> block(blockBytes);
+	UINT64 checksum = 0;
+
+	//One pass through the file each way, optionally sampling the resident memory as it goes (not while timing)
+	auto readMapped = [&](UINT64* outputPeakMemory)
+	{
+		MemoryMappedFile mappedFile;
+		if (FAILED(mappedFile.Open(wideFilePath.c_str())))
+		{
+			return false;
+		}
+		for (UINT64 offset = 0; offset < mappedFile.GetSize(); offset += blockBytes)
+		{
+			UINT64 bytesToRead = std::min(blockBytes, mappedFile.GetSize() - offset);
+			if (FAILED(mappedFile.CheckReadable(offset, bytesToRead)))
+			{
+				return false;
+			}
+			mappedFile.AdviseSequentialRead(offset);
+			memcpy(block.data(), mappedFile.GetData() + offset, (size_t)bytesToRead);
+			checksum += block[0];
+			if (outputPeakMemory != nullptr && (offset / blockBytes) % 64 == 0)
+			{
+				*outputPeakMemory = std::max(*outputPeakMemory, GetProcessMemoryBytes());
+			}
+		}
+		return true;
+	};
+	auto readBuffered = [&](UINT64* outputPeakMemory)
+	{
+		std::ifstream inputFile(filePath, std::ios::binary);
+		UINT64 offset = 0;
+		while (inputFile.read((char*)block.data(), (std::streamsize)blockBytes) || inputFile.gcount() > 0)
+		{
+			checksum += block[0];
+			if (outputPeakMemory != nullptr && (offset / blockBytes) % 64 == 0)
+			{
+				*outputPeakMemory = std::max(*outputPeakMemory, GetProcessMemoryBytes());
+			}
+			offset += (UINT64)inputFile.gcount();
+		}
+		return offset == fileSize;
+	};
+
+	//Opening (and closing) the file, without reading it
+	LatencySamples mappedOpenLatency{ "open_mapped" };
+	LatencySamples bufferedOpenLatency{ "open_buffered" };
+	for (UINT32 iteration = 0; iteration < iterations; iteration++)
+	{
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		HRESULT hr = S_OK;
+		{
+			MemoryMappedFile mappedFile;
+			hr = mappedFile.Open(wideFilePath.c_str());
+		}
+		RecordSample(mappedOpenLatency, start, hr);
+
+		start = BenchmarkClock::now();
+		{
+			std::ifstream inputFile(filePath, std::ios::binary);
+			hr = inputFile.is_open() ? S_OK : E_FAIL;
+		}
+		RecordSample(bufferedOpenLatency, start, hr);
+	}
+	result.Latencies.push_back(mappedOpenLatency);
+	result.Latencies.push_back(bufferedOpenLatency);
+
+	//Read throughput, alternating the two so neither gets a warmer cache
+	const UINT32 passCount = 5;
+	double mappedSeconds = 0;
+	double bufferedSeconds = 0;
+	for (UINT32 pass = 0; pass < passCount; pass++)
+	{
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		result.Failures += readMapped(nullptr) ? 0 : 1;
+		mappedSeconds += MeasureMicroseconds(start) / 1e6;
+
+		start = BenchmarkClock::now();
+		result.Failures += readBuffered(nullptr) ? 0 : 1;
+		bufferedSeconds += MeasureMicroseconds(start) / 1e6;
+	}
+	double passMegabytes = passCount * fileSize / 1e6;
+	result.Values.push_back({ "file_mb", fileSize / 1e6 });
+	result.Values.push_back({ "read_mb_per_second_mapped", mappedSeconds > 0 ? passMegabytes / mappedSeconds : 0.0 });
+	result.Values.push_back({ "read_mb_per_second_buffered", bufferedSeconds > 0 ? passMegabytes / bufferedSeconds : 0.0 });
+
+	//Resident memory a reader adds at its peak: the mapping keeps the read-ahead windows, a handle only its buffers
+	UINT64 baseMemory = GetProcessMemoryBytes();
+	UINT64 mappedPeakMemory = baseMemory;
+	UINT64 bufferedPeakMemory = baseMemory;
+	result.Failures += readMapped(&mappedPeakMemory) ? 0 : 1;
+	result.Failures += readBuffered(&bufferedPeakMemory) ? 0 : 1;
+	result.Values.push_back({ "peak_resident_mb_mapped", (mappedPeakMemory - baseMemory) / 1e6 });
+	result.Values.push_back({ "peak_resident_mb_buffered", (bufferedPeakMemory - baseMemory) / 1e6 });
+	result.Failures += checksum > 0 ? 0 : 1;
+	fs::remove(filePath);
+	return result;
+}
+
+ScenarioResult MeasureMemoryMedia(UINT32 iterations)
+{
+	//The same WAV in memory (a download or generated speech), played from a registered path and from a temporary file it
+	//is written to first, each time on a new player. Measured from handing over the audio to the first block the render
+	//thread sends to the sink that isn't silent, so it includes opening, decoding and the first render period.
+	ScenarioResult result;
+	result.Name = "memory_media";
+	fs::path filePath = fs::temp_directory_path() / "MMFSoundPlayerBenchmark_Memory.wav";
+	std::vector<char> fileData;
+	if (WriteSineWavFile(filePath, SampleRate, FileDurationSeconds, 440.0))
+	{
+		std::ifstream inputFile(filePath, std::ios::binary);
+		fileData.assign(std::istreambuf_iterator<char>(inputFile), std::istreambuf_iterator<char>());
+	}
+	fs::remove(filePath);
+	if (fileData.empty())
+	{
+		result.Failures++;
+		return result;
+	}
+
+	//Time from the start to the first audible block, on a player that taps its output
+	auto playUntilHeard = [](MMFSoundPlayer* player, BenchmarkClock::time_point start, const std::wstring& path)
+	{
+		HRESULT hr = player->SetFileIntoPlayer(path.c_str());
+		VisualizationTap* tap = nullptr;
+		if (SUCCEEDED(hr))
+		{
+			hr = player->GetVisualizationTap(&tap);
+		}
+		BenchmarkClock::time_point deadline = start + std::chrono::seconds(2);
+		while (SUCCEEDED(hr))
+		{
+			const VisualizationBlock* block = tap->BeginRead();
+			if (block == nullptr)
+			{
+				hr = BenchmarkClock::now() < deadline ? S_OK : E_FAIL;
+				std::this_thread::yield();
+				continue;
+			}
+			bool isAudible = std::any_of(block->Samples.begin(), block->Samples.begin() + (size_t)block->FrameCount * block->ChannelCount, [](float sample) { return sample != 0.0f; });
+			tap->EndRead();
+			if (isAudible)
+			{
+				break;
+			}
+		}
+		return hr;
+	};
+	auto createTappedPlayer = [](MMFSoundPlayer** outputPlayer)
+	{
+		HRESULT hr = CreateHeadlessPlayer(outputPlayer);
+		VisualizationTap* tap = nullptr;
+		if (SUCCEEDED(hr))
+		{
+			hr = (*outputPlayer)->GetVisualizationTap(&tap);
+		}
+		if (SUCCEEDED(hr))
+		{
+			hr = tap->Enable(true);
+		}
+		return hr;
+	};
+
+	LatencySamples memoryLatency{ "first_sample_memory_media" };
+	LatencySamples temporaryFileLatency{ "first_sample_temporary_file" };
+	for (UINT32 iteration = 0; iteration < std::min<UINT32>(iterations, 50); iteration++)
+	{
+		//Registered (borrowed, the buffer outlives the player) and played
+		MMFSoundPlayer* player = nullptr;
+		HRESULT hr = createTappedPlayer(&player);
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		std::wstring memoryPath;
+		if (SUCCEEDED(hr))
+		{
+			hr = MemoryMedia::Register(fileData.data(), fileData.size(), nullptr, L"wav", &memoryPath);
+		}
+		if (SUCCEEDED(hr))
+		{
+			hr = playUntilHeard(player, start, memoryPath);
+		}
+		RecordSample(memoryLatency, start, hr);
+		if (player != nullptr)
+		{
+			player->Shutdown();
+			player->Release();
+		}
+		if (!memoryPath.empty())
+		{
+			MemoryMedia::Unregister(memoryPath.c_str());
+		}
+
+		//Written out and played
+		player = nullptr;
+		hr = createTappedPlayer(&player);
+		start = BenchmarkClock::now();
+		if (SUCCEEDED(hr))
+		{
+			std::ofstream outputFile(filePath, std::ios::binary | std::ios::trunc);
+			outputFile.write(fileData.data(), (std::streamsize)fileData.size());
+			hr = outputFile ? S_OK : E_FAIL;
+		}
+		if (SUCCEEDED(hr))
+		{
+			hr = playUntilHeard(player, start, filePath.wstring());
+		}
+		RecordSample(temporaryFileLatency, start, hr);
+		if (player != nullptr)
+		{
+			player->Shutdown();
+			player->Release();
+		}
+		fs::remove(filePath);
+	}
+	result.Latencies.push_back(memoryLatency);
+	result.Latencies.push_back(temporaryFileLatency);
+	return result;
+}
+
+std::string FormatResults(const BenchmarkOptions& options, const std::vector<LatencySamples>& latencies, const ContentionResult& contention, const std::vector<LatencySamples>& analyzerCosts, const OverviewResult& overview, const std::vector<ScenarioResult>& scenarios)
+{
+	std::ostringstream output;
+	output.setf(std::ios::fixed);
+	output.precision(1);
+
+	output << "{\n";
+	output << "  \"backend\": \"headless\",\n";
+	output << "  \"iterations\": " << options.Iterations << ",\n";
+	output << "  \"latency_us\": {\n";
+	for (size_t index = 0; index < latencies.size(); index++)
+	{
+		output << "    ";
+		AppendLatency(output, latencies[index]);
+		output << (index + 1 < latencies.size() ? ",\n" : "\n");
+	}
+	output << "  },\n";
+	output << "  \"contention\": {\n";
+	output << "    \"threads\": " << contention.Threads << ",\n";
+	output << "    \"seconds\": " << contention.Seconds << ",\n";
+	output << "    \"operations\": " << contention.Operations << ",\n";
+	output << "    \"failures\": " << contention.Failures << ",\n";
+	output << "    \"ops_per_second\": " << (contention.Seconds > 0 ? contention.Operations / contention.Seconds : 0.0) << ",\n";
+	output << "    ";
+	AppendLatency(output, contention.Latency);
+	output << "\n  },\n";
+	output << "  \"analyzer_frame_us\": {\n";
+	for (size_t index = 0; index < analyzerCosts.size(); index++)
+	{
+		output << "    ";
+		AppendLatency(output, analyzerCosts[index]);
+		output << (index + 1 < analyzerCosts.size() ? ",\n" : "\n");
+	}
+	output << "  },\n";
+	output << "  \"overview\": {\n";
+	output << "    \"files\": " << overview.Files << ",\n";
+	output.precision(3);
+	output << "    \"audio_hours\": " << overview.AudioHours << ",\n";
+	output << "    \"single_thread_seconds\": " << overview.SingleThreadSeconds << ",\n";
+	output << "    \"single_thread_audio_hours_per_second\": " << (overview.SingleThreadSeconds > 0 ? overview.AudioHours / overview.SingleThreadSeconds : 0.0) << ",\n";
+	output << "    \"threads\": " << overview.Threads << ",\n";
+	output << "    \"all_threads_seconds\": " << overview.AllThreadsSeconds << ",\n";
+	output << "    \"all_threads_audio_hours_per_second\": " << (overview.AllThreadsSeconds > 0 ? overview.AudioHours / overview.AllThreadsSeconds : 0.0) << ",\n";
+	output << "    \"cached_ms\": " << overview.Cached_Milliseconds << ",\n";
+	output << "    \"failures\": " << overview.Failures << "\n";
+	output << "  },\n";
+	output << "  \"scenarios\": {\n";
+	for (size_t index = 0; index < scenarios.size(); index++)
+	{
+		const ScenarioResult& scenario = scenarios[index];
+		output << "    \"" << scenario.Name << "\": {\n";
+		output << "      \"failures\": " << scenario.Failures << (!scenario.Values.empty() || !scenario.Latencies.empty() ? ",\n" : "\n");
+		for (const std::pair<std::string, double>& value : scenario.Values)
+		{
+			output << "      \"" << value.first << "\": " << value.second << (&value != &scenario.Values.back() || !scenario.Latencies.empty() ? ",\n" : "\n");
+		}
+		if (!scenario.Latencies.empty())
+		{
+			output << "      \"latency_us\": {\n";
+			for (const LatencySamples& samples : scenario.Latencies)
+			{
+				output << "        ";
+				AppendLatency(output, samples);
+				output << (&samples != &scenario.Latencies.back() ? ",\n" : "\n");
+			}
+			output << "      }\n";
+		}
+		output << "    }" << (index + 1 < scenarios.size() ? ",\n" : "\n");
+	}
+	output << "  }\n";
+	output << "}\n";
+	return output.str();
+}
+
+void AppendLatency(std::ostringstream& output, const LatencySamples& samples)
+{
+	//Nearest rank percentiles
+	std::vector<double> sorted = samples.Microseconds;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&](double fraction)
+	{
+		if (sorted.empty())
+		{
+			return 0.0;
+		}
+		size_t rank = (size_t)std::ceil(fraction * sorted.size());
+		return sorted[rank == 0 ? 0 : rank - 1];
+	};
+
+	output << "\"" << samples.Name << "\": { \"count\": " << sorted.size() << ", \"failures\": " << samples.Failures
+		<< ", \"p50\": " << percentile(0.50) << ", \"p99\": " << percentile(0.99) << ", \"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << " }";
+}
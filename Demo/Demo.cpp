@@ -1,5 +1,6 @@
 #include <iostream>
 #include "../MMFSoundPlayer/MMFSoundPlayer.h"
+#include <atlbase.h>
 #include <filesystem>
 #include <chrono>
 #include <thread>
@@ -11,9 +12,6 @@ using namespace MMFSoundPlayerLib;
 //Function declarations
 std::string Convert100NanoSecondsToTimestamp(UINT64 input100NanoSeconds);
 
-//Constants
-UINT64 const OneSecond_100NanoSecondUnits = 10000000;
-
 int main()
 {
    //Create media player instance
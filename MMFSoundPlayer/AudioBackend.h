@@ -0,0 +1,143 @@
+#pragma once
+
+#include "Platform.h"
+#include "RenderTelemetry.h"
+
+namespace MMFSoundPlayerLib
+{
+	class VisualizationTap;
+
+	//Session events a backend reports back to the player (these mirror the Media Foundation session events the player handles)
+	enum class BackendEventType
+	{
+		SessionClosed,      // MESessionClosed: the session is fully closed, it is safe to shut it down.
+		TopologySet,        // MESessionTopologySet: the file is opened and ready to be started (event value: its duration).
+		SessionStarted,     // MESessionStarted: playback has started (or resumed/seeked).
+		SessionPaused,      // MESessionPaused: playback is paused.
+		SessionStopped,     // MESessionStopped: playback is stopped and rewound.
+		EndOfPresentation,  // MEEndOfPresentation: the last sample of the file has been rendered.
+		VolumeChanged,      // MEAudioSessionVolumeChanged: the volume was changed outside of the player.
+		NextFilePrepared,   // The file given to PrepareNextFile is opened and pre-rolled (event value: its duration).
+		NextFileStarted,    // The prepared file took over at the end of the current one (replaces its EndOfPresentation).
+		Unknown             // Any other event, only reported for diagnostics.
+	};
+
+	//Shape of a gain ramp: linear in amplitude, or exponential (linear in decibels, which sounds even to the ear)
+	enum class GainRampCurve
+	{
+		Linear,
+		Exponential
+	};
+
+	//Description of a stream of PCM audio
+	struct AudioFormat
+	{
+		UINT32 SampleRate = 0;
+		UINT32 ChannelCount = 0;
+		UINT32 BitsPerSample = 0;
+		bool IsFloatingPoint = false;
+	};
+
+	//Receives events from a backend. Called on the backend's own worker threads (the MF work queue for Media Foundation).
+	class IAudioBackendCallback
+	{
+	public:
+		virtual ~IAudioBackendCallback() = default;
+
+		//eventValue carries the event's payload where it has one (see BackendEventType), 0 otherwise
+		virtual void OnBackendEvent(BackendEventType eventType, HRESULT eventStatus, UINT64 eventValue) = 0;
+	};
+
+	//Decoder/source: produces interleaved 32-bit float PCM from an opened file
+	class IAudioDecoder
+	{
+	public:
+		virtual ~IAudioDecoder() = default;
+
+		//Format of the encoded file (the decoded output is always float with the same rate and channel count)
+		virtual AudioFormat GetFormat() = 0;
+		virtual UINT64 GetFrameCount() = 0;
+		virtual UINT64 GetDuration_100NanoSecondUnits() = 0;
+
+		//Decode up to frameCapacity frames. framesRead is 0 once the end of the file is reached.
+		virtual HRESULT ReadFrames(float* outputFrames, UINT32 frameCapacity, UINT32* framesRead) = 0;
+		virtual HRESULT SeekToFrame(UINT64 frameIndex) = 0;
+	};
+
+	//Render sink: consumes interleaved 32-bit float PCM
+	class IAudioSink
+	{
+	public:
+		virtual ~IAudioSink() = default;
+
+		//May be called once per opened file. Sinks keep running across calls with the same format.
+		virtual HRESULT Open(const AudioFormat& inputFormat) = 0;
+		virtual HRESULT Write(const float* inputFrames, UINT32 frameCount) = 0;
+		virtual HRESULT Close() = 0;
+	};
+
+	/*
+	Everything the player needs from the platform: a session that opens a file, renders it, keeps the presentation clock
+	and signals its progress through IAudioBackendCallback. Control calls only issue the command, completion is always
+	reported asynchronously through the callback (exactly like IMFMediaSession), so the player decides how long to wait.
+	*/
+	class IAudioBackend
+	{
+	public:
+		virtual ~IAudioBackend() = default;
+
+		//Backend lifetime (a reference to the shared Media Foundation runtime for Media Foundation)
+		virtual HRESULT Startup(IAudioBackendCallback* inputCallback) = 0;
+		virtual HRESULT Shutdown() = 0;
+
+		//Session lifetime. CloseSession reports through closeEventPending whether a SessionClosed event will follow.
+		virtual HRESULT CreateSession() = 0;
+		virtual HRESULT CloseSession(bool* closeEventPending) = 0;
+		virtual HRESULT ShutdownSession() = 0;
+
+		//Asynchronously resolve, validate and set the file into the session: TopologySet follows, with the file's duration as
+		//its value (or the failure). Nothing waits on the file meanwhile, however slow it is to open (a network share). Closing
+		//the session, or opening another file, cancels an open still in progress: its result is dropped without an event.
+		virtual HRESULT OpenFile(PCWSTR inputFilePath) = 0;
+
+		//Asynchronously resolve, open and pre-roll the file that should follow the current one (replacing any file that
+		//was prepared or is still being prepared before). NextFilePrepared reports the outcome, NextFileStarted the moment it
+		//takes over.
+		virtual HRESULT PrepareNextFile(PCWSTR inputFilePath) = 0;
+
+		//Overlap the prepared file with the end of the current one for this long (0 switches gaplessly). Backends that can
+		//only decode one file at a time return E_NOTIMPL for anything but 0.
+		virtual HRESULT SetCrossfade(UINT32 durationMilliseconds) = 0;
+
+		//Transport. Start resumes from the current position (the beginning when stopped), StartAt seeks first.
+		virtual HRESULT Start() = 0;
+		virtual HRESULT StartAt(UINT64 startPosition_100NanoSecondUnits) = 0;
+		virtual HRESULT Pause() = 0;
+		virtual HRESULT Stop() = 0;
+
+		//Volume. Backends with a gain stage of their own glide to every new level (a short ramp for SetVolume, the given one
+		//for RampVolume) and fade on top of the volume; the others step to the level and can't fade (E_NOTIMPL).
+		virtual HRESULT SetVolume(float volumeLevel) = 0;
+		virtual HRESULT RampVolume(float volumeLevel, UINT32 durationMilliseconds, GainRampCurve curve) = 0;
+		virtual HRESULT Fade(bool fadeIn, UINT32 durationMilliseconds, GainRampCurve curve) = 0;
+		virtual HRESULT GetVolume(float& currentVolumeLevel) = 0;
+		virtual HRESULT SetMute(bool isMuted) = 0;
+		virtual HRESULT GetMute(bool& isMuted) = 0;
+
+		//Loudness normalization, a linear gain applied on top of the volume (glides like SetVolume). Backends without a gain
+		//stage of their own return E_NOTIMPL for anything but 1.
+		virtual HRESULT SetNormalizationGain(float gain) = 0;
+
+		//Presentation clock. The rate is the speed the clock advances at while started, relative to real time (0 if it isn't paced).
+		virtual HRESULT GetPresentationTime(UINT64* presentationTime_100NanoSecondUnits) = 0;
+		virtual double GetPresentationRate() = 0;
+
+		//Health of the render engine (underruns, period jitter, decode-ahead fill, decode cost) since the backend started.
+		//Backends whose rendering is done by the platform return E_NOTIMPL.
+		virtual HRESULT GetRenderTelemetry(RenderTelemetrySnapshot* outputSnapshot) = 0;
+
+		//Tap on the rendered audio (after the gain), for meters and spectrum displays. The tap lives as long as the backend.
+		//Backends whose rendering is done by the platform return E_NOTIMPL.
+		virtual HRESULT GetVisualizationTap(VisualizationTap** outputTap) = 0;
+	};
+}
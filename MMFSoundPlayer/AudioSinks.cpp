@@ -0,0 +1,164 @@
+#include "AudioSinks.h"
+#include <cassert>
+#include <cstring>
+
+using namespace MMFSoundPlayerLib;
+
+//Null Sink----------------------------------------------------------------------------------------------------------------------------------------------------
+NullAudioSink::NullAudioSink()
+{
+	FramesWritten = 0;
+}
+
+HRESULT NullAudioSink::Open(const AudioFormat& inputFormat)
+{
+	if (inputFormat.SampleRate == 0 || inputFormat.ChannelCount == 0)
+	{
+		return E_INVALIDARG;
+	}
+	return S_OK;
+}
+
+HRESULT NullAudioSink::Write(const float* /*inputFrames*/, UINT32 frameCount)
+{
+	FramesWritten += frameCount;
+	return S_OK;
+}
+
+HRESULT NullAudioSink::Close()
+{
+	return S_OK;
+}
+
+UINT64 NullAudioSink::GetFramesWritten()
+{
+	return FramesWritten;
+}
+
+//WAV File Sink------------------------------------------------------------------------------------------------------------------------------------------------
+static void WriteLittleEndian16(unsigned char* output, UINT32 value)
+{
+	output[0] = (unsigned char)(value & 0xFF);
+	output[1] = (unsigned char)((value >> 8) & 0xFF);
+}
+
+static void WriteLittleEndian32(unsigned char* output, UINT32 value)
+{
+	output[0] = (unsigned char)(value & 0xFF);
+	output[1] = (unsigned char)((value >> 8) & 0xFF);
+	output[2] = (unsigned char)((value >> 16) & 0xFF);
+	output[3] = (unsigned char)((value >> 24) & 0xFF);
+}
+
+WavFileAudioSink::WavFileAudioSink(PCWSTR outputFilePath)
+{
+	OutputFilePath = outputFilePath != nullptr ? outputFilePath : L"";
+	File = nullptr;
+	FramesWritten = 0;
+}
+
+WavFileAudioSink::~WavFileAudioSink()
+{
+	Close();
+}
+
+HRESULT WavFileAudioSink::Open(const AudioFormat& inputFormat)
+{
+	if (inputFormat.SampleRate == 0 || inputFormat.ChannelCount == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	//Keep recording into the same file as long as the format doesn't change
+	if (File != nullptr)
+	{
+		if (inputFormat.SampleRate == Format.SampleRate && inputFormat.ChannelCount == Format.ChannelCount)
+		{
+			return S_OK;
+		}
+		Close();
+	}
+
+	File = OpenFileWithWidePath(OutputFilePath.c_str(), "wb");
+	if (File == nullptr)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+
+	//The sink always records the float samples it is given
+	Format = inputFormat;
+	Format.BitsPerSample = 32;
+	Format.IsFloatingPoint = true;
+	FramesWritten = 0;
+
+	//Write a placeholder header, the sizes get patched in Close
+	return WriteHeader();
+}
+
+HRESULT WavFileAudioSink::Write(const float* inputFrames, UINT32 frameCount)
+{
+	if (File == nullptr)
+	{
+		return E_UNEXPECTED;
+	}
+
+	size_t sampleCount = (size_t)frameCount * Format.ChannelCount;
+	if (fwrite(inputFrames, sizeof(float), sampleCount, File) != sampleCount)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+	FramesWritten += frameCount;
+	return S_OK;
+}
+
+HRESULT WavFileAudioSink::Close()
+{
+	if (File == nullptr)
+	{
+		return S_OK;
+	}
+
+	//Patch the header with the final sizes
+	HRESULT hr = S_OK;
+	if (fseek(File, 0, SEEK_SET) == 0)
+	{
+		hr = WriteHeader();
+	}
+	else
+	{
+		hr = GetLastFileErrorAsHRESULT();
+	}
+
+	fclose(File);
+	File = nullptr;
+	return hr;
+}
+
+HRESULT WavFileAudioSink::WriteHeader()
+{
+	//Canonical 44 byte header: RIFF, fmt (WAVE_FORMAT_IEEE_FLOAT) and data chunk header
+	UINT32 bytesPerFrame = Format.ChannelCount * sizeof(float);
+	UINT64 dataSize64 = FramesWritten * bytesPerFrame;
+	UINT32 dataSize = dataSize64 > 0xFFFFFFFF - 36 ? 0xFFFFFFFF - 36 : (UINT32)dataSize64;
+
+	unsigned char header[44];
+	memcpy(header, "RIFF", 4);
+	WriteLittleEndian32(header + 4, 36 + dataSize);
+	memcpy(header + 8, "WAVE", 4);
+	memcpy(header + 12, "fmt ", 4);
+	WriteLittleEndian32(header + 16, 16);
+	WriteLittleEndian16(header + 20, 3);
+	WriteLittleEndian16(header + 22, Format.ChannelCount);
+	WriteLittleEndian32(header + 24, Format.SampleRate);
+	WriteLittleEndian32(header + 28, Format.SampleRate * bytesPerFrame);
+	WriteLittleEndian16(header + 32, bytesPerFrame);
+	WriteLittleEndian16(header + 34, 32);
+	memcpy(header + 36, "data", 4);
+	WriteLittleEndian32(header + 40, dataSize);
+
+	if (fwrite(header, 1, sizeof(header), File) != sizeof(header))
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+	return S_OK;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "AudioBackend.h"
+#include <string>
+
+namespace MMFSoundPlayerLib
+{
+	//Sink that discards everything it is given (headless benchmarking with no audio hardware)
+	class NullAudioSink : public IAudioSink
+	{
+	private:
+		UINT64 FramesWritten;
+
+	public:
+		NullAudioSink();
+
+		//IAudioSink methods
+		HRESULT Open(const AudioFormat& inputFormat) override;
+		HRESULT Write(const float* inputFrames, UINT32 frameCount) override;
+		HRESULT Close() override;
+
+		UINT64 GetFramesWritten();
+	};
+
+	/*
+	Sink that records everything rendered into a 32-bit float WAV file. The file stays open across opened files with the
+	same format, so a whole play session (track switches included) ends up in one file. A format change restarts the file.
+	*/
+	class WavFileAudioSink : public IAudioSink
+	{
+	private:
+		std::wstring OutputFilePath;
+		FILE* File;
+		AudioFormat Format;
+		UINT64 FramesWritten;
+
+		HRESULT WriteHeader();
+
+	public:
+		WavFileAudioSink(PCWSTR outputFilePath);
+		~WavFileAudioSink();
+
+		//IAudioSink methods
+		HRESULT Open(const AudioFormat& inputFormat) override;
+		HRESULT Write(const float* inputFrames, UINT32 frameCount) override;
+		HRESULT Close() override;
+	};
+}
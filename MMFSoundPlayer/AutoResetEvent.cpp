@@ -0,0 +1,38 @@
+#include "AutoResetEvent.h"
+#include <chrono>
+
+using namespace MMFSoundPlayerLib;
+
+AutoResetEvent::AutoResetEvent()
+{
+	Signalled = false;
+}
+
+void AutoResetEvent::Set()
+{
+	{
+		std::lock_guard<std::mutex> lock(EventMutex);
+		Signalled = true;
+	}
+	EventCondition.notify_one();
+}
+
+void AutoResetEvent::Reset()
+{
+	std::lock_guard<std::mutex> lock(EventMutex);
+	Signalled = false;
+}
+
+bool AutoResetEvent::Wait(DWORD timeoutMilliseconds)
+{
+	std::unique_lock<std::mutex> lock(EventMutex);
+	bool signalledInTime = EventCondition.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [this]() { return Signalled; });
+	if (!signalledInTime)
+	{
+		return false;
+	}
+
+	//Auto reset, just like the Win32 event
+	Signalled = false;
+	return true;
+}
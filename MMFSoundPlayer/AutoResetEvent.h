@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Platform.h"
+#include <mutex>
+#include <condition_variable>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Portable replacement for a Win32 auto-reset event (CreateEvent(nullptr, FALSE, FALSE, nullptr)). Set wakes a
+	single waiter, or stays signalled until the next Wait if nobody is waiting, and a successful Wait resets it.
+	*/
+	class AutoResetEvent
+	{
+	private:
+		std::mutex EventMutex;
+		std::condition_variable EventCondition;
+		bool Signalled;
+
+	public:
+		AutoResetEvent();
+
+		//Signal the event
+		void Set();
+
+		//Clear the signal without waking anybody
+		void Reset();
+
+		//Wait at most timeoutMilliseconds for the event. Returns false on timeout.
+		bool Wait(DWORD timeoutMilliseconds);
+	};
+}
@@ -0,0 +1,116 @@
+#include "BackgroundThreads.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace MMFSoundPlayerLib;
+
+std::unique_lock<std::mutex> BackgroundGate::Enter()
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	if (IsClosed)
+	{
+		lock.unlock();
+	}
+	return lock;
+}
+
+BackgroundThreads::~BackgroundThreads()
+{
+	Abandon(0);
+}
+
+HRESULT BackgroundThreads::Run(std::function<void(BackgroundGate&)> task)
+{
+	if (!task)
+	{
+		return E_INVALIDARG;
+	}
+
+	std::lock_guard<std::mutex> lock(ThreadsMutex);
+	JoinFinishedThreads();
+
+	BackgroundThread newThread;
+	try
+	{
+		if (Gate == nullptr)
+		{
+			Gate = std::make_shared<BackgroundGate>();
+		}
+		newThread.IsFinished = std::make_shared<std::atomic<bool>>(false);
+		std::shared_ptr<std::atomic<bool>> isFinished = newThread.IsFinished;
+		std::shared_ptr<BackgroundGate> gate = Gate;
+		newThread.Thread = std::thread([task = std::move(task), isFinished, gate]()
+		{
+			task(*gate);
+
+			//Under the gate's mutex, so Abandon can't miss the notification between checking the flags and waiting
+			std::lock_guard<std::mutex> gateLock(gate->Mutex);
+			*isFinished = true;
+			gate->FinishedCondition.notify_all();
+		});
+		Threads.push_back(std::move(newThread));
+	}
+	catch (...)
+	{
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+size_t BackgroundThreads::Abandon(UINT32 timeoutMilliseconds)
+{
+	//Wait outside of ThreadsMutex, a task may start another one
+	std::vector<BackgroundThread> threads;
+	std::shared_ptr<BackgroundGate> gate;
+	{
+		std::lock_guard<std::mutex> lock(ThreadsMutex);
+		threads.swap(Threads);
+		gate.swap(Gate);
+	}
+	if (gate == nullptr)
+	{
+		return 0;
+	}
+
+	//Closing waits for a task that is inside the owner, after that none gets in anymore
+	auto isFinished = [](const BackgroundThread& thread) { return (bool)*thread.IsFinished; };
+	{
+		std::unique_lock<std::mutex> gateLock(gate->Mutex);
+		gate->IsClosed = true;
+		gate->FinishedCondition.wait_for(gateLock, std::chrono::milliseconds(timeoutMilliseconds),
+			[&]() { return std::all_of(threads.begin(), threads.end(), isFinished); });
+	}
+
+	//A thread that is still stuck (on a file that doesn't answer) is left to finish on its own, it only holds the closed gate
+	size_t abandonedCount = 0;
+	for (BackgroundThread& thread : threads)
+	{
+		if (isFinished(thread))
+		{
+			thread.Thread.join();
+		}
+		else
+		{
+			thread.Thread.detach();
+			abandonedCount++;
+		}
+	}
+	return abandonedCount;
+}
+
+size_t BackgroundThreads::GetRunningCount()
+{
+	std::lock_guard<std::mutex> lock(ThreadsMutex);
+	return (size_t)std::count_if(Threads.begin(), Threads.end(), [](const BackgroundThread& thread) { return !*thread.IsFinished; });
+}
+
+void BackgroundThreads::JoinFinishedThreads()
+{
+	//Only while ThreadsMutex is held. A finished thread is at most returning from its lambda, joining it doesn't block.
+	auto firstFinished = std::partition(Threads.begin(), Threads.end(), [](const BackgroundThread& thread) { return !*thread.IsFinished; });
+	for (auto thread = firstFinished; thread != Threads.end(); ++thread)
+	{
+		thread->Thread.join();
+	}
+	Threads.erase(firstFinished, Threads.end());
+}
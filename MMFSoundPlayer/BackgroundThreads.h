@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Platform.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	The way back from a background task to its owner. A task touches the owner's state only while it holds the gate, and
+	keeps that short (no file access): abandoning the tasks closes the gate, which waits for the task inside, and from then
+	on the owner may be gone.
+	*/
+	class BackgroundGate
+	{
+	private:
+		friend class BackgroundThreads;
+
+		std::mutex Mutex;
+		std::condition_variable FinishedCondition;
+		bool IsClosed = false;
+
+	public:
+		//The returned lock owns the gate, unless the owner abandoned the task (then the task drops its result)
+		std::unique_lock<std::mutex> Enter();
+	};
+
+	/*
+	Threads for blocking work that can take arbitrarily long and can't be interrupted, like resolving a file on a slow
+	network share. Every task gets a thread of its own, so a task that is stuck never delays the ones started after it
+	(a pool would queue them behind it). The owner cancels a task by ignoring its result, the thread is joined once it
+	finished: by the next Run, or by Abandon (backend shutdown), which waits a bounded time for the ones still running and
+	detaches the rest. A detached task runs on with nothing but its own data and the gate it was given, which is closed.
+	*/
+	class BackgroundThreads
+	{
+	private:
+		struct BackgroundThread
+		{
+			std::thread Thread;
+			std::shared_ptr<std::atomic<bool>> IsFinished;
+		};
+
+		std::mutex ThreadsMutex;
+		std::vector<BackgroundThread> Threads;
+		std::shared_ptr<BackgroundGate> Gate;
+
+		void JoinFinishedThreads();
+
+	public:
+		~BackgroundThreads();
+
+		HRESULT Run(std::function<void(BackgroundGate&)> task);
+
+		//Close the gate of the tasks started so far, join the ones finishing within the timeout and detach the others.
+		//Returns the number of tasks abandoned. Tasks started afterwards get a new gate.
+		size_t Abandon(UINT32 timeoutMilliseconds);
+
+		//Tasks that haven't finished yet
+		size_t GetRunningCount();
+	};
+}
@@ -0,0 +1,241 @@
+#include "DecodedAudioCache.h"
+#include <algorithm>
+#include <new>
+
+using namespace MMFSoundPlayerLib;
+
+//Buffer Pool--------------------------------------------------------------------------------------------------------------------------------------------------
+AudioBufferPool::AudioBufferPool(UINT64 memoryCapBytes)
+{
+	AllocatedBytes = 0;
+	PooledBytes = 0;
+	MemoryCapBytes = memoryCapBytes;
+	FreeBuffers.resize(64);
+}
+
+AudioBufferPool::~AudioBufferPool()
+{
+	for (UINT32 sizeClass = 0; sizeClass < FreeBuffers.size(); sizeClass++)
+	{
+		for (float* buffer : FreeBuffers[sizeClass])
+		{
+			operator delete[](buffer, std::align_val_t(BufferAlignment));
+		}
+	}
+}
+
+UINT32 AudioBufferPool::GetSizeClass(UINT64 sampleCount)
+{
+	//Smallest power of two holding sampleCount
+	UINT32 sizeClass = SmallestSizeClass;
+	while (((UINT64)1 << sizeClass) < sampleCount)
+	{
+		sizeClass++;
+	}
+	return sizeClass;
+}
+
+float* AudioBufferPool::Acquire(UINT64 sampleCount, UINT64* outputCapacity)
+{
+	UINT32 sizeClass = GetSizeClass(sampleCount);
+	UINT64 capacity = (UINT64)1 << sizeClass;
+	*outputCapacity = capacity;
+
+	//Reuse a released buffer of the same class
+	{
+		std::lock_guard<std::mutex> lock(PoolMutex);
+		if (!FreeBuffers[sizeClass].empty())
+		{
+			float* buffer = FreeBuffers[sizeClass].back();
+			FreeBuffers[sizeClass].pop_back();
+			PooledBytes -= capacity * sizeof(float);
+			return buffer;
+		}
+		AllocatedBytes += capacity * sizeof(float);
+	}
+
+	float* buffer = new (std::align_val_t(BufferAlignment), std::nothrow) float[(size_t)capacity];
+	if (buffer == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(PoolMutex);
+		AllocatedBytes -= capacity * sizeof(float);
+	}
+	return buffer;
+}
+
+void AudioBufferPool::Release(float* buffer, UINT64 capacity)
+{
+	if (buffer == nullptr)
+	{
+		return;
+	}
+
+	//Keep the buffer while the pool is under its cap, give it back to the heap otherwise
+	UINT32 sizeClass = GetSizeClass(capacity);
+	{
+		std::lock_guard<std::mutex> lock(PoolMutex);
+		if (AllocatedBytes <= MemoryCapBytes)
+		{
+			FreeBuffers[sizeClass].push_back(buffer);
+			PooledBytes += capacity * sizeof(float);
+			return;
+		}
+		AllocatedBytes -= capacity * sizeof(float);
+	}
+	operator delete[](buffer, std::align_val_t(BufferAlignment));
+}
+
+UINT64 AudioBufferPool::GetAllocatedBytes()
+{
+	std::lock_guard<std::mutex> lock(PoolMutex);
+	return AllocatedBytes;
+}
+
+UINT64 AudioBufferPool::GetPooledBytes()
+{
+	std::lock_guard<std::mutex> lock(PoolMutex);
+	return PooledBytes;
+}
+
+DecodedAudioHead::~DecodedAudioHead()
+{
+	if (BufferPool != nullptr)
+	{
+		BufferPool->Release(Buffer, BufferCapacity);
+	}
+}
+
+//Cache--------------------------------------------------------------------------------------------------------------------------------------------------------
+DecodedAudioCache::DecodedAudioCache(UINT64 memoryCapBytes, UINT32 headMilliseconds)
+{
+	MemoryCapBytes = memoryCapBytes;
+	MemoryUsedBytes = 0;
+	HeadMilliseconds = headMilliseconds;
+	BufferPool = std::make_shared<AudioBufferPool>(memoryCapBytes);
+}
+
+std::shared_ptr<const DecodedAudioHead> DecodedAudioCache::Lookup(PCWSTR inputFilePath)
+{
+	if (inputFilePath == nullptr)
+	{
+		return nullptr;
+	}
+
+	//Stat the file outside of the lock, a changed file doesn't count as cached
+	UINT64 fileSize = 0;
+	INT64 modifiedTime = 0;
+	bool fileExists = SUCCEEDED(GetFileSizeAndModifiedTime(inputFilePath, &fileSize, &modifiedTime));
+
+	std::lock_guard<std::mutex> lock(CacheMutex);
+	auto entry = EntriesByPath.find(inputFilePath);
+	if (entry == EntriesByPath.end())
+	{
+		Statistics.Misses++;
+		return nullptr;
+	}
+
+	std::shared_ptr<const DecodedAudioHead> head = entry->second->Head;
+	if (!fileExists || head->FileSize != fileSize || head->ModifiedTime != modifiedTime)
+	{
+		RemoveEntry(entry->second);
+		Statistics.Misses++;
+		return nullptr;
+	}
+
+	//Most recently used moves to the front
+	Entries.splice(Entries.begin(), Entries, entry->second);
+	Statistics.Hits++;
+	return head;
+}
+
+HRESULT DecodedAudioCache::Insert(PCWSTR inputFilePath, UINT64 fileSize, INT64 modifiedTime, const AudioFormat& format, const float* samples, UINT32 frameCount, bool isWholeFile)
+{
+	if (inputFilePath == nullptr || samples == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (frameCount == 0 || format.ChannelCount == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	//A head bigger than the whole cache would only evict everything else
+	UINT64 sampleCount = (UINT64)frameCount * format.ChannelCount;
+	if (sampleCount * sizeof(float) > MemoryCapBytes)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	//Copy the samples outside of the lock
+	std::shared_ptr<DecodedAudioHead> head = std::make_shared<DecodedAudioHead>();
+	head->Buffer = BufferPool->Acquire(sampleCount, &head->BufferCapacity);
+	if (head->Buffer == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	head->BufferPool = BufferPool;
+	std::copy_n(samples, (size_t)sampleCount, head->Buffer);
+	head->Samples = head->Buffer;
+	head->Format = format;
+	head->FileSize = fileSize;
+	head->ModifiedTime = modifiedTime;
+	head->FrameCount = frameCount;
+	head->IsWholeFile = isWholeFile;
+	UINT64 headBytes = head->BufferCapacity * sizeof(float);
+
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	//Replace an older head of the same file
+	auto existingEntry = EntriesByPath.find(inputFilePath);
+	if (existingEntry != EntriesByPath.end())
+	{
+		RemoveEntry(existingEntry->second);
+	}
+
+	//Evict the least recently used entries until the new one fits
+	while (!Entries.empty() && MemoryUsedBytes + headBytes > MemoryCapBytes)
+	{
+		RemoveEntry(std::prev(Entries.end()));
+		Statistics.Evictions++;
+	}
+
+	Entries.push_front({ inputFilePath, head });
+	EntriesByPath[inputFilePath] = Entries.begin();
+	MemoryUsedBytes += headBytes;
+	Statistics.Insertions++;
+	return S_OK;
+}
+
+void DecodedAudioCache::RemoveEntry(std::list<CacheEntry>::iterator entry)
+{
+	//The buffer goes back to the pool once the last user of the head lets go of it
+	MemoryUsedBytes -= entry->Head->BufferCapacity * sizeof(float);
+	EntriesByPath.erase(entry->FilePath);
+	Entries.erase(entry);
+}
+
+UINT32 DecodedAudioCache::GetHeadFrameCount(UINT32 sampleRate)
+{
+	return (UINT32)((UINT64)sampleRate * HeadMilliseconds / 1000);
+}
+
+void DecodedAudioCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+	EntriesByPath.clear();
+	Entries.clear();
+	MemoryUsedBytes = 0;
+}
+
+DecodedAudioCacheStatistics DecodedAudioCache::GetStatistics()
+{
+	DecodedAudioCacheStatistics statistics;
+	{
+		std::lock_guard<std::mutex> lock(CacheMutex);
+		statistics = Statistics;
+		statistics.EntryCount = Entries.size();
+		statistics.MemoryUsedBytes = MemoryUsedBytes;
+	}
+	statistics.MemoryPooledBytes = BufferPool->GetPooledBytes();
+	return statistics;
+}
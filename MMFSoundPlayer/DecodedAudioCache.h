@@ -0,0 +1,114 @@
+#pragma once
+
+#include "AudioBackend.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Pool of 64 byte aligned sample buffers in power of two size classes. Released buffers are kept for reuse while the
+	pool's total allocation stays under its cap, so the cache doesn't go back to the heap for every track.
+	*/
+	class AudioBufferPool
+	{
+	private:
+		std::mutex PoolMutex;
+		std::vector<std::vector<float*>> FreeBuffers;
+		UINT64 AllocatedBytes;
+		UINT64 PooledBytes;
+		UINT64 MemoryCapBytes;
+
+		static UINT32 GetSizeClass(UINT64 sampleCount);
+
+	public:
+		static constexpr size_t BufferAlignment = 64;
+		static constexpr UINT32 SmallestSizeClass = 14; // 16K samples (64 KB)
+
+		AudioBufferPool(UINT64 memoryCapBytes);
+		~AudioBufferPool();
+
+		//Get a buffer of at least sampleCount samples (outputCapacity receives its real size). Returns nullptr when out of memory.
+		float* Acquire(UINT64 sampleCount, UINT64* outputCapacity);
+		void Release(float* buffer, UINT64 capacity);
+
+		UINT64 GetAllocatedBytes();
+		UINT64 GetPooledBytes();
+	};
+
+	//The decoded start of a file. Immutable once cached, and kept alive by its users even after it is evicted.
+	struct DecodedAudioHead
+	{
+		AudioFormat Format;
+		UINT64 FileSize = 0;
+		INT64 ModifiedTime = 0;
+		UINT32 FrameCount = 0;
+		bool IsWholeFile = false;
+		const float* Samples = nullptr;
+
+		//The buffer goes back to the pool with the last reference
+		std::shared_ptr<AudioBufferPool> BufferPool;
+		float* Buffer = nullptr;
+		UINT64 BufferCapacity = 0;
+
+		~DecodedAudioHead();
+	};
+
+	struct DecodedAudioCacheStatistics
+	{
+		UINT64 Hits = 0;
+		UINT64 Misses = 0;
+		UINT64 Insertions = 0;
+		UINT64 Evictions = 0;
+		UINT64 EntryCount = 0;
+		UINT64 MemoryUsedBytes = 0;  // Buffers held by cached entries.
+		UINT64 MemoryPooledBytes = 0;// Released buffers kept for reuse.
+	};
+
+	/*
+	Bounded LRU cache of the first seconds of decoded PCM of recently played and upcoming files. A file starts instantly
+	from its cached head while the decoder seeks past it and catches up behind. Entries are keyed by path and checked
+	against the file's size and modification time, so an edited file is never served stale audio. Thread-safe, and meant
+	to be shared by every backend of the application.
+	*/
+	class DecodedAudioCache
+	{
+	private:
+		struct CacheEntry
+		{
+			std::wstring FilePath;
+			std::shared_ptr<const DecodedAudioHead> Head;
+		};
+
+		std::mutex CacheMutex;
+		std::list<CacheEntry> Entries; // Most recently used first.
+		std::unordered_map<std::wstring, std::list<CacheEntry>::iterator> EntriesByPath;
+		std::shared_ptr<AudioBufferPool> BufferPool;
+		UINT64 MemoryCapBytes;
+		UINT64 MemoryUsedBytes;
+		UINT32 HeadMilliseconds;
+		DecodedAudioCacheStatistics Statistics;
+
+		void RemoveEntry(std::list<CacheEntry>::iterator entry);
+
+	public:
+		//memoryCapBytes bounds the decoded audio kept, headMilliseconds is how much of every file is kept
+		DecodedAudioCache(UINT64 memoryCapBytes = 64ull * 1024 * 1024, UINT32 headMilliseconds = 5000);
+
+		//The cached head of a file, if there is one and the file hasn't changed since (counted as a hit or a miss)
+		std::shared_ptr<const DecodedAudioHead> Lookup(PCWSTR inputFilePath);
+
+		//Copy the decoded start of a file into the cache, evicting the least recently used entries to make room
+		HRESULT Insert(PCWSTR inputFilePath, UINT64 fileSize, INT64 modifiedTime, const AudioFormat& format, const float* samples, UINT32 frameCount, bool isWholeFile);
+
+		//Number of frames worth caching for a file of the given rate (the head length)
+		UINT32 GetHeadFrameCount(UINT32 sampleRate);
+
+		void Clear();
+		DecodedAudioCacheStatistics GetStatistics();
+	};
+}
@@ -0,0 +1,487 @@
+#include "GainStage.h"
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define GAIN_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define GAIN_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+//GCC and Clang only emit AVX2 instructions in functions marked for it, MSVC emits them anywhere
+#if defined(GAIN_KERNELS_X86) && !defined(_MSC_VER)
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define AVX2_FUNCTION
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+//Kernels------------------------------------------------------------------------------------------------------------------------------------------------------
+static void MultiplyConstantScalar(float* samples, size_t sampleCount, float gain)
+{
+	for (size_t sample = 0; sample < sampleCount; sample++)
+	{
+		samples[sample] *= gain;
+	}
+}
+
+static void MultiplyElementwiseScalar(float* samples, const float* gains, size_t sampleCount)
+{
+	for (size_t sample = 0; sample < sampleCount; sample++)
+	{
+		samples[sample] *= gains[sample];
+	}
+}
+
+static void MixElementwiseScalar(float* samples, const float* gains, const float* mixSamples, const float* mixGains, size_t sampleCount)
+{
+	for (size_t sample = 0; sample < sampleCount; sample++)
+	{
+		float scaledSample = samples[sample] * gains[sample];
+		float scaledMixSample = mixSamples[sample] * mixGains[sample];
+		samples[sample] = scaledSample + scaledMixSample;
+	}
+}
+
+static void MixConstantScalar(float* samples, const float* mixSamples, size_t sampleCount, float mixGain)
+{
+	for (size_t sample = 0; sample < sampleCount; sample++)
+	{
+		samples[sample] += mixSamples[sample] * mixGain;
+	}
+}
+
+#ifdef GAIN_KERNELS_X86
+static void MultiplyConstantSse2(float* samples, size_t sampleCount, float gain)
+{
+	__m128 gains = _mm_set1_ps(gain);
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		_mm_storeu_ps(samples + sample, _mm_mul_ps(_mm_loadu_ps(samples + sample), gains));
+	}
+	MultiplyConstantScalar(samples + sample, sampleCount - sample, gain);
+}
+
+static void MultiplyElementwiseSse2(float* samples, const float* gains, size_t sampleCount)
+{
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		_mm_storeu_ps(samples + sample, _mm_mul_ps(_mm_loadu_ps(samples + sample), _mm_loadu_ps(gains + sample)));
+	}
+	MultiplyElementwiseScalar(samples + sample, gains + sample, sampleCount - sample);
+}
+
+static void MixElementwiseSse2(float* samples, const float* gains, const float* mixSamples, const float* mixGains, size_t sampleCount)
+{
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		__m128 scaledSamples = _mm_mul_ps(_mm_loadu_ps(samples + sample), _mm_loadu_ps(gains + sample));
+		__m128 scaledMixSamples = _mm_mul_ps(_mm_loadu_ps(mixSamples + sample), _mm_loadu_ps(mixGains + sample));
+		_mm_storeu_ps(samples + sample, _mm_add_ps(scaledSamples, scaledMixSamples));
+	}
+	MixElementwiseScalar(samples + sample, gains + sample, mixSamples + sample, mixGains + sample, sampleCount - sample);
+}
+
+static void MixConstantSse2(float* samples, const float* mixSamples, size_t sampleCount, float mixGain)
+{
+	__m128 mixGains = _mm_set1_ps(mixGain);
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		_mm_storeu_ps(samples + sample, _mm_add_ps(_mm_loadu_ps(samples + sample), _mm_mul_ps(_mm_loadu_ps(mixSamples + sample), mixGains)));
+	}
+	MixConstantScalar(samples + sample, mixSamples + sample, sampleCount - sample, mixGain);
+}
+
+AVX2_FUNCTION static void MultiplyConstantAvx2(float* samples, size_t sampleCount, float gain)
+{
+	__m256 gains = _mm256_set1_ps(gain);
+	size_t sample = 0;
+	for (; sample + 16 <= sampleCount; sample += 16)
+	{
+		_mm256_storeu_ps(samples + sample, _mm256_mul_ps(_mm256_loadu_ps(samples + sample), gains));
+		_mm256_storeu_ps(samples + sample + 8, _mm256_mul_ps(_mm256_loadu_ps(samples + sample + 8), gains));
+	}
+	for (; sample + 8 <= sampleCount; sample += 8)
+	{
+		_mm256_storeu_ps(samples + sample, _mm256_mul_ps(_mm256_loadu_ps(samples + sample), gains));
+	}
+	MultiplyConstantScalar(samples + sample, sampleCount - sample, gain);
+}
+
+AVX2_FUNCTION static void MultiplyElementwiseAvx2(float* samples, const float* gains, size_t sampleCount)
+{
+	size_t sample = 0;
+	for (; sample + 8 <= sampleCount; sample += 8)
+	{
+		_mm256_storeu_ps(samples + sample, _mm256_mul_ps(_mm256_loadu_ps(samples + sample), _mm256_loadu_ps(gains + sample)));
+	}
+	MultiplyElementwiseScalar(samples + sample, gains + sample, sampleCount - sample);
+}
+
+AVX2_FUNCTION static void MixElementwiseAvx2(float* samples, const float* gains, const float* mixSamples, const float* mixGains, size_t sampleCount)
+{
+	//No FMA: the products are rounded separately, exactly like the scalar reference
+	size_t sample = 0;
+	for (; sample + 8 <= sampleCount; sample += 8)
+	{
+		__m256 scaledSamples = _mm256_mul_ps(_mm256_loadu_ps(samples + sample), _mm256_loadu_ps(gains + sample));
+		__m256 scaledMixSamples = _mm256_mul_ps(_mm256_loadu_ps(mixSamples + sample), _mm256_loadu_ps(mixGains + sample));
+		_mm256_storeu_ps(samples + sample, _mm256_add_ps(scaledSamples, scaledMixSamples));
+	}
+	MixElementwiseScalar(samples + sample, gains + sample, mixSamples + sample, mixGains + sample, sampleCount - sample);
+}
+
+AVX2_FUNCTION static void MixConstantAvx2(float* samples, const float* mixSamples, size_t sampleCount, float mixGain)
+{
+	__m256 mixGains = _mm256_set1_ps(mixGain);
+	size_t sample = 0;
+	for (; sample + 8 <= sampleCount; sample += 8)
+	{
+		_mm256_storeu_ps(samples + sample, _mm256_add_ps(_mm256_loadu_ps(samples + sample), _mm256_mul_ps(_mm256_loadu_ps(mixSamples + sample), mixGains)));
+	}
+	MixConstantScalar(samples + sample, mixSamples + sample, sampleCount - sample, mixGain);
+}
+#endif
+
+#ifdef GAIN_KERNELS_NEON
+static void MultiplyConstantNeon(float* samples, size_t sampleCount, float gain)
+{
+	float32x4_t gains = vdupq_n_f32(gain);
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		vst1q_f32(samples + sample, vmulq_f32(vld1q_f32(samples + sample), gains));
+	}
+	MultiplyConstantScalar(samples + sample, sampleCount - sample, gain);
+}
+
+static void MultiplyElementwiseNeon(float* samples, const float* gains, size_t sampleCount)
+{
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		vst1q_f32(samples + sample, vmulq_f32(vld1q_f32(samples + sample), vld1q_f32(gains + sample)));
+	}
+	MultiplyElementwiseScalar(samples + sample, gains + sample, sampleCount - sample);
+}
+
+static void MixElementwiseNeon(float* samples, const float* gains, const float* mixSamples, const float* mixGains, size_t sampleCount)
+{
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		float32x4_t scaledSamples = vmulq_f32(vld1q_f32(samples + sample), vld1q_f32(gains + sample));
+		float32x4_t scaledMixSamples = vmulq_f32(vld1q_f32(mixSamples + sample), vld1q_f32(mixGains + sample));
+		vst1q_f32(samples + sample, vaddq_f32(scaledSamples, scaledMixSamples));
+	}
+	MixElementwiseScalar(samples + sample, gains + sample, mixSamples + sample, mixGains + sample, sampleCount - sample);
+}
+
+static void MixConstantNeon(float* samples, const float* mixSamples, size_t sampleCount, float mixGain)
+{
+	float32x4_t mixGains = vdupq_n_f32(mixGain);
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		vst1q_f32(samples + sample, vaddq_f32(vld1q_f32(samples + sample), vmulq_f32(vld1q_f32(mixSamples + sample), mixGains)));
+	}
+	MixConstantScalar(samples + sample, mixSamples + sample, sampleCount - sample, mixGain);
+}
+#endif
+
+GainKernels::InstructionSet GainKernels::GetBestInstructionSet()
+{
+	static const InstructionSet bestInstructionSet = []()
+		{
+#if defined(GAIN_KERNELS_X86)
+#ifdef _MSC_VER
+			//AVX2 needs the CPU flag and the OS saving the YMM registers (OSXSAVE + XCR0)
+			int cpuInfo[4];
+			__cpuid(cpuInfo, 0);
+			if (cpuInfo[0] >= 7)
+			{
+				__cpuid(cpuInfo, 1);
+				bool osSavesYmm = (cpuInfo[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+				__cpuidex(cpuInfo, 7, 0);
+				if (osSavesYmm && (cpuInfo[1] & (1 << 5)) != 0)
+				{
+					return InstructionSet::Avx2;
+				}
+			}
+#else
+			if (__builtin_cpu_supports("avx2"))
+			{
+				return InstructionSet::Avx2;
+			}
+#endif
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+			return InstructionSet::Sse2;
+#else
+			return InstructionSet::Scalar;
+#endif
+#elif defined(GAIN_KERNELS_NEON)
+			return InstructionSet::Neon;
+#else
+			return InstructionSet::Scalar;
+#endif
+		}();
+	return bestInstructionSet;
+}
+
+void GainKernels::MultiplyConstant(float* samples, size_t sampleCount, float gain, InstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+#ifdef GAIN_KERNELS_X86
+	case InstructionSet::Avx2:
+		MultiplyConstantAvx2(samples, sampleCount, gain);
+		return;
+	case InstructionSet::Sse2:
+		MultiplyConstantSse2(samples, sampleCount, gain);
+		return;
+#endif
+#ifdef GAIN_KERNELS_NEON
+	case InstructionSet::Neon:
+		MultiplyConstantNeon(samples, sampleCount, gain);
+		return;
+#endif
+	default:
+		MultiplyConstantScalar(samples, sampleCount, gain);
+		return;
+	}
+}
+
+void GainKernels::MultiplyElementwise(float* samples, const float* gains, size_t sampleCount, InstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+#ifdef GAIN_KERNELS_X86
+	case InstructionSet::Avx2:
+		MultiplyElementwiseAvx2(samples, gains, sampleCount);
+		return;
+	case InstructionSet::Sse2:
+		MultiplyElementwiseSse2(samples, gains, sampleCount);
+		return;
+#endif
+#ifdef GAIN_KERNELS_NEON
+	case InstructionSet::Neon:
+		MultiplyElementwiseNeon(samples, gains, sampleCount);
+		return;
+#endif
+	default:
+		MultiplyElementwiseScalar(samples, gains, sampleCount);
+		return;
+	}
+}
+
+void GainKernels::MixElementwise(float* samples, const float* gains, const float* mixSamples, const float* mixGains, size_t sampleCount, InstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+#ifdef GAIN_KERNELS_X86
+	case InstructionSet::Avx2:
+		MixElementwiseAvx2(samples, gains, mixSamples, mixGains, sampleCount);
+		return;
+	case InstructionSet::Sse2:
+		MixElementwiseSse2(samples, gains, mixSamples, mixGains, sampleCount);
+		return;
+#endif
+#ifdef GAIN_KERNELS_NEON
+	case InstructionSet::Neon:
+		MixElementwiseNeon(samples, gains, mixSamples, mixGains, sampleCount);
+		return;
+#endif
+	default:
+		MixElementwiseScalar(samples, gains, mixSamples, mixGains, sampleCount);
+		return;
+	}
+}
+
+void GainKernels::MixConstant(float* samples, const float* mixSamples, size_t sampleCount, float mixGain, InstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+#ifdef GAIN_KERNELS_X86
+	case InstructionSet::Avx2:
+		MixConstantAvx2(samples, mixSamples, sampleCount, mixGain);
+		return;
+	case InstructionSet::Sse2:
+		MixConstantSse2(samples, mixSamples, sampleCount, mixGain);
+		return;
+#endif
+#ifdef GAIN_KERNELS_NEON
+	case InstructionSet::Neon:
+		MixConstantNeon(samples, mixSamples, sampleCount, mixGain);
+		return;
+#endif
+	default:
+		MixConstantScalar(samples, mixSamples, sampleCount, mixGain);
+		return;
+	}
+}
+
+//Control------------------------------------------------------------------------------------------------------------------------------------------------------
+GainStage::GainStage()
+{
+	Volume = 1.0f;
+	FadeLevel = 1.0f;
+	NormalizationGain = 1.0f;
+	IsMuted = false;
+	RampRequest = 0;
+	AppliedRampRequest = 0;
+	AppliedMute = false;
+	CurrentGain = 1.0f;
+	RampTargetGain = 1.0f;
+	RampIncrement = 0.0f;
+	RampFramesLeft = 0;
+	RampCurve = GainRampCurve::Linear;
+}
+
+void GainStage::RequestRamp(UINT32 rampMilliseconds, GainRampCurve curve, bool startFromSilence)
+{
+	//The levels are stored first, the render thread reads them once it sees the new request
+	UINT64 request = RampRequest.load(std::memory_order_relaxed);
+	UINT64 newRequest;
+	do
+	{
+		newRequest = (((request >> 33) + 1) << 33) | ((UINT64)startFromSilence << 32) | ((UINT64)curve << 31) | (rampMilliseconds & 0x7FFFFFFF);
+	} while (!RampRequest.compare_exchange_weak(request, newRequest, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void GainStage::SetVolume(float volumeLevel, UINT32 rampMilliseconds, GainRampCurve curve)
+{
+	Volume.store(volumeLevel, std::memory_order_relaxed);
+	RequestRamp(rampMilliseconds, curve, false);
+}
+
+void GainStage::FadeTo(float fadeLevel, UINT32 rampMilliseconds, GainRampCurve curve, bool startFromSilence)
+{
+	FadeLevel.store(fadeLevel, std::memory_order_relaxed);
+	RequestRamp(rampMilliseconds, curve, startFromSilence);
+}
+
+void GainStage::SetNormalizationGain(float gain)
+{
+	NormalizationGain.store(gain, std::memory_order_relaxed);
+	RequestRamp(DefaultRampMilliseconds, GainRampCurve::Linear, false);
+}
+
+void GainStage::SetMute(bool isMuted)
+{
+	IsMuted.store(isMuted, std::memory_order_release);
+}
+
+float GainStage::GetVolume()
+{
+	return Volume.load(std::memory_order_relaxed);
+}
+
+float GainStage::GetFadeLevel()
+{
+	return FadeLevel.load(std::memory_order_relaxed);
+}
+
+float GainStage::GetNormalizationGain()
+{
+	return NormalizationGain.load(std::memory_order_relaxed);
+}
+
+bool GainStage::GetMute()
+{
+	return IsMuted.load(std::memory_order_relaxed);
+}
+
+//Processing---------------------------------------------------------------------------------------------------------------------------------------------------
+float GainStage::GetTargetGain()
+{
+	return AppliedMute ? 0.0f : Volume.load(std::memory_order_relaxed) * FadeLevel.load(std::memory_order_relaxed) * NormalizationGain.load(std::memory_order_relaxed);
+}
+
+void GainStage::StartRamp(UINT32 rampMilliseconds, GainRampCurve curve, UINT32 sampleRate)
+{
+	RampTargetGain = GetTargetGain();
+	RampCurve = curve;
+	RampFramesLeft = (UINT32)((UINT64)rampMilliseconds * sampleRate / 1000);
+	if (RampFramesLeft == 0 || RampTargetGain == CurrentGain)
+	{
+		CurrentGain = RampTargetGain;
+		RampFramesLeft = 0;
+		return;
+	}
+
+	if (curve == GainRampCurve::Exponential)
+	{
+		float startGain = CurrentGain > ExponentialRampFloor ? CurrentGain : ExponentialRampFloor;
+		float endGain = RampTargetGain > ExponentialRampFloor ? RampTargetGain : ExponentialRampFloor;
+		CurrentGain = startGain;
+		RampIncrement = (float)std::pow((double)endGain / startGain, 1.0 / RampFramesLeft);
+	}
+	else
+	{
+		RampIncrement = (RampTargetGain - CurrentGain) / RampFramesLeft;
+	}
+}
+
+void GainStage::Process(float* samples, UINT32 frameCount, UINT32 channelCount, UINT32 sampleRate)
+{
+	//Pick up the changes made since the last call (a mute toggle ramps like a plain volume change)
+	UINT64 request = RampRequest.load(std::memory_order_acquire);
+	bool isMuted = IsMuted.load(std::memory_order_acquire);
+	if (request != AppliedRampRequest || isMuted != AppliedMute)
+	{
+		UINT32 rampMilliseconds = DefaultRampMilliseconds;
+		GainRampCurve curve = GainRampCurve::Linear;
+		if (request != AppliedRampRequest)
+		{
+			rampMilliseconds = (UINT32)(request & 0x7FFFFFFF);
+			curve = (GainRampCurve)((request >> 31) & 1);
+			if ((request >> 32) & 1)
+			{
+				CurrentGain = 0.0f;
+			}
+		}
+		AppliedRampRequest = request;
+		AppliedMute = isMuted;
+		StartRamp(rampMilliseconds, curve, sampleRate);
+	}
+
+	//The ramp part: one gain per frame, spread over the channels, then multiplied through the kernels
+	UINT32 frame = 0;
+	size_t sampleCount = (size_t)frameCount * channelCount;
+	if (RampFramesLeft > 0)
+	{
+		UINT32 rampFrames = RampFramesLeft < frameCount ? RampFramesLeft : frameCount;
+		RampGains.resize((size_t)rampFrames * channelCount);
+		float gain = CurrentGain;
+		for (; frame < rampFrames; frame++)
+		{
+			gain = RampCurve == GainRampCurve::Exponential ? gain * RampIncrement : gain + RampIncrement;
+			for (UINT32 channel = 0; channel < channelCount; channel++)
+			{
+				RampGains[(size_t)frame * channelCount + channel] = gain;
+			}
+		}
+		RampFramesLeft -= rampFrames;
+
+		//Land exactly on the target, whatever the rounding along the way
+		CurrentGain = RampFramesLeft == 0 ? RampTargetGain : gain;
+		GainKernels::MultiplyElementwise(samples, RampGains.data(), (size_t)rampFrames * channelCount);
+	}
+
+	//The steady part
+	size_t rampSampleCount = (size_t)frame * channelCount;
+	if (rampSampleCount < sampleCount && CurrentGain != 1.0f)
+	{
+		GainKernels::MultiplyConstant(samples + rampSampleCount, sampleCount - rampSampleCount, CurrentGain);
+	}
+}
+
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "AudioBackend.h"
+#include <atomic>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	In-pipeline gain: volume * fade level * loudness normalization gain, or silence while muted. Every change glides from the gain currently applied to the
+	new one over a ramp instead of stepping (a step is an audible click, a loop of steps is zipper noise). Any thread may
+	change the gain, the change is picked up lock-free by the next Process call on the render thread; a newer change made
+	before that replaces the older one. Constant gain runs through AVX2/SSE2/NEON kernels picked at runtime (with a scalar
+	fallback); ramps compute one gain per frame, then multiply through the same kernels, so every path multiplies each
+	sample by exactly the gain the scalar reference would and the output is bit-identical across instruction sets.
+	*/
+	class GainStage
+	{
+	public:
+		//Ramp of plain volume changes and mute, short enough to feel instant but long enough not to click
+		static constexpr UINT32 DefaultRampMilliseconds = 5;
+
+		//Exponential ramps can't start or end at zero, they run to and from -80 dB and land on the exact target
+		static constexpr float ExponentialRampFloor = 0.0001f;
+
+	private:
+		//Requested from any thread: (sequence << 33) | (start from silence << 32) | (curve << 31) | ramp milliseconds
+		std::atomic<float> Volume;
+		std::atomic<float> FadeLevel;
+		std::atomic<float> NormalizationGain;
+		std::atomic<bool> IsMuted;
+		std::atomic<UINT64> RampRequest;
+
+		//Render thread state
+		UINT64 AppliedRampRequest;
+		bool AppliedMute;
+		float CurrentGain;
+		float RampTargetGain;
+		float RampIncrement;        // Added to the gain every frame (linear) or multiplied with it (exponential).
+		UINT32 RampFramesLeft;
+		GainRampCurve RampCurve;
+		std::vector<float> RampGains;
+
+		void RequestRamp(UINT32 rampMilliseconds, GainRampCurve curve, bool startFromSilence);
+		void StartRamp(UINT32 rampMilliseconds, GainRampCurve curve, UINT32 sampleRate);
+		float GetTargetGain();
+
+	public:
+		GainStage();
+
+		//Control, from any thread
+		void SetVolume(float volumeLevel, UINT32 rampMilliseconds = DefaultRampMilliseconds, GainRampCurve curve = GainRampCurve::Linear);
+		void FadeTo(float fadeLevel, UINT32 rampMilliseconds, GainRampCurve curve = GainRampCurve::Linear, bool startFromSilence = false);
+		void SetMute(bool isMuted);
+
+		//Loudness normalization (ReplayGain) of the file being played, on top of the volume (may exceed 1)
+		void SetNormalizationGain(float gain);
+		float GetVolume();
+		float GetFadeLevel();
+		float GetNormalizationGain();
+		bool GetMute();
+
+		//Render thread: apply the gain to interleaved samples in place
+		void Process(float* samples, UINT32 frameCount, UINT32 channelCount, UINT32 sampleRate);
+	};
+
+	//The kernels behind GainStage, the crossfades of the headless backend and the voice engine's mixer, exposed for benchmarking and for checking them against the scalar reference
+	namespace GainKernels
+	{
+		enum class InstructionSet
+		{
+			Scalar,
+			Sse2,
+			Avx2,
+			Neon
+		};
+
+		//The best instruction set this CPU supports (detected once)
+		InstructionSet GetBestInstructionSet();
+
+		//samples[i] *= gain
+		void MultiplyConstant(float* samples, size_t sampleCount, float gain, InstructionSet instructionSet = GetBestInstructionSet());
+
+		//samples[i] *= gains[i]
+		void MultiplyElementwise(float* samples, const float* gains, size_t sampleCount, InstructionSet instructionSet = GetBestInstructionSet());
+
+		//samples[i] = samples[i] * gains[i] + mixSamples[i] * mixGains[i] (crossfades)
+		void MixElementwise(float* samples, const float* gains, const float* mixSamples, const float* mixGains, size_t sampleCount, InstructionSet instructionSet = GetBestInstructionSet());
+
+		//samples[i] += mixSamples[i] * mixGain (voices)
+		void MixConstant(float* samples, const float* mixSamples, size_t sampleCount, float mixGain, InstructionSet instructionSet = GetBestInstructionSet());
+	}
+}
@@ -0,0 +1,1405 @@
+#include "HeadlessBackend.h"
+#include "AudioSinks.h"
+#include "WavFileDecoder.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+using namespace MMFSoundPlayerLib;
+
+//Time shutdown gives the files still being opened before it leaves them behind
+static const UINT32 LoadShutdownTimeoutMilliseconds = 500;
+
+//Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
+HeadlessBackend::HeadlessBackend(const HeadlessBackendOptions& inputOptions)
+{
+	Options = inputOptions;
+	Callback = nullptr;
+	ExitRequested = false;
+	SessionOpen = false;
+	OpenSequence = 0;
+	PrepareSequence = 0;
+	PresentationEnded = false;
+	IsDecoding = false;
+	SinkReopenPending = false;
+	NextBlockStartsFile = false;
+	DecodePosition = 0;
+	CrossfadeMilliseconds = 0;
+	CrossfadeFrameCount = 0;
+	CrossfadePosition = 0;
+	WorkerWaitingForRender = false;
+	RenderWaitingForData = false;
+	RenderControl = (UINT64)RenderRequest::Stop;
+	RenderAcknowledged = (UINT64)RenderRequest::Stop;
+	RenderStatus = S_OK;
+	FramesSinceRenderStart = 0;
+	IsResampling = false;
+	CurrentFramePosition = 0;
+	CurrentSampleRate = 0;
+}
+
+HeadlessBackend::~HeadlessBackend()
+{
+	Shutdown();
+}
+
+HRESULT HeadlessBackend::CreateInstance(const HeadlessBackendOptions& inputOptions, IAudioBackend** outputBackend)
+{
+	//Ensure that the double pointer actually points somewhere
+	if (outputBackend == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//A WAV sink needs somewhere to write to
+	if (inputOptions.SinkType == HeadlessSinkType::WavFile && inputOptions.OutputFilePath.empty())
+	{
+		return E_INVALIDARG;
+	}
+	if (inputOptions.PlaybackSpeed < 0 || inputOptions.RenderPeriodMilliseconds == 0 || inputOptions.RenderLatencyMilliseconds == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULT can be returned
+	HeadlessBackend* newBackend = new (std::nothrow) HeadlessBackend(inputOptions);
+	if (newBackend == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	*outputBackend = newBackend;
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::Startup(IAudioBackendCallback* inputCallback)
+{
+	if (inputCallback == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (WorkerThread.joinable())
+	{
+		return E_UNEXPECTED;
+	}
+	Callback = inputCallback;
+
+	//Create the sink
+	if (Options.SinkType == HeadlessSinkType::WavFile)
+	{
+		Sink.reset(new (std::nothrow) WavFileAudioSink(Options.OutputFilePath.c_str()));
+	}
+	else
+	{
+		Sink.reset(new (std::nothrow) NullAudioSink());
+	}
+	if (Sink == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	//Enough blocks to cover the latency
+	UINT32 blockCount = (Options.RenderLatencyMilliseconds + Options.RenderPeriodMilliseconds - 1) / Options.RenderPeriodMilliseconds;
+	BlockRing.SetCapacity(blockCount > 2 ? blockCount : 2);
+
+	//Start the render thread (stopped until there is something to play), then the worker thread that plays the part of the MF work queue
+	ExitRequested = false;
+	RenderControl = (UINT64)RenderRequest::Stop;
+	RenderAcknowledged = (UINT64)RenderRequest::Stop;
+	try
+	{
+		RenderThread = std::thread(&HeadlessBackend::RenderLoop, this);
+		WorkerThread = std::thread(&HeadlessBackend::WorkerLoop, this);
+	}
+	catch (...)
+	{
+		assert(false);
+		if (RenderThread.joinable())
+		{
+			RequestRender(RenderRequest::Exit);
+			RenderThread.join();
+		}
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::Shutdown()
+{
+	//A file still being opened must not queue its result after the worker is gone. One that doesn't open in time (a share
+	//that doesn't answer) is left behind, it finds the gate closed.
+	OpenSequence++;
+	PrepareSequence++;
+	size_t abandonedCount = LoadThreads.Abandon(LoadShutdownTimeoutMilliseconds);
+	if (abandonedCount > 0)
+	{
+		char message[96];
+		snprintf(message, sizeof(message), "HEADLESS BACKEND: Abandoned %u file(s) still being opened\n", (unsigned int)abandonedCount);
+		WriteDebugString(message);
+	}
+
+	//Stop the worker thread (it drains the commands that are already queued first)
+	if (WorkerThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(CommandMutex);
+			ExitRequested = true;
+		}
+		CommandCondition.notify_all();
+		WorkerThread.join();
+	}
+
+	//The worker thread stopped the render thread on its way out, now it can exit
+	if (RenderThread.joinable())
+	{
+		RequestRender(RenderRequest::Exit);
+		RenderThread.join();
+	}
+
+	//Finalize whatever the sink was writing
+	HRESULT hr = S_OK;
+	if (Sink != nullptr)
+	{
+		hr = Sink->Close();
+		Sink = nullptr;
+	}
+	CurrentFile = LoadedFile();
+	NextFile = LoadedFile();
+	PreviousFile = LoadedFile();
+	BlockRing.Discard();
+	PendingRenderEvents.clear();
+	SessionOpen = false;
+	return hr;
+}
+
+//Session------------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT HeadlessBackend::CreateSession()
+{
+	if (!WorkerThread.joinable())
+	{
+		return E_UNEXPECTED;
+	}
+	SessionOpen = true;
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::CloseSession(bool* closeEventPending)
+{
+	if (closeEventPending == nullptr)
+	{
+		return E_POINTER;
+	}
+	*closeEventPending = false;
+
+	//Nothing to close
+	if (!SessionOpen)
+	{
+		return S_OK;
+	}
+
+	//Files still being opened are left to finish on their own, the worker thread drops what they queue
+	OpenSequence++;
+	PrepareSequence++;
+
+	Command closeCommand;
+	closeCommand.Type = CommandType::Close;
+	HRESULT hr = QueueCommand(std::move(closeCommand));
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	*closeEventPending = true;
+	return hr;
+}
+
+HRESULT HeadlessBackend::ShutdownSession()
+{
+	//The close command already released the decoder on the worker thread
+	SessionOpen = false;
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::OpenFile(PCWSTR inputFilePath)
+{
+	if (inputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (!SessionOpen)
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Open the file in the background, the result goes through the command queue so the worker thread stays the only owner of the decoders
+	UINT64 openSequence = ++OpenSequence;
+	std::wstring filePath = inputFilePath;
+	return LoadThreads.Run([this, options = Options, filePath, openSequence](BackgroundGate& gate) { OpenFileInBackground(this, options, gate, filePath, openSequence); });
+}
+
+HRESULT HeadlessBackend::PrepareNextFile(PCWSTR inputFilePath)
+{
+	if (inputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (!SessionOpen)
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Open the file in the background like OpenFile, a newer request replaces this one even if this one is still opening
+	UINT64 prepareSequence = ++PrepareSequence;
+	std::wstring filePath = inputFilePath;
+	return LoadThreads.Run([this, options = Options, filePath, prepareSequence](BackgroundGate& gate) { PreloadFile(this, options, gate, filePath, prepareSequence); });
+}
+
+HRESULT HeadlessBackend::SetCrossfade(UINT32 durationMilliseconds)
+{
+	//Picked up by the next switch the worker thread decodes (a crossfade in progress keeps its length)
+	CrossfadeMilliseconds = durationMilliseconds;
+	return S_OK;
+}
+
+void HeadlessBackend::OpenFileInBackground(HeadlessBackend* backend, HeadlessBackendOptions options, BackgroundGate& gate, std::wstring inputFilePath, UINT64 openSequence)
+{
+	//Open and validate the file, just like the source resolver does (nothing is decoded here, a cold start shouldn't wait
+	//for more than the header). The worker thread reports TopologySet once the decoder is in place.
+	Command topologyCommand;
+	topologyCommand.Type = CommandType::SetTopology;
+	topologyCommand.Sequence = openSequence;
+	topologyCommand.Status = LoadFile(options, gate, inputFilePath.c_str(), false, topologyCommand.File);
+
+	std::unique_lock<std::mutex> entry = gate.Enter();
+	if (entry.owns_lock())
+	{
+		backend->QueueCommand(std::move(topologyCommand));
+	}
+}
+
+void HeadlessBackend::PreloadFile(HeadlessBackend* backend, HeadlessBackendOptions options, BackgroundGate& gate, std::wstring inputFilePath, UINT64 prepareSequence)
+{
+	//Open and pre-roll the file, the switch then never waits on the disk
+	Command preparedCommand;
+	preparedCommand.Type = CommandType::NextFilePrepared;
+	preparedCommand.Sequence = prepareSequence;
+	preparedCommand.Status = LoadFile(options, gate, inputFilePath.c_str(), true, preparedCommand.File);
+
+	std::unique_lock<std::mutex> entry = gate.Enter();
+	if (entry.owns_lock())
+	{
+		backend->QueueCommand(std::move(preparedCommand));
+	}
+}
+
+//Runs on a load thread that may outlive the backend: only the options and the file are its own, the decoded cache is only used through the gate
+HRESULT HeadlessBackend::LoadFile(const HeadlessBackendOptions& options, BackgroundGate& gate, PCWSTR inputFilePath, bool decodeHeadNow, LoadedFile& outputFile)
+{
+	//Open and validate the file
+	std::unique_ptr<WavFileDecoder> newDecoder(new (std::nothrow) WavFileDecoder());
+	if (newDecoder == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	HRESULT hr = newDecoder->Open(inputFilePath);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	AudioFormat format = newDecoder->GetFormat();
+	outputFile.FilePath = inputFilePath;
+
+	//Building a filter bank takes a while, here it is off the render thread (which only finds it ready when it switches over)
+	if (options.OutputSampleRate != 0 && options.OutputSampleRate != format.SampleRate)
+	{
+		Resampler::GetFilterBank(format.SampleRate, options.OutputSampleRate, options.ResamplingQuality);
+	}
+	GetFileSizeAndModifiedTime(inputFilePath, &outputFile.FileSize, &outputFile.ModifiedTime);
+
+	//A cached start plays right away, the decoder continues behind it
+	DecodedAudioCache* decodedCache = options.DecodedCache;
+	UINT32 headFrameCount = 0;
+	if (decodedCache != nullptr)
+	{
+		std::shared_ptr<const DecodedAudioHead> cachedHead;
+		{
+			std::unique_lock<std::mutex> entry = gate.Enter();
+			if (!entry.owns_lock())
+			{
+				return E_ABORT;
+			}
+			cachedHead = decodedCache->Lookup(inputFilePath);
+			headFrameCount = decodedCache->GetHeadFrameCount(format.SampleRate);
+		}
+		if (cachedHead != nullptr && cachedHead->Format.SampleRate == format.SampleRate && cachedHead->Format.ChannelCount == format.ChannelCount &&
+			SUCCEEDED(newDecoder->SeekToFrame(cachedHead->FrameCount)))
+		{
+			outputFile.CachedHead = cachedHead;
+			outputFile.PrerollFrames = cachedHead->FrameCount;
+			outputFile.Decoder = std::move(newDecoder);
+			return S_OK;
+		}
+	}
+
+	if (decodeHeadNow)
+	{
+		//Pre-roll in the background: the whole head when it is going into the cache, one period otherwise
+		UINT32 prerollFrames = decodedCache != nullptr ? headFrameCount : std::max<UINT32>(format.SampleRate * options.RenderPeriodMilliseconds / 1000, 1);
+		outputFile.Preroll.resize((size_t)prerollFrames * format.ChannelCount);
+		hr = newDecoder->ReadFrames(outputFile.Preroll.data(), prerollFrames, &outputFile.PrerollFrames);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+		if (decodedCache != nullptr && outputFile.PrerollFrames > 0)
+		{
+			std::unique_lock<std::mutex> entry = gate.Enter();
+			if (!entry.owns_lock())
+			{
+				return E_ABORT;
+			}
+			decodedCache->Insert(inputFilePath, outputFile.FileSize, outputFile.ModifiedTime, format, outputFile.Preroll.data(), outputFile.PrerollFrames, outputFile.PrerollFrames < prerollFrames);
+		}
+	}
+	else if (decodedCache != nullptr)
+	{
+		//Record the start while it plays instead (the buffer is reserved here, off the render thread)
+		outputFile.CapturedHead.reserve((size_t)headFrameCount * format.ChannelCount);
+		outputFile.IsCapturingHead = true;
+	}
+
+	outputFile.Decoder = std::move(newDecoder);
+	return S_OK;
+}
+
+//Transport----------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT HeadlessBackend::Start()
+{
+	Command startCommand;
+	startCommand.Type = CommandType::Start;
+	return QueueCommand(std::move(startCommand));
+}
+
+HRESULT HeadlessBackend::StartAt(UINT64 startPosition_100NanoSecondUnits)
+{
+	Command startCommand;
+	startCommand.Type = CommandType::StartAt;
+	startCommand.Position_100NanoSecondUnits = startPosition_100NanoSecondUnits;
+	return QueueCommand(std::move(startCommand));
+}
+
+HRESULT HeadlessBackend::Pause()
+{
+	Command pauseCommand;
+	pauseCommand.Type = CommandType::Pause;
+	return QueueCommand(std::move(pauseCommand));
+}
+
+HRESULT HeadlessBackend::Stop()
+{
+	Command stopCommand;
+	stopCommand.Type = CommandType::Stop;
+	return QueueCommand(std::move(stopCommand));
+}
+
+//Volume and Clock---------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT HeadlessBackend::SetVolume(float volumeLevel)
+{
+	return RampVolume(volumeLevel, GainStage::DefaultRampMilliseconds, GainRampCurve::Linear);
+}
+
+HRESULT HeadlessBackend::RampVolume(float volumeLevel, UINT32 durationMilliseconds, GainRampCurve curve)
+{
+	if (!SessionOpen)
+	{
+		return E_UNEXPECTED;
+	}
+	if (volumeLevel < 0.0f || volumeLevel > 1.0f)
+	{
+		return E_INVALIDARG;
+	}
+	Gain.SetVolume(volumeLevel, durationMilliseconds, curve);
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::Fade(bool fadeIn, UINT32 durationMilliseconds, GainRampCurve curve)
+{
+	if (!SessionOpen)
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Fading in always starts from silence, fading out stays silent until the next fade in
+	Gain.FadeTo(fadeIn ? 1.0f : 0.0f, durationMilliseconds, curve, fadeIn);
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::GetVolume(float& currentVolumeLevel)
+{
+	if (!SessionOpen)
+	{
+		return E_UNEXPECTED;
+	}
+	currentVolumeLevel = Gain.GetVolume();
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::SetMute(bool isMuted)
+{
+	if (!SessionOpen)
+	{
+		return E_UNEXPECTED;
+	}
+	Gain.SetMute(isMuted);
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::GetMute(bool& isMuted)
+{
+	if (!SessionOpen)
+	{
+		return E_UNEXPECTED;
+	}
+	isMuted = Gain.GetMute();
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::SetNormalizationGain(float gain)
+{
+	if (!SessionOpen)
+	{
+		return E_UNEXPECTED;
+	}
+	if (gain < 0.0f || !std::isfinite(gain))
+	{
+		return E_INVALIDARG;
+	}
+	Gain.SetNormalizationGain(gain);
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::GetPresentationTime(UINT64* presentationTime_100NanoSecondUnits)
+{
+	if (presentationTime_100NanoSecondUnits == nullptr)
+	{
+		return E_POINTER;
+	}
+	*presentationTime_100NanoSecondUnits = 0;
+
+	UINT32 sampleRate = CurrentSampleRate;
+	if (!SessionOpen || sampleRate == 0)
+	{
+		return E_FAIL;
+	}
+
+	//The clock is the number of frames handed to the sink
+	*presentationTime_100NanoSecondUnits = CurrentFramePosition * OneSecond_100NanoSecondUnits / sampleRate;
+	return S_OK;
+}
+
+double HeadlessBackend::GetPresentationRate()
+{
+	return Options.PlaybackSpeed;
+}
+
+HRESULT HeadlessBackend::GetRenderTelemetry(RenderTelemetrySnapshot* outputSnapshot)
+{
+	if (outputSnapshot == nullptr)
+	{
+		return E_POINTER;
+	}
+	*outputSnapshot = Telemetry.GetSnapshot();
+	return S_OK;
+}
+
+HRESULT HeadlessBackend::GetVisualizationTap(VisualizationTap** outputTap)
+{
+	if (outputTap == nullptr)
+	{
+		return E_POINTER;
+	}
+	*outputTap = &Tap;
+	return S_OK;
+}
+
+UINT64 HeadlessBackend::GetUnderrunCount()
+{
+	return Telemetry.GetUnderrunCount();
+}
+
+//Worker Thread------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT HeadlessBackend::QueueCommand(Command inputCommand)
+{
+	if (!WorkerThread.joinable())
+	{
+		return E_UNEXPECTED;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(CommandMutex);
+		Commands.push_back(std::move(inputCommand));
+	}
+	CommandCondition.notify_one();
+	return S_OK;
+}
+
+void HeadlessBackend::WorkerLoop()
+{
+	while (true)
+	{
+		Command nextCommand;
+		bool haveCommand = false;
+		{
+			std::unique_lock<std::mutex> lock(CommandMutex);
+
+			//Sleep until there is a command, room for a decoded block or an event the render thread got to
+			WorkerWaitingForRender = true;
+			CommandCondition.wait(lock, [this]()
+				{
+					return ExitRequested || !Commands.empty() || (IsDecoding && !BlockRing.IsFull()) || FAILED(RenderStatus.load()) ||
+						(!PendingRenderEvents.empty() && BlockRing.GetReadCount() > PendingRenderEvents.front().BlockSequence);
+				});
+			WorkerWaitingForRender = false;
+
+			if (!Commands.empty())
+			{
+				nextCommand = std::move(Commands.front());
+				Commands.pop_front();
+				haveCommand = true;
+			}
+			else if (ExitRequested)
+			{
+				break;
+			}
+		}
+
+		//Commands always take priority over decoding
+		if (haveCommand)
+		{
+			ExecuteCommand(nextCommand);
+			continue;
+		}
+
+		ReportRenderedEvents(true);
+		FillBlockRing();
+	}
+
+	StopRendering();
+}
+
+void HeadlessBackend::WakeWorker()
+{
+	//Taking the lock orders this with the worker's check of its wait condition, so the wakeup can't fall in between (the
+	//fence keeps the check of the flag from moving ahead of the ring update it is about)
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (WorkerWaitingForRender)
+	{
+		std::lock_guard<std::mutex> lock(CommandMutex);
+	}
+	CommandCondition.notify_one();
+}
+
+HRESULT HeadlessBackend::SeekDecoder(UINT64 position_100NanoSecondUnits)
+{
+	IAudioDecoder* decoder = CurrentFile.Decoder.get();
+	if (decoder == nullptr)
+	{
+		return E_UNEXPECTED;
+	}
+
+	PresentationEnded = false;
+	UINT64 frameIndex = position_100NanoSecondUnits * DecoderFormat.SampleRate / OneSecond_100NanoSecondUnits;
+
+	//The recorded start has to be contiguous from the first frame, so only a seek back to the beginning keeps recording
+	if (CurrentFile.IsCapturingHead)
+	{
+		CurrentFile.CapturedHead.clear();
+		if (frameIndex != 0 || CurrentFile.PrerollFrames != 0)
+		{
+			CurrentFile.IsCapturingHead = false;
+			CurrentFile.CapturedHead.shrink_to_fit();
+		}
+	}
+
+	//The pre-roll holds the start of the file, so a seek into it (like a replay or a stop) plays from memory again while
+	//the decoder waits right behind it. Anywhere else, the pre-roll is skipped.
+	HRESULT hr = S_OK;
+	if (frameIndex < CurrentFile.PrerollFrames)
+	{
+		hr = decoder->SeekToFrame(CurrentFile.PrerollFrames);
+		CurrentFile.PrerollPosition = (UINT32)frameIndex;
+	}
+	else
+	{
+		hr = decoder->SeekToFrame(frameIndex);
+		CurrentFile.PrerollPosition = CurrentFile.PrerollFrames;
+	}
+	if (FAILED(hr))
+	{
+		IsDecoding = false;
+		return hr;
+	}
+	DecodePosition = frameIndex < decoder->GetFrameCount() ? frameIndex : decoder->GetFrameCount();
+	CurrentFramePosition = DecodePosition;
+	IsDecoding = true;
+	return hr;
+}
+
+void HeadlessBackend::RewindLoadedFile(LoadedFile& inputFile)
+{
+	//Back to the first frame: the pre-roll plays again and the decoder waits right behind it
+	inputFile.PrerollPosition = 0;
+	inputFile.Decoder->SeekToFrame(inputFile.PrerollFrames);
+	if (inputFile.IsCapturingHead)
+	{
+		inputFile.CapturedHead.clear();
+	}
+}
+
+UINT32 HeadlessBackend::GetPeriodFrames(UINT32 sampleRate)
+{
+	UINT32 periodFrames = sampleRate * Options.RenderPeriodMilliseconds / 1000;
+	return periodFrames > 0 ? periodFrames : 1;
+}
+
+const float* HeadlessBackend::LoadedFile::GetPrerollSamples() const
+{
+	return CachedHead != nullptr ? CachedHead->Samples : Preroll.data();
+}
+
+//Reads from the pre-rolled frames first, then from the decoder. Only returns fewer frames than asked for at the end of the file.
+HRESULT HeadlessBackend::ReadLoadedFrames(LoadedFile& inputFile, UINT32 channelCount, float* outputFrames, UINT32 frameCapacity, UINT32* framesRead)
+{
+	UINT32 totalFramesRead = 0;
+
+	//Pre-rolled frames
+	UINT32 prerollAvailable = inputFile.PrerollFrames - inputFile.PrerollPosition;
+	if (prerollAvailable > 0)
+	{
+		UINT32 framesToCopy = prerollAvailable < frameCapacity ? prerollAvailable : frameCapacity;
+		std::copy_n(inputFile.GetPrerollSamples() + (size_t)inputFile.PrerollPosition * channelCount, (size_t)framesToCopy * channelCount, outputFrames);
+		inputFile.PrerollPosition += framesToCopy;
+		totalFramesRead += framesToCopy;
+	}
+
+	//Decoded frames
+	while (totalFramesRead < frameCapacity)
+	{
+		UINT32 decodedFrames = 0;
+		float* decodedOutput = outputFrames + (size_t)totalFramesRead * channelCount;
+		HRESULT hr = inputFile.Decoder->ReadFrames(decodedOutput, frameCapacity - totalFramesRead, &decodedFrames);
+		if (FAILED(hr))
+		{
+			*framesRead = totalFramesRead;
+			return hr;
+		}
+		CaptureHead(inputFile, decodedOutput, decodedFrames, decodedFrames == 0);
+		if (decodedFrames == 0)
+		{
+			break;
+		}
+		totalFramesRead += decodedFrames;
+	}
+
+	*framesRead = totalFramesRead;
+	return S_OK;
+}
+
+void HeadlessBackend::CaptureHead(LoadedFile& inputFile, const float* decodedFrames, UINT32 frameCount, bool isEndOfFile)
+{
+	DecodedAudioCache* decodedCache = Options.DecodedCache;
+	if (!inputFile.IsCapturingHead || decodedCache == nullptr)
+	{
+		return;
+	}
+
+	//Record up to the head length
+	AudioFormat format = inputFile.Decoder->GetFormat();
+	UINT32 headFrames = decodedCache->GetHeadFrameCount(format.SampleRate);
+	UINT32 capturedFrames = (UINT32)(inputFile.CapturedHead.size() / format.ChannelCount);
+	UINT32 framesToCapture = std::min(frameCount, headFrames - capturedFrames);
+	inputFile.CapturedHead.insert(inputFile.CapturedHead.end(), decodedFrames, decodedFrames + (size_t)framesToCapture * format.ChannelCount);
+	capturedFrames += framesToCapture;
+
+	//Once the head (or the whole, shorter file) is recorded, it goes into the cache
+	if (capturedFrames >= headFrames || isEndOfFile)
+	{
+		if (capturedFrames > 0)
+		{
+			decodedCache->Insert(inputFile.FilePath.c_str(), inputFile.FileSize, inputFile.ModifiedTime, format, inputFile.CapturedHead.data(), capturedFrames, isEndOfFile);
+		}
+		inputFile.IsCapturingHead = false;
+		inputFile.CapturedHead = std::vector<float>();
+	}
+}
+
+void HeadlessBackend::SwitchToNextFile()
+{
+	//The prepared file becomes the one being decoded. The old one is kept until the render thread got to the switch too.
+	PreviousFile = std::move(CurrentFile);
+	CurrentFile = std::move(NextFile);
+	NextFile = LoadedFile();
+	PresentationEnded = false;
+	DecodePosition = 0;
+
+	//A file with a different format needs the sink reopened
+	AudioFormat nextFormat = CurrentFile.Decoder->GetFormat();
+	if (nextFormat.SampleRate != DecoderFormat.SampleRate || nextFormat.ChannelCount != DecoderFormat.ChannelCount)
+	{
+		SinkReopenPending = true;
+	}
+	DecoderFormat = nextFormat;
+}
+
+void HeadlessBackend::StartNextFileAfterEnd()
+{
+	//The render thread stopped at the end of the previous file, so this is a fresh start rather than a switch inside of a block
+	StopRendering();
+	SwitchToNextFile();
+	PreviousFile = LoadedFile();
+	CurrentFramePosition = 0;
+	IsDecoding = true;
+	FillBlockRing();
+	RequestRender(RenderRequest::Run);
+	Callback->OnBackendEvent(BackendEventType::NextFileStarted, S_OK, CurrentFile.Decoder->GetDuration_100NanoSecondUnits());
+}
+
+void HeadlessBackend::DiscardDecodedBlocks()
+{
+	//Only while the render thread is stopped. What it never rendered never happened: a gapless switch it didn't get to is
+	//undone, a crossfade it got to is cut short (the position is about to move anyway).
+	bool switchPending = IsSwitchPending();
+	BlockRing.Discard();
+	PendingRenderEvents.clear();
+	NextBlockStartsFile = false;
+	CrossfadeFrameCount = 0;
+	CrossfadePosition = 0;
+	if (PreviousFile.Decoder != nullptr && switchPending)
+	{
+		NextFile = std::move(CurrentFile);
+		RewindLoadedFile(NextFile);
+		CurrentFile = std::move(PreviousFile);
+		DecoderFormat = CurrentFile.Decoder->GetFormat();
+	}
+	PreviousFile = LoadedFile();
+	if (IsResampling)
+	{
+		OutputResampler.Reset();
+	}
+	SinkReopenPending = DecoderFormat.SampleRate != RenderFormat.SampleRate || DecoderFormat.ChannelCount != RenderFormat.ChannelCount;
+	IsDecoding = CurrentFile.Decoder != nullptr;
+}
+
+void HeadlessBackend::ExecuteCommand(Command& inputCommand)
+{
+	HRESULT hr = S_OK;
+	UINT64 eventValue = 0;
+	BackendEventType eventType = BackendEventType::Unknown;
+
+	switch (inputCommand.Type)
+	{
+	case CommandType::SetTopology:
+		//An open that was cancelled (the session was closed, or another file opened since) reports nothing
+		if (inputCommand.Sequence != OpenSequence)
+		{
+			return;
+		}
+		eventType = BackendEventType::TopologySet;
+		hr = inputCommand.Status;
+		if (FAILED(hr))
+		{
+			break;
+		}
+
+		//Replace the current file (MFSESSION_SETTOPOLOGY_IMMEDIATE), which also drops any prepared file
+		StopRendering();
+		DiscardDecodedBlocks();
+		PresentationEnded = false;
+		CurrentFile = std::move(inputCommand.File);
+		NextFile = LoadedFile();
+		DecoderFormat = CurrentFile.Decoder->GetFormat();
+		RenderFormat = DecoderFormat;
+		SinkReopenPending = false;
+		DecodePosition = 0;
+		CurrentFramePosition = 0;
+		CurrentSampleRate = DecoderFormat.SampleRate;
+		eventValue = CurrentFile.Decoder->GetDuration_100NanoSecondUnits();
+		hr = OpenSink(DecoderFormat);
+
+		//Decoding starts right away, so Start finds the first blocks ready
+		IsDecoding = SUCCEEDED(hr);
+		break;
+
+	case CommandType::NextFilePrepared:
+		//The session was closed or replaced while the file was being prepared, or a newer file was queued, nobody is waiting for it anymore
+		if (CurrentFile.Decoder == nullptr || inputCommand.Sequence != PrepareSequence)
+		{
+			return;
+		}
+
+		hr = inputCommand.Status;
+		if (SUCCEEDED(hr))
+		{
+			NextFile = std::move(inputCommand.File);
+			eventValue = NextFile.Decoder->GetDuration_100NanoSecondUnits();
+		}
+		Callback->OnBackendEvent(BackendEventType::NextFilePrepared, hr, eventValue);
+
+		//If the current file already ended, the prepared one starts right away (like a queued topology)
+		if (SUCCEEDED(hr) && PresentationEnded)
+		{
+			StartNextFileAfterEnd();
+		}
+		return;
+
+	case CommandType::Start:
+	case CommandType::StartAt:
+		if (CurrentFile.Decoder == nullptr)
+		{
+			hr = E_UNEXPECTED;
+		}
+		else if (inputCommand.Type == CommandType::StartAt)
+		{
+			//Everything decoded so far belongs to the old position (what was rendered before stopping is still reported)
+			StopRendering();
+			ReportRenderedEvents(false);
+			DiscardDecodedBlocks();
+			hr = SeekDecoder(inputCommand.Position_100NanoSecondUnits);
+		}
+		else if (!IsDecoding && BlockRing.GetReadableCount() == 0)
+		{
+			//Started again at the end: there is nothing left, which ends the presentation again
+			IsDecoding = true;
+		}
+
+		//Have the first blocks ready before the render thread asks for them
+		if (SUCCEEDED(hr))
+		{
+			FillBlockRing();
+			RequestRender(RenderRequest::Run);
+		}
+		eventType = BackendEventType::SessionStarted;
+		break;
+
+	case CommandType::Pause:
+		//The decoded blocks stay where they are, resuming continues with them
+		StopRendering();
+		ReportRenderedEvents(false);
+		eventType = BackendEventType::SessionPaused;
+		break;
+
+	case CommandType::Stop:
+		//Stopping rewinds, so the next Start plays from the beginning
+		StopRendering();
+		ReportRenderedEvents(false);
+		if (CurrentFile.Decoder != nullptr)
+		{
+			DiscardDecodedBlocks();
+			hr = SeekDecoder(0);
+		}
+		eventType = BackendEventType::SessionStopped;
+		break;
+
+	case CommandType::Close:
+		StopRendering();
+		DiscardDecodedBlocks();
+		PresentationEnded = false;
+		IsDecoding = false;
+		CurrentFile = LoadedFile();
+		NextFile = LoadedFile();
+		CurrentFramePosition = 0;
+		CurrentSampleRate = 0;
+		eventType = BackendEventType::SessionClosed;
+		break;
+	}
+
+	Callback->OnBackendEvent(eventType, hr, eventValue);
+}
+
+//Decoding-----------------------------------------------------------------------------------------------------------------------------------------------------
+void HeadlessBackend::FillBlockRing()
+{
+	//Decode until the ring holds the configured latency, or the presentation is fully decoded
+	RenderBlock* block;
+	while (IsDecoding && (block = BlockRing.BeginWrite()) != nullptr)
+	{
+		UINT64 decodeStartTime = GetMonotonicTimeNanoseconds();
+		UINT64 decodeStartCpuTime = GetThreadCpuTimeNanoseconds();
+		DecodeBlock(*block);
+		Telemetry.AddDecodedBlock(GetMonotonicTimeNanoseconds() - decodeStartTime, GetThreadCpuTimeNanoseconds() - decodeStartCpuTime);
+		BlockRing.EndWrite();
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (RenderWaitingForData)
+		{
+			std::lock_guard<std::mutex> lock(RenderMutex);
+		}
+		RenderCondition.notify_one();
+	}
+}
+
+void HeadlessBackend::DecodeBlock(RenderBlock& outputBlock)
+{
+	UINT64 blockSequence = BlockRing.GetWriteCount();
+	UINT32 periodFrames = GetPeriodFrames(DecoderFormat.SampleRate);
+	UINT32 channelCount = DecoderFormat.ChannelCount;
+	outputBlock.Samples.resize((size_t)periodFrames * channelCount);
+	outputBlock.StartPosition = DecodePosition;
+	outputBlock.StartsNextFile = NextBlockStartsFile;
+	outputBlock.NextFileFrameOffset = 0;
+	outputBlock.ReopensSink = SinkReopenPending;
+	outputBlock.Format = DecoderFormat;
+	outputBlock.IsEndOfStream = false;
+	NextBlockStartsFile = false;
+	SinkReopenPending = false;
+
+	//Decode one period worth of audio. A crossfade starting inside of it splits it: the current file up to the start of
+	//the crossfade, then the prepared file (from fileOffset on) with the tail of the old one mixed in.
+	UINT32 crossfadeOffset = GetCrossfadeOffset(periodFrames);
+	UINT32 fileOffset = 0;
+	UINT32 framesRead = 0;
+	HRESULT hr = ReadLoadedFrames(CurrentFile, channelCount, outputBlock.Samples.data(), crossfadeOffset, &framesRead);
+	if (SUCCEEDED(hr) && crossfadeOffset < periodFrames && framesRead == crossfadeOffset)
+	{
+		DecodePosition += framesRead;
+		StartCrossfade();
+		outputBlock.StartsNextFile = true;
+		outputBlock.NextFileFrameOffset = framesRead;
+		PendingRenderEvents.push_back({ blockSequence, BackendEventType::NextFileStarted, S_OK, CurrentFile.Decoder->GetDuration_100NanoSecondUnits() });
+		fileOffset = framesRead;
+		hr = ReadLoadedFrames(CurrentFile, channelCount, outputBlock.Samples.data() + (size_t)fileOffset * channelCount, periodFrames - fileOffset, &framesRead);
+	}
+	if (FAILED(hr))
+	{
+		//What was decoded still plays, then the presentation ends with the error
+		outputBlock.FrameCount = fileOffset + framesRead;
+		outputBlock.IsEndOfStream = true;
+		IsDecoding = false;
+		PendingRenderEvents.push_back({ blockSequence, BackendEventType::EndOfPresentation, hr, 0 });
+		return;
+	}
+	if (CrossfadeFrameCount > 0)
+	{
+		MixCrossfade(outputBlock.Samples.data() + (size_t)fileOffset * channelCount, framesRead);
+	}
+	UINT32 fileEndOffset = fileOffset + framesRead;
+
+	//Gapless: when the file ends inside this period and the prepared file has the same format, fill the rest of the period from it
+	bool fileEnded = fileEndOffset < periodFrames;
+	UINT32 nextFramesRead = 0;
+	bool switchInsidePeriod = false;
+	if (fileEnded && NextFile.Decoder != nullptr)
+	{
+		AudioFormat nextFormat = NextFile.Decoder->GetFormat();
+		if (nextFormat.SampleRate == DecoderFormat.SampleRate && nextFormat.ChannelCount == channelCount)
+		{
+			hr = ReadLoadedFrames(NextFile, channelCount, outputBlock.Samples.data() + (size_t)fileEndOffset * channelCount, periodFrames - fileEndOffset, &nextFramesRead);
+			switchInsidePeriod = SUCCEEDED(hr);
+			if (!switchInsidePeriod)
+			{
+				nextFramesRead = 0;
+			}
+		}
+	}
+	outputBlock.FrameCount = fileEndOffset + nextFramesRead;
+	DecodePosition += framesRead;
+
+	if (fileEnded)
+	{
+		if (NextFile.Decoder != nullptr)
+		{
+			//Hand over to the prepared file. Its first frames (if any) are in this block already, otherwise it starts with the next one.
+			SwitchToNextFile();
+			UINT64 durationValue = CurrentFile.Decoder->GetDuration_100NanoSecondUnits();
+			if (switchInsidePeriod)
+			{
+				outputBlock.StartsNextFile = true;
+				outputBlock.NextFileFrameOffset = fileEndOffset;
+				DecodePosition = nextFramesRead;
+				PendingRenderEvents.push_back({ blockSequence, BackendEventType::NextFileStarted, S_OK, durationValue });
+			}
+			else
+			{
+				NextBlockStartsFile = true;
+				PendingRenderEvents.push_back({ blockSequence + 1, BackendEventType::NextFileStarted, S_OK, durationValue });
+			}
+		}
+		else
+		{
+			//A short read means the whole file has been decoded
+			outputBlock.IsEndOfStream = true;
+			IsDecoding = false;
+			PendingRenderEvents.push_back({ blockSequence, BackendEventType::EndOfPresentation, S_OK, 0 });
+		}
+	}
+}
+
+void HeadlessBackend::ReportRenderedEvents(bool canStartNextFile)
+{
+	//A failed sink ends the presentation right away, whatever was decoded ahead is dropped
+	HRESULT renderStatus = RenderStatus.exchange(S_OK);
+	if (FAILED(renderStatus))
+	{
+		StopRendering();
+		DiscardDecodedBlocks();
+		IsDecoding = false;
+		Callback->OnBackendEvent(BackendEventType::EndOfPresentation, renderStatus, 0);
+		return;
+	}
+
+	//Events whose block the render thread is done with
+	UINT64 renderedBlocks = BlockRing.GetReadCount();
+	while (!PendingRenderEvents.empty() && renderedBlocks > PendingRenderEvents.front().BlockSequence)
+	{
+		PendingRenderEvent renderEvent = PendingRenderEvents.front();
+		PendingRenderEvents.pop_front();
+
+		if (renderEvent.Type == BackendEventType::NextFileStarted)
+		{
+			//The old file stays around while its tail is still being mixed in
+			if (CrossfadeFrameCount == 0)
+			{
+				PreviousFile = LoadedFile();
+			}
+			Callback->OnBackendEvent(BackendEventType::NextFileStarted, renderEvent.Status, renderEvent.Value);
+		}
+		else if (renderEvent.Type == BackendEventType::EndOfPresentation)
+		{
+			//The render thread stopped behind the last block. A file prepared too late for a gapless switch starts right away
+			//(unless a command is about to decide what plays next).
+			PresentationEnded = SUCCEEDED(renderEvent.Status);
+			Callback->OnBackendEvent(BackendEventType::EndOfPresentation, renderEvent.Status, 0);
+			if (PresentationEnded && NextFile.Decoder != nullptr && canStartNextFile)
+			{
+				StartNextFileAfterEnd();
+			}
+		}
+	}
+}
+
+//Crossfades---------------------------------------------------------------------------------------------------------------------------------------------------
+bool HeadlessBackend::IsSwitchPending()
+{
+	return std::any_of(PendingRenderEvents.begin(), PendingRenderEvents.end(), [](const PendingRenderEvent& renderEvent) { return renderEvent.Type == BackendEventType::NextFileStarted; });
+}
+
+UINT32 HeadlessBackend::GetCrossfadeOffset(UINT32 periodFrames)
+{
+	//Frame of the period the prepared file starts at, periodFrames when it doesn't start in this period
+	UINT32 crossfadeMilliseconds = CrossfadeMilliseconds.load(std::memory_order_relaxed);
+	if (crossfadeMilliseconds == 0 || CrossfadeFrameCount > 0 || NextFile.Decoder == nullptr)
+	{
+		return periodFrames;
+	}
+
+	//Mixing needs both files in the same format (others switch gaplessly, reopening the sink), and something to mix
+	AudioFormat nextFormat = NextFile.Decoder->GetFormat();
+	UINT64 fileFrames = CurrentFile.Decoder->GetFrameCount();
+	if (nextFormat.SampleRate != DecoderFormat.SampleRate || nextFormat.ChannelCount != DecoderFormat.ChannelCount ||
+		NextFile.Decoder->GetFrameCount() == 0 || DecodePosition >= fileFrames)
+	{
+		return periodFrames;
+	}
+
+	//A file prepared (or seeked) too late for the full crossfade starts right away, over what is left of the current one
+	UINT64 crossfadeFrames = (UINT64)crossfadeMilliseconds * DecoderFormat.SampleRate / 1000;
+	UINT64 crossfadeStart = fileFrames > crossfadeFrames ? fileFrames - crossfadeFrames : 0;
+	if (crossfadeStart >= DecodePosition + periodFrames)
+	{
+		return periodFrames;
+	}
+	return crossfadeStart > DecodePosition ? (UINT32)(crossfadeStart - DecodePosition) : 0;
+}
+
+void HeadlessBackend::StartCrossfade()
+{
+	//The prepared file takes over, the rest of the current one becomes the tail mixed into it. A shorter prepared file cuts
+	//the tail short (the outgoing curve has reached silence by then).
+	UINT64 tailFrames = CurrentFile.Decoder->GetFrameCount() - DecodePosition;
+	UINT64 nextFileFrames = NextFile.Decoder->GetFrameCount();
+	CrossfadeFrameCount = (UINT32)std::min(tailFrames, nextFileFrames);
+	CrossfadePosition = 0;
+	SwitchToNextFile();
+}
+
+void HeadlessBackend::MixCrossfade(float* samples, UINT32 frameCount)
+{
+	UINT32 channelCount = DecoderFormat.ChannelCount;
+	UINT32 framesToMix = std::min(frameCount, CrossfadeFrameCount - CrossfadePosition);
+	size_t sampleCount = (size_t)framesToMix * channelCount;
+
+	//Decode the tail of the outgoing file (silence for whatever a failing decoder doesn't deliver)
+	CrossfadeSamples.resize(sampleCount);
+	UINT32 tailFramesRead = 0;
+	if (FAILED(ReadLoadedFrames(PreviousFile, channelCount, CrossfadeSamples.data(), framesToMix, &tailFramesRead)))
+	{
+		tailFramesRead = 0;
+	}
+	std::fill(CrossfadeSamples.begin() + (size_t)tailFramesRead * channelCount, CrossfadeSamples.end(), 0.0f);
+
+	//Equal-power curves (sin/cos of a quarter turn): the summed power of two uncorrelated files stays constant throughout
+	CrossfadeInGains.resize(sampleCount);
+	CrossfadeOutGains.resize(sampleCount);
+	const double quarterTurn = 1.5707963267948966;
+	for (UINT32 frame = 0; frame < framesToMix; frame++)
+	{
+		double angle = quarterTurn * (CrossfadePosition + frame + 0.5) / CrossfadeFrameCount;
+		float inGain = (float)std::sin(angle);
+		float outGain = (float)std::cos(angle);
+		std::fill_n(CrossfadeInGains.data() + (size_t)frame * channelCount, channelCount, inGain);
+		std::fill_n(CrossfadeOutGains.data() + (size_t)frame * channelCount, channelCount, outGain);
+	}
+	GainKernels::MixElementwise(samples, CrossfadeInGains.data(), CrossfadeSamples.data(), CrossfadeOutGains.data(), sampleCount);
+
+	//Once the tail is mixed in, the outgoing file is done with (if the render thread got to the switch already)
+	CrossfadePosition += framesToMix;
+	if (CrossfadePosition == CrossfadeFrameCount)
+	{
+		CrossfadeFrameCount = 0;
+		CrossfadePosition = 0;
+		if (!IsSwitchPending())
+		{
+			PreviousFile = LoadedFile();
+		}
+	}
+}
+
+//Render Thread------------------------------------------------------------------------------------------------------------------------------------------------
+UINT64 HeadlessBackend::RequestRender(RenderRequest request)
+{
+	//A new sequence number with every request, so an acknowledgement can't be mistaken for one of an older request
+	UINT64 renderControl = RenderControl.load();
+	UINT64 newRenderControl;
+	do
+	{
+		newRenderControl = (((renderControl >> 2) + 1) << 2) | (UINT64)request;
+	} while (!RenderControl.compare_exchange_weak(renderControl, newRenderControl));
+
+	{
+		std::lock_guard<std::mutex> lock(RenderMutex);
+	}
+	RenderCondition.notify_all();
+	return newRenderControl;
+}
+
+void HeadlessBackend::StopRendering()
+{
+	//Returns once the render thread is parked, after which the worker thread may touch the ring, the sink and the render state
+	UINT64 stopControl = RequestRender(RenderRequest::Stop);
+	UINT64 acknowledged = RenderAcknowledged.load();
+	while (acknowledged != stopControl)
+	{
+		RenderAcknowledged.wait(acknowledged);
+		acknowledged = RenderAcknowledged.load();
+	}
+}
+
+HRESULT HeadlessBackend::OpenSink(const AudioFormat& inputFormat)
+{
+	//The sink runs at the output rate if there is one, files at other rates go through the resampler
+	SinkFormat = inputFormat;
+	IsResampling = Options.OutputSampleRate != 0 && Options.OutputSampleRate != inputFormat.SampleRate;
+	if (IsResampling)
+	{
+		SinkFormat.SampleRate = Options.OutputSampleRate;
+		HRESULT hr = OutputResampler.Initialize(inputFormat.SampleRate, Options.OutputSampleRate, inputFormat.ChannelCount, Options.ResamplingQuality);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+		ResampledSamples.reserve((size_t)OutputResampler.GetMaxOutputFrameCount(GetPeriodFrames(inputFormat.SampleRate)) * SinkFormat.ChannelCount);
+	}
+	return Sink->Open(SinkFormat);
+}
+
+HRESULT HeadlessBackend::WriteToSink(float* samples, UINT32 frameCount, bool isEndOfStream)
+{
+	//Without resampling the block is written as it is
+	if (!IsResampling)
+	{
+		if (frameCount == 0)
+		{
+			return S_OK;
+		}
+		Gain.Process(samples, frameCount, SinkFormat.ChannelCount, SinkFormat.SampleRate);
+		return WriteRenderedFrames(samples, frameCount);
+	}
+
+	//The resampler holds back half its filter, the end of the stream drains that too
+	UINT32 resampledFrames = 0;
+	HRESULT hr = OutputResampler.Process(samples, frameCount, ResampledSamples, &resampledFrames);
+	if (SUCCEEDED(hr) && resampledFrames > 0)
+	{
+		Gain.Process(ResampledSamples.data(), resampledFrames, SinkFormat.ChannelCount, SinkFormat.SampleRate);
+		hr = WriteRenderedFrames(ResampledSamples.data(), resampledFrames);
+	}
+	if (SUCCEEDED(hr) && isEndOfStream)
+	{
+		hr = OutputResampler.Drain(ResampledSamples, &resampledFrames);
+		if (SUCCEEDED(hr) && resampledFrames > 0)
+		{
+			Gain.Process(ResampledSamples.data(), resampledFrames, SinkFormat.ChannelCount, SinkFormat.SampleRate);
+			hr = WriteRenderedFrames(ResampledSamples.data(), resampledFrames);
+		}
+	}
+	return hr;
+}
+
+HRESULT HeadlessBackend::WriteRenderedFrames(const float* samples, UINT32 frameCount)
+{
+	//Whatever goes to the sink goes past the tap first (a copy into its ring, if it is on)
+	Tap.Write(samples, frameCount, SinkFormat.ChannelCount, SinkFormat.SampleRate);
+	return Sink->Write(samples, frameCount);
+}
+
+void HeadlessBackend::RestartRenderPacing()
+{
+	RenderStartTime = std::chrono::steady_clock::now();
+	NextRenderTime = RenderStartTime;
+	FramesSinceRenderStart = 0;
+}
+
+void HeadlessBackend::RenderLoop()
+{
+	UINT64 runningControl = 0;
+	while (true)
+	{
+		//Acknowledge the request, the worker thread may be waiting for the render thread to stop
+		UINT64 renderControl = RenderControl.load();
+		RenderAcknowledged.store(renderControl);
+		RenderAcknowledged.notify_all();
+
+		RenderRequest request = (RenderRequest)(renderControl & 3);
+		if (request == RenderRequest::Exit)
+		{
+			return;
+		}
+		if (request == RenderRequest::Stop)
+		{
+			std::unique_lock<std::mutex> lock(RenderMutex);
+			RenderCondition.wait(lock, [&]() { return RenderControl.load() != renderControl; });
+			continue;
+		}
+
+		//Every run request restarts the pacing from now
+		if (renderControl != runningControl)
+		{
+			runningControl = renderControl;
+			RestartRenderPacing();
+		}
+
+		//Wait for the period to be due (a new request cuts the wait short)
+		if (Options.PlaybackSpeed > 0)
+		{
+			std::unique_lock<std::mutex> lock(RenderMutex);
+			if (RenderCondition.wait_until(lock, NextRenderTime, [&]() { return RenderControl.load() != renderControl; }))
+			{
+				continue;
+			}
+
+			//Jitter: how long after the period was due the thread got to it
+			std::chrono::steady_clock::duration lateness = std::chrono::steady_clock::now() - NextRenderTime;
+			UINT64 lateness_Nanoseconds = lateness.count() > 0 ? (UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(lateness).count() : 0;
+			UINT64 period_Nanoseconds = RenderFormat.SampleRate > 0 ? (UINT64)(GetPeriodFrames(RenderFormat.SampleRate) * 1000000000.0 / RenderFormat.SampleRate / Options.PlaybackSpeed) : 0;
+			Telemetry.AddPeriodWakeUp(lateness_Nanoseconds, period_Nanoseconds);
+		}
+
+		UINT64 renderStartCpuTime = GetThreadCpuTimeNanoseconds();
+		bool isRendering = RenderNextBlock(renderControl);
+		Telemetry.AddRenderCpuTime(GetThreadCpuTimeNanoseconds() - renderStartCpuTime);
+		if (!isRendering)
+		{
+			//The presentation ended: park until the worker thread asks for more (unless it already did)
+			UINT64 expectedControl = renderControl;
+			RenderControl.compare_exchange_strong(expectedControl, (((renderControl >> 2) + 1) << 2) | (UINT64)RenderRequest::Stop);
+		}
+	}
+}
+
+bool HeadlessBackend::RenderNextBlock(UINT64 renderControl)
+{
+	RenderBlock* block = BlockRing.BeginRead();
+	if (block == nullptr)
+	{
+		//Unpaced rendering waits for the decoder, it never has to keep up with anything
+		if (Options.PlaybackSpeed <= 0)
+		{
+			std::unique_lock<std::mutex> lock(RenderMutex);
+			RenderWaitingForData = true;
+			RenderCondition.wait(lock, [&]() { return BlockRing.GetReadableCount() > 0 || RenderControl.load() != renderControl; });
+			RenderWaitingForData = false;
+			return true;
+		}
+
+		//Underrun: the decoder fell behind, the sink gets a period of silence rather than a gap in time
+		UINT32 silenceFrames = GetPeriodFrames(SinkFormat.SampleRate);
+		SilenceBuffer.assign((size_t)silenceFrames * SinkFormat.ChannelCount, 0.0f);
+		HRESULT hr = WriteRenderedFrames(SilenceBuffer.data(), silenceFrames);
+		Telemetry.AddBufferFill(0);
+		Telemetry.AddRenderedPeriod(silenceFrames, SinkFormat.SampleRate, true);
+		FramesSinceRenderStart += GetPeriodFrames(RenderFormat.SampleRate);
+		if (FAILED(hr))
+		{
+			Telemetry.AddSinkFailure();
+			RenderStatus = hr;
+			WakeWorker();
+			return false;
+		}
+	}
+	else
+	{
+		//A file with another format starts with this block, its pacing restarts with it (the end of the previous file still
+		//held back by the resampler goes out first)
+		UINT64 readableBlockCount = BlockRing.GetReadableCount();
+		HRESULT hr = S_OK;
+		if (block->ReopensSink)
+		{
+			hr = WriteToSink(nullptr, 0, true);
+			if (SUCCEEDED(hr))
+			{
+				hr = OpenSink(block->Format);
+			}
+			RenderFormat = block->Format;
+			CurrentSampleRate = RenderFormat.SampleRate;
+			RestartRenderPacing();
+		}
+
+		//Apply the gain and render
+		UINT32 frameCount = block->FrameCount;
+		if (SUCCEEDED(hr))
+		{
+			hr = WriteToSink(block->Samples.data(), frameCount, block->IsEndOfStream);
+		}
+
+		//The clock follows the rendered frames
+		CurrentFramePosition = block->StartsNextFile ? frameCount - block->NextFileFrameOffset : block->StartPosition + frameCount;
+		FramesSinceRenderStart += frameCount;
+		bool isEndOfStream = block->IsEndOfStream;
+		BlockRing.EndRead();
+		Telemetry.AddBufferFill(readableBlockCount);
+		Telemetry.AddRenderedPeriod(frameCount, RenderFormat.SampleRate, false);
+
+		if (FAILED(hr))
+		{
+			Telemetry.AddSinkFailure();
+			RenderStatus = hr;
+			WakeWorker();
+			return false;
+		}
+		WakeWorker();
+		if (isEndOfStream)
+		{
+			return false;
+		}
+	}
+
+	//Schedule the next period against the time the rendered audio should take to play back
+	if (Options.PlaybackSpeed > 0)
+	{
+		double elapsedSeconds = (double)FramesSinceRenderStart / RenderFormat.SampleRate / Options.PlaybackSpeed;
+		NextRenderTime = RenderStartTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(elapsedSeconds));
+	}
+	return true;
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "AudioBackend.h"
+#include "BackgroundThreads.h"
+#include "DecodedAudioCache.h"
+#include "GainStage.h"
+#include "Resampler.h"
+#include "SingleProducerSingleConsumerRing.h"
+#include "VisualizationTap.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	//Where the headless backend sends the rendered audio
+	enum class HeadlessSinkType
+	{
+		Null,   // Discard the samples.
+		WavFile // Record the samples into OutputFilePath.
+	};
+
+	struct HeadlessBackendOptions
+	{
+		HeadlessSinkType SinkType = HeadlessSinkType::Null;
+		std::wstring OutputFilePath;
+
+		//1.0 renders in real time, larger values render that many times faster and 0 renders as fast as possible
+		double PlaybackSpeed = 1.0;
+
+		//Amount of audio rendered per period of the render thread
+		UINT32 RenderPeriodMilliseconds = 10;
+
+		//Amount of audio decoded ahead of the render thread (rounded up to whole periods, at least two). Lower is more
+		//responsive to seeks and less tolerant of a slow disk.
+		UINT32 RenderLatencyMilliseconds = 40;
+
+		//Rate the sink runs at, files at other rates are converted by the render thread (0 opens the sink at every file's own rate)
+		UINT32 OutputSampleRate = 0;
+		ResamplerQuality ResamplingQuality = ResamplerQuality::Balanced;
+
+		//Decoded starts of files shared between backends, so recently played and queued files start instantly (optional,
+		//not owned, must outlive the backend)
+		DecodedAudioCache* DecodedCache = nullptr;
+	};
+
+	/*
+	Backend that needs no audio hardware and no Media Foundation, and our own pull-model render engine: WAV files are
+	decoded by WavFileDecoder and rendered into a null or WAV file sink, paced against the monotonic clock (or not paced at
+	all). Two threads share the work:
+	- The worker thread executes the session commands and reports the resulting events, so the player sees the same
+	  asynchronous behaviour it gets from an IMFMediaSession. In between it decodes period sized blocks into a lock-free
+	  single-producer/single-consumer ring, up to the configured latency ahead of the render thread.
+	- The render thread drains one block per period into the sink (through the gain stage), never waiting on the decoder or
+	  the disk. An empty ring is an underrun and renders silence (unpaced rendering waits for the decoder instead).
+	With an output sample rate set, the render thread converts the blocks of files at other rates on their way to the sink.
+	Blocks carry their file position and the file switches/ends they contain, so the clock follows what was rendered and
+	end/switch events are reported once the render thread got there, not when the decoder did.
+	With a crossfade set, the prepared file takes over the crossfade duration before the end of the current one: from there
+	on the worker thread decodes both and mixes the tail of the outgoing file into the incoming one with equal-power curves.
+	*/
+	class HeadlessBackend : public IAudioBackend
+	{
+	private:
+		enum class CommandType
+		{
+			SetTopology,
+			NextFilePrepared,
+			Start,
+			StartAt,
+			Pause,
+			Stop,
+			Close
+		};
+
+		/*
+		A decoder together with the frames that were already decoded ahead of it (pre-roll). The pre-roll always holds the
+		start of the file, either decoded when the file was opened or shared from the decoded audio cache, and the decoder
+		is positioned right behind it.
+		*/
+		struct LoadedFile
+		{
+			std::unique_ptr<IAudioDecoder> Decoder;
+			std::vector<float> Preroll;
+			std::shared_ptr<const DecodedAudioHead> CachedHead;
+			UINT32 PrerollFrames = 0;
+			UINT32 PrerollPosition = 0;
+
+			//A file that wasn't cached records its start while it plays, and goes into the cache once that is complete
+			std::wstring FilePath;
+			UINT64 FileSize = 0;
+			INT64 ModifiedTime = 0;
+			std::vector<float> CapturedHead;
+			bool IsCapturingHead = false;
+
+			const float* GetPrerollSamples() const;
+		};
+
+		//A period of decoded audio on its way to the render thread
+		struct RenderBlock
+		{
+			std::vector<float> Samples;
+			UINT32 FrameCount = 0;
+			UINT64 StartPosition = 0;       // Position (in its file) of the first frame.
+			bool StartsNextFile = false;    // The frames from NextFileFrameOffset on are the start of the next file (gapless switch).
+			UINT32 NextFileFrameOffset = 0;
+			bool ReopensSink = false;       // The sink is reopened with Format before the block is written (the format changed).
+			AudioFormat Format;
+			bool IsEndOfStream = false;     // Last block of the presentation, the render thread stops behind it.
+		};
+
+		//Event reported once the render thread is done with the block it belongs to
+		struct PendingRenderEvent
+		{
+			UINT64 BlockSequence = 0;
+			BackendEventType Type = BackendEventType::Unknown;
+			HRESULT Status = S_OK;
+			UINT64 Value = 0;
+		};
+
+		//What the worker thread asks of the render thread
+		enum class RenderRequest
+		{
+			Stop,
+			Run,
+			Exit
+		};
+
+		struct Command
+		{
+			CommandType Type = CommandType::Start;
+			HRESULT Status = S_OK;
+			UINT64 Sequence = 0;            // Of the OpenFile/PrepareNextFile call a SetTopology/NextFilePrepared answers.
+			UINT64 Position_100NanoSecondUnits = 0;
+			LoadedFile File;
+		};
+
+		HeadlessBackendOptions Options;
+		IAudioBackendCallback* Callback;
+		std::unique_ptr<IAudioSink> Sink;
+
+		//Command queue consumed by the worker thread
+		std::mutex CommandMutex;
+		std::condition_variable CommandCondition;
+		std::deque<Command> Commands;
+		bool ExitRequested;
+		std::thread WorkerThread;
+
+		//Open the files given to OpenFile and PrepareNextFile while the worker thread keeps rendering, a thread per file so a
+		//slow one holds up nothing. Only the result of the latest call of each counts, closing the session drops both.
+		//The load threads only reach the backend through their gate, so shutdown can leave one stuck on a file behind.
+		BackgroundThreads LoadThreads;
+		std::atomic<UINT64> OpenSequence;
+		std::atomic<UINT64> PrepareSequence;
+
+		//Session and decoding state (only touched by the worker thread, except SessionOpen)
+		std::atomic<bool> SessionOpen;
+		LoadedFile CurrentFile;
+		LoadedFile NextFile;
+		LoadedFile PreviousFile;    // The file the decoder switched away from, until the render thread got to the switch (and its crossfade is decoded).
+		bool PresentationEnded;
+		bool IsDecoding;
+		bool SinkReopenPending;
+		bool NextBlockStartsFile;
+		AudioFormat DecoderFormat;
+		UINT64 DecodePosition;
+		std::deque<PendingRenderEvent> PendingRenderEvents;
+
+		//Crossfade: the frames of PreviousFile's tail still to be mixed into CurrentFile (only touched by the worker thread, except CrossfadeMilliseconds)
+		std::atomic<UINT32> CrossfadeMilliseconds;
+		UINT32 CrossfadeFrameCount;
+		UINT32 CrossfadePosition;
+		std::vector<float> CrossfadeSamples;
+		std::vector<float> CrossfadeInGains;
+		std::vector<float> CrossfadeOutGains;
+
+		//Decoded blocks between the worker thread (producer) and the render thread (consumer)
+		SingleProducerSingleConsumerRing<RenderBlock> BlockRing;
+		std::atomic<bool> WorkerWaitingForRender;
+		std::atomic<bool> RenderWaitingForData;
+
+		//Render thread control: (request sequence << 2) | RenderRequest, echoed back in RenderAcknowledged once the render thread saw it
+		std::thread RenderThread;
+		std::mutex RenderMutex;
+		std::condition_variable RenderCondition;
+		std::atomic<UINT64> RenderControl;
+		std::atomic<UINT64> RenderAcknowledged;
+		std::atomic<HRESULT> RenderStatus;
+
+		//Underruns, pacing, decode-ahead fill and decode cost (written by the worker and render threads, read from any thread)
+		RenderTelemetry Telemetry;
+
+		//Copy of what the render thread writes to the sink, for visualizations (off until its consumer enables it)
+		VisualizationTap Tap;
+
+		//Render state (only touched by the render thread, or by the worker thread while the render thread is stopped). RenderFormat
+		//is the blocks' format, SinkFormat the one the sink was opened with (they differ in rate while resampling).
+		AudioFormat RenderFormat;
+		AudioFormat SinkFormat;
+		Resampler OutputResampler;
+		bool IsResampling;
+		std::vector<float> ResampledSamples;
+		std::vector<float> SilenceBuffer;
+		std::chrono::steady_clock::time_point RenderStartTime;
+		std::chrono::steady_clock::time_point NextRenderTime;
+		UINT64 FramesSinceRenderStart;
+
+		//Clock, read from any thread
+		std::atomic<UINT64> CurrentFramePosition;
+		std::atomic<UINT32> CurrentSampleRate;
+
+		//Volume, fades and mute, controlled from any thread and applied by the render thread
+		GainStage Gain;
+
+		//Worker thread
+		void WorkerLoop();
+		void ExecuteCommand(Command& inputCommand);
+		void FillBlockRing();
+		void DecodeBlock(RenderBlock& outputBlock);
+		void ReportRenderedEvents(bool canStartNextFile);
+		void SwitchToNextFile();
+		bool IsSwitchPending();
+		UINT32 GetCrossfadeOffset(UINT32 periodFrames);
+		void StartCrossfade();
+		void MixCrossfade(float* samples, UINT32 frameCount);
+		void StartNextFileAfterEnd();
+		void DiscardDecodedBlocks();
+		void RewindLoadedFile(LoadedFile& inputFile);
+		static void OpenFileInBackground(HeadlessBackend* backend, HeadlessBackendOptions options, BackgroundGate& gate, std::wstring inputFilePath, UINT64 openSequence);
+		static void PreloadFile(HeadlessBackend* backend, HeadlessBackendOptions options, BackgroundGate& gate, std::wstring inputFilePath, UINT64 prepareSequence);
+		static HRESULT LoadFile(const HeadlessBackendOptions& options, BackgroundGate& gate, PCWSTR inputFilePath, bool decodeHeadNow, LoadedFile& outputFile);
+		HRESULT ReadLoadedFrames(LoadedFile& inputFile, UINT32 channelCount, float* outputFrames, UINT32 frameCapacity, UINT32* framesRead);
+		void CaptureHead(LoadedFile& inputFile, const float* decodedFrames, UINT32 frameCount, bool isEndOfFile);
+		UINT32 GetPeriodFrames(UINT32 sampleRate);
+		HRESULT QueueCommand(Command inputCommand);
+		HRESULT SeekDecoder(UINT64 position_100NanoSecondUnits);
+
+		//Render thread
+		void RenderLoop();
+		bool RenderNextBlock(UINT64 renderControl);
+		HRESULT OpenSink(const AudioFormat& inputFormat);
+		HRESULT WriteToSink(float* samples, UINT32 frameCount, bool isEndOfStream);
+		HRESULT WriteRenderedFrames(const float* samples, UINT32 frameCount);
+		void RestartRenderPacing();
+		UINT64 RequestRender(RenderRequest request);
+		void StopRendering();
+		void WakeWorker();
+
+	public:
+		HeadlessBackend(const HeadlessBackendOptions& inputOptions);
+		~HeadlessBackend();
+
+		//Creates a headless backend (the player takes ownership)
+		static HRESULT CreateInstance(const HeadlessBackendOptions& inputOptions, IAudioBackend** outputBackend);
+
+		//IAudioBackend methods
+		HRESULT Startup(IAudioBackendCallback* inputCallback) override;
+		HRESULT Shutdown() override;
+		HRESULT CreateSession() override;
+		HRESULT CloseSession(bool* closeEventPending) override;
+		HRESULT ShutdownSession() override;
+		HRESULT OpenFile(PCWSTR inputFilePath) override;
+		HRESULT PrepareNextFile(PCWSTR inputFilePath) override;
+		HRESULT SetCrossfade(UINT32 durationMilliseconds) override;
+		HRESULT Start() override;
+		HRESULT StartAt(UINT64 startPosition_100NanoSecondUnits) override;
+		HRESULT Pause() override;
+		HRESULT Stop() override;
+		HRESULT SetVolume(float volumeLevel) override;
+		HRESULT RampVolume(float volumeLevel, UINT32 durationMilliseconds, GainRampCurve curve) override;
+		HRESULT Fade(bool fadeIn, UINT32 durationMilliseconds, GainRampCurve curve) override;
+		HRESULT GetVolume(float& currentVolumeLevel) override;
+		HRESULT SetMute(bool isMuted) override;
+		HRESULT GetMute(bool& isMuted) override;
+		HRESULT SetNormalizationGain(float gain) override;
+		HRESULT GetPresentationTime(UINT64* presentationTime_100NanoSecondUnits) override;
+		double GetPresentationRate() override;
+		HRESULT GetRenderTelemetry(RenderTelemetrySnapshot* outputSnapshot) override;
+		HRESULT GetVisualizationTap(VisualizationTap** outputTap) override;
+
+		//Periods the render thread found no decoded audio for and rendered silence instead
+		UINT64 GetUnderrunCount();
+	};
+}
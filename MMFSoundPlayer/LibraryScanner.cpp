@@ -0,0 +1,285 @@
+#include "LibraryScanner.h"
+#include <filesystem>
+#include <cassert>
+
+#ifdef _WIN32
+#include <mfapi.h>
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+//Paths go through the file system library narrow (UTF-8) outside of Windows, so non-ASCII names survive any locale
+static std::filesystem::path ToFileSystemPath(const std::wstring& inputPath)
+{
+#ifdef _WIN32
+	return std::filesystem::path(inputPath);
+#else
+	return std::filesystem::path(ConvertWidePathToNarrow(inputPath.c_str()));
+#endif
+}
+
+static std::wstring FromFileSystemPath(const std::filesystem::path& inputPath)
+{
+#ifdef _WIN32
+	return inputPath.wstring();
+#else
+	return ConvertNarrowPathToWide(inputPath.c_str());
+#endif
+}
+
+//Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
+LibraryScanner::LibraryScanner(MediaMetadataIndex* inputIndex, const LibraryScanOptions& inputOptions)
+{
+	Index = inputIndex;
+	Options = inputOptions;
+	FreeProbeSlots = 0;
+	DirectoriesScanned = 0;
+	FilesFound = 0;
+	FilesProbed = 0;
+	FilesUnchanged = 0;
+	FilesFailed = 0;
+	SeekIndexesFailed = 0;
+	LastProgressTime_Nanoseconds = 0;
+	IsCancelled = false;
+
+	//The formats each backend can play
+	if (Options.Extensions.empty())
+	{
+#ifdef _WIN32
+		Options.Extensions = { L".wav", L".mp3", L".m4a", L".aac", L".adts", L".wma", L".flac", L".ac3", L".3gp" };
+#else
+		Options.Extensions = { L".wav" };
+#endif
+	}
+}
+
+LibraryScanner::~LibraryScanner()
+{
+	Cancel();
+	ThreadPool.Stop();
+}
+
+//Scanning-----------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT LibraryScanner::Scan(const std::vector<std::wstring>& rootDirectories, LibraryScanProgressCallback progressCallback)
+{
+	if (Index == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Start from scratch
+	DirectoriesScanned = 0;
+	FilesFound = 0;
+	FilesProbed = 0;
+	FilesUnchanged = 0;
+	FilesFailed = 0;
+	SeekIndexesFailed = 0;
+	LastProgressTime_Nanoseconds = GetMonotonicTimeNanoseconds();
+	IsCancelled = false;
+	ProgressCallback = std::move(progressCallback);
+
+	//Probing through Media Foundation needs COM and Media Foundation on every worker, start them once per thread instead of once per file
+#ifdef _WIN32
+	auto threadStartup = []
+		{
+			CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+			MFStartup(MF_VERSION, MFSTARTUP_LITE);
+		};
+	auto threadShutdown = []
+		{
+			MFShutdown();
+			CoUninitialize();
+		};
+	HRESULT hr = ThreadPool.Start(Options.ThreadCount, threadStartup, threadShutdown);
+#else
+	HRESULT hr = ThreadPool.Start(Options.ThreadCount);
+#endif
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(ProbeSlotMutex);
+		FreeProbeSlots = Options.MaxConcurrentProbes != 0 ? Options.MaxConcurrentProbes : ThreadPool.GetThreadCount();
+	}
+
+	//The directory tasks queue everything else
+	for (const std::wstring& rootDirectory : rootDirectories)
+	{
+		hr = ThreadPool.Submit([this, rootDirectory] { ScanDirectory(rootDirectory); });
+		if (FAILED(hr))
+		{
+			break;
+		}
+	}
+
+	ThreadPool.WaitForIdle();
+	ThreadPool.Stop();
+
+	ReportProgress(true);
+	ProgressCallback = nullptr;
+
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	return IsCancelled ? E_ABORT : S_OK;
+}
+
+void LibraryScanner::ScanDirectory(std::wstring directoryPath)
+{
+	if (IsCancelled)
+	{
+		return;
+	}
+
+	//Unreadable directories are skipped, the rest of the tree is still scanned
+	std::error_code errorCode;
+	std::filesystem::directory_iterator directoryIterator(ToFileSystemPath(directoryPath), std::filesystem::directory_options::skip_permission_denied, errorCode);
+	if (errorCode)
+	{
+		return;
+	}
+
+	for (const std::filesystem::directory_entry& entry : directoryIterator)
+	{
+		if (IsCancelled)
+		{
+			return;
+		}
+
+		//Symbolic links to directories aren't followed, they could loop
+		if (entry.is_directory(errorCode) && !entry.is_symlink(errorCode))
+		{
+			std::wstring subdirectoryPath = FromFileSystemPath(entry.path());
+			ThreadPool.Submit([this, subdirectoryPath] { ScanDirectory(subdirectoryPath); });
+		}
+		else if (entry.is_regular_file(errorCode))
+		{
+			std::wstring filePath = FromFileSystemPath(entry.path());
+			if (HasAudioExtension(filePath))
+			{
+				FilesFound++;
+				ThreadPool.Submit([this, filePath] { ProbeFile(filePath); });
+			}
+		}
+	}
+
+	DirectoriesScanned++;
+	ReportProgress(false);
+}
+
+void LibraryScanner::ProbeFile(std::wstring filePath)
+{
+	if (IsCancelled)
+	{
+		return;
+	}
+
+	//Wait for a probe slot
+	{
+		std::unique_lock<std::mutex> lock(ProbeSlotMutex);
+		ProbeSlotCondition.wait(lock, [this] { return FreeProbeSlots > 0; });
+		FreeProbeSlots--;
+	}
+
+	HRESULT hr = Index->Refresh(filePath.c_str());
+	if (SUCCEEDED(hr) && Options.SeekIndexes != nullptr && SeekIndex::IsSupportedFile(filePath.c_str()) && FAILED(Options.SeekIndexes->Build(filePath.c_str())))
+	{
+		SeekIndexesFailed++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(ProbeSlotMutex);
+		FreeProbeSlots++;
+	}
+	ProbeSlotCondition.notify_one();
+
+	if (FAILED(hr))
+	{
+		FilesFailed++;
+	}
+	else if (hr == S_FALSE)
+	{
+		FilesUnchanged++;
+	}
+	else
+	{
+		FilesProbed++;
+	}
+	ReportProgress(false);
+}
+
+bool LibraryScanner::HasAudioExtension(const std::wstring& filePath)
+{
+	size_t dotPosition = filePath.find_last_of(L'.');
+	size_t separatorPosition = filePath.find_last_of(L"/\\");
+	if (dotPosition == std::wstring::npos || (separatorPosition != std::wstring::npos && dotPosition < separatorPosition))
+	{
+		return false;
+	}
+
+	//Compare case insensitively (extensions are ASCII)
+	std::wstring extension = filePath.substr(dotPosition);
+	for (wchar_t& character : extension)
+	{
+		if (character >= L'A' && character <= L'Z')
+		{
+			character = character - L'A' + L'a';
+		}
+	}
+
+	for (const std::wstring& audioExtension : Options.Extensions)
+	{
+		if (extension == audioExtension)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//Progress-----------------------------------------------------------------------------------------------------------------------------------------------------
+void LibraryScanner::ReportProgress(bool isComplete)
+{
+	if (!ProgressCallback)
+	{
+		return;
+	}
+
+	//Only one worker per interval gets to report
+	if (!isComplete)
+	{
+		UINT64 now = GetMonotonicTimeNanoseconds();
+		UINT64 lastProgressTime = LastProgressTime_Nanoseconds.load(std::memory_order_relaxed);
+		if (now - lastProgressTime < (UINT64)Options.ProgressIntervalMilliseconds * 1000000 ||
+			!LastProgressTime_Nanoseconds.compare_exchange_strong(lastProgressTime, now, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+
+	LibraryScanProgress progress = GetProgress();
+	progress.IsComplete = isComplete;
+
+	std::lock_guard<std::mutex> lock(ProgressMutex);
+	ProgressCallback(progress);
+}
+
+void LibraryScanner::Cancel()
+{
+	IsCancelled = true;
+}
+
+LibraryScanProgress LibraryScanner::GetProgress()
+{
+	LibraryScanProgress progress;
+	progress.DirectoriesScanned = DirectoriesScanned;
+	progress.FilesFound = FilesFound;
+	progress.FilesProbed = FilesProbed;
+	progress.FilesUnchanged = FilesUnchanged;
+	progress.FilesFailed = FilesFailed;
+	progress.SeekIndexesFailed = SeekIndexesFailed;
+	return progress;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Platform.h"
+#include "MediaMetadataIndex.h"
+#include "SeekIndexStore.h"
+#include "WorkStealingThreadPool.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	struct LibraryScanOptions
+	{
+		//Worker threads (0 = one per hardware thread)
+		UINT32 ThreadCount = 0;
+
+		//Files probed at the same time (0 = one per worker). Lower it for spinning disks and network shares.
+		UINT32 MaxConcurrentProbes = 0;
+
+		//File extensions worth probing, lower case with the dot (empty = the platform's default list)
+		std::vector<std::wstring> Extensions;
+
+		//Time between progress reports
+		UINT32 ProgressIntervalMilliseconds = 100;
+
+		//Also bring the seek indexes of compressed files up to date, inside the same probe slot (optional, must outlive the scanner)
+		SeekIndexStore* SeekIndexes = nullptr;
+	};
+
+	struct LibraryScanProgress
+	{
+		UINT64 DirectoriesScanned = 0;
+		UINT64 FilesFound = 0;        // Files with a matching extension.
+		UINT64 FilesProbed = 0;       // New or changed files whose metadata went into the index.
+		UINT64 FilesUnchanged = 0;    // Files the index already had current metadata for.
+		UINT64 FilesFailed = 0;       // Files that couldn't be probed (unsupported, corrupt, unreadable).
+		UINT64 SeekIndexesFailed = 0; // Probed files whose seek index couldn't be built (they still play, seeks are just estimated).
+		bool IsComplete = false;
+	};
+
+	//Called from the scanner's worker threads (one at a time) while scanning, and once more when the scan is complete
+	typedef std::function<void(const LibraryScanProgress&)> LibraryScanProgressCallback;
+
+	/*
+	Walks directory trees and brings a MediaMetadataIndex up to date, on a work-stealing thread pool. Every directory is a
+	task that queues a task per subdirectory and per audio file, so big and small folders balance across the workers by
+	themselves. Probing is the I/O heavy part, so the number of probes in flight is capped separately from the number of
+	threads. Results go into the index as they arrive (Refresh only probes new or changed files); saving it is up to the caller.
+	*/
+	class LibraryScanner
+	{
+	private:
+		MediaMetadataIndex* Index;
+		LibraryScanOptions Options;
+		WorkStealingThreadPool ThreadPool;
+
+		//Probe throttle
+		std::mutex ProbeSlotMutex;
+		std::condition_variable ProbeSlotCondition;
+		UINT32 FreeProbeSlots;
+
+		//Progress
+		std::atomic<UINT64> DirectoriesScanned;
+		std::atomic<UINT64> FilesFound;
+		std::atomic<UINT64> FilesProbed;
+		std::atomic<UINT64> FilesUnchanged;
+		std::atomic<UINT64> FilesFailed;
+		std::atomic<UINT64> SeekIndexesFailed;
+		std::atomic<UINT64> LastProgressTime_Nanoseconds;
+		std::mutex ProgressMutex;
+		LibraryScanProgressCallback ProgressCallback;
+
+		std::atomic<bool> IsCancelled;
+
+		void ScanDirectory(std::wstring directoryPath);
+		void ProbeFile(std::wstring filePath);
+		bool HasAudioExtension(const std::wstring& filePath);
+		void ReportProgress(bool isComplete);
+
+	public:
+		//The index must outlive the scanner
+		LibraryScanner(MediaMetadataIndex* inputIndex, const LibraryScanOptions& inputOptions = LibraryScanOptions());
+		~LibraryScanner();
+
+		//Scan the directory trees (blocks until done). Returns E_ABORT if the scan was cancelled.
+		HRESULT Scan(const std::vector<std::wstring>& rootDirectories, LibraryScanProgressCallback progressCallback = nullptr);
+
+		//Stop a running scan early (from any thread). Files already probed stay in the index.
+		void Cancel();
+
+		LibraryScanProgress GetProgress();
+	};
+}
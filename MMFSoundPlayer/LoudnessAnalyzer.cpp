@@ -0,0 +1,285 @@
+#include "LoudnessAnalyzer.h"
+#include "MediaProbe.h"
+#include <algorithm>
+#include <map>
+
+#ifdef _WIN32
+#include <mfapi.h>
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+//Frames decoded and measured at a time
+static const UINT32 AnalysisChunkFrames = 8192;
+
+//Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
+LoudnessAnalyzer::LoudnessAnalyzer(LoudnessStore* inputStore, const LoudnessAnalysisOptions& inputOptions)
+{
+	Store = inputStore;
+	Options = inputOptions;
+	FilesQueued = 0;
+	FilesAnalyzed = 0;
+	FilesUnchanged = 0;
+	FilesFailed = 0;
+	AlbumsCompleted = 0;
+	LastProgressTime_Nanoseconds = 0;
+	IsCancelled = false;
+}
+
+LoudnessAnalyzer::~LoudnessAnalyzer()
+{
+	Cancel();
+	ThreadPool.Stop();
+}
+
+//Analysis-----------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT LoudnessAnalyzer::Analyze(const std::vector<std::wstring>& filePaths, LoudnessAnalysisProgressCallback progressCallback)
+{
+	if (Store == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Start from scratch
+	FilesQueued = 0;
+	FilesAnalyzed = 0;
+	FilesUnchanged = 0;
+	FilesFailed = 0;
+	AlbumsCompleted = 0;
+	LastProgressTime_Nanoseconds = GetMonotonicTimeNanoseconds();
+	IsCancelled = false;
+	ProgressCallback = std::move(progressCallback);
+
+	//Decoding through Media Foundation needs COM and Media Foundation on every worker, start them once per thread instead of once per file
+#ifdef _WIN32
+	auto threadStartup = []
+		{
+			CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+			MFStartup(MF_VERSION, MFSTARTUP_LITE);
+		};
+	auto threadShutdown = []
+		{
+			MFShutdown();
+			CoUninitialize();
+		};
+	HRESULT hr = ThreadPool.Start(Options.ThreadCount, threadStartup, threadShutdown);
+#else
+	HRESULT hr = ThreadPool.Start(Options.ThreadCount);
+#endif
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Group the files into albums by directory
+	std::map<std::wstring, std::vector<std::wstring>> albums;
+	for (const std::wstring& filePath : filePaths)
+	{
+		size_t separatorPosition = filePath.find_last_of(L"/\\");
+		std::wstring directoryPath = separatorPosition != std::wstring::npos ? filePath.substr(0, separatorPosition) : std::wstring();
+		albums[directoryPath].push_back(filePath);
+	}
+
+	//A task per track of every album that isn't current
+	for (auto& album : albums)
+	{
+		FilesQueued += album.second.size();
+		if (IsAlbumCurrent(album.second))
+		{
+			FilesUnchanged += album.second.size();
+			AlbumsCompleted++;
+			continue;
+		}
+
+		std::shared_ptr<AlbumAnalysis> albumAnalysis = std::make_shared<AlbumAnalysis>();
+		size_t trackCount = album.second.size();
+		albumAnalysis->Tracks.resize(trackCount);
+		for (size_t trackIndex = 0; trackIndex < trackCount; trackIndex++)
+		{
+			albumAnalysis->Tracks[trackIndex].FilePath = std::move(album.second[trackIndex]);
+		}
+		albumAnalysis->TracksLeft = trackCount;
+		for (size_t trackIndex = 0; trackIndex < trackCount && SUCCEEDED(hr); trackIndex++)
+		{
+			hr = ThreadPool.Submit([this, albumAnalysis, trackIndex] { AnalyzeTrack(albumAnalysis, trackIndex); });
+		}
+		if (FAILED(hr))
+		{
+			break;
+		}
+	}
+
+	ThreadPool.WaitForIdle();
+	ThreadPool.Stop();
+
+	ReportProgress(true);
+	ProgressCallback = nullptr;
+
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	return IsCancelled ? E_ABORT : S_OK;
+}
+
+bool LoudnessAnalyzer::IsAlbumCurrent(const std::vector<std::wstring>& filePaths)
+{
+	//Every track unchanged, and analyzed as part of an album of the same size (a track added or removed changes the album loudness)
+	for (const std::wstring& filePath : filePaths)
+	{
+		LoudnessInfo info;
+		if (Store->Lookup(filePath.c_str(), &info) != S_OK || info.AlbumTrackCount != filePaths.size())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void LoudnessAnalyzer::AnalyzeTrack(std::shared_ptr<AlbumAnalysis> album, size_t trackIndex)
+{
+	if (!IsCancelled)
+	{
+		TrackAnalysis& track = album->Tracks[trackIndex];
+		LoudnessInfo& result = track.Result;
+		PCWSTR filePath = track.FilePath.c_str();
+
+		//The size and modification time are taken before decoding, a file changing meanwhile is analyzed again next time
+		LoudnessMeter meter;
+		HRESULT hr = GetFileSizeAndModifiedTime(filePath, &result.FileSize, &result.ModifiedTime);
+		if (SUCCEEDED(hr))
+		{
+			hr = MeasureFile(filePath, meter);
+		}
+		if (SUCCEEDED(hr))
+		{
+			result.IntegratedLoudness_LUFS = meter.GetIntegratedLoudness_LUFS();
+			result.LoudnessRange_LU = meter.GetLoudnessRange_LU();
+			result.TruePeak = meter.GetTruePeak();
+			track.BlockEnergies = meter.GetBlockEnergies();
+			track.Succeeded = true;
+			FilesAnalyzed++;
+		}
+		else if (hr != E_ABORT)
+		{
+			FilesFailed++;
+		}
+	}
+
+	//The last track to finish completes the album
+	if (album->TracksLeft.fetch_sub(1, std::memory_order_acq_rel) == 1 && !IsCancelled)
+	{
+		CompleteAlbum(*album);
+	}
+	ReportProgress(false);
+}
+
+HRESULT LoudnessAnalyzer::MeasureFile(PCWSTR inputFilePath, LoudnessMeter& meter)
+{
+	IAudioDecoder* openedDecoder = nullptr;
+	HRESULT hr = OpenAudioFileDecoder(inputFilePath, &openedDecoder);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	std::unique_ptr<IAudioDecoder> decoder(openedDecoder);
+
+	AudioFormat format = decoder->GetFormat();
+	hr = meter.Initialize(format.SampleRate, format.ChannelCount);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	std::vector<float> frames((size_t)AnalysisChunkFrames * format.ChannelCount);
+	while (true)
+	{
+		if (IsCancelled)
+		{
+			return E_ABORT;
+		}
+
+		UINT32 framesRead = 0;
+		hr = decoder->ReadFrames(frames.data(), AnalysisChunkFrames, &framesRead);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+		if (framesRead == 0)
+		{
+			return S_OK;
+		}
+		meter.AddFrames(frames.data(), framesRead);
+	}
+}
+
+void LoudnessAnalyzer::CompleteAlbum(AlbumAnalysis& album)
+{
+	//The album loudness gates the blocks of every track together, its peak is the loudest track's
+	std::vector<const std::vector<double>*> albumBlockEnergies;
+	float albumTruePeak = 0.0f;
+	for (const TrackAnalysis& track : album.Tracks)
+	{
+		if (track.Succeeded)
+		{
+			albumBlockEnergies.push_back(&track.BlockEnergies);
+			albumTruePeak = std::max(albumTruePeak, track.Result.TruePeak);
+		}
+	}
+	double albumLoudness = LoudnessMeter::ComputeIntegratedLoudness_LUFS(albumBlockEnergies);
+
+	for (TrackAnalysis& track : album.Tracks)
+	{
+		if (track.Succeeded)
+		{
+			track.Result.AlbumIntegratedLoudness_LUFS = albumLoudness;
+			track.Result.AlbumTruePeak = albumTruePeak;
+			track.Result.AlbumTrackCount = (UINT32)album.Tracks.size();
+			Store->Update(track.FilePath.c_str(), track.Result);
+		}
+	}
+	AlbumsCompleted++;
+}
+
+//Progress-----------------------------------------------------------------------------------------------------------------------------------------------------
+void LoudnessAnalyzer::ReportProgress(bool isComplete)
+{
+	if (!ProgressCallback)
+	{
+		return;
+	}
+
+	//Only one worker per interval gets to report
+	if (!isComplete)
+	{
+		UINT64 now = GetMonotonicTimeNanoseconds();
+		UINT64 lastProgressTime = LastProgressTime_Nanoseconds.load(std::memory_order_relaxed);
+		if (now - lastProgressTime < (UINT64)Options.ProgressIntervalMilliseconds * 1000000 ||
+			!LastProgressTime_Nanoseconds.compare_exchange_strong(lastProgressTime, now, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+
+	LoudnessAnalysisProgress progress = GetProgress();
+	progress.IsComplete = isComplete;
+
+	std::lock_guard<std::mutex> lock(ProgressMutex);
+	ProgressCallback(progress);
+}
+
+void LoudnessAnalyzer::Cancel()
+{
+	IsCancelled = true;
+}
+
+LoudnessAnalysisProgress LoudnessAnalyzer::GetProgress()
+{
+	LoudnessAnalysisProgress progress;
+	progress.FilesQueued = FilesQueued;
+	progress.FilesAnalyzed = FilesAnalyzed;
+	progress.FilesUnchanged = FilesUnchanged;
+	progress.FilesFailed = FilesFailed;
+	progress.AlbumsCompleted = AlbumsCompleted;
+	return progress;
+}
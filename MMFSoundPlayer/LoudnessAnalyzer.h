@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Platform.h"
+#include "LoudnessMeter.h"
+#include "LoudnessStore.h"
+#include "WorkStealingThreadPool.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	struct LoudnessAnalysisOptions
+	{
+		//Worker threads (0 = one per hardware thread)
+		UINT32 ThreadCount = 0;
+
+		//Time between progress reports
+		UINT32 ProgressIntervalMilliseconds = 100;
+	};
+
+	struct LoudnessAnalysisProgress
+	{
+		UINT64 FilesQueued = 0;
+		UINT64 FilesAnalyzed = 0;   // Files decoded and measured.
+		UINT64 FilesUnchanged = 0;  // Files whose album the store already had current results for.
+		UINT64 FilesFailed = 0;     // Files that couldn't be decoded.
+		UINT64 AlbumsCompleted = 0;
+		bool IsComplete = false;
+	};
+
+	//Called from the analyzer's worker threads (one at a time) while analyzing, and once more when the analysis is complete
+	typedef std::function<void(const LoudnessAnalysisProgress&)> LoudnessAnalysisProgressCallback;
+
+	/*
+	Offline loudness analysis: decodes files as fast as the CPU allows (no pacing), measures them with LoudnessMeter and
+	puts the results into a LoudnessStore. The files of one directory make up an album, its loudness is gated over the
+	blocks of all of its tracks once the last one is measured. Every track is a task of a work-stealing thread pool, so
+	the tracks of a large album spread over all cores as well. Albums whose tracks all have current results are skipped (an
+	album with a file that can't be decoded never has, it is analyzed again every time). Saving the store is up to the caller.
+	*/
+	class LoudnessAnalyzer
+	{
+	private:
+		//One track of an album, written only by the task measuring it
+		struct TrackAnalysis
+		{
+			std::wstring FilePath;
+			LoudnessInfo Result;
+			std::vector<double> BlockEnergies;
+			bool Succeeded = false;
+		};
+
+		//The tracks of one album, measured in parallel
+		struct AlbumAnalysis
+		{
+			std::vector<TrackAnalysis> Tracks;
+			std::atomic<size_t> TracksLeft{ 0 };
+		};
+
+		LoudnessStore* Store;
+		LoudnessAnalysisOptions Options;
+		WorkStealingThreadPool ThreadPool;
+
+		//Progress
+		std::atomic<UINT64> FilesQueued;
+		std::atomic<UINT64> FilesAnalyzed;
+		std::atomic<UINT64> FilesUnchanged;
+		std::atomic<UINT64> FilesFailed;
+		std::atomic<UINT64> AlbumsCompleted;
+		std::atomic<UINT64> LastProgressTime_Nanoseconds;
+		std::mutex ProgressMutex;
+		LoudnessAnalysisProgressCallback ProgressCallback;
+
+		std::atomic<bool> IsCancelled;
+
+		bool IsAlbumCurrent(const std::vector<std::wstring>& filePaths);
+		void AnalyzeTrack(std::shared_ptr<AlbumAnalysis> album, size_t trackIndex);
+		void CompleteAlbum(AlbumAnalysis& album);
+		HRESULT MeasureFile(PCWSTR inputFilePath, LoudnessMeter& meter);
+		void ReportProgress(bool isComplete);
+
+	public:
+		//The store must outlive the analyzer
+		LoudnessAnalyzer(LoudnessStore* inputStore, const LoudnessAnalysisOptions& inputOptions = LoudnessAnalysisOptions());
+		~LoudnessAnalyzer();
+
+		//Analyze the files, grouped into albums by directory (blocks until done). Returns E_ABORT if the analysis was cancelled.
+		HRESULT Analyze(const std::vector<std::wstring>& filePaths, LoudnessAnalysisProgressCallback progressCallback = nullptr);
+
+		//Stop a running analysis early (from any thread). Albums already completed stay in the store.
+		void Cancel();
+
+		LoudnessAnalysisProgress GetProgress();
+	};
+}
@@ -0,0 +1,379 @@
+#include "LoudnessMeter.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define LOUDNESS_KERNELS_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define LOUDNESS_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+static const double Pi = 3.14159265358979323846;
+
+//The 4x oversampling filter of BS.1770-4 (Annex 2), one row of 12 taps per phase, oldest sample first
+static const float TruePeakFilter[4][12] =
+{
+	{ -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f, -0.1022949218750f, 0.9721679687500f, 0.1373291015625f, -0.0594482421875f, 0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f },
+	{ -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, -0.2003173828125f, 0.7797851562500f, 0.4650878906250f, -0.1665039062500f, 0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f },
+	{ -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, -0.1665039062500f, 0.4650878906250f, 0.7797851562500f, -0.2003173828125f, 0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f },
+	{ 0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f, -0.0594482421875f, 0.1373291015625f, 0.9721679687500f, -0.1022949218750f, 0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f }
+};
+static const UINT32 TruePeakTaps = 12;
+
+static double LoudnessFromEnergy(double energy)
+{
+	return energy > 0.0 ? -0.691 + 10.0 * std::log10(energy) : -std::numeric_limits<double>::infinity();
+}
+
+static double EnergyFromLoudness(double loudness)
+{
+	return std::pow(10.0, (loudness + 0.691) / 10.0);
+}
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+LoudnessMeter::LoudnessMeter()
+{
+	SampleRate = 0;
+	ChannelCount = 0;
+	PaddedChannelCount = 0;
+	SubBlockFrames = 0;
+	SubBlockFramesDone = 0;
+	PeakHistoryPosition = 0;
+	TruePeak = 0.0f;
+	SamplePeak = 0.0f;
+}
+
+HRESULT LoudnessMeter::Initialize(UINT32 inputSampleRate, UINT32 inputChannelCount)
+{
+	if (inputSampleRate < 8000 || inputChannelCount == 0 || inputChannelCount > MaxChannelCount)
+	{
+		return E_INVALIDARG;
+	}
+	SampleRate = inputSampleRate;
+	ChannelCount = inputChannelCount;
+	PaddedChannelCount = (inputChannelCount + 1) & ~1u;
+
+	//K-weighting for any sample rate: the analog prototypes of the 48 kHz coefficients in the standard, through the bilinear transform
+	double shelfK = std::tan(Pi * 1681.974450955533 / SampleRate);
+	double shelfQ = 0.7071752369554196;
+	double shelfHighGain = std::pow(10.0, 3.999843853973347 / 20.0);
+	double shelfBandGain = std::pow(shelfHighGain, 0.4996667741545416);
+	double shelfA0 = 1.0 + shelfK / shelfQ + shelfK * shelfK;
+	Shelf.B0 = (shelfHighGain + shelfBandGain * shelfK / shelfQ + shelfK * shelfK) / shelfA0;
+	Shelf.B1 = 2.0 * (shelfK * shelfK - shelfHighGain) / shelfA0;
+	Shelf.B2 = (shelfHighGain - shelfBandGain * shelfK / shelfQ + shelfK * shelfK) / shelfA0;
+	Shelf.A1 = 2.0 * (shelfK * shelfK - 1.0) / shelfA0;
+	Shelf.A2 = (1.0 - shelfK / shelfQ + shelfK * shelfK) / shelfA0;
+
+	double highPassK = std::tan(Pi * 38.13547087602444 / SampleRate);
+	double highPassQ = 0.5003270373238773;
+	double highPassA0 = 1.0 + highPassK / highPassQ + highPassK * highPassK;
+	HighPass.B0 = 1.0;
+	HighPass.B1 = -2.0;
+	HighPass.B2 = 1.0;
+	HighPass.A1 = 2.0 * (highPassK * highPassK - 1.0) / highPassA0;
+	HighPass.A2 = (1.0 - highPassK / highPassQ + highPassK * highPassK) / highPassA0;
+
+	//Channel weights: 5.1 (L R C LFE Ls Rs) leaves out the LFE and weights the surrounds by 1.41, everything else counts fully
+	ChannelWeights.assign(PaddedChannelCount, 1.0);
+	if (ChannelCount == 6)
+	{
+		ChannelWeights[3] = 0.0;
+		ChannelWeights[4] = 1.41;
+		ChannelWeights[5] = 1.41;
+	}
+	if (PaddedChannelCount != ChannelCount)
+	{
+		ChannelWeights[ChannelCount] = 0.0;
+	}
+
+	ShelfState1.assign(PaddedChannelCount, 0.0);
+	ShelfState2.assign(PaddedChannelCount, 0.0);
+	HighPassState1.assign(PaddedChannelCount, 0.0);
+	HighPassState2.assign(PaddedChannelCount, 0.0);
+	ChannelEnergySums.assign(PaddedChannelCount, 0.0);
+	SubBlockFrames = SampleRate / 10;
+	SubBlockFramesDone = 0;
+	SubBlockEnergies.clear();
+	BlockEnergies.clear();
+	ShortTermEnergies.clear();
+
+	PeakHistory.assign((size_t)ChannelCount * TruePeakTaps * 2, 0.0f);
+	PeakHistoryPosition = 0;
+	TruePeak = 0.0f;
+	SamplePeak = 0.0f;
+	return S_OK;
+}
+
+//Measurement--------------------------------------------------------------------------------------------------------------------------------------------------
+void LoudnessMeter::AddFrames(const float* frames, UINT32 frameCount)
+{
+	if (SampleRate == 0)
+	{
+		return;
+	}
+	MeasurePeaks(frames, frameCount);
+
+	//Filter up to the end of every 100 ms sub-block, then close it
+	while (frameCount > 0)
+	{
+		UINT32 framesToFilter = std::min(frameCount, SubBlockFrames - SubBlockFramesDone);
+		FilterFrames(frames, framesToFilter);
+		frames += (size_t)framesToFilter * ChannelCount;
+		frameCount -= framesToFilter;
+		SubBlockFramesDone += framesToFilter;
+		if (SubBlockFramesDone == SubBlockFrames)
+		{
+			CompleteSubBlock();
+		}
+	}
+}
+
+void LoudnessMeter::FilterFrames(const float* frames, UINT32 frameCount)
+{
+	//The filters are recursive, so the lanes hold channels rather than consecutive samples: pairs of channels run through
+	//both biquads together, keeping their state in registers for the whole run of frames
+	for (UINT32 channel = 0; channel < PaddedChannelCount; channel += 2)
+	{
+		bool hasSecondChannel = channel + 1 < ChannelCount;
+#if defined(LOUDNESS_KERNELS_SSE2)
+		__m128d shelfB0 = _mm_set1_pd(Shelf.B0), shelfB1 = _mm_set1_pd(Shelf.B1), shelfB2 = _mm_set1_pd(Shelf.B2);
+		__m128d shelfA1 = _mm_set1_pd(Shelf.A1), shelfA2 = _mm_set1_pd(Shelf.A2);
+		__m128d highPassA1 = _mm_set1_pd(HighPass.A1), highPassA2 = _mm_set1_pd(HighPass.A2);
+		__m128d shelfState1 = _mm_loadu_pd(&ShelfState1[channel]), shelfState2 = _mm_loadu_pd(&ShelfState2[channel]);
+		__m128d highPassState1 = _mm_loadu_pd(&HighPassState1[channel]), highPassState2 = _mm_loadu_pd(&HighPassState2[channel]);
+		__m128d energySums = _mm_loadu_pd(&ChannelEnergySums[channel]);
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			const float* samples = frames + (size_t)frame * ChannelCount + channel;
+			__m128d input = hasSecondChannel ? _mm_set_pd(samples[1], samples[0]) : _mm_set_sd(samples[0]);
+
+			//High shelf
+			__m128d shelfOutput = _mm_add_pd(_mm_mul_pd(shelfB0, input), shelfState1);
+			shelfState1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(shelfB1, input), _mm_mul_pd(shelfA1, shelfOutput)), shelfState2);
+			shelfState2 = _mm_sub_pd(_mm_mul_pd(shelfB2, input), _mm_mul_pd(shelfA2, shelfOutput));
+
+			//High pass (b = 1, -2, 1)
+			__m128d highPassOutput = _mm_add_pd(shelfOutput, highPassState1);
+			highPassState1 = _mm_add_pd(_mm_sub_pd(_mm_sub_pd(_mm_setzero_pd(), _mm_add_pd(shelfOutput, shelfOutput)), _mm_mul_pd(highPassA1, highPassOutput)), highPassState2);
+			highPassState2 = _mm_sub_pd(shelfOutput, _mm_mul_pd(highPassA2, highPassOutput));
+
+			energySums = _mm_add_pd(energySums, _mm_mul_pd(highPassOutput, highPassOutput));
+		}
+		_mm_storeu_pd(&ShelfState1[channel], shelfState1);
+		_mm_storeu_pd(&ShelfState2[channel], shelfState2);
+		_mm_storeu_pd(&HighPassState1[channel], highPassState1);
+		_mm_storeu_pd(&HighPassState2[channel], highPassState2);
+		_mm_storeu_pd(&ChannelEnergySums[channel], energySums);
+#elif defined(LOUDNESS_KERNELS_NEON)
+		float64x2_t shelfB0 = vdupq_n_f64(Shelf.B0), shelfB1 = vdupq_n_f64(Shelf.B1), shelfB2 = vdupq_n_f64(Shelf.B2);
+		float64x2_t shelfA1 = vdupq_n_f64(Shelf.A1), shelfA2 = vdupq_n_f64(Shelf.A2);
+		float64x2_t highPassA1 = vdupq_n_f64(HighPass.A1), highPassA2 = vdupq_n_f64(HighPass.A2);
+		float64x2_t shelfState1 = vld1q_f64(&ShelfState1[channel]), shelfState2 = vld1q_f64(&ShelfState2[channel]);
+		float64x2_t highPassState1 = vld1q_f64(&HighPassState1[channel]), highPassState2 = vld1q_f64(&HighPassState2[channel]);
+		float64x2_t energySums = vld1q_f64(&ChannelEnergySums[channel]);
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			const float* samples = frames + (size_t)frame * ChannelCount + channel;
+			float64x2_t input = vsetq_lane_f64(hasSecondChannel ? samples[1] : 0.0, vdupq_n_f64(samples[0]), 1);
+
+			float64x2_t shelfOutput = vaddq_f64(vmulq_f64(shelfB0, input), shelfState1);
+			shelfState1 = vaddq_f64(vsubq_f64(vmulq_f64(shelfB1, input), vmulq_f64(shelfA1, shelfOutput)), shelfState2);
+			shelfState2 = vsubq_f64(vmulq_f64(shelfB2, input), vmulq_f64(shelfA2, shelfOutput));
+
+			float64x2_t highPassOutput = vaddq_f64(shelfOutput, highPassState1);
+			highPassState1 = vaddq_f64(vsubq_f64(vnegq_f64(vaddq_f64(shelfOutput, shelfOutput)), vmulq_f64(highPassA1, highPassOutput)), highPassState2);
+			highPassState2 = vsubq_f64(shelfOutput, vmulq_f64(highPassA2, highPassOutput));
+
+			energySums = vaddq_f64(energySums, vmulq_f64(highPassOutput, highPassOutput));
+		}
+		vst1q_f64(&ShelfState1[channel], shelfState1);
+		vst1q_f64(&ShelfState2[channel], shelfState2);
+		vst1q_f64(&HighPassState1[channel], highPassState1);
+		vst1q_f64(&HighPassState2[channel], highPassState2);
+		vst1q_f64(&ChannelEnergySums[channel], energySums);
+#else
+		UINT32 laneCount = hasSecondChannel ? 2 : 1;
+		for (UINT32 lane = channel; lane < channel + laneCount; lane++)
+		{
+			for (UINT32 frame = 0; frame < frameCount; frame++)
+			{
+				double input = frames[(size_t)frame * ChannelCount + lane];
+				double shelfOutput = Shelf.B0 * input + ShelfState1[lane];
+				ShelfState1[lane] = Shelf.B1 * input - Shelf.A1 * shelfOutput + ShelfState2[lane];
+				ShelfState2[lane] = Shelf.B2 * input - Shelf.A2 * shelfOutput;
+
+				double highPassOutput = shelfOutput + HighPassState1[lane];
+				HighPassState1[lane] = -2.0 * shelfOutput - HighPass.A1 * highPassOutput + HighPassState2[lane];
+				HighPassState2[lane] = shelfOutput - HighPass.A2 * highPassOutput;
+
+				ChannelEnergySums[lane] += highPassOutput * highPassOutput;
+			}
+		}
+#endif
+	}
+}
+
+void LoudnessMeter::MeasurePeaks(const float* frames, UINT32 frameCount)
+{
+	for (UINT32 frame = 0; frame < frameCount; frame++)
+	{
+		UINT32 position = PeakHistoryPosition;
+		for (UINT32 channel = 0; channel < ChannelCount; channel++)
+		{
+			float sample = frames[(size_t)frame * ChannelCount + channel];
+			SamplePeak = std::max(SamplePeak, std::fabs(sample));
+
+			//The newest sample goes in twice, so the last 12 are always contiguous (oldest first) behind position
+			float* history = &PeakHistory[(size_t)channel * TruePeakTaps * 2];
+			history[position] = sample;
+			history[position + TruePeakTaps] = sample;
+			const float* window = history + position + 1;
+
+			//Every input sample gives four interpolated ones
+			for (UINT32 phase = 0; phase < 4; phase++)
+			{
+				float interpolated = 0.0f;
+				for (UINT32 tap = 0; tap < TruePeakTaps; tap++)
+				{
+					interpolated += TruePeakFilter[phase][tap] * window[tap];
+				}
+				TruePeak = std::max(TruePeak, std::fabs(interpolated));
+			}
+		}
+		PeakHistoryPosition = position + 1 < TruePeakTaps ? position + 1 : 0;
+	}
+}
+
+void LoudnessMeter::CompleteSubBlock()
+{
+	//Weighted sum of the channels' mean squares
+	double energy = 0.0;
+	for (UINT32 channel = 0; channel < ChannelCount; channel++)
+	{
+		energy += ChannelWeights[channel] * ChannelEnergySums[channel];
+	}
+	std::fill(ChannelEnergySums.begin(), ChannelEnergySums.end(), 0.0);
+	SubBlockEnergies.push_back(energy / SubBlockFrames);
+	SubBlockFramesDone = 0;
+
+	//400 ms blocks and 3 s blocks, both moving by a sub-block at a time
+	size_t subBlockCount = SubBlockEnergies.size();
+	if (subBlockCount >= 4)
+	{
+		BlockEnergies.push_back((SubBlockEnergies[subBlockCount - 1] + SubBlockEnergies[subBlockCount - 2] + SubBlockEnergies[subBlockCount - 3] + SubBlockEnergies[subBlockCount - 4]) / 4.0);
+	}
+	if (subBlockCount >= 30)
+	{
+		double shortTermEnergy = 0.0;
+		for (size_t subBlock = subBlockCount - 30; subBlock < subBlockCount; subBlock++)
+		{
+			shortTermEnergy += SubBlockEnergies[subBlock];
+		}
+		ShortTermEnergies.push_back(shortTermEnergy / 30.0);
+	}
+}
+
+//Results------------------------------------------------------------------------------------------------------------------------------------------------------
+double LoudnessMeter::ComputeIntegratedLoudness_LUFS(const std::vector<const std::vector<double>*>& blockEnergyLists)
+{
+	//Absolute gate, then a relative gate 10 LU below the loudness of what passed the absolute one
+	double absoluteGate = EnergyFromLoudness(AbsoluteGate_LUFS);
+	double energySum = 0.0;
+	UINT64 blockCount = 0;
+	for (const std::vector<double>* blockEnergies : blockEnergyLists)
+	{
+		for (double energy : *blockEnergies)
+		{
+			if (energy > absoluteGate)
+			{
+				energySum += energy;
+				blockCount++;
+			}
+		}
+	}
+	if (blockCount == 0)
+	{
+		return -std::numeric_limits<double>::infinity();
+	}
+
+	double relativeGate = std::max(absoluteGate, energySum / blockCount * std::pow(10.0, IntegratedRelativeGate_LU / 10.0));
+	energySum = 0.0;
+	blockCount = 0;
+	for (const std::vector<double>* blockEnergies : blockEnergyLists)
+	{
+		for (double energy : *blockEnergies)
+		{
+			if (energy > relativeGate)
+			{
+				energySum += energy;
+				blockCount++;
+			}
+		}
+	}
+	return blockCount > 0 ? LoudnessFromEnergy(energySum / blockCount) : -std::numeric_limits<double>::infinity();
+}
+
+double LoudnessMeter::GetIntegratedLoudness_LUFS()
+{
+	return ComputeIntegratedLoudness_LUFS({ &BlockEnergies });
+}
+
+double LoudnessMeter::GetLoudnessRange_LU()
+{
+	//Short-term loudness past the absolute gate and a relative gate 20 LU down, then the spread between its 10th and 95th percentile
+	double absoluteGate = EnergyFromLoudness(AbsoluteGate_LUFS);
+	double energySum = 0.0;
+	UINT64 blockCount = 0;
+	for (double energy : ShortTermEnergies)
+	{
+		if (energy > absoluteGate)
+		{
+			energySum += energy;
+			blockCount++;
+		}
+	}
+	if (blockCount == 0)
+	{
+		return 0.0;
+	}
+
+	double relativeGate = std::max(absoluteGate, energySum / blockCount * std::pow(10.0, RangeRelativeGate_LU / 10.0));
+	std::vector<double> gatedLoudness;
+	gatedLoudness.reserve(blockCount);
+	for (double energy : ShortTermEnergies)
+	{
+		if (energy > relativeGate)
+		{
+			gatedLoudness.push_back(LoudnessFromEnergy(energy));
+		}
+	}
+	if (gatedLoudness.empty())
+	{
+		return 0.0;
+	}
+	std::sort(gatedLoudness.begin(), gatedLoudness.end());
+	size_t lastIndex = gatedLoudness.size() - 1;
+	return gatedLoudness[(size_t)std::llround(lastIndex * 0.95)] - gatedLoudness[(size_t)std::llround(lastIndex * 0.10)];
+}
+
+float LoudnessMeter::GetTruePeak()
+{
+	//The interpolated samples can't be below the samples they interpolate
+	return std::max(TruePeak, SamplePeak);
+}
+
+float LoudnessMeter::GetSamplePeak()
+{
+	return SamplePeak;
+}
+
+const std::vector<double>& LoudnessMeter::GetBlockEnergies()
+{
+	return BlockEnergies;
+}
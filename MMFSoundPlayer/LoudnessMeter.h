@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Platform.h"
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Loudness measurement of one stream after ITU-R BS.1770-4 and EBU R128/Tech 3342: integrated loudness, loudness range
+	and true peak. Every channel runs through the K-weighting filter (a high shelf and a high pass biquad, in double
+	precision with the channels side by side in SSE2/NEON registers), the weighted energy is summed per 100 ms and kept
+	as 400 ms blocks (75% overlap) for the gated integrated loudness and 3 s blocks for the loudness range. The true
+	peak comes from the standard's 4x oversampling filter. The 400 ms block energies of several streams can be gated
+	together, which gives the loudness of an album.
+	Not thread-safe, every stream being measured has a meter of its own.
+	*/
+	class LoudnessMeter
+	{
+	public:
+		static constexpr double AbsoluteGate_LUFS = -70.0;
+		static constexpr double IntegratedRelativeGate_LU = -10.0;
+		static constexpr double RangeRelativeGate_LU = -20.0;
+		static constexpr UINT32 MaxChannelCount = 32;
+
+	private:
+		//Direct form II transposed biquad coefficients (a0 = 1)
+		struct BiquadCoefficients
+		{
+			double B0 = 1.0;
+			double B1 = 0.0;
+			double B2 = 0.0;
+			double A1 = 0.0;
+			double A2 = 0.0;
+		};
+
+		UINT32 SampleRate;
+		UINT32 ChannelCount;
+		UINT32 PaddedChannelCount;  // Rounded up to an even number, the filters run on pairs of channels.
+		BiquadCoefficients Shelf;
+		BiquadCoefficients HighPass;
+		std::vector<double> ChannelWeights;
+
+		//Filter state and the energy of the current 100 ms per channel (PaddedChannelCount entries each)
+		std::vector<double> ShelfState1;
+		std::vector<double> ShelfState2;
+		std::vector<double> HighPassState1;
+		std::vector<double> HighPassState2;
+		std::vector<double> ChannelEnergySums;
+		UINT32 SubBlockFrames;
+		UINT32 SubBlockFramesDone;
+
+		//Weighted mean square energies of the 100 ms sub-blocks, 400 ms blocks and 3 s blocks
+		std::vector<double> SubBlockEnergies;
+		std::vector<double> BlockEnergies;
+		std::vector<double> ShortTermEnergies;
+
+		//True peak: the last input samples of every channel (twice in a row, so any 12 of them are contiguous)
+		std::vector<float> PeakHistory;
+		UINT32 PeakHistoryPosition;
+		float TruePeak;
+		float SamplePeak;
+
+		void FilterFrames(const float* frames, UINT32 frameCount);
+		void MeasurePeaks(const float* frames, UINT32 frameCount);
+		void CompleteSubBlock();
+
+	public:
+		LoudnessMeter();
+
+		//Start measuring a stream (also resets the meter)
+		HRESULT Initialize(UINT32 inputSampleRate, UINT32 inputChannelCount);
+
+		//Measure interleaved frames of the stream
+		void AddFrames(const float* frames, UINT32 frameCount);
+
+		//Results of everything measured so far. The loudness is -infinity when every block is below the absolute gate.
+		double GetIntegratedLoudness_LUFS();
+		double GetLoudnessRange_LU();
+		float GetTruePeak();    // Linear, 1.0 is full scale.
+		float GetSamplePeak();
+
+		//The 400 ms block energies, for gating several streams together
+		const std::vector<double>& GetBlockEnergies();
+
+		//Gated loudness of the blocks of several streams as one (the album loudness of its tracks)
+		static double ComputeIntegratedLoudness_LUFS(const std::vector<const std::vector<double>*>& blockEnergyLists);
+	};
+}
@@ -0,0 +1,212 @@
+#include "LoudnessStore.h"
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace MMFSoundPlayerLib;
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+LoudnessStore::LoudnessStore(PCWSTR inputStoreFilePath)
+{
+	StoreFilePath = inputStoreFilePath;
+	HasUnsavedChanges = false;
+}
+
+HRESULT LoudnessStore::CreateInstance(PCWSTR storeFilePath, LoudnessStore** outputStore)
+{
+	//Ensure that the pointers actually point somewhere
+	if (storeFilePath == nullptr || outputStore == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULT can be returned
+	LoudnessStore* newStore = new (std::nothrow) LoudnessStore(storeFilePath);
+	if (newStore == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	//Whatever is wrong with the existing file, the store still works (empty) and Save writes a good one. A missing file is
+	//just the first run, only a damaged one is worth mentioning.
+	HRESULT hr = newStore->LoadStoreFile();
+	if (FAILED(hr))
+	{
+		if (hr != HRESULT_FROM_WIN32(ENOENT))
+		{
+			WriteDebugString("LOUDNESS STORE: Unreadable store file, starting with an empty store\n");
+		}
+		newStore->Entries.clear();
+	}
+
+	*outputStore = newStore;
+	return S_OK;
+}
+
+HRESULT LoudnessStore::LoadStoreFile()
+{
+	FILE* file = OpenFileWithWidePath(StoreFilePath.c_str(), "rb");
+	if (file == nullptr)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+
+	StoreHeader header;
+	HRESULT hr = S_OK;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.Magic != StoreMagic || header.Version != StoreVersion)
+	{
+		hr = E_INVALIDARG;
+	}
+
+	//Every entry is checked to fit, a truncated file stops at the first entry that doesn't
+	std::string narrowPath;
+	for (UINT64 entry = 0; SUCCEEDED(hr) && entry < header.EntryCount; entry++)
+	{
+		UINT32 pathLength = 0;
+		StoreRecord record;
+		if (fread(&pathLength, sizeof(pathLength), 1, file) != 1 || pathLength == 0 || pathLength > 32768)
+		{
+			hr = E_INVALIDARG;
+			break;
+		}
+		narrowPath.resize(pathLength);
+		if (fread(&narrowPath[0], 1, pathLength, file) != pathLength || fread(&record, sizeof(record), 1, file) != 1)
+		{
+			hr = E_INVALIDARG;
+			break;
+		}
+
+		LoudnessInfo& info = Entries[narrowPath];
+		info.FileSize = record.FileSize;
+		info.ModifiedTime = record.ModifiedTime;
+		info.IntegratedLoudness_LUFS = record.IntegratedLoudness_LUFS;
+		info.LoudnessRange_LU = record.LoudnessRange_LU;
+		info.TruePeak = record.TruePeak;
+		info.AlbumIntegratedLoudness_LUFS = record.AlbumIntegratedLoudness_LUFS;
+		info.AlbumTruePeak = record.AlbumTruePeak;
+		info.AlbumTrackCount = record.AlbumTrackCount;
+	}
+
+	fclose(file);
+	return hr;
+}
+
+//Entries------------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT LoudnessStore::Lookup(PCWSTR inputFilePath, LoudnessInfo* outputInfo)
+{
+	if (inputFilePath == nullptr || outputInfo == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//The entry only counts if the file is still the one that was analyzed
+	UINT64 fileSize = 0;
+	INT64 modifiedTime = 0;
+	HRESULT hr = GetFileSizeAndModifiedTime(inputFilePath, &fileSize, &modifiedTime);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	LoudnessInfo storedInfo;
+	{
+		std::shared_lock<std::shared_mutex> lock(StoreMutex);
+		auto entry = Entries.find(ConvertWidePathToNarrow(inputFilePath));
+		if (entry == Entries.end())
+		{
+			return S_FALSE;
+		}
+		storedInfo = entry->second;
+	}
+
+	if (storedInfo.FileSize != fileSize || storedInfo.ModifiedTime != modifiedTime)
+	{
+		return S_FALSE;
+	}
+	*outputInfo = storedInfo;
+	return S_OK;
+}
+
+HRESULT LoudnessStore::Update(PCWSTR inputFilePath, const LoudnessInfo& inputInfo)
+{
+	if (inputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	std::string narrowPath = ConvertWidePathToNarrow(inputFilePath);
+	std::unique_lock<std::shared_mutex> lock(StoreMutex);
+	Entries[narrowPath] = inputInfo;
+	HasUnsavedChanges = true;
+	return S_OK;
+}
+
+HRESULT LoudnessStore::Save()
+{
+	//Updates wait while the store is written, saving is rare (after an analysis run) so that is fine
+	std::unique_lock<std::shared_mutex> lock(StoreMutex);
+	if (!HasUnsavedChanges)
+	{
+		return S_FALSE;
+	}
+
+	//Write the new store next to the old one, so a failure leaves the old one intact
+	std::wstring temporaryFilePath = StoreFilePath + L".tmp";
+	FILE* file = OpenFileWithWidePath(temporaryFilePath.c_str(), "wb");
+	if (file == nullptr)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+
+	StoreHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Magic = StoreMagic;
+	header.Version = StoreVersion;
+	header.EntryCount = Entries.size();
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	for (auto entry = Entries.begin(); written && entry != Entries.end(); ++entry)
+	{
+		const LoudnessInfo& info = entry->second;
+		StoreRecord record;
+		memset(&record, 0, sizeof(record));
+		record.FileSize = info.FileSize;
+		record.ModifiedTime = info.ModifiedTime;
+		record.IntegratedLoudness_LUFS = info.IntegratedLoudness_LUFS;
+		record.LoudnessRange_LU = info.LoudnessRange_LU;
+		record.AlbumIntegratedLoudness_LUFS = info.AlbumIntegratedLoudness_LUFS;
+		record.TruePeak = info.TruePeak;
+		record.AlbumTruePeak = info.AlbumTruePeak;
+		record.AlbumTrackCount = info.AlbumTrackCount;
+
+		UINT32 pathLength = (UINT32)entry->first.size();
+		written = fwrite(&pathLength, sizeof(pathLength), 1, file) == 1 &&
+			fwrite(entry->first.data(), 1, pathLength, file) == pathLength &&
+			fwrite(&record, sizeof(record), 1, file) == 1;
+	}
+	if (fclose(file) != 0)
+	{
+		written = false;
+	}
+	if (!written)
+	{
+		RemoveFileWithWidePath(temporaryFilePath.c_str());
+		return E_FAIL;
+	}
+
+	HRESULT hr = ReplaceFileWithWidePath(temporaryFilePath.c_str(), StoreFilePath.c_str());
+	if (FAILED(hr))
+	{
+		//The entries stay in memory, the next save tries again
+		return hr;
+	}
+	HasUnsavedChanges = false;
+	return S_OK;
+}
+
+UINT64 LoudnessStore::GetEntryCount()
+{
+	std::shared_lock<std::shared_mutex> lock(StoreMutex);
+	return Entries.size();
+}
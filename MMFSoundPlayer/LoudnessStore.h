@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Platform.h"
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace MMFSoundPlayerLib
+{
+	//Loudness of a file (EBU R128) and of the album it was analyzed with
+	struct LoudnessInfo
+	{
+		UINT64 FileSize = 0;
+		INT64 ModifiedTime = 0;
+		double IntegratedLoudness_LUFS = 0.0;   // -infinity for silence.
+		double LoudnessRange_LU = 0.0;
+		float TruePeak = 0.0f;                  // Linear, 1.0 is full scale.
+		double AlbumIntegratedLoudness_LUFS = 0.0;
+		float AlbumTruePeak = 0.0f;
+		UINT32 AlbumTrackCount = 0;
+	};
+
+	/*
+	Persistent cache of loudness analysis results, so a file is analyzed once and not every time it is played. The whole
+	file is read when the store is created (an entry is a few dozen bytes, analysis is far too slow for the store to grow
+	large), Save writes a new one next to it and swaps it in. An entry only counts while the file has the size and
+	modification time it was analyzed with. All methods are thread-safe.
+
+	File layout (native little endian): Magic 'MMFL', Version, EntryCount, then per entry the UTF-8 path length, the path
+	and a fixed size record.
+	*/
+	class LoudnessStore
+	{
+	public:
+		static constexpr UINT32 StoreMagic = 0x4C464D4D; // "MMFL"
+		static constexpr UINT32 StoreVersion = 1;
+
+	private:
+#pragma pack(push, 1)
+		struct StoreHeader
+		{
+			UINT32 Magic;
+			UINT32 Version;
+			UINT64 EntryCount;
+		};
+
+		struct StoreRecord
+		{
+			UINT64 FileSize;
+			INT64 ModifiedTime;
+			double IntegratedLoudness_LUFS;
+			double LoudnessRange_LU;
+			double AlbumIntegratedLoudness_LUFS;
+			float TruePeak;
+			float AlbumTruePeak;
+			UINT32 AlbumTrackCount;
+			UINT32 Reserved;
+		};
+#pragma pack(pop)
+
+		std::wstring StoreFilePath;
+
+		//Entries keyed by UTF-8 path (guarded by StoreMutex)
+		std::shared_mutex StoreMutex;
+		std::unordered_map<std::string, LoudnessInfo> Entries;
+		bool HasUnsavedChanges;
+
+		LoudnessStore(PCWSTR inputStoreFilePath);
+
+		HRESULT LoadStoreFile();
+
+	public:
+		//Open the store saved at storeFilePath. A missing file gives an empty store, a corrupt one is ignored (and replaced by Save).
+		static HRESULT CreateInstance(PCWSTR storeFilePath, LoudnessStore** outputStore);
+
+		//Loudness of a file that is unchanged since it was analyzed. Returns S_OK, or S_FALSE if there is none or the file changed.
+		HRESULT Lookup(PCWSTR inputFilePath, LoudnessInfo* outputInfo);
+
+		//Add or replace the entry of a file (FileSize and ModifiedTime must be the ones it was analyzed with)
+		HRESULT Update(PCWSTR inputFilePath, const LoudnessInfo& inputInfo);
+
+		//Write the entries to a new store file and swap it in. Returns S_FALSE if nothing changed since the last save.
+		HRESULT Save();
+
+		UINT64 GetEntryCount();
+	};
+}
@@ -1,33 +1,63 @@
 #include "MMFSoundPlayer.h"
-#include <mfapi.h>
+#include "HeadlessBackend.h"
+#include "MediaFoundationBackend.h"
 #include <stdexcept>
 #include <cassert>
-#include <shlwapi.h>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
 
 using namespace MMFSoundPlayerLib;
 
 //Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
-MMFSoundPlayer::MMFSoundPlayer()
+MMFSoundPlayer::MMFSoundPlayer(IAudioBackend* inputBackend) : Backend(inputBackend), StateMachine(&EventRing, &Trace)
 {
-	//Initialize variables
-	CurrentState = PlayerState::Closed;
+	//Initialize variables (the state machine starts out Closed)
 	CurrentFilePath = L"No File Loaded";
 	CurrentAudioFileDuration_100NanoSecondUnits = 0;
 	ReferenceCount = 1;
+	InFlightCommandEvent = BackendEventType::Unknown;
+	HasInFlightCommand = false;
+	HasPendingOpen = false;
+	MetadataIndex = nullptr;
+	SeekIndexes = nullptr;
+	LoudnessResults = nullptr;
+	NormalizationMode = LoudnessNormalizationMode::Off;
+	NormalizationTarget_LUFS = -18.0f;
 }
 
 HRESULT MMFSoundPlayer::CreateInstance(MMFSoundPlayer** outputMMFSoundPlayer)
+{
+	//Create the default backend for this platform
+	IAudioBackend* defaultBackend = nullptr;
+#ifdef _WIN32
+	HRESULT hr = MediaFoundationBackend::CreateInstance(&defaultBackend);
+#else
+	HRESULT hr = HeadlessBackend::CreateInstance(HeadlessBackendOptions(), &defaultBackend);
+#endif
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	return CreateInstance(defaultBackend, outputMMFSoundPlayer);
+}
+
+HRESULT MMFSoundPlayer::CreateInstance(IAudioBackend* inputBackend, MMFSoundPlayer** outputMMFSoundPlayer)
 {
 	//Ensure that the double pointer actually points somewhere
-	if (outputMMFSoundPlayer == nullptr)
+	if (outputMMFSoundPlayer == nullptr || inputBackend == nullptr)
 	{
+		delete inputBackend;
 		return E_POINTER;
 	}
 
 	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULt can be returned
-	MMFSoundPlayer* newPlayer = new (std::nothrow) MMFSoundPlayer();
+	MMFSoundPlayer* newPlayer = new (std::nothrow) MMFSoundPlayer(inputBackend);
 	if (newPlayer == nullptr)
 	{
+		delete inputBackend;
 		return E_OUTOFMEMORY;
 	}
 
@@ -50,57 +80,17 @@ HRESULT MMFSoundPlayer::CreateInstance(MMFSoundPlayer** outputMMFSoundPlayer)
 
 HRESULT MMFSoundPlayer::Initialize()
 {
-	//Start up the MMF library
-	HRESULT hr = MFStartup(MF_VERSION);
+	//Start up the backend (a reference to the shared runtime for Media Foundation) and have its events sent to this player
+	HRESULT hr = Backend->Startup(this);
 	if (FAILED(hr))
 	{
 		assert(false);
 		return hr;
 	}
-	
-	//Setup event handles
-	ExitEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-	if (ExitEvent == nullptr)
-	{
-		assert(false);
-		return HRESULT_FROM_WIN32(GetLastError());
-	}
-
-	PlayEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-	if (PlayEvent == nullptr)
-	{
-		assert(false);
-		return HRESULT_FROM_WIN32(GetLastError());
-	}
-	
-	PauseEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-	if (PauseEvent == nullptr)
-	{
-		assert(false);
-		return HRESULT_FROM_WIN32(GetLastError());
-	}
-	
-	StopEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-	if (StopEvent == nullptr)
-	{
-		assert(false);
-		return HRESULT_FROM_WIN32(GetLastError());
-	}
 
-	TopologySetEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-	if (TopologySetEvent == nullptr)
-	{
-		assert(false);
-		return HRESULT_FROM_WIN32(GetLastError());
-	}
+	//The interpolated clock advances at the backend's rate
+	InterpolatedClock.SetRate(Backend->GetPresentationRate());
 
-	VolumeExternallyChanged = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-	if (VolumeExternallyChanged == nullptr)
-	{
-		assert(false);
-		return HRESULT_FROM_WIN32(GetLastError());
-	}
-	
 	return hr;
 }
 
@@ -112,42 +102,41 @@ MMFSoundPlayer::~MMFSoundPlayer()
 
 HRESULT MMFSoundPlayer::Shutdown()
 {
+	//The export reads the backend, it ends (with a last export) before the backend goes
+	TelemetryExport.Stop();
 	HRESULT hr = CloseMediaSessionAndSource();
 
-	//Shut down the MMF library
-	hr = MFShutdown();
+	//Shut down the backend
+	hr = Backend->Shutdown();
 
-	//Throw away the event objects
-	if (ExitEvent != nullptr)
-	{
-		CloseHandle(ExitEvent);
-		ExitEvent = nullptr;
-	}
-	if (PlayEvent != nullptr)
-	{
-		CloseHandle(PlayEvent);
-		PlayEvent = nullptr;
-	}
-	if (PauseEvent != nullptr)
-	{
-		CloseHandle(PauseEvent);
-		PauseEvent = nullptr;
-	}
-	if (StopEvent != nullptr)
-	{
-		CloseHandle(StopEvent);
-		StopEvent = nullptr;
-	}
-	if (TopologySetEvent != nullptr)
+	//Return final code
+	return hr;
+}
+
+HRESULT MMFSoundPlayer::Recycle()
+{
+	HRESULT hr = CloseMediaSessionAndSource();
+
+	//Back to the settings of a new player
 	{
-		CloseHandle(TopologySetEvent);
-		TopologySetEvent = nullptr;
+		std::lock_guard<std::mutex> lock(SongInfoMutex);
+		CurrentFilePath = L"No File Loaded";
+		CurrentAudioFileDuration_100NanoSecondUnits = 0;
+		QueuedFilePath.clear();
 	}
-	if (VolumeExternallyChanged != nullptr)
+	Backend->SetCrossfade(0);
+	Trace.Enable(false);
+	TelemetryExport.Stop();
+	VisualizationTap* tap = nullptr;
+	if (SUCCEEDED(Backend->GetVisualizationTap(&tap)))
 	{
-		CloseHandle(VolumeExternallyChanged);
-		VolumeExternallyChanged = nullptr;
+		tap->Enable(false);
 	}
+	NormalizationMode = LoudnessNormalizationMode::Off;
+	NormalizationTarget_LUFS = -18.0f;
+	MetadataIndex = nullptr;
+	SeekIndexes = nullptr;
+	LoudnessResults = nullptr;
 
 	//Return final code
 	return hr;
@@ -156,16 +145,18 @@ HRESULT MMFSoundPlayer::Shutdown()
 HRESULT MMFSoundPlayer::CloseMediaSessionAndSource()
 {
 	//Signal that session is closing up
-	CurrentState = PlayerState::Closing;
-	
+	StateMachine.Transition(PlayerState::Closing);
+
 	//Close media session
-	if (CurrentMediaSession != nullptr)
+	bool closeEventPending = false;
+	HRESULT hr = Backend->CloseSession(&closeEventPending);
+
+	//The backend drops a file it is still resolving, so an open waiting on it will never complete
+	CompletePendingOpen(E_ABORT);
+	if (SUCCEEDED(hr) && closeEventPending)
 	{
-		CurrentMediaSession->Close();
-		
 		//Waits on MESessionClose event, so I know the Media Session is fully closed. Timeout after 10 seconds. (This verifies if there is an error)
-		DWORD result = WaitForSingleObject(ExitEvent, 10000);
-		if (result == WAIT_TIMEOUT)
+		if (!ExitEvent.Wait(10000))
 		{
 			//THIS CAN NEVER HAPPEN, NO MATTER WHAT! (This means the Exit was never completed and this is catastrophic. NO RECOURSE)
 			assert(false);
@@ -173,31 +164,22 @@ HRESULT MMFSoundPlayer::CloseMediaSessionAndSource()
 	}
 
 	//Shutdown the media session and source
-	if (CurrentMediaSource != nullptr)
-	{
-		CurrentMediaSource->Shutdown();
-	}
-	if (CurrentMediaSession != nullptr)
-	{
-		CurrentMediaSession->Shutdown();
-	}
-
-	//Null the session and source for further use
-	CurrentMediaSource = nullptr;
-	CurrentMediaSession = nullptr;
+	Backend->ShutdownSession();
 
 	//Change the state of the player to closed
-	CurrentState = PlayerState::Closed;
+	StateMachine.Transition(PlayerState::Closed);
+	InterpolatedClock.SetDuration(0);
+	InterpolatedClock.Freeze(0);
 
 	//Return final success code
 	return S_OK;
 }
 
-//IUnknown and IMFAsyncCallback Implementation Functions-------------------------------------------------------------------------------------------------------
-STDMETHODIMP_(ULONG) MMFSoundPlayer::Release()
+//Reference Counting and IAudioBackendCallback Implementation Functions----------------------------------------------------------------------------------------
+ULONG MMFSoundPlayer::Release()
 {
 	//Decrement the reference count
-	LONG newCount = InterlockedDecrement(&ReferenceCount);
+	ULONG newCount = --ReferenceCount;
 
 	//If the reference count is 0, delete the object
 	if (newCount == 0)
@@ -209,152 +191,191 @@ STDMETHODIMP_(ULONG) MMFSoundPlayer::Release()
 	return newCount;
 }
 
-STDMETHODIMP MMFSoundPlayer::GetParameters(DWORD* pdwFlags, DWORD* pdwQueue)
-{
-	return E_NOTIMPL;
-}
-
-STDMETHODIMP MMFSoundPlayer::QueryInterface(REFIID iid, void** ppv)
-{
-	static const QITAB qit[] =
-	{
-		QITABENT(MMFSoundPlayer, IMFAsyncCallback),
-		{ 0 }
-	};
-	return QISearch(this, qit, iid, ppv);
-}
-
-STDMETHODIMP_(ULONG) MMFSoundPlayer::AddRef()
+ULONG MMFSoundPlayer::AddRef()
 {
 	//Atomic Increment
-	return InterlockedIncrement(&ReferenceCount);
+	return ++ReferenceCount;
 }
 
-STDMETHODIMP MMFSoundPlayer::Invoke(IMFAsyncResult* pAsyncResult)
+void MMFSoundPlayer::OnBackendEvent(BackendEventType eventType, HRESULT eventStatus, UINT64 eventValue)
 {
-	//Dequeue an event from the event queue
-	CComPtr<IMFMediaEvent> event;
-	HRESULT hr = CurrentMediaSession->EndGetEvent(pAsyncResult, &event);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
+	//Every event goes into the trace first, with its status and value (next to free while tracing is off)
+	Trace.Record(TraceRecordType::BackendEvent, (UINT32)eventType, 0, eventStatus, eventValue);
 
-	//Ensure the operation that triggered the event was not a total failure
-	HRESULT operationStatus = S_OK;
-	hr = event->GetStatus(&operationStatus);
-
-	//If getting the status itself failed, return that failure code
-	if (FAILED(hr))
+	//A file that can't be opened completes its open with the failure, the session stays empty
+	if (eventType == BackendEventType::TopologySet && FAILED(eventStatus))
 	{
-		assert(false);
-		return hr;
+		if (CompletePendingOpen(eventStatus))
+		{
+			StateMachine.Transition(PlayerState::Ready);
+		}
+		return;
 	}
 
-	//If getting the status was successful but, the operation failed, return that operation failure code
-	if (FAILED(operationStatus))
+	//A queued song that can't be opened is simply dropped, the current song then ends normally
+	if (eventType == BackendEventType::NextFilePrepared && FAILED(eventStatus))
 	{
-		assert(false);
-		return operationStatus;
+		std::lock_guard<std::mutex> lock(SongInfoMutex);
+		QueuedFilePath.clear();
+		return;
 	}
 
-	//Get the event type so it can be handled
-	MediaEventType eventType = MEUnknown;
-	hr = event->GetType(&eventType);
-	if (FAILED(hr))
+	//Ensure the operation that triggered the event was not a total failure. A command waiting on the event gets the failure code.
+	if (FAILED(eventStatus))
 	{
-		assert(false);
-		return hr;
+		if (!CompleteInFlightCommand(eventType, eventStatus))
+		{
+			assert(false);
+		}
+		return;
 	}
 
-	//Handle the event
+	//Handle the event (state transitions that aren't valid anymore, like a late MESessionStarted while closing, are dropped by the state machine)
 	switch (eventType)
 	{
-	case MESessionClosed:
-		OutputDebugStringA("HANDLED EVENT: MESessionClosed\n");
+	case BackendEventType::SessionClosed:
+		//A command still waiting on the closed session will never complete
+		AbortInFlightCommand();
+
 		//Signal that the session is closed
-		SetEvent(ExitEvent);
+		ExitEvent.Set();
 		break;
 
-	case MESessionTopologySet:
-		OutputDebugStringA("HANDLED EVENT: MESessionTopologySet\n");
+	case BackendEventType::TopologySet:
+	{
 		//Change the state of the player to show that it is stopped
-		CurrentState = PlayerState::Stopped;
+		StateMachine.Transition(PlayerState::Stopped);
+		InterpolatedClock.Freeze(0);
 
-		//Signal that the topology is set
-		SetEvent(TopologySetEvent);
-		break;
+		//The open waiting on this file now sets it up and plays it
+		PlayerCommand completedOpen;
+		std::wstring openedFilePath;
+		if (!TakePendingOpen(&completedOpen, &openedFilePath))
+		{
+			break;
+		}
 
-	case MESessionStarted:
-		OutputDebugStringA("HANDLED EVENT: MESessionStarted\n");
-		//Change the state of the player to indicate the music has started playing
-		CurrentState = PlayerState::Playing;
+		UINT64 openedFileDuration = GetIndexedDuration_100NanoSecondUnits(openedFilePath, eventValue);
+		InterpolatedClock.SetDuration(openedFileDuration);
+		ApplyLoudnessNormalization(openedFilePath);
 
-		//Signal that the player has started playing
-		SetEvent(PlayEvent);
-		break;
+		//Setup the current file path and audio file duration
+		{
+			std::lock_guard<std::mutex> lock(SongInfoMutex);
+			CurrentFilePath = openedFilePath;
+			CurrentAudioFileDuration_100NanoSecondUnits = openedFileDuration;
+		}
 
-	case MESessionPaused:
-		OutputDebugStringA("HANDLED EVENT: MESessionPaused\n");
-		//Change the state of the player to indicate the music has paused
-		CurrentState = PlayerState::Paused;
+		//Play the sound, the open completes along with the play command
+		std::shared_ptr<PlayerCommand> playingOpen = std::make_shared<PlayerCommand>(std::move(completedOpen));
+		PlayAsync([this, playingOpen](HRESULT result)
+		{
+			Trace.Record(TraceRecordType::OpenCompleted, 0, 0, result);
+			playingOpen->Complete(result);
+		});
+		break;
+	}
 
-		//Signal that the player has paused
-		SetEvent(PauseEvent);
+	case BackendEventType::SessionStarted:
+		//Change the state of the player to indicate the music has started playing (from where it was started or seeked to)
+		StateMachine.Transition(PlayerState::Playing);
+		CorrelatePresentationClock(true);
 		break;
 
-	case MESessionStopped:
-		OutputDebugStringA("HANDLED EVENT: MESessionStopped\n");
-		//Change the state of the player to indicate the music has stopped
-		CurrentState = PlayerState::Stopped;
+	case BackendEventType::SessionPaused:
+		//Change the state of the player to indicate the music has paused
+		StateMachine.Transition(PlayerState::Paused);
+		CorrelatePresentationClock(false);
+		break;
 
-		//Signal that the player has stopped
-		SetEvent(StopEvent);
+	case BackendEventType::SessionStopped:
+		//Change the state of the player to indicate the music has stopped (stopping rewinds)
+		StateMachine.Transition(PlayerState::Stopped);
+		InterpolatedClock.Freeze(0);
 		break;
 
-	case MEEndOfPresentation:
-		OutputDebugStringA("HANDLED EVENT: MEEndOfPresentation\n");
+	case BackendEventType::EndOfPresentation:
 		//Change the state of the player to indicate that the old song finished and that the new song is ready for loading if available
-		CurrentState = PlayerState::PresentationEnd;
+		StateMachine.Transition(PlayerState::PresentationEnd);
+		CorrelatePresentationClock(false);
 		break;
 
-	case MEAudioSessionVolumeChanged:
-		OutputDebugStringA("HANDLED EVENT: MEAudioSessionVolumeChanged\n");
-
-		//Signal that the volume has changed from an external source (like the volume mixer)
-		SetEvent(VolumeExternallyChanged);
+	case BackendEventType::NextFilePrepared:
 		break;
 
-	default:
-		OutputDebugStringA("HANDLED EVENT: Unknown Event\n");
+	case BackendEventType::NextFileStarted:
+	{
+		//The queued song took over at the end of the old one, so it becomes the current song. The seek index lookup may hit
+		//the disk, so it happens before taking SongInfoMutex.
+		std::wstring startedFilePath;
+		{
+			std::lock_guard<std::mutex> lock(SongInfoMutex);
+			startedFilePath = QueuedFilePath;
+		}
+		UINT64 startedFileDuration = GetIndexedDuration_100NanoSecondUnits(startedFilePath, eventValue);
+		{
+			std::lock_guard<std::mutex> lock(SongInfoMutex);
+			CurrentFilePath = startedFilePath;
+			CurrentAudioFileDuration_100NanoSecondUnits = startedFileDuration;
+			if (QueuedFilePath == startedFilePath)
+			{
+				QueuedFilePath.clear();
+			}
+		}
+
+		//The loudness lookup reads the store (and may hit the disk), so it happens outside of SongInfoMutex
+		ApplyLoudnessNormalization(startedFilePath);
+		StateMachine.Transition(PlayerState::Playing);
+		InterpolatedClock.SetDuration(startedFileDuration);
+		CorrelatePresentationClock(true);
+
+		//The state doesn't change, so the subscribers are told about the new song separately
+		PlayerState state = StateMachine.GetState();
+		EventRing.Publish(PlayerEventType::TrackChanged, state, state, S_OK);
 		break;
 	}
 
-	//Handle the next event if the session is not being closed (MESessionClosed is the final event)
-	if (eventType != MESessionClosed)
+	case BackendEventType::VolumeChanged:
 	{
-		hr = CurrentMediaSession->BeginGetEvent(this, nullptr);
-		if (FAILED(hr))
-		{
-			assert(false);
-			return hr;
-		}
+		//Tell the subscribers that the volume has changed from an external source (like the volume mixer)
+		PlayerState state = StateMachine.GetState();
+		EventRing.Publish(PlayerEventType::VolumeExternallyChanged, state, state, S_OK);
+		break;
 	}
 
-	//Return a success code
-	return S_OK;
+	default:
+		break;
+	}
+
+	//The state is up to date, so the command waiting on this event can complete and the next one can be issued
+	CompleteInFlightCommand(eventType, S_OK);
 }
 
 //Public Functions---------------------------------------------------------------------------------------------------------------------------------------------
 HRESULT MMFSoundPlayer::SetFileIntoPlayer(PCWSTR inputFilePath)
 {
-	//Close up any existing sessions and source
+	//No timeout, a file on a slow share takes as long as it takes (CancelOpen or another open end the wait early)
+	return SetFileIntoPlayerAsync(inputFilePath).get();
+}
+
+std::future<HRESULT> MMFSoundPlayer::SetFileIntoPlayerAsync(PCWSTR inputFilePath, PlayerCommandCallback completionCallback)
+{
+	PlayerCommand newOpen;
+	newOpen.CompletionCallback = std::move(completionCallback);
+	std::future<HRESULT> completion = newOpen.Completion.get_future();
+	if (inputFilePath == nullptr)
+	{
+		newOpen.Complete(E_POINTER);
+		return completion;
+	}
+
+	//Close up any existing sessions and source (an open still pending is aborted with them)
 	HRESULT hr = CloseMediaSessionAndSource();
 	if (FAILED(hr))
 	{
 		assert(false);
-		return hr;
+		newOpen.Complete(hr);
+		return completion;
 	}
 	
 	//Startup the media session
@@ -362,255 +383,288 @@ HRESULT MMFSoundPlayer::SetFileIntoPlayer(PCWSTR inputFilePath)
 	if (FAILED(hr))
 	{
 		assert(false);
-		CurrentState = PlayerState::Closed;
-		return hr;
+		StateMachine.Transition(PlayerState::Closed);
+		newOpen.Complete(hr);
+		return completion;
 	}
 
-	//Reset song info
-	CurrentFilePath = L"No File Loaded";
-	CurrentAudioFileDuration_100NanoSecondUnits = 0;
+	//Reset song info (this also forgets any queued song). An indexed file is known before its source is even opened, without
+	//touching the file (a stat on a slow share would block the caller), the open replaces the indexed duration with the real one.
+	MediaFileMetadata indexedMetadata;
+	MediaMetadataIndex* metadataIndex = MetadataIndex;
+	bool isIndexed = metadataIndex != nullptr && metadataIndex->LookupWithoutChecking(inputFilePath, &indexedMetadata) == S_OK;
+	{
+		std::lock_guard<std::mutex> lock(SongInfoMutex);
+		CurrentFilePath = isIndexed ? inputFilePath : L"No File Loaded";
+		CurrentAudioFileDuration_100NanoSecondUnits = isIndexed ? indexedMetadata.Duration_100NanoSecondUnits : 0;
+		QueuedFilePath.clear();
+	}
 
 	//Begin opening the file
-	CurrentState = PlayerState::OpenPending;
+	StateMachine.Transition(PlayerState::OpenPending);
+	Trace.Record(TraceRecordType::OpenStarted, 0);
+	{
+		std::lock_guard<std::mutex> lock(PendingOpenMutex);
+		PendingOpen = std::move(newOpen);
+		PendingOpenFilePath = inputFilePath;
+		HasPendingOpen = true;
+	}
 
-	//Create new media source with new input file
-	hr = CreateMediaSource(inputFilePath);
+	//Have the backend resolve, validate and set the file into the session in the background, TopologySet takes it from there
+	hr = Backend->OpenFile(inputFilePath);
 	if (FAILED(hr))
 	{
 		assert(false);
-		CurrentState = PlayerState::Ready;
-		return hr;
+		if (CompletePendingOpen(hr))
+		{
+			StateMachine.Transition(PlayerState::Ready);
+		}
 	}
+	return completion;
+}
 
-	//Retrieve the Presentation Descriptor for the file's media source
-	CComPtr<IMFPresentationDescriptor> presentationDescriptor;
-	hr = CurrentMediaSource->CreatePresentationDescriptor(&presentationDescriptor);
-	if (FAILED(hr))
+HRESULT MMFSoundPlayer::CancelOpen()
+{
+	//Nothing to cancel once the file is set. Taking the open settles a race with the backend finishing it, whoever takes it
+	//completes it.
+	PlayerCommand cancelledOpen;
+	std::wstring cancelledFilePath;
+	if (!TakePendingOpen(&cancelledOpen, &cancelledFilePath))
 	{
-		assert(false);
-		CurrentState = PlayerState::Ready;
-		return hr;
+		return S_FALSE;
 	}
+	CompleteTakenOpen(cancelledOpen, E_ABORT);
 
-	//Use the presentation descriptor to get the file's audio duration
-	UINT64 tempCurrentAudioFileDuration = 0;
-	hr = presentationDescriptor->GetUINT64(MF_PD_DURATION, &tempCurrentAudioFileDuration);
+	//Closing the session drops the file, a new session is ready for the next one
+	HRESULT hr = CloseMediaSessionAndSource();
 	if (FAILED(hr))
 	{
 		assert(false);
-		CurrentState = PlayerState::Ready;
 		return hr;
 	}
-
-	//Use presentation descriptor to create Playback Topology
-	CComPtr<IMFTopology> playbackTopology;
-	hr = CreatePlaybackTopology(presentationDescriptor, &playbackTopology);
+	hr = CreateMediaSession();
 	if (FAILED(hr))
 	{
 		assert(false);
-		CurrentState = PlayerState::Ready;
+		StateMachine.Transition(PlayerState::Closed);
 		return hr;
 	}
+	return S_OK;
+}
 
-	//Set the playback topology into the media session and set flag so that the old presentation is immediately stopped and cleared before setting new topology
-	hr = CurrentMediaSession->SetTopology(MFSESSION_SETTOPOLOGY_IMMEDIATE, playbackTopology);
-	if (FAILED(hr))
+HRESULT MMFSoundPlayer::QueueNextFile(PCWSTR inputFilePath)
+{
+	if (inputFilePath == nullptr)
 	{
-		assert(false);
-		CurrentState = PlayerState::Ready;
-		return hr;
+		return E_POINTER;
 	}
-	
-	//Wait at most 3 seconds for the topology to be set
-	DWORD waitResult = WaitForSingleObject(TopologySetEvent, 3000);
-	if (waitResult == WAIT_TIMEOUT)
+
+	//A song has to be loaded for another one to follow it. Otherwise, the caller should use SetFileIntoPlayer.
+	PlayerState state = StateMachine.GetState();
+	if (!(state == PlayerState::Playing || state == PlayerState::Paused || state == PlayerState::Stopped || state == PlayerState::PresentationEnd))
 	{
-		assert(false);
-		CurrentState = PlayerState::Ready;
-		return E_FAIL;
+		return E_UNEXPECTED;
+	}
+
+	//Remember the song before the backend can report it started
+	{
+		std::lock_guard<std::mutex> lock(SongInfoMutex);
+		QueuedFilePath = inputFilePath;
 	}
 
-	//Play the sound and wait at most three seconds for it to do so
-	hr = Play();
+	//Have the backend resolve, open and pre-roll the song in the background. It takes over at the end of the current song.
+	HRESULT hr = Backend->PrepareNextFile(inputFilePath);
 	if (FAILED(hr))
 	{
 		assert(false);
+		std::lock_guard<std::mutex> lock(SongInfoMutex);
+		QueuedFilePath.clear();
 		return hr;
 	}
 
-	//Setup the current file path and audio file duration
-	CurrentFilePath = inputFilePath;
-	CurrentAudioFileDuration_100NanoSecondUnits = tempCurrentAudioFileDuration;
-
 	//Return final code
 	return hr;
 }
 
 HRESULT MMFSoundPlayer::Play()
 {
-	//Ensure the player is either paused or stopped. If not, ignore this call
-	if (!(CurrentState == PlayerState::Paused || CurrentState == PlayerState::Stopped))
-	{
-		return S_OK;
-	}
+	return WaitForCommand(PlayAsync());
+}
 
-	//Set the audio to start playing at the current time (if stopped, will start audio track from beginning)
-	PROPVARIANT varStart;
-	PropVariantInit(&varStart);
+HRESULT MMFSoundPlayer::Pause()
+{
+	return WaitForCommand(PauseAsync());
+}
 
-	//Start the session
-	HRESULT hr = CurrentMediaSession->Start(&GUID_NULL, &varStart);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
+HRESULT MMFSoundPlayer::Stop()
+{
+	return WaitForCommand(StopAsync());
+}
 
-	//Wait at most 3 seconds for song to start playing
-	DWORD waitResult = WaitForSingleObject(PlayEvent, 3000);
-	if (waitResult == WAIT_TIMEOUT)
-	{
-		assert(false);
-		return E_FAIL;
-	}
+HRESULT MMFSoundPlayer::Seek(UINT64 seekPosition_100NanoSecondUnits)
+{
+	return WaitForCommand(SeekAsync(seekPosition_100NanoSecondUnits));
+}
 
-	//Return final code
-	return hr;
+std::future<HRESULT> MMFSoundPlayer::PlayAsync(PlayerCommandCallback completionCallback)
+{
+	PlayerCommand newCommand;
+	newCommand.Type = PlayerCommandType::Play;
+	newCommand.CompletionCallback = std::move(completionCallback);
+	return SubmitCommand(std::move(newCommand));
 }
 
-HRESULT MMFSoundPlayer::Pause()
+std::future<HRESULT> MMFSoundPlayer::PauseAsync(PlayerCommandCallback completionCallback)
 {
-	//Ensure the player is currently playing. If not, ignore this call
-	if (!(CurrentState == PlayerState::Playing))
-	{
-		return S_OK;
-	}
+	PlayerCommand newCommand;
+	newCommand.Type = PlayerCommandType::Pause;
+	newCommand.CompletionCallback = std::move(completionCallback);
+	return SubmitCommand(std::move(newCommand));
+}
 
-	//Pause the session
-	HRESULT hr = CurrentMediaSession->Pause();
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
+std::future<HRESULT> MMFSoundPlayer::StopAsync(PlayerCommandCallback completionCallback)
+{
+	PlayerCommand newCommand;
+	newCommand.Type = PlayerCommandType::Stop;
+	newCommand.CompletionCallback = std::move(completionCallback);
+	return SubmitCommand(std::move(newCommand));
+}
 
-	//Wait at most 3 seconds for song to pause
-	DWORD waitResult = WaitForSingleObject(PauseEvent, 3000);
-	if (waitResult == WAIT_TIMEOUT)
-	{
-		assert(false);
-		return E_FAIL;
-	}
-	
-	//Return final code
-	return hr;
+std::future<HRESULT> MMFSoundPlayer::SeekAsync(UINT64 seekPosition_100NanoSecondUnits, PlayerCommandCallback completionCallback)
+{
+	PlayerCommand newCommand;
+	newCommand.Type = PlayerCommandType::Seek;
+	newCommand.SeekPosition_100NanoSecondUnits = seekPosition_100NanoSecondUnits;
+	newCommand.CompletionCallback = std::move(completionCallback);
+	return SubmitCommand(std::move(newCommand));
 }
 
-HRESULT MMFSoundPlayer::Stop()
+std::future<HRESULT> MMFSoundPlayer::ScrubAsync(UINT64 seekPosition_100NanoSecondUnits, PlayerCommandCallback completionCallback)
 {
-	//Ensure the player is either paused or playing. If not, ignore this call
-	if (!(CurrentState == PlayerState::Paused || CurrentState == PlayerState::Playing))
-	{
-		return S_OK;
-	}
+	PlayerCommand newCommand;
+	newCommand.Type = PlayerCommandType::Seek;
+	newCommand.SeekPosition_100NanoSecondUnits = seekPosition_100NanoSecondUnits;
+	newCommand.IsSupersedable = true;
+	newCommand.CompletionCallback = std::move(completionCallback);
+	return SubmitCommand(std::move(newCommand));
+}
 
-	//Stop the session
-	HRESULT hr = CurrentMediaSession->Stop();
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
+HRESULT MMFSoundPlayer::SetVolume(float volumeLevel)
+{
+	//Try to set volume
+	return Backend->SetVolume(volumeLevel);
+}
 
-	//Wait at most 3 seconds for song to stop
-	DWORD waitResult = WaitForSingleObject(StopEvent, 3000);
-	if (waitResult == WAIT_TIMEOUT)
-	{
-		assert(false);
-		return E_FAIL;
-	}
+HRESULT MMFSoundPlayer::SetCrossfadeDuration(UINT32 durationMilliseconds)
+{
+	return Backend->SetCrossfade(durationMilliseconds);
+}
 
-	//Return final code
-	return hr;
+HRESULT MMFSoundPlayer::RampVolume(float volumeLevel, UINT32 durationMilliseconds, GainRampCurve curve)
+{
+	return Backend->RampVolume(volumeLevel, durationMilliseconds, curve);
 }
 
-HRESULT MMFSoundPlayer::Seek(UINT64 seekPosition_100NanoSecondUnits)
+HRESULT MMFSoundPlayer::FadeIn(UINT32 durationMilliseconds, GainRampCurve curve)
 {
-	//Ensure the player is either paused or playing. If not, ignore this call
-	if (!(CurrentState == PlayerState::Paused || CurrentState == PlayerState::Playing))
-	{
-		return S_OK;
-	}
+	return Backend->Fade(true, durationMilliseconds, curve);
+}
+
+HRESULT MMFSoundPlayer::FadeOut(UINT32 durationMilliseconds, GainRampCurve curve)
+{
+	return Backend->Fade(false, durationMilliseconds, curve);
+}
+
+HRESULT MMFSoundPlayer::SetMute(bool isMuted)
+{
+	return Backend->SetMute(isMuted);
+}
+
+void MMFSoundPlayer::SetMetadataIndex(MediaMetadataIndex* inputIndex)
+{
+	MetadataIndex = inputIndex;
+}
 
-	//Ensure the seek position is within the bounds of the file
-	if (!(seekPosition_100NanoSecondUnits <= CurrentAudioFileDuration_100NanoSecondUnits))
+void MMFSoundPlayer::SetSeekIndexStore(SeekIndexStore* inputStore)
+{
+	SeekIndexes = inputStore;
+}
+
+void MMFSoundPlayer::SetLoudnessStore(LoudnessStore* inputStore)
+{
+	LoudnessResults = inputStore;
+}
+
+HRESULT MMFSoundPlayer::SetLoudnessNormalization(LoudnessNormalizationMode mode, float targetLoudness_LUFS)
+{
+	if (!std::isfinite(targetLoudness_LUFS))
 	{
-		assert(false);
 		return E_INVALIDARG;
 	}
 
-	//Pause the session
-	HRESULT hr = Pause();
-	if (FAILED(hr))
+	NormalizationMode = mode;
+	NormalizationTarget_LUFS = targetLoudness_LUFS;
+
+	//The current song follows right away
+	std::wstring currentFilePath;
 	{
-		assert(false);
-		return hr;
+		std::lock_guard<std::mutex> lock(SongInfoMutex);
+		currentFilePath = CurrentFilePath;
 	}
+	HRESULT hr = ApplyLoudnessNormalization(currentFilePath);
+	return hr == E_NOTIMPL ? hr : S_OK;
+}
 
-	//Set the start time to the seek position
-	PROPVARIANT varStart;
-	PropVariantInit(&varStart);
-	varStart.vt = VT_I8;
-	varStart.hVal.QuadPart = seekPosition_100NanoSecondUnits;
-
-	//Start the session
-	hr = CurrentMediaSession->Start(&GUID_NULL, &varStart);
-	if (FAILED(hr))
+//Private Functions--------------------------------------------------------------------------------------------------------------------------------------------
+UINT64 MMFSoundPlayer::GetIndexedDuration_100NanoSecondUnits(const std::wstring& inputFilePath, UINT64 estimatedDuration_100NanoSecondUnits)
+{
+	//The source only estimates the duration of VBR files, a seek index has it exact (a missing one is built for the next time)
+	SeekIndexStore* seekIndexes = SeekIndexes;
+	if (seekIndexes == nullptr || !SeekIndex::IsSupportedFile(inputFilePath.c_str()))
 	{
-		assert(false);
-		return hr;
+		return estimatedDuration_100NanoSecondUnits;
 	}
-
-	//Wait at most 3 seconds for song to start playing again
-	DWORD waitResult = WaitForSingleObject(PlayEvent, 3000);
-	if (waitResult == WAIT_TIMEOUT)
+	std::shared_ptr<const SeekIndex> seekIndex;
+	if (seekIndexes->Lookup(inputFilePath.c_str(), &seekIndex) == S_OK)
 	{
-		assert(false);
-		return E_FAIL;
+		return seekIndex->GetDuration_100NanoSecondUnits();
 	}
-
-	//Return final code
-	return hr;
+	seekIndexes->BuildInBackground(inputFilePath.c_str());
+	return estimatedDuration_100NanoSecondUnits;
 }
 
-HRESULT MMFSoundPlayer::SetVolume(float volumeLevel)
+HRESULT MMFSoundPlayer::ApplyLoudnessNormalization(const std::wstring& inputFilePath)
 {
-	//Get volume object
-	CComPtr<IMFSimpleAudioVolume> simpleAudioVolume;
-	HRESULT hr = MFGetService(CurrentMediaSession, MR_POLICY_VOLUME_SERVICE, IID_PPV_ARGS(&simpleAudioVolume));
-	if (FAILED(hr))
-	{
-		return hr;
+	//Without results (or with normalization off) the file plays as it is
+	float gain = 1.0f;
+	LoudnessStore* loudnessResults = LoudnessResults;
+	LoudnessNormalizationMode mode = NormalizationMode;
+	LoudnessInfo info;
+	if (mode != LoudnessNormalizationMode::Off && loudnessResults != nullptr && !inputFilePath.empty() &&
+		loudnessResults->Lookup(inputFilePath.c_str(), &info) == S_OK)
+	{
+		bool useAlbum = mode == LoudnessNormalizationMode::Album && info.AlbumTrackCount > 0;
+		double loudness_LUFS = useAlbum ? info.AlbumIntegratedLoudness_LUFS : info.IntegratedLoudness_LUFS;
+		float truePeak = useAlbum ? info.AlbumTruePeak : info.TruePeak;
+		if (std::isfinite(loudness_LUFS))
+		{
+			double normalizationGain = std::pow(10.0, (NormalizationTarget_LUFS - loudness_LUFS) / 20.0);
+			if (truePeak > 0.0f)
+			{
+				normalizationGain = std::min(normalizationGain, 1.0 / truePeak);
+			}
+			gain = (float)normalizationGain;
+		}
 	}
 
-	//Try to set volume
-	hr = simpleAudioVolume->SetMasterVolume(volumeLevel);
-	return hr;
+	//A backend without a gain stage plays the file unchanged (E_NOTIMPL)
+	return Backend->SetNormalizationGain(gain);
 }
 
-//Private Functions--------------------------------------------------------------------------------------------------------------------------------------------
 HRESULT MMFSoundPlayer::CreateMediaSession()
 {
 	//Create the media session
-	HRESULT hr = MFCreateMediaSession(nullptr, &CurrentMediaSession);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
-
-	//Set the media session event handler
-	CurrentMediaSession->BeginGetEvent((IMFAsyncCallback*)this, NULL);
+	HRESULT hr = Backend->CreateSession();
 	if (FAILED(hr))
 	{
 		assert(false);
@@ -618,292 +672,366 @@ HRESULT MMFSoundPlayer::CreateMediaSession()
 	}
 
 	//Successfully created media session
-	CurrentState = PlayerState::Ready;
+	StateMachine.Transition(PlayerState::Ready);
 	return hr;
 }
 
-HRESULT MMFSoundPlayer::CreateMediaSource(PCWSTR inputFilePath)
+void MMFSoundPlayer::CorrelatePresentationClock(bool isRunning)
 {
-	//Create source resolver
-	CComPtr<IMFSourceResolver> sourceResolver;
-	HRESULT hr = MFCreateSourceResolver(&sourceResolver);
-	if (FAILED(hr))
+	//The backend's clock is exact right after a transport event, so the interpolation restarts from it
+	UINT64 presentationTime = 0;
+	if (FAILED(Backend->GetPresentationTime(&presentationTime)))
 	{
-		assert(false);
-		return hr;
+		presentationTime = 0;
 	}
 
-	/*
-	Synchrounously create the media source with the input file (Not doing it asynchronously because,
-	I never use a network file and this media player is typically going to be managed in a seperate
-	thread from the GUI anyways.
-
-	The GUI can look at the "OpenPending" state and place a loading screen or something like that while
-	the media source is being created.
-	*/
-	CComPtr<IUnknown> source;
-	MF_OBJECT_TYPE objectType = MF_OBJECT_INVALID;
-	hr = sourceResolver->CreateObjectFromURL(
-		inputFilePath,             // URL of the source.
-		MF_RESOLUTION_MEDIASOURCE, // Create a source object.
-		nullptr,                    // Optional property store.
-		&objectType,            // Receives the created object type. 
-		&source                   // Receives a pointer to the media source.
-	);
-	
-	//Only media sources should be allowed at this point
-	assert(objectType == MF_OBJECT_MEDIASOURCE); 
-	if (FAILED(hr))
+	if (isRunning)
 	{
-		assert(false);
-		return hr;
+		InterpolatedClock.Run(presentationTime);
+	}
+	else
+	{
+		InterpolatedClock.Freeze(presentationTime);
 	}
-
-	//Query and get the IMFMediaSource interface from the media source.
-	hr = source->QueryInterface(IID_PPV_ARGS(&CurrentMediaSource));
-	
-	//Return the final code
-	assert(SUCCEEDED(hr));
-	return hr;
 }
 
-HRESULT MMFSoundPlayer::CreatePlaybackTopology(IMFPresentationDescriptor* inputPresentationDescriptor, IMFTopology** outputTopology)
+//Command Dispatch---------------------------------------------------------------------------------------------------------------------------------------------
+std::future<HRESULT> MMFSoundPlayer::SubmitCommand(PlayerCommand&& inputCommand)
 {
-	//Create an empty topology
-	CComPtr<IMFTopology> newTopology;
-	HRESULT hr = MFCreateTopology(&newTopology);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
-	
-	//Ensure that there is only one stream in the file. If there is more than one stream, then the file is not supported at this time.
-	DWORD streamCount = 0;
-	hr = inputPresentationDescriptor->GetStreamDescriptorCount(&streamCount);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
-	if (streamCount != 1)
-	{
-		assert(false);
-		return E_INVALIDARG;
-	}
-	
-	//Check if the single stream is audio by getting the stream descriptor
-	CComPtr<IMFStreamDescriptor> streamDescriptor;
-	BOOL selected = FALSE;
-	hr = inputPresentationDescriptor->GetStreamDescriptorByIndex(0, &selected, &streamDescriptor);
-	if (FAILED(hr))
+	std::future<HRESULT> completion = inputCommand.Completion.get_future();
+
+	//If nobody is issuing commands right now, this thread issues them until one has to wait for the backend
+	if (CommandQueue.Enqueue(std::move(inputCommand)))
 	{
-		assert(false);
-		return hr;
+		DispatchCommands();
 	}
-	
-	//Ensure that the stream is selected. If it isn't there are serious issues with playing the file.
-	if (!selected)
+	return completion;
+}
+
+HRESULT MMFSoundPlayer::WaitForCommand(std::future<HRESULT> completion)
+{
+	//Wait at most 3 seconds for the command to complete
+	if (completion.wait_for(std::chrono::milliseconds(3000)) == std::future_status::timeout)
 	{
 		assert(false);
 		return E_FAIL;
 	}
+	return completion.get();
+}
 
-	//Check the media type by getting the media type handler and checking its major type. If it is non-audio, it is not supported
-	CComPtr<IMFMediaTypeHandler> mediaTypeHandler;
-	hr = streamDescriptor->GetMediaTypeHandler(&mediaTypeHandler);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
-	
-	GUID majorType;
-	hr = mediaTypeHandler->GetMajorType(&majorType);
-	if (FAILED(hr))
+void MMFSoundPlayer::DispatchCommands()
+{
+	//Only the holder of the consumer role gets here. Issue commands until one is in flight (its completion continues dispatching) or the queue is empty.
+	PlayerCommand nextCommand;
+	while (CommandQueue.DequeueOrRelease(nextCommand))
 	{
-		assert(false);
-		return hr;
+		if (IssueCommand(nextCommand))
+		{
+			return;
+		}
 	}
+}
+
+bool MMFSoundPlayer::IssueCommand(PlayerCommand& inputCommand)
+{
+	Trace.Record(TraceRecordType::CommandIssued, (UINT32)inputCommand.Type, 0, S_OK, inputCommand.SeekPosition_100NanoSecondUnits);
+	PlayerState state = StateMachine.GetState();
+	BackendEventType completionEvent = BackendEventType::Unknown;
 
-	if (majorType != MFMediaType_Audio)
+	switch (inputCommand.Type)
 	{
-		assert(false);
-		return E_INVALIDARG;
+	case PlayerCommandType::Play:
+		//Ensure the player is either paused or stopped. If not, ignore this call
+		if (!(state == PlayerState::Paused || state == PlayerState::Stopped))
+		{
+			CompleteCommand(inputCommand, S_OK);
+			return false;
+		}
+		completionEvent = BackendEventType::SessionStarted;
+		break;
+
+	case PlayerCommandType::Pause:
+		//Ensure the player is currently playing. If not, ignore this call
+		if (!(state == PlayerState::Playing))
+		{
+			CompleteCommand(inputCommand, S_OK);
+			return false;
+		}
+		completionEvent = BackendEventType::SessionPaused;
+		break;
+
+	case PlayerCommandType::Stop:
+		//Ensure the player is either paused or playing. If not, ignore this call
+		if (!(state == PlayerState::Paused || state == PlayerState::Playing))
+		{
+			CompleteCommand(inputCommand, S_OK);
+			return false;
+		}
+		completionEvent = BackendEventType::SessionStopped;
+		break;
+
+	case PlayerCommandType::Seek:
+		//Ensure the player is either paused or playing. If not, ignore this call
+		if (!(state == PlayerState::Paused || state == PlayerState::Playing))
+		{
+			CompleteCommand(inputCommand, S_OK);
+			return false;
+		}
+
+		//Ensure the seek position is within the bounds of the file (a caller error, reported through the command's result)
+		if (!(inputCommand.SeekPosition_100NanoSecondUnits <= GetAudioFileDuration_100NanoSecondUnits()))
+		{
+			CompleteCommand(inputCommand, E_INVALIDARG);
+			return false;
+		}
+
+		//Starting at a position seeks directly, there is no need to pause first
+		completionEvent = BackendEventType::SessionStarted;
+		break;
 	}
 
-	//Create media sink for SAR (Streaming Audio Renderer)
-	CComPtr<IMFActivate> mediaSinkActivationObject;
-	hr = MFCreateAudioRendererActivate(&mediaSinkActivationObject);
-	if (FAILED(hr))
+	//The command is in flight before it is issued, the backend may complete it before the call even returns
+	PlayerCommandType commandType = inputCommand.Type;
+	UINT64 seekPosition = inputCommand.SeekPosition_100NanoSecondUnits;
 	{
-		assert(false);
-		return hr;
+		std::lock_guard<std::mutex> lock(InFlightCommandMutex);
+		InFlightCommand = std::move(inputCommand);
+		InFlightCommandEvent = completionEvent;
+		HasInFlightCommand = true;
 	}
 
-	//Add Source Node to the topology
-	CComPtr<IMFTopologyNode> sourceNode;
-	hr = AddSourceNode(newTopology, inputPresentationDescriptor, streamDescriptor, &sourceNode);
-	if (FAILED(hr))
+	HRESULT hr = S_OK;
+	switch (commandType)
 	{
-		assert(false);
-		return hr;
+	case PlayerCommandType::Play:
+		//Start the session at the current time (if stopped, will start audio track from beginning)
+		hr = Backend->Start();
+		break;
+
+	case PlayerCommandType::Pause:
+		hr = Backend->Pause();
+		break;
+
+	case PlayerCommandType::Stop:
+		hr = Backend->Stop();
+		break;
+
+	case PlayerCommandType::Seek:
+		hr = Backend->StartAt(seekPosition);
+		break;
 	}
 
-	//Add Output Node to the topology
-	CComPtr<IMFTopologyNode> outputNode;
-	hr = AddOutputNode(newTopology, mediaSinkActivationObject, &outputNode);
+	//If the backend refused the command, it completes right here with the failure code
 	if (FAILED(hr))
 	{
 		assert(false);
-		return hr;
+		PlayerCommand failedCommand;
+		bool stillInFlight = false;
+		{
+			std::lock_guard<std::mutex> lock(InFlightCommandMutex);
+			if (HasInFlightCommand)
+			{
+				failedCommand = std::move(InFlightCommand);
+				HasInFlightCommand = false;
+				stillInFlight = true;
+			}
+		}
+		if (stillInFlight)
+		{
+			CompleteCommand(failedCommand, hr);
+		}
+		return false;
 	}
 
-	//Connect the source node to the output node
-	hr = sourceNode->ConnectOutput(0, outputNode, 0);
-	if (FAILED(hr))
+	return true;
+}
+
+bool MMFSoundPlayer::CompleteInFlightCommand(BackendEventType eventType, HRESULT eventStatus)
+{
+	//Only the event the in flight command is waiting for completes it
+	PlayerCommand completedCommand;
 	{
-		assert(false);
-		return hr;
+		std::lock_guard<std::mutex> lock(InFlightCommandMutex);
+		if (!HasInFlightCommand || InFlightCommandEvent != eventType)
+		{
+			return false;
+		}
+		completedCommand = std::move(InFlightCommand);
+		HasInFlightCommand = false;
 	}
+	CompleteCommand(completedCommand, eventStatus);
 
-	//Give the caller the pointer to newTopology through the output parameter
-	*outputTopology = newTopology.Detach();
-	
-	//Return the final code
-	return hr;
+	//This thread now holds the consumer role, so it issues the next commands
+	DispatchCommands();
+	return true;
 }
 
+void MMFSoundPlayer::CompleteCommand(PlayerCommand& inputCommand, HRESULT result)
+{
+	Trace.Record(TraceRecordType::CommandCompleted, (UINT32)inputCommand.Type, 0, result);
+	inputCommand.Complete(result);
+}
 
-HRESULT MMFSoundPlayer::AddSourceNode(IMFTopology* inputTopology, IMFPresentationDescriptor* inputPresentationDescriptor, IMFStreamDescriptor* inputStreamDescriptor, IMFTopologyNode** sourceNode)
+void MMFSoundPlayer::AbortInFlightCommand()
 {
-	//Create the input node
-	CComPtr<IMFTopologyNode> newNode;
-	HRESULT hr = MFCreateTopologyNode(MF_TOPOLOGY_SOURCESTREAM_NODE, &newNode);
-	if (FAILED(hr))
+	PlayerCommand abortedCommand;
 	{
-		assert(false);
-		return hr;
+		std::lock_guard<std::mutex> lock(InFlightCommandMutex);
+		if (!HasInFlightCommand)
+		{
+			return;
+		}
+		abortedCommand = std::move(InFlightCommand);
+		HasInFlightCommand = false;
 	}
+	CompleteCommand(abortedCommand, E_ABORT);
 
-	//Load the media source, presentation descriptor, and stream descriptor into the node for the topology
-	hr = newNode->SetUnknown(MF_TOPONODE_SOURCE, CurrentMediaSource);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
-	
-	hr = newNode->SetUnknown(MF_TOPONODE_PRESENTATION_DESCRIPTOR, inputPresentationDescriptor);
-	if (FAILED(hr))
+	//The remaining commands see the closing session and are ignored
+	DispatchCommands();
+}
+
+bool MMFSoundPlayer::TakePendingOpen(PlayerCommand* outputOpen, std::wstring* outputFilePath)
+{
+	std::lock_guard<std::mutex> lock(PendingOpenMutex);
+	if (!HasPendingOpen)
 	{
-		assert(false);
-		return hr;
+		return false;
 	}
-	
-	hr = newNode->SetUnknown(MF_TOPONODE_STREAM_DESCRIPTOR, inputStreamDescriptor);
-	if (FAILED(hr))
+	*outputOpen = std::move(PendingOpen);
+	*outputFilePath = std::move(PendingOpenFilePath);
+	HasPendingOpen = false;
+	return true;
+}
+
+bool MMFSoundPlayer::CompletePendingOpen(HRESULT result)
+{
+	PlayerCommand completedOpen;
+	std::wstring openedFilePath;
+	if (!TakePendingOpen(&completedOpen, &openedFilePath))
 	{
-		assert(false);
-		return hr;
+		return false;
 	}
+	CompleteTakenOpen(completedOpen, result);
+	return true;
+}
 
-	//Finally add the node to the topology
-	hr = inputTopology->AddNode(newNode);
-	if (FAILED(hr))
+void MMFSoundPlayer::CompleteTakenOpen(PlayerCommand& takenOpen, HRESULT result)
+{
+	Trace.Record(TraceRecordType::OpenCompleted, 0, 0, result);
+
+	//The song info taken from the metadata index doesn't hold for a file that never opened
+	if (FAILED(result))
 	{
-		assert(false);
-		return hr;
+		std::lock_guard<std::mutex> lock(SongInfoMutex);
+		CurrentFilePath = L"No File Loaded";
+		CurrentAudioFileDuration_100NanoSecondUnits = 0;
 	}
+	takenOpen.Complete(result);
+}
 
-	//Return the newNode pointer to caller through outputNode and return the final code
-	*sourceNode = newNode.Detach();
-	return hr;
+PlayerEventSubscription MMFSoundPlayer::SubscribeToEvents()
+{
+	return PlayerEventSubscription(&EventRing);
 }
 
-HRESULT MMFSoundPlayer::AddOutputNode(IMFTopology* inputTopology, IMFActivate* inputMediaSinkActivationObject, IMFTopologyNode** outputNode)
+HRESULT MMFSoundPlayer::EnableTracing(bool isEnabled)
 {
-	//Create the output node
-	CComPtr<IMFTopologyNode> newNode;
-	HRESULT hr = MFCreateTopologyNode(MF_TOPOLOGY_OUTPUT_NODE, &newNode);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
+	return Trace.Enable(isEnabled);
+}
 
-	//Bind the media sink activation object to the output node
-	hr = newNode->SetObject(inputMediaSinkActivationObject);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
+HRESULT MMFSoundPlayer::WriteTrace(PCWSTR outputFilePath)
+{
+	return Trace.WriteChromeTrace(outputFilePath);
+}
 
-	//Ensure that the node is shut down when the topology is swapped out
-	hr = newNode->SetUINT32(MF_TOPONODE_NOSHUTDOWN_ON_REMOVE, FALSE);
-	if (FAILED(hr))
-	{
-		assert(false);
-		return hr;
-	}
-	
-	//Finally add the node to the topology
-	hr = inputTopology->AddNode(newNode);
+//Telemetry----------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT MMFSoundPlayer::GetRenderTelemetry(RenderTelemetrySnapshot* outputSnapshot)
+{
+	return Backend->GetRenderTelemetry(outputSnapshot);
+}
+
+HRESULT MMFSoundPlayer::StartTelemetryExport(ITelemetryExporter* inputExporter, UINT32 intervalMilliseconds)
+{
+	//Nothing to export from a backend without telemetry
+	RenderTelemetrySnapshot snapshot;
+	HRESULT hr = Backend->GetRenderTelemetry(&snapshot);
 	if (FAILED(hr))
 	{
-		assert(false);
 		return hr;
 	}
 
-	//Return the newNode pointer to caller through outputNode and return the final code
-	*outputNode = newNode.Detach();
-	return hr;
+	IAudioBackend* backend = Backend.get();
+	return TelemetryExport.Start([backend](RenderTelemetrySnapshot* outputSnapshot) { return backend->GetRenderTelemetry(outputSnapshot); }, inputExporter, intervalMilliseconds);
+}
+
+HRESULT MMFSoundPlayer::StopTelemetryExport()
+{
+	return TelemetryExport.Stop();
+}
+
+HRESULT MMFSoundPlayer::GetVisualizationTap(VisualizationTap** outputTap)
+{
+	return Backend->GetVisualizationTap(outputTap);
 }
 
 //Getters------------------------------------------------------------------------------------------------------------------------------------------------------
 PlayerState MMFSoundPlayer::GetPlayerState()
 {
-	return CurrentState;
+	return StateMachine.GetState();
 }
 
 std::wstring MMFSoundPlayer::GetAudioFilepath()
 {
+	std::lock_guard<std::mutex> lock(SongInfoMutex);
 	return CurrentFilePath;
 }
 
+std::wstring MMFSoundPlayer::GetQueuedAudioFilepath()
+{
+	std::lock_guard<std::mutex> lock(SongInfoMutex);
+	return QueuedFilePath;
+}
+
 UINT64 MMFSoundPlayer::GetAudioFileDuration_100NanoSecondUnits()
 {
+	std::lock_guard<std::mutex> lock(SongInfoMutex);
 	return CurrentAudioFileDuration_100NanoSecondUnits;
 }
 
-UINT64 MMFSoundPlayer::GetCurrentPresentationTime_100NanoSecondUnits()
+HRESULT MMFSoundPlayer::GetAudioFileDuration_100NanoSecondUnits(PCWSTR inputFilePath, UINT64* audioFileDuration_100NanoSecondUnits)
 {
-	//If the session is nulled, return 0
-	if (CurrentMediaSession == nullptr)
+	if (inputFilePath == nullptr || audioFileDuration_100NanoSecondUnits == nullptr)
 	{
-		return 0;
+		return E_POINTER;
 	}
 
-	//Get the media session's clock and if it is unavailable, return 0
-	CComPtr<IMFClock> mediaSessionClock;
-	HRESULT hr = CurrentMediaSession->GetClock(&mediaSessionClock);
-	if (FAILED(hr))
+	//A current seek index has the exact duration
+	SeekIndexStore* seekIndexes = SeekIndexes;
+	std::shared_ptr<const SeekIndex> seekIndex;
+	if (seekIndexes != nullptr && seekIndexes->Lookup(inputFilePath, &seekIndex) == S_OK)
 	{
-		return 0;
+		*audioFileDuration_100NanoSecondUnits = seekIndex->GetDuration_100NanoSecondUnits();
+		return S_OK;
 	}
 
-	//Query the media session clock for a presentation clock and if there is an error, return 0
-	CComPtr<IMFPresentationClock> presentationClock;
-	hr = mediaSessionClock->QueryInterface(IID_PPV_ARGS(&presentationClock));
+	//With an index, a file is only probed when it is new or changed (and then remembered). Without one, it is always probed.
+	MediaFileMetadata metadata;
+	MediaMetadataIndex* metadataIndex = MetadataIndex;
+	HRESULT hr = metadataIndex != nullptr ? metadataIndex->Refresh(inputFilePath, &metadata) : ProbeMediaFile(inputFilePath, &metadata);
 	if (FAILED(hr))
 	{
-		return 0;
+		return hr;
 	}
 
-	//Return the current time of the presentation. Return 0 if there is an error
-	MFTIME currentPresentationTime = 0;
-	hr = presentationClock->GetTime(&currentPresentationTime);
+	*audioFileDuration_100NanoSecondUnits = metadata.Duration_100NanoSecondUnits;
+	return S_OK;
+}
+
+UINT64 MMFSoundPlayer::GetCurrentPresentationTime_100NanoSecondUnits()
+{
+	//Return the current time of the presentation. Return 0 if there is an error (no session, no clock...)
+	UINT64 currentPresentationTime = 0;
+	HRESULT hr = Backend->GetPresentationTime(&currentPresentationTime);
 	if (FAILED(hr))
 	{
 		return 0;
@@ -911,17 +1039,17 @@ UINT64 MMFSoundPlayer::GetCurrentPresentationTime_100NanoSecondUnits()
 	return currentPresentationTime;
 }
 
+UINT64 MMFSoundPlayer::GetInterpolatedPresentationTime_100NanoSecondUnits()
+{
+	return InterpolatedClock.GetTime_100NanoSecondUnits();
+}
+
 HRESULT MMFSoundPlayer::GetVolumeLevel(float& currentVolumeLevel)
 {
-	//Get volume object
-	CComPtr<IMFSimpleAudioVolume> simpleAudioVolume;
-	HRESULT hr = MFGetService(CurrentMediaSession, MR_POLICY_VOLUME_SERVICE, IID_PPV_ARGS(&simpleAudioVolume));
-	if (FAILED(hr))
-	{
-		return hr;
-	}
+	return Backend->GetVolume(currentVolumeLevel);
+}
 
-	//Try to retrieve the volume
-	hr = simpleAudioVolume->GetMasterVolume(&currentVolumeLevel);
-	return hr;
+HRESULT MMFSoundPlayer::GetMute(bool& isMuted)
+{
+	return Backend->GetMute(isMuted);
 }
\ No newline at end of file
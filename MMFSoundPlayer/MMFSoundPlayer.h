@@ -1,94 +1,245 @@
 #pragma once
 
-#include <mfidl.h>
+#include "Platform.h"
+#include "AudioBackend.h"
+#include "AutoResetEvent.h"
+#include "PlayerCommandQueue.h"
+#include "PlayerEventRing.h"
+#include "PlayerStateMachine.h"
+#include "PlayerTrace.h"
+#include "PresentationClock.h"
+#include "SpectrumAnalyzer.h"
+#include "TelemetryExport.h"
+#include "MediaMetadataIndex.h"
+#include "SeekIndexStore.h"
+#include "LoudnessStore.h"
+#include "MemoryMedia.h"
 #include <string>
-#include <atlbase.h>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 namespace MMFSoundPlayerLib
 {
-	enum PlayerState
+	//Which loudness a file is normalized by: its own, or its album's (keeping the level differences between the tracks of an album)
+	enum class LoudnessNormalizationMode
 	{
-		Closed,         // No session.
-		Ready,          // Session was created, ready to open a file. 
-		PresentationEnd,// Song just ended and if songs are in a queue, it is ready for the next song
-		OpenPending,    // Session is opening a file.
-		Playing,        // Session is playing a file.
-		Paused,         // Session is paused.
-		Stopped,        // Session is stopped (ready to play).
-		Closing         // Application has closed the session, but is waiting for MESessionClosed.
+		Off,
+		Track,
+		Album
 	};
-	
-	class MMFSoundPlayer : public IMFAsyncCallback
+
+	class MMFSoundPlayer : public IAudioBackendCallback
 	{
 	private:
 		//Player datafields
-		CComPtr<IMFMediaSession> CurrentMediaSession;
-		CComPtr<IMFMediaSource> CurrentMediaSource;
-		PlayerState CurrentState;
-		
-		//Song info
+		std::unique_ptr<IAudioBackend> Backend;
+
+		//Player state, validated and published to every subscriber of the event ring (the ring is declared first, the state machine publishes to it)
+		PlayerEventRing EventRing;
+		PlayerStateMachine StateMachine;
+
+		//Song info (written from the backend's event thread during gapless transitions, so guarded by SongInfoMutex)
+		std::mutex SongInfoMutex;
 		std::wstring CurrentFilePath;
 		UINT64 CurrentAudioFileDuration_100NanoSecondUnits;
-		
-		//Event Handles
-		HANDLE ExitEvent;
-		HANDLE PlayEvent;
-		HANDLE PauseEvent;
-		HANDLE StopEvent;
-		HANDLE TopologySetEvent;
-		
-		//Reference count for IUnknown
-		long ReferenceCount;
+
+		//Song queued to play gaplessly after the current one (empty when nothing is queued)
+		std::wstring QueuedFilePath;
+
+		//Library index answering metadata questions without opening files (optional, not owned)
+		std::atomic<MediaMetadataIndex*> MetadataIndex;
+
+		//Seek indexes giving compressed VBR files their exact duration (optional, not owned)
+		std::atomic<SeekIndexStore*> SeekIndexes;
+
+		//Loudness analysis results the played files are normalized with (optional, not owned)
+		std::atomic<LoudnessStore*> LoudnessResults;
+		std::atomic<LoudnessNormalizationMode> NormalizationMode;
+		std::atomic<float> NormalizationTarget_LUFS;
+
+		//What the player did and when, for finding out where the time goes (off until EnableTracing)
+		PlayerTrace Trace;
+
+		//Periodic dumps of the backend's render telemetry (off until StartTelemetryExport)
+		PeriodicTelemetryExport TelemetryExport;
+
+		//Position of the presentation, correlated with the backend's clock on every transport event and interpolated in between
+		PresentationClock InterpolatedClock;
+
+		//Events
+		AutoResetEvent ExitEvent;
+
+		//File being opened: the backend resolves it in the background and reports TopologySet, which starts playback and
+		//completes the open (a newer open or closing the player aborts it)
+		std::mutex PendingOpenMutex;
+		PlayerCommand PendingOpen;
+		std::wstring PendingOpenFilePath;
+		bool HasPendingOpen;
+
+		//Transport commands: queued by any thread, issued one at a time, completed from OnBackendEvent
+		PlayerCommandQueue CommandQueue;
+		std::mutex InFlightCommandMutex;
+		PlayerCommand InFlightCommand;
+		BackendEventType InFlightCommandEvent;
+		bool HasInFlightCommand;
+
+		//Reference count
+		std::atomic<ULONG> ReferenceCount;
 
 		//Acts as constructor, called by CreateInstance
 		HRESULT Initialize();
 
 		//Private Constructor (public should call CreateInstance) and Destructor (public should call Shutdown)
-		MMFSoundPlayer();
+		MMFSoundPlayer(IAudioBackend* inputBackend);
 		~MMFSoundPlayer();
 
 		//Setup Functions
 		HRESULT CreateMediaSession();
-		HRESULT CreateMediaSource(PCWSTR inputFilePath);
-		HRESULT CreatePlaybackTopology(IMFPresentationDescriptor* inputPresentationDescriptor, IMFTopology** outputTopology);
-		HRESULT AddSourceNode(IMFTopology* inputTopology, IMFPresentationDescriptor* inputPresentationDescriptor, IMFStreamDescriptor* inputStreamDescriptor, IMFTopologyNode** sourceNode);
-		HRESULT AddOutputNode(IMFTopology* inputTopology, IMFActivate* inputMediaSinkActivationObject, IMFTopologyNode** outputNode);
-		
+
+		//Clock functions
+		void CorrelatePresentationClock(bool isRunning);
+		UINT64 GetIndexedDuration_100NanoSecondUnits(const std::wstring& inputFilePath, UINT64 estimatedDuration_100NanoSecondUnits);
+
+		//Loudness functions
+		HRESULT ApplyLoudnessNormalization(const std::wstring& inputFilePath);
+
 		//Destruction functions
 		HRESULT CloseMediaSessionAndSource();
-		
-	public:
-		//Public events
-		HANDLE VolumeExternallyChanged;
 
-		//A static public function to create an instance of the object (needed to make object a COM object)
+		//Command dispatch functions
+		std::future<HRESULT> SubmitCommand(PlayerCommand&& inputCommand);
+		HRESULT WaitForCommand(std::future<HRESULT> completion);
+		void DispatchCommands();
+		bool IssueCommand(PlayerCommand& inputCommand);
+		bool CompleteInFlightCommand(BackendEventType eventType, HRESULT eventStatus);
+		void CompleteCommand(PlayerCommand& inputCommand, HRESULT result);
+		void AbortInFlightCommand();
+		bool TakePendingOpen(PlayerCommand* outputOpen, std::wstring* outputFilePath);
+		bool CompletePendingOpen(HRESULT result);
+		void CompleteTakenOpen(PlayerCommand& takenOpen, HRESULT result);
+
+	public:
+		//A static public function to create an instance of the object with the platform's default backend (Media Foundation on Windows, headless elsewhere)
 		static HRESULT CreateInstance(MMFSoundPlayer** outputMMFSoundPlayer);
 
+		//Create an instance on top of a specific backend. The player takes ownership of the backend, even on failure.
+		static HRESULT CreateInstance(IAudioBackend* inputBackend, MMFSoundPlayer** outputMMFSoundPlayer);
+
 		//Public destructor function that must be called before program ends
 		HRESULT Shutdown();
 
-		//IMFAsyncCallback methods (required for handling of events)
-		STDMETHODIMP Invoke(IMFAsyncResult* pAsyncResult);
-		STDMETHODIMP GetParameters(DWORD* pdwFlags, DWORD* pdwQueue);
-		
-		//IUnknown methods (required for IMFAsyncCallback)
-		STDMETHODIMP QueryInterface(REFIID iid, void** ppv);
-		STDMETHODIMP_(ULONG) AddRef();
-		STDMETHODIMP_(ULONG) Release();
+		//Close the file and forget what the last user set up (queued file, crossfade, normalization, stores, tracing, telemetry
+		//export, visualization tap), so the player and its backend can serve another user (PlayerPool). Volume and mute belong
+		//to the backend and stay as they are.
+		HRESULT Recycle();
+
+		//IAudioBackendCallback method (required for handling of events)
+		void OnBackendEvent(BackendEventType eventType, HRESULT eventStatus, UINT64 eventValue) override;
 
-		//Audio Control
+		//Reference counting (the object is deleted when the count reaches 0)
+		ULONG AddRef();
+		ULONG Release();
+
+		//Audio Control (Play, Pause, Stop and Seek block until their command completes, at most 3 seconds, SetFileIntoPlayer
+		//until the file plays or failed to open, however long the file takes to resolve). Files can also be audio held in
+		//memory, through the path MemoryMedia::Register gives the buffer.
 		HRESULT SetFileIntoPlayer(PCWSTR inputFilepath);
+		HRESULT QueueNextFile(PCWSTR inputFilepath);
 		HRESULT Play();
 		HRESULT Pause();
-		HRESULT Stop(); 
+		HRESULT Stop();
 		HRESULT Seek(UINT64 seekPosition_100NanoSecondUnits);
 		HRESULT SetVolume(float volumeLevel);
 
+		//Start the queued file this long before the end of the current one, crossfading between the two (0, the default,
+		//plays it gaplessly after the end). Only engines that decode two files at once crossfade, Media Foundation returns E_NOTIMPL.
+		HRESULT SetCrossfadeDuration(UINT32 durationMilliseconds);
+
+		//Glide to a volume over a duration, fade in (from silence) or out on top of the volume, and mute without losing the
+		//volume. Only engines with their own gain stage ramp and fade, Media Foundation steps to the volume and can't fade
+		//(E_NOTIMPL). A fade out stays silent until the next fade in.
+		HRESULT RampVolume(float volumeLevel, UINT32 durationMilliseconds, GainRampCurve curve = GainRampCurve::Linear);
+		HRESULT FadeIn(UINT32 durationMilliseconds, GainRampCurve curve = GainRampCurve::Linear);
+		HRESULT FadeOut(UINT32 durationMilliseconds, GainRampCurve curve = GainRampCurve::Linear);
+		HRESULT SetMute(bool isMuted);
+
+		//Use a library index for file durations (nullptr to stop using one). The index must outlive its use by the player.
+		void SetMetadataIndex(MediaMetadataIndex* inputIndex);
+
+		//Use seek indexes for the files that have one (missing ones are built in the background when a file is set). The store must outlive its use by the player.
+		void SetSeekIndexStore(SeekIndexStore* inputStore);
+
+		//Normalize every file set or queued from now on (and the current one) to the target loudness, using the results of a
+		//LoudnessAnalyzer. Files without current results play unchanged, a boost never lifts the true peak above full scale.
+		//Only engines with their own gain stage normalize, Media Foundation plays files unchanged (E_NOTIMPL when the
+		//current file would need a gain).
+		void SetLoudnessStore(LoudnessStore* inputStore);
+		HRESULT SetLoudnessNormalization(LoudnessNormalizationMode mode, float targetLoudness_LUFS = -18.0f);
+
+		/*
+		Asynchronous Audio Control. These never block: the command is queued (from any thread) and the future resolves, and the
+		optional callback is called, once the backend reports completion. Commands are issued in submission order, each one
+		checked against the state left by the previous one, and are ignored (S_OK) in the same states as their blocking versions.
+		A command the player rejects (a seek past the end of the file) resolves with E_INVALIDARG instead of being issued.
+		Don't wait on the future from inside a completion callback, the callback runs on the thread that completes commands.
+		*/
+		std::future<HRESULT> PlayAsync(PlayerCommandCallback completionCallback = nullptr);
+		std::future<HRESULT> PauseAsync(PlayerCommandCallback completionCallback = nullptr);
+		std::future<HRESULT> StopAsync(PlayerCommandCallback completionCallback = nullptr);
+		std::future<HRESULT> SeekAsync(UINT64 seekPosition_100NanoSecondUnits, PlayerCommandCallback completionCallback = nullptr);
+
+		/*
+		Seek for seek bars being dragged: call it for every cursor move. While a seek is in flight, only the latest scrub waits
+		behind it, each scrub it replaces resolves with S_FALSE without being issued, so the audio follows the cursor at the
+		rate the backend can seek instead of lagging behind a backlog of positions.
+		*/
+		std::future<HRESULT> ScrubAsync(UINT64 seekPosition_100NanoSecondUnits, PlayerCommandCallback completionCallback = nullptr);
+
+		/*
+		Open for files that may take a while to resolve (network shares). The session is replaced right away and the player
+		stays OpenPending while the backend resolves the file on a thread of its own, so commands and other players never wait
+		on it. The future resolves once the file plays, or with the failure to open it. A newer open supersedes this one and
+		CancelOpen (or closing the player) cancels it, either way it resolves with E_ABORT and the file is never set.
+		*/
+		std::future<HRESULT> SetFileIntoPlayerAsync(PCWSTR inputFilepath, PlayerCommandCallback completionCallback = nullptr);
+		HRESULT CancelOpen();
+
+		//Observe state changes, gapless track changes and external volume changes. Each subscriber sees every event published after it subscribed.
+		PlayerEventSubscription SubscribeToEvents();
+
+		//Record backend events, state transitions, commands and opens with their timings into a ring of the latest records
+		//(off by default, next to free while off), and write them out as Chrome trace-event JSON (chrome://tracing, Perfetto)
+		HRESULT EnableTracing(bool isEnabled);
+		HRESULT WriteTrace(PCWSTR outputFilePath);
+
+		//Render health (underruns, late periods, period jitter, decode-ahead fill, decode time, CPU time per second of audio),
+		//snapshotted from the backend's counters at any time. Backends rendering through the platform return E_NOTIMPL.
+		HRESULT GetRenderTelemetry(RenderTelemetrySnapshot* outputSnapshot);
+
+		//Hand a snapshot to the exporter every interval on a thread of the player's (PrometheusTextFileExporter,
+		//JsonLinesFileExporter or one of the application's). The exporter isn't owned, it must outlive the export.
+		HRESULT StartTelemetryExport(ITelemetryExporter* inputExporter, UINT32 intervalMilliseconds);
+		HRESULT StopTelemetryExport();
+
+		//Tap on the audio being rendered, for meters and spectrum displays: enable it and feed it to a SpectrumAnalyzer from
+		//one consumer thread (a UI timer). The tap belongs to the backend and stays valid until the player is released.
+		//Backends rendering through the platform return E_NOTIMPL.
+		HRESULT GetVisualizationTap(VisualizationTap** outputTap);
+
 		//Getters
 		PlayerState GetPlayerState();
 		std::wstring GetAudioFilepath();
+		std::wstring GetQueuedAudioFilepath();
 		UINT64 GetAudioFileDuration_100NanoSecondUnits();
+
+		//Duration of any file, from its seek index or the metadata index when they are current (probing and indexing the file otherwise)
+		HRESULT GetAudioFileDuration_100NanoSecondUnits(PCWSTR inputFilePath, UINT64* audioFileDuration_100NanoSecondUnits);
 		UINT64 GetCurrentPresentationTime_100NanoSecondUnits();
+
+		//Wait-free position for high frequency polling (UI position bars), extrapolated from the last transport event
+		UINT64 GetInterpolatedPresentationTime_100NanoSecondUnits();
 		HRESULT  GetVolumeLevel(float& currentVolumeLevel);
+		HRESULT GetMute(bool& isMuted);
 	};
-}
\ No newline at end of file
+}
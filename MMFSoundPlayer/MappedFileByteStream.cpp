@@ -0,0 +1,312 @@
+#ifdef _WIN32
+
+#include "MappedFileByteStream.h"
+#include <mfapi.h>
+#include <mferror.h>
+#include <shlwapi.h>
+#include <atlbase.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace MMFSoundPlayerLib;
+
+//Carries the byte count of a BeginRead to its EndRead through the async result
+class ReadOperation : public IUnknown
+{
+private:
+	long ReferenceCount;
+
+public:
+	ULONG BytesRead;
+
+	ReadOperation(ULONG bytesRead)
+	{
+		ReferenceCount = 1;
+		BytesRead = bytesRead;
+	}
+
+	STDMETHODIMP QueryInterface(REFIID iid, void** ppv)
+	{
+		if (ppv == nullptr)
+		{
+			return E_POINTER;
+		}
+		if (iid != IID_IUnknown)
+		{
+			*ppv = nullptr;
+			return E_NOINTERFACE;
+		}
+		*ppv = static_cast<IUnknown*>(this);
+		AddRef();
+		return S_OK;
+	}
+
+	STDMETHODIMP_(ULONG) AddRef()
+	{
+		return InterlockedIncrement(&ReferenceCount);
+	}
+
+	STDMETHODIMP_(ULONG) Release()
+	{
+		long referenceCount = InterlockedDecrement(&ReferenceCount);
+		if (referenceCount == 0)
+		{
+			delete this;
+		}
+		return referenceCount;
+	}
+};
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+MappedFileByteStream::MappedFileByteStream()
+{
+	ReferenceCount = 1;
+	Position = 0;
+	IsClosed = false;
+}
+
+HRESULT MappedFileByteStream::CreateInstance(PCWSTR inputFilePath, IMFByteStream** outputByteStream)
+{
+	//Ensure that the double pointer actually points somewhere
+	if (inputFilePath == nullptr || outputByteStream == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULT can be returned
+	MappedFileByteStream* newByteStream = new (std::nothrow) MappedFileByteStream();
+	if (newByteStream == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	HRESULT hr = newByteStream->MappedFile.Open(inputFilePath);
+	if (FAILED(hr))
+	{
+		newByteStream->Release();
+		return hr;
+	}
+
+	*outputByteStream = newByteStream;
+	return S_OK;
+}
+
+//IUnknown Implementation Functions----------------------------------------------------------------------------------------------------------------------------
+STDMETHODIMP MappedFileByteStream::QueryInterface(REFIID iid, void** ppv)
+{
+	static const QITAB qit[] =
+	{
+		QITABENT(MappedFileByteStream, IMFByteStream),
+		{ 0 }
+	};
+	return QISearch(this, qit, iid, ppv);
+}
+
+STDMETHODIMP_(ULONG) MappedFileByteStream::AddRef()
+{
+	return InterlockedIncrement(&ReferenceCount);
+}
+
+STDMETHODIMP_(ULONG) MappedFileByteStream::Release()
+{
+	//The source holds the last reference, the mapping goes with it
+	long referenceCount = InterlockedDecrement(&ReferenceCount);
+	if (referenceCount == 0)
+	{
+		delete this;
+	}
+	return referenceCount;
+}
+
+//IMFByteStream Implementation Functions-----------------------------------------------------------------------------------------------------------------------
+STDMETHODIMP MappedFileByteStream::GetCapabilities(DWORD* pdwCapabilities)
+{
+	if (pdwCapabilities == nullptr)
+	{
+		return E_POINTER;
+	}
+	*pdwCapabilities = MFBYTESTREAM_IS_READABLE | MFBYTESTREAM_IS_SEEKABLE | MFBYTESTREAM_DOES_NOT_USE_NETWORK;
+	return S_OK;
+}
+
+STDMETHODIMP MappedFileByteStream::GetLength(QWORD* pqwLength)
+{
+	if (pqwLength == nullptr)
+	{
+		return E_POINTER;
+	}
+	std::lock_guard<std::mutex> lock(StreamMutex);
+	*pqwLength = MappedFile.GetSize();
+	return S_OK;
+}
+
+STDMETHODIMP MappedFileByteStream::SetLength(QWORD qwLength)
+{
+	return E_ACCESSDENIED;
+}
+
+STDMETHODIMP MappedFileByteStream::GetCurrentPosition(QWORD* pqwPosition)
+{
+	if (pqwPosition == nullptr)
+	{
+		return E_POINTER;
+	}
+	std::lock_guard<std::mutex> lock(StreamMutex);
+	*pqwPosition = Position;
+	return S_OK;
+}
+
+STDMETHODIMP MappedFileByteStream::SetCurrentPosition(QWORD qwPosition)
+{
+	std::lock_guard<std::mutex> lock(StreamMutex);
+	if (IsClosed)
+	{
+		return MF_E_SHUTDOWN;
+	}
+
+	//Positions past the end are allowed, reads there just return nothing
+	Position = qwPosition;
+	return S_OK;
+}
+
+STDMETHODIMP MappedFileByteStream::IsEndOfStream(BOOL* pfEndOfStream)
+{
+	if (pfEndOfStream == nullptr)
+	{
+		return E_POINTER;
+	}
+	std::lock_guard<std::mutex> lock(StreamMutex);
+	*pfEndOfStream = Position >= MappedFile.GetSize() ? TRUE : FALSE;
+	return S_OK;
+}
+
+STDMETHODIMP MappedFileByteStream::Read(BYTE* pb, ULONG cb, ULONG* pcbRead)
+{
+	if ((pb == nullptr && cb > 0) || pcbRead == nullptr)
+	{
+		return E_POINTER;
+	}
+	*pcbRead = 0;
+
+	std::lock_guard<std::mutex> lock(StreamMutex);
+	if (IsClosed)
+	{
+		return MF_E_SHUTDOWN;
+	}
+	UINT64 fileSize = MappedFile.GetSize();
+	if (Position >= fileSize)
+	{
+		return S_OK;
+	}
+
+	//The only copy between the page cache and the parser (unless the file was cut short meanwhile)
+	ULONG bytesToRead = (ULONG)std::min<UINT64>(cb, fileSize - Position);
+	HRESULT hr = MappedFile.CheckReadable(Position, bytesToRead);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	MappedFile.AdviseSequentialRead(Position);
+	memcpy(pb, MappedFile.GetData() + Position, bytesToRead);
+	Position += bytesToRead;
+	*pcbRead = bytesToRead;
+	return S_OK;
+}
+
+STDMETHODIMP MappedFileByteStream::BeginRead(BYTE* pb, ULONG cb, IMFAsyncCallback* pCallback, IUnknown* punkState)
+{
+	if (pCallback == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Read right away and queue the completion
+	ULONG bytesRead = 0;
+	HRESULT readResult = Read(pb, cb, &bytesRead);
+
+	CComPtr<ReadOperation> operation;
+	operation.Attach(new (std::nothrow) ReadOperation(bytesRead));
+	if (operation == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	CComPtr<IMFAsyncResult> asyncResult;
+	HRESULT hr = MFCreateAsyncResult(operation, pCallback, punkState, &asyncResult);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	asyncResult->SetStatus(readResult);
+	return MFInvokeCallback(asyncResult);
+}
+
+STDMETHODIMP MappedFileByteStream::EndRead(IMFAsyncResult* pResult, ULONG* pcbRead)
+{
+	if (pResult == nullptr || pcbRead == nullptr)
+	{
+		return E_POINTER;
+	}
+	*pcbRead = 0;
+
+	CComPtr<IUnknown> operation;
+	HRESULT hr = pResult->GetObject(&operation);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	*pcbRead = static_cast<ReadOperation*>(operation.p)->BytesRead;
+	return pResult->GetStatus();
+}
+
+STDMETHODIMP MappedFileByteStream::Write(const BYTE* pb, ULONG cb, ULONG* pcbWritten)
+{
+	return E_ACCESSDENIED;
+}
+
+STDMETHODIMP MappedFileByteStream::BeginWrite(const BYTE* pb, ULONG cb, IMFAsyncCallback* pCallback, IUnknown* punkState)
+{
+	return E_ACCESSDENIED;
+}
+
+STDMETHODIMP MappedFileByteStream::EndWrite(IMFAsyncResult* pResult, ULONG* pcbWritten)
+{
+	return E_ACCESSDENIED;
+}
+
+STDMETHODIMP MappedFileByteStream::Seek(MFBYTESTREAM_SEEK_ORIGIN SeekOrigin, LONGLONG llSeekOffset, DWORD dwSeekFlags, QWORD* pqwCurrentPosition)
+{
+	std::lock_guard<std::mutex> lock(StreamMutex);
+	if (IsClosed)
+	{
+		return MF_E_SHUTDOWN;
+	}
+
+	LONGLONG newPosition = SeekOrigin == msoCurrent ? (LONGLONG)Position + llSeekOffset : llSeekOffset;
+	if (newPosition < 0)
+	{
+		return E_INVALIDARG;
+	}
+	Position = (UINT64)newPosition;
+	if (pqwCurrentPosition != nullptr)
+	{
+		*pqwCurrentPosition = Position;
+	}
+	return S_OK;
+}
+
+STDMETHODIMP MappedFileByteStream::Flush()
+{
+	return S_OK;
+}
+
+STDMETHODIMP MappedFileByteStream::Close()
+{
+	//Unmap right away, the object itself lives until the last reference is released
+	std::lock_guard<std::mutex> lock(StreamMutex);
+	MappedFile.Close();
+	IsClosed = true;
+	return S_OK;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#ifdef _WIN32
+
+#include "MemoryMappedFile.h"
+#include <mfidl.h>
+#include <mfobjects.h>
+#include <mutex>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Read-only Media Foundation byte stream over a memory-mapped local file, handed to the source resolver instead of the
+	path so the media source reads straight out of the page cache: a read is a single copy from the mapping into the
+	parser's buffer, with no file handle reads or byte stream buffering of its own in between. The mapping prefetches ahead
+	of the read position and releases what it left behind, so a large lossless file doesn't stay resident. Paths registered
+	with MemoryMedia are read the same way, straight out of the caller's buffer.
+	Asynchronous reads complete before BeginRead returns (the copy doesn't block on anything but page faults), the callback
+	is still invoked on a work queue.
+	*/
+	class MappedFileByteStream : public IMFByteStream
+	{
+	private:
+		long ReferenceCount;
+
+		//Guards the position and the mapping's read-ahead state (the source may read from several work queue threads)
+		std::mutex StreamMutex;
+		MemoryMappedFile MappedFile;
+		UINT64 Position;
+		bool IsClosed;
+
+		MappedFileByteStream();
+		~MappedFileByteStream() = default;
+
+	public:
+		//Map the file (or view the registered buffer). Fails for anything that isn't a local file or a registered buffer.
+		static HRESULT CreateInstance(PCWSTR inputFilePath, IMFByteStream** outputByteStream);
+
+		//IUnknown methods
+		STDMETHODIMP QueryInterface(REFIID iid, void** ppv);
+		STDMETHODIMP_(ULONG) AddRef();
+		STDMETHODIMP_(ULONG) Release();
+
+		//IMFByteStream methods
+		STDMETHODIMP GetCapabilities(DWORD* pdwCapabilities);
+		STDMETHODIMP GetLength(QWORD* pqwLength);
+		STDMETHODIMP SetLength(QWORD qwLength);
+		STDMETHODIMP GetCurrentPosition(QWORD* pqwPosition);
+		STDMETHODIMP SetCurrentPosition(QWORD qwPosition);
+		STDMETHODIMP IsEndOfStream(BOOL* pfEndOfStream);
+		STDMETHODIMP Read(BYTE* pb, ULONG cb, ULONG* pcbRead);
+		STDMETHODIMP BeginRead(BYTE* pb, ULONG cb, IMFAsyncCallback* pCallback, IUnknown* punkState);
+		STDMETHODIMP EndRead(IMFAsyncResult* pResult, ULONG* pcbRead);
+		STDMETHODIMP Write(const BYTE* pb, ULONG cb, ULONG* pcbWritten);
+		STDMETHODIMP BeginWrite(const BYTE* pb, ULONG cb, IMFAsyncCallback* pCallback, IUnknown* punkState);
+		STDMETHODIMP EndWrite(IMFAsyncResult* pResult, ULONG* pcbWritten);
+		STDMETHODIMP Seek(MFBYTESTREAM_SEEK_ORIGIN SeekOrigin, LONGLONG llSeekOffset, DWORD dwSeekFlags, QWORD* pqwCurrentPosition);
+		STDMETHODIMP Flush();
+		STDMETHODIMP Close();
+	};
+}
+
+#endif
@@ -0,0 +1,1042 @@
+#ifdef _WIN32
+
+#include "MediaFoundationBackend.h"
+#include "MediaRuntime.h"
+#include "MappedFileByteStream.h"
+#include "MemoryMedia.h"
+#include <mfapi.h>
+#include <cassert>
+#include <cstdio>
+#include <shlwapi.h>
+
+using namespace MMFSoundPlayerLib;
+
+//Time shutdown gives the files still being resolved before it leaves them behind
+static const UINT32 LoadShutdownTimeoutMilliseconds = 500;
+
+//Returns the ID of the topology carried by a session event (0 if the event carries none)
+static TOPOID GetEventTopologyId(IMFMediaEvent* inputEvent)
+{
+	TOPOID topologyId = 0;
+	PROPVARIANT eventValue;
+	PropVariantInit(&eventValue);
+	if (SUCCEEDED(inputEvent->GetValue(&eventValue)) && eventValue.vt == VT_UNKNOWN && eventValue.punkVal != nullptr)
+	{
+		CComPtr<IMFTopology> topology;
+		if (SUCCEEDED(eventValue.punkVal->QueryInterface(IID_PPV_ARGS(&topology))))
+		{
+			topology->GetTopologyID(&topologyId);
+		}
+	}
+	PropVariantClear(&eventValue);
+	return topologyId;
+}
+
+//Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
+MediaFoundationBackend::MediaFoundationBackend()
+{
+	Callback = nullptr;
+	IsStarted = false;
+	OpenSequence = 0;
+	OpenedAudioFileDuration_100NanoSecondUnits = 0;
+	PrepareSequence = 0;
+	NextTopologyId = 0;
+	NextTopologyQueued = false;
+	NextAudioFileDuration_100NanoSecondUnits = 0;
+	ReferenceCount = 1;
+}
+
+MediaFoundationBackend::~MediaFoundationBackend()
+{
+	Shutdown();
+}
+
+HRESULT MediaFoundationBackend::CreateInstance(IAudioBackend** outputBackend)
+{
+	//Ensure that the double pointer actually points somewhere
+	if (outputBackend == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULT can be returned
+	MediaFoundationBackend* newBackend = new (std::nothrow) MediaFoundationBackend();
+	if (newBackend == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	*outputBackend = newBackend;
+	return S_OK;
+}
+
+HRESULT MediaFoundationBackend::Startup(IAudioBackendCallback* inputCallback)
+{
+	if (inputCallback == nullptr)
+	{
+		return E_POINTER;
+	}
+	Callback = inputCallback;
+
+	//Take a reference to the shared MMF library (only the first backend of the process actually starts it)
+	HRESULT hr = MediaRuntime::AddRef();
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	IsStarted = true;
+	return hr;
+}
+
+HRESULT MediaFoundationBackend::Shutdown()
+{
+	//Shutdown can be reached both explicitly and through the destructor, only balance MFStartup once
+	if (!IsStarted)
+	{
+		return S_OK;
+	}
+	IsStarted = false;
+
+	//Make sure nothing is left running, then let go of the MMF library (the last backend shuts it down). A file that isn't
+	//resolved in time (a share that doesn't answer) is left behind, it finds the gate closed.
+	ShutdownSession();
+	size_t abandonedCount = LoadThreads.Abandon(LoadShutdownTimeoutMilliseconds);
+	if (abandonedCount > 0)
+	{
+		char message[96];
+		snprintf(message, sizeof(message), "MEDIA FOUNDATION BACKEND: Abandoned %u file(s) still being resolved\n", (unsigned int)abandonedCount);
+		WriteDebugString(message);
+	}
+	MediaRuntime::Release();
+	return S_OK;
+}
+
+HRESULT MediaFoundationBackend::CreateSession()
+{
+	//Create the media session
+	HRESULT hr = MFCreateMediaSession(nullptr, &CurrentMediaSession);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Set the media session event handler
+	hr = CurrentMediaSession->BeginGetEvent((IMFAsyncCallback*)this, NULL);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Successfully created media session
+	return hr;
+}
+
+HRESULT MediaFoundationBackend::CloseSession(bool* closeEventPending)
+{
+	if (closeEventPending == nullptr)
+	{
+		return E_POINTER;
+	}
+	*closeEventPending = false;
+
+	//Files still being resolved are left to finish on their own, their results are dropped
+	CancelBackgroundLoads();
+
+	//Nothing to close
+	if (CurrentMediaSession == nullptr)
+	{
+		return S_OK;
+	}
+
+	//Close media session, MESessionClosed follows once it is done
+	HRESULT hr = CurrentMediaSession->Close();
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	*closeEventPending = true;
+	return hr;
+}
+
+HRESULT MediaFoundationBackend::ShutdownSession()
+{
+	//Forget the files being resolved and the queued file first
+	CancelBackgroundLoads();
+	ClearNextFile();
+
+	//Shutdown the media session and source
+	if (CurrentMediaSource != nullptr)
+	{
+		CurrentMediaSource->Shutdown();
+	}
+	if (CurrentMediaSession != nullptr)
+	{
+		CurrentMediaSession->Shutdown();
+	}
+
+	//Null the clock, session and source for further use
+	{
+		std::lock_guard<std::mutex> lock(ClockMutex);
+		PresentationClock = nullptr;
+	}
+	{
+		std::lock_guard<std::mutex> lock(VolumeMutex);
+		VolumeService = nullptr;
+	}
+	CurrentMediaSource = nullptr;
+	CurrentMediaSession = nullptr;
+	return S_OK;
+}
+
+HRESULT MediaFoundationBackend::OpenFile(PCWSTR inputFilePath)
+{
+	if (inputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (CurrentMediaSession == nullptr)
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Resolve the file in the background (opening a file on a share can take seconds), MESessionTopologySet follows
+	UINT64 openSequence = 0;
+	{
+		std::lock_guard<std::mutex> lock(OpenMutex);
+		openSequence = ++OpenSequence;
+	}
+	std::wstring filePath = inputFilePath;
+	return LoadThreads.Run([this, filePath, openSequence](BackgroundGate& gate) { OpenFileInBackground(this, gate, filePath, openSequence); });
+}
+
+void MediaFoundationBackend::OpenFileInBackground(MediaFoundationBackend* backend, BackgroundGate& gate, std::wstring inputFilePath, UINT64 openSequence)
+{
+	//Resolving a source needs COM on this thread as well
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	bool comInitialized = SUCCEEDED(hr);
+
+	//Create the media source and its playback topology
+	CComPtr<IMFMediaSource> openedSource;
+	CComPtr<IMFTopology> playbackTopology;
+	UINT64 openedDuration = 0;
+	hr = LoadFile(inputFilePath.c_str(), &openedSource, &playbackTopology, &openedDuration);
+
+	//The backend is only there while the gate is open, a result arriving after shutdown counts as cancelled
+	std::unique_lock<std::mutex> entry = gate.Enter();
+	bool isCancelled = !entry.owns_lock();
+	if (!isCancelled)
+	{
+		std::lock_guard<std::mutex> lock(backend->OpenMutex);
+		isCancelled = openSequence != backend->OpenSequence;
+		if (!isCancelled && SUCCEEDED(hr))
+		{
+			//Set the playback topology into the media session and set flag so that the old presentation is immediately stopped and cleared before setting new topology
+			backend->CurrentMediaSource = openedSource;
+			backend->OpenedAudioFileDuration_100NanoSecondUnits = openedDuration;
+			hr = backend->CurrentMediaSession->SetTopology(MFSESSION_SETTOPOLOGY_IMMEDIATE, playbackTopology);
+		}
+	}
+
+	//A cancelled source is shut down without a word, a failure is reported like a failed MESessionTopologySet
+	if ((isCancelled || FAILED(hr)) && openedSource != nullptr)
+	{
+		openedSource->Shutdown();
+	}
+	if (!isCancelled && FAILED(hr))
+	{
+		backend->Callback->OnBackendEvent(BackendEventType::TopologySet, hr, 0);
+	}
+	if (entry.owns_lock())
+	{
+		entry.unlock();
+	}
+
+	if (comInitialized)
+	{
+		CoUninitialize();
+	}
+}
+
+HRESULT MediaFoundationBackend::PrepareNextFile(PCWSTR inputFilePath)
+{
+	if (inputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (CurrentMediaSession == nullptr)
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Resolve the file in the background, the session is free threaded so the topology can be queued from there. A newer
+	//request replaces this one, even if this one is still being resolved.
+	UINT64 prepareSequence = 0;
+	{
+		std::lock_guard<std::mutex> lock(NextFileMutex);
+		prepareSequence = ++PrepareSequence;
+	}
+	std::wstring filePath = inputFilePath;
+	return LoadThreads.Run([this, filePath, prepareSequence](BackgroundGate& gate) { PreloadFile(this, gate, filePath, prepareSequence); });
+}
+
+void MediaFoundationBackend::PreloadFile(MediaFoundationBackend* backend, BackgroundGate& gate, std::wstring inputFilePath, UINT64 prepareSequence)
+{
+	//Resolving a source needs COM on this thread as well
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	bool comInitialized = SUCCEEDED(hr);
+
+	//Create the media source and its playback topology
+	CComPtr<IMFMediaSource> nextSource;
+	CComPtr<IMFTopology> nextTopology;
+	UINT64 nextDuration = 0;
+	hr = LoadFile(inputFilePath.c_str(), &nextSource, &nextTopology, &nextDuration);
+
+	//The backend is only there while the gate is open, a result arriving after shutdown counts as cancelled
+	std::unique_lock<std::mutex> entry = gate.Enter();
+	bool isCancelled = !entry.owns_lock();
+	if (!isCancelled)
+	{
+		std::lock_guard<std::mutex> lock(backend->NextFileMutex);
+		isCancelled = prepareSequence != backend->PrepareSequence;
+		if (SUCCEEDED(hr) && !isCancelled)
+		{
+			//Replace a file that was queued before (the session only keeps the current topology after ClearTopologies)
+			if (backend->NextTopologyQueued)
+			{
+				backend->CurrentMediaSession->ClearTopologies();
+				backend->NextMediaSource->Shutdown();
+				backend->NextMediaSource = nullptr;
+				backend->NextTopologyQueued = false;
+			}
+
+			//Without MFSESSION_SETTOPOLOGY_IMMEDIATE, the session resolves and pre-rolls the topology now and starts it at the end of the current one
+			hr = nextTopology->GetTopologyID(&backend->NextTopologyId);
+			if (SUCCEEDED(hr))
+			{
+				hr = backend->CurrentMediaSession->SetTopology(0, nextTopology);
+			}
+			if (SUCCEEDED(hr))
+			{
+				backend->NextMediaSource = nextSource;
+				backend->NextAudioFileDuration_100NanoSecondUnits = nextDuration;
+				backend->NextTopologyQueued = true;
+			}
+		}
+	}
+
+	//A source that didn't make it into the session is shut down right away, a replaced request isn't reported
+	if ((FAILED(hr) || isCancelled) && nextSource != nullptr)
+	{
+		nextSource->Shutdown();
+	}
+	if (!isCancelled)
+	{
+		backend->Callback->OnBackendEvent(BackendEventType::NextFilePrepared, hr, nextDuration);
+	}
+	if (entry.owns_lock())
+	{
+		entry.unlock();
+	}
+
+	if (comInitialized)
+	{
+		CoUninitialize();
+	}
+}
+
+HRESULT MediaFoundationBackend::SetCrossfade(UINT32 durationMilliseconds)
+{
+	//A session plays one topology at a time, the queued one can only follow the current one gaplessly
+	return durationMilliseconds == 0 ? S_OK : E_NOTIMPL;
+}
+
+void MediaFoundationBackend::CancelBackgroundLoads()
+{
+	{
+		std::lock_guard<std::mutex> lock(OpenMutex);
+		OpenSequence++;
+	}
+	std::lock_guard<std::mutex> lock(NextFileMutex);
+	PrepareSequence++;
+}
+
+void MediaFoundationBackend::ClearNextFile()
+{
+	std::lock_guard<std::mutex> lock(NextFileMutex);
+	if (NextMediaSource != nullptr)
+	{
+		NextMediaSource->Shutdown();
+		NextMediaSource = nullptr;
+	}
+	NextTopologyQueued = false;
+	NextTopologyId = 0;
+}
+
+//Transport----------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT MediaFoundationBackend::Start()
+{
+	//Set the audio to start playing at the current time (if stopped, will start audio track from beginning)
+	PROPVARIANT varStart;
+	PropVariantInit(&varStart);
+
+	//Start the session
+	return CurrentMediaSession->Start(&GUID_NULL, &varStart);
+}
+
+HRESULT MediaFoundationBackend::StartAt(UINT64 startPosition_100NanoSecondUnits)
+{
+	//Set the start time to the seek position
+	PROPVARIANT varStart;
+	PropVariantInit(&varStart);
+	varStart.vt = VT_I8;
+	varStart.hVal.QuadPart = startPosition_100NanoSecondUnits;
+
+	//Start the session
+	return CurrentMediaSession->Start(&GUID_NULL, &varStart);
+}
+
+HRESULT MediaFoundationBackend::Pause()
+{
+	return CurrentMediaSession->Pause();
+}
+
+HRESULT MediaFoundationBackend::Stop()
+{
+	return CurrentMediaSession->Stop();
+}
+
+//Volume and Clock---------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT MediaFoundationBackend::GetVolumeService(IMFSimpleAudioVolume** outputVolumeService)
+{
+	//The service lives as long as the session, so it is only looked up once per session instead of on every call
+	std::lock_guard<std::mutex> lock(VolumeMutex);
+	if (VolumeService == nullptr)
+	{
+		if (CurrentMediaSession == nullptr)
+		{
+			return E_UNEXPECTED;
+		}
+		HRESULT hr = MFGetService(CurrentMediaSession, MR_POLICY_VOLUME_SERVICE, IID_PPV_ARGS(&VolumeService));
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+	}
+	return VolumeService.CopyTo(outputVolumeService);
+}
+
+HRESULT MediaFoundationBackend::SetVolume(float volumeLevel)
+{
+	//Get volume object
+	CComPtr<IMFSimpleAudioVolume> simpleAudioVolume;
+	HRESULT hr = GetVolumeService(&simpleAudioVolume);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Try to set volume
+	hr = simpleAudioVolume->SetMasterVolume(volumeLevel);
+	return hr;
+}
+
+HRESULT MediaFoundationBackend::RampVolume(float volumeLevel, UINT32 durationMilliseconds, GainRampCurve curve)
+{
+	//The SAR topology has no gain stage to ramp in, the level is set directly
+	return SetVolume(volumeLevel);
+}
+
+HRESULT MediaFoundationBackend::Fade(bool fadeIn, UINT32 durationMilliseconds, GainRampCurve curve)
+{
+	return E_NOTIMPL;
+}
+
+HRESULT MediaFoundationBackend::GetVolume(float& currentVolumeLevel)
+{
+	//Get volume object
+	CComPtr<IMFSimpleAudioVolume> simpleAudioVolume;
+	HRESULT hr = GetVolumeService(&simpleAudioVolume);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Try to retrieve the volume
+	hr = simpleAudioVolume->GetMasterVolume(&currentVolumeLevel);
+	return hr;
+}
+
+HRESULT MediaFoundationBackend::SetMute(bool isMuted)
+{
+	CComPtr<IMFSimpleAudioVolume> simpleAudioVolume;
+	HRESULT hr = GetVolumeService(&simpleAudioVolume);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	return simpleAudioVolume->SetMute(isMuted ? TRUE : FALSE);
+}
+
+HRESULT MediaFoundationBackend::GetMute(bool& isMuted)
+{
+	CComPtr<IMFSimpleAudioVolume> simpleAudioVolume;
+	HRESULT hr = GetVolumeService(&simpleAudioVolume);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	BOOL mute = FALSE;
+	hr = simpleAudioVolume->GetMute(&mute);
+	isMuted = mute != FALSE;
+	return hr;
+}
+
+HRESULT MediaFoundationBackend::SetNormalizationGain(float gain)
+{
+	//The audio renderer's volume is the user's volume, there is no second gain to apply normalization with
+	return gain == 1.0f ? S_OK : E_NOTIMPL;
+}
+
+HRESULT MediaFoundationBackend::GetPresentationTime(UINT64* presentationTime_100NanoSecondUnits)
+{
+	if (presentationTime_100NanoSecondUnits == nullptr)
+	{
+		return E_POINTER;
+	}
+	*presentationTime_100NanoSecondUnits = 0;
+
+	//The clock is cached once the topology is set. Before that (or once the session is closed), there is no clock.
+	std::lock_guard<std::mutex> lock(ClockMutex);
+	if (PresentationClock == nullptr)
+	{
+		return E_FAIL;
+	}
+
+	//Get the current time of the presentation
+	MFTIME currentPresentationTime = 0;
+	HRESULT hr = PresentationClock->GetTime(&currentPresentationTime);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	*presentationTime_100NanoSecondUnits = currentPresentationTime;
+	return hr;
+}
+
+double MediaFoundationBackend::GetPresentationRate()
+{
+	//The session always runs at the normal rate (the rate control is never used)
+	return 1.0;
+}
+
+HRESULT MediaFoundationBackend::GetRenderTelemetry(RenderTelemetrySnapshot* outputSnapshot)
+{
+	//The session's audio renderer runs its own buffers and doesn't tell how they are doing
+	if (outputSnapshot == nullptr)
+	{
+		return E_POINTER;
+	}
+	return E_NOTIMPL;
+}
+
+HRESULT MediaFoundationBackend::GetVisualizationTap(VisualizationTap** outputTap)
+{
+	//The samples go from the decoder straight into the audio renderer inside the session's topology, nothing renders them here
+	if (outputTap == nullptr)
+	{
+		return E_POINTER;
+	}
+	*outputTap = nullptr;
+	return E_NOTIMPL;
+}
+
+void MediaFoundationBackend::CachePresentationClock()
+{
+	//The session keeps the same clock for its whole lifetime, so this only runs for the first topology
+	std::lock_guard<std::mutex> lock(ClockMutex);
+	if (PresentationClock != nullptr || CurrentMediaSession == nullptr)
+	{
+		return;
+	}
+
+	//Get the media session's clock
+	CComPtr<IMFClock> mediaSessionClock;
+	HRESULT hr = CurrentMediaSession->GetClock(&mediaSessionClock);
+	if (FAILED(hr))
+	{
+		return;
+	}
+
+	//Query the media session clock for a presentation clock
+	mediaSessionClock->QueryInterface(IID_PPV_ARGS(&PresentationClock));
+}
+
+//IUnknown and IMFAsyncCallback Implementation Functions-------------------------------------------------------------------------------------------------------
+STDMETHODIMP_(ULONG) MediaFoundationBackend::Release()
+{
+	//Decrement the reference count (the owning player deletes the backend, so the object is never deleted here)
+	return InterlockedDecrement(&ReferenceCount);
+}
+
+STDMETHODIMP MediaFoundationBackend::GetParameters(DWORD* pdwFlags, DWORD* pdwQueue)
+{
+	return E_NOTIMPL;
+}
+
+STDMETHODIMP MediaFoundationBackend::QueryInterface(REFIID iid, void** ppv)
+{
+	static const QITAB qit[] =
+	{
+		QITABENT(MediaFoundationBackend, IMFAsyncCallback),
+		{ 0 }
+	};
+	return QISearch(this, qit, iid, ppv);
+}
+
+STDMETHODIMP_(ULONG) MediaFoundationBackend::AddRef()
+{
+	//Atomic Increment
+	return InterlockedIncrement(&ReferenceCount);
+}
+
+STDMETHODIMP MediaFoundationBackend::Invoke(IMFAsyncResult* pAsyncResult)
+{
+	//Dequeue an event from the event queue
+	CComPtr<IMFMediaEvent> event;
+	HRESULT hr = CurrentMediaSession->EndGetEvent(pAsyncResult, &event);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Retrieve the status of the operation that triggered the event (the player decides what a failure means)
+	HRESULT operationStatus = S_OK;
+	hr = event->GetStatus(&operationStatus);
+
+	//If getting the status itself failed, return that failure code
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Get the event type so it can be handled
+	MediaEventType eventType = MEUnknown;
+	hr = event->GetType(&eventType);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Translate the event for the player
+	BackendEventType backendEventType = BackendEventType::Unknown;
+	UINT64 eventValue = 0;
+	switch (eventType)
+	{
+	case MESessionClosed:
+		backendEventType = BackendEventType::SessionClosed;
+		break;
+
+	case MESessionTopologySet:
+	{
+		//The queued topology of a gapless transition isn't a newly opened file
+		std::lock_guard<std::mutex> lock(NextFileMutex);
+		if (!(NextTopologyQueued && GetEventTopologyId(event) == NextTopologyId))
+		{
+			backendEventType = BackendEventType::TopologySet;
+			std::lock_guard<std::mutex> openLock(OpenMutex);
+			eventValue = OpenedAudioFileDuration_100NanoSecondUnits;
+		}
+		if (SUCCEEDED(operationStatus))
+		{
+			CachePresentationClock();
+		}
+		break;
+	}
+
+	case MESessionTopologyStatus:
+	{
+		//The source of the queued topology starting is the moment of the gapless transition
+		UINT32 topologyStatus = MFGetAttributeUINT32(event, MF_EVENT_TOPOLOGY_STATUS, MF_TOPOSTATUS_INVALID);
+		std::lock_guard<std::mutex> lock(NextFileMutex);
+		if (topologyStatus == MF_TOPOSTATUS_STARTED_SOURCE && NextTopologyQueued && GetEventTopologyId(event) == NextTopologyId)
+		{
+			//The old source is done, the queued one becomes the current one
+			if (CurrentMediaSource != nullptr)
+			{
+				CurrentMediaSource->Shutdown();
+			}
+			CurrentMediaSource = NextMediaSource;
+			NextMediaSource = nullptr;
+			NextTopologyQueued = false;
+
+			backendEventType = BackendEventType::NextFileStarted;
+			eventValue = NextAudioFileDuration_100NanoSecondUnits;
+		}
+		break;
+	}
+
+	case MESessionStarted:
+		backendEventType = BackendEventType::SessionStarted;
+		break;
+
+	case MESessionPaused:
+		backendEventType = BackendEventType::SessionPaused;
+		break;
+
+	case MESessionStopped:
+		backendEventType = BackendEventType::SessionStopped;
+		break;
+
+	case MEEndOfPresentation:
+	{
+		//With a topology queued, the presentation continues with the next file
+		std::lock_guard<std::mutex> lock(NextFileMutex);
+		if (!NextTopologyQueued)
+		{
+			backendEventType = BackendEventType::EndOfPresentation;
+		}
+		break;
+	}
+
+	case MEAudioSessionVolumeChanged:
+		backendEventType = BackendEventType::VolumeChanged;
+		break;
+
+	default:
+		break;
+	}
+	Callback->OnBackendEvent(backendEventType, operationStatus, eventValue);
+
+	//Handle the next event if the session is not being closed (MESessionClosed is the final event)
+	if (eventType != MESessionClosed)
+	{
+		hr = CurrentMediaSession->BeginGetEvent(this, nullptr);
+		if (FAILED(hr))
+		{
+			assert(false);
+			return hr;
+		}
+	}
+
+	//Return a success code
+	return S_OK;
+}
+
+//Private Functions--------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT MediaFoundationBackend::LoadFile(PCWSTR inputFilePath, IMFMediaSource** outputSource, IMFTopology** outputTopology, UINT64* audioFileDuration_100NanoSecondUnits)
+{
+	//Create new media source with new input file
+	CComPtr<IMFMediaSource> newSource;
+	HRESULT hr = CreateMediaSource(inputFilePath, &newSource);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Retrieve the Presentation Descriptor for the file's media source
+	CComPtr<IMFPresentationDescriptor> presentationDescriptor;
+	hr = newSource->CreatePresentationDescriptor(&presentationDescriptor);
+	if (FAILED(hr))
+	{
+		newSource->Shutdown();
+		return hr;
+	}
+
+	//Use the presentation descriptor to get the file's audio duration
+	hr = presentationDescriptor->GetUINT64(MF_PD_DURATION, audioFileDuration_100NanoSecondUnits);
+	if (FAILED(hr))
+	{
+		newSource->Shutdown();
+		return hr;
+	}
+
+	//Use presentation descriptor to create Playback Topology
+	hr = CreatePlaybackTopology(newSource, presentationDescriptor, outputTopology);
+	if (FAILED(hr))
+	{
+		newSource->Shutdown();
+		return hr;
+	}
+
+	//Give the caller the source
+	*outputSource = newSource.Detach();
+	return hr;
+}
+
+HRESULT MediaFoundationBackend::CreateMediaSource(PCWSTR inputFilePath, IMFMediaSource** outputSource)
+{
+	//Create source resolver
+	CComPtr<IMFSourceResolver> sourceResolver;
+	HRESULT hr = MFCreateSourceResolver(&sourceResolver);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	/*
+	Synchrounously create the media source with the input file. This always runs on a background thread of OpenFile or
+	PrepareNextFile, and mapping the file blocks just as much as the resolver would, so its asynchronous version gains nothing.
+
+	The GUI can look at the "OpenPending" state and place a loading screen or something like that while
+	the media source is being created.
+	*/
+	CComPtr<IUnknown> source;
+	MF_OBJECT_TYPE objectType = MF_OBJECT_INVALID;
+
+	//Local files and buffers registered with MemoryMedia are read through a byte stream of their own (the URL still picks
+	//the byte stream handler by extension), anything else goes to the resolver as a URL
+	CComPtr<IMFByteStream> mappedByteStream;
+	HRESULT mappingResult = MappedFileByteStream::CreateInstance(inputFilePath, &mappedByteStream);
+	if (FAILED(mappingResult) && MemoryMedia::IsMemoryPath(inputFilePath))
+	{
+		return mappingResult;
+	}
+	if (SUCCEEDED(mappingResult))
+	{
+		hr = sourceResolver->CreateObjectFromByteStream(
+			mappedByteStream,          // Byte stream holding the file.
+			inputFilePath,             // URL of the source (a hint for the file type).
+			MF_RESOLUTION_MEDIASOURCE, // Create a source object.
+			nullptr,                   // Optional property store.
+			&objectType,               // Receives the created object type.
+			&source                    // Receives a pointer to the media source.
+		);
+	}
+	else
+	{
+		hr = sourceResolver->CreateObjectFromURL(
+			inputFilePath,             // URL of the source.
+			MF_RESOLUTION_MEDIASOURCE, // Create a source object.
+			nullptr,                    // Optional property store.
+			&objectType,            // Receives the created object type. 
+			&source                   // Receives a pointer to the media source.
+		);
+	}
+	
+	//A file that can't be resolved fails here (the library scanner probes arbitrary files, so this isn't asserted)
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Query and get the IMFMediaSource interface from the media source.
+	hr = source->QueryInterface(IID_PPV_ARGS(outputSource));
+	
+	//Return the final code
+	return hr;
+}
+
+HRESULT MediaFoundationBackend::GetPlayableAudioStream(IMFPresentationDescriptor* inputPresentationDescriptor, IMFStreamDescriptor** outputStreamDescriptor)
+{
+	//Ensure that there is only one stream in the file. If there is more than one stream, then the file is not supported at this time.
+	DWORD streamCount = 0;
+	HRESULT hr = inputPresentationDescriptor->GetStreamDescriptorCount(&streamCount);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	if (streamCount != 1)
+	{
+		return E_INVALIDARG;
+	}
+	
+	//Check if the single stream is audio by getting the stream descriptor
+	CComPtr<IMFStreamDescriptor> streamDescriptor;
+	BOOL selected = FALSE;
+	hr = inputPresentationDescriptor->GetStreamDescriptorByIndex(0, &selected, &streamDescriptor);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	
+	//Ensure that the stream is selected. If it isn't there are serious issues with playing the file.
+	if (!selected)
+	{
+		return E_FAIL;
+	}
+
+	//Check the media type by getting the media type handler and checking its major type. If it is non-audio, it is not supported
+	CComPtr<IMFMediaTypeHandler> mediaTypeHandler;
+	hr = streamDescriptor->GetMediaTypeHandler(&mediaTypeHandler);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	
+	GUID majorType;
+	hr = mediaTypeHandler->GetMajorType(&majorType);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	if (majorType != MFMediaType_Audio)
+	{
+		return E_INVALIDARG;
+	}
+
+	*outputStreamDescriptor = streamDescriptor.Detach();
+	return S_OK;
+}
+
+HRESULT MediaFoundationBackend::CreatePlaybackTopology(IMFMediaSource* inputSource, IMFPresentationDescriptor* inputPresentationDescriptor, IMFTopology** outputTopology)
+{
+	//Create an empty topology
+	CComPtr<IMFTopology> newTopology;
+	HRESULT hr = MFCreateTopology(&newTopology);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+	
+	//Ensure the file is a single, selected audio stream
+	CComPtr<IMFStreamDescriptor> streamDescriptor;
+	hr = GetPlayableAudioStream(inputPresentationDescriptor, &streamDescriptor);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Create media sink for SAR (Streaming Audio Renderer)
+	CComPtr<IMFActivate> mediaSinkActivationObject;
+	hr = MFCreateAudioRendererActivate(&mediaSinkActivationObject);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Add Source Node to the topology
+	CComPtr<IMFTopologyNode> sourceNode;
+	hr = AddSourceNode(newTopology, inputSource, inputPresentationDescriptor, streamDescriptor, &sourceNode);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Add Output Node to the topology
+	CComPtr<IMFTopologyNode> outputNode;
+	hr = AddOutputNode(newTopology, mediaSinkActivationObject, &outputNode);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Connect the source node to the output node
+	hr = sourceNode->ConnectOutput(0, outputNode, 0);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Give the caller the pointer to newTopology through the output parameter
+	*outputTopology = newTopology.Detach();
+	
+	//Return the final code
+	return hr;
+}
+
+
+HRESULT MediaFoundationBackend::AddSourceNode(IMFTopology* inputTopology, IMFMediaSource* inputSource, IMFPresentationDescriptor* inputPresentationDescriptor, IMFStreamDescriptor* inputStreamDescriptor, IMFTopologyNode** sourceNode)
+{
+	//Create the input node
+	CComPtr<IMFTopologyNode> newNode;
+	HRESULT hr = MFCreateTopologyNode(MF_TOPOLOGY_SOURCESTREAM_NODE, &newNode);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Load the media source, presentation descriptor, and stream descriptor into the node for the topology
+	hr = newNode->SetUnknown(MF_TOPONODE_SOURCE, inputSource);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+	
+	hr = newNode->SetUnknown(MF_TOPONODE_PRESENTATION_DESCRIPTOR, inputPresentationDescriptor);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+	
+	hr = newNode->SetUnknown(MF_TOPONODE_STREAM_DESCRIPTOR, inputStreamDescriptor);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Finally add the node to the topology
+	hr = inputTopology->AddNode(newNode);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Return the newNode pointer to caller through outputNode and return the final code
+	*sourceNode = newNode.Detach();
+	return hr;
+}
+
+HRESULT MediaFoundationBackend::AddOutputNode(IMFTopology* inputTopology, IMFActivate* inputMediaSinkActivationObject, IMFTopologyNode** outputNode)
+{
+	//Create the output node
+	CComPtr<IMFTopologyNode> newNode;
+	HRESULT hr = MFCreateTopologyNode(MF_TOPOLOGY_OUTPUT_NODE, &newNode);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Bind the media sink activation object to the output node
+	hr = newNode->SetObject(inputMediaSinkActivationObject);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Ensure that the node is shut down when the topology is swapped out
+	hr = newNode->SetUINT32(MF_TOPONODE_NOSHUTDOWN_ON_REMOVE, FALSE);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+	
+	//Finally add the node to the topology
+	hr = inputTopology->AddNode(newNode);
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+
+	//Return the newNode pointer to caller through outputNode and return the final code
+	*outputNode = newNode.Detach();
+	return hr;
+}
+
+#endif
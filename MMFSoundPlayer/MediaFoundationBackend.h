@@ -0,0 +1,117 @@
+#pragma once
+
+#ifdef _WIN32
+
+#include "AudioBackend.h"
+#include "BackgroundThreads.h"
+#include <mfidl.h>
+#include <atlbase.h>
+#include <mutex>
+#include <thread>
+
+namespace MMFSoundPlayerLib
+{
+	//Media Foundation implementation of the backend: an IMFMediaSession rendering to the SAR (Streaming Audio Renderer)
+	class MediaFoundationBackend : public IAudioBackend, public IMFAsyncCallback
+	{
+	private:
+		//Session datafields
+		CComPtr<IMFMediaSession> CurrentMediaSession;
+		CComPtr<IMFMediaSource> CurrentMediaSource;
+
+		//Presentation clock of the session, cached when the topology is set (guarded by ClockMutex)
+		std::mutex ClockMutex;
+		CComPtr<IMFPresentationClock> PresentationClock;
+
+		//Volume service of the session, fetched on first use (guarded by VolumeMutex)
+		std::mutex VolumeMutex;
+		CComPtr<IMFSimpleAudioVolume> VolumeService;
+
+		//Files given to OpenFile and PrepareNextFile are resolved on threads of their own, so a slow share holds up nothing.
+		//Only the latest call of each counts and closing the session drops both: the sequences change under OpenMutex and
+		//NextFileMutex, where the results are checked against them. The load threads only reach the backend through their
+		//gate, so shutdown can leave one stuck on a file behind.
+		BackgroundThreads LoadThreads;
+		std::mutex OpenMutex;
+		UINT64 OpenSequence;
+		UINT64 OpenedAudioFileDuration_100NanoSecondUnits;
+
+		//Source of the topology queued behind the current one for a gapless transition (guarded by NextFileMutex)
+		std::mutex NextFileMutex;
+		UINT64 PrepareSequence;
+		CComPtr<IMFMediaSource> NextMediaSource;
+		TOPOID NextTopologyId;
+		bool NextTopologyQueued;
+		UINT64 NextAudioFileDuration_100NanoSecondUnits;
+
+		//Receiver of the session events
+		IAudioBackendCallback* Callback;
+		bool IsStarted;
+
+		//Reference count for IUnknown (the backend is owned by the player, so this never deletes the object)
+		long ReferenceCount;
+
+		//Setup Functions (static, the load threads may outlive the backend)
+		static HRESULT LoadFile(PCWSTR inputFilePath, IMFMediaSource** outputSource, IMFTopology** outputTopology, UINT64* audioFileDuration_100NanoSecondUnits);
+		static HRESULT CreatePlaybackTopology(IMFMediaSource* inputSource, IMFPresentationDescriptor* inputPresentationDescriptor, IMFTopology** outputTopology);
+		static HRESULT AddSourceNode(IMFTopology* inputTopology, IMFMediaSource* inputSource, IMFPresentationDescriptor* inputPresentationDescriptor, IMFStreamDescriptor* inputStreamDescriptor, IMFTopologyNode** sourceNode);
+		static HRESULT AddOutputNode(IMFTopology* inputTopology, IMFActivate* inputMediaSinkActivationObject, IMFTopologyNode** outputNode);
+
+		//Background resolution and gapless transition functions
+		static void OpenFileInBackground(MediaFoundationBackend* backend, BackgroundGate& gate, std::wstring inputFilePath, UINT64 openSequence);
+		static void PreloadFile(MediaFoundationBackend* backend, BackgroundGate& gate, std::wstring inputFilePath, UINT64 prepareSequence);
+		void CancelBackgroundLoads();
+		void ClearNextFile();
+
+		//Clock and volume functions
+		void CachePresentationClock();
+		HRESULT GetVolumeService(IMFSimpleAudioVolume** outputVolumeService);
+
+	public:
+		MediaFoundationBackend();
+		~MediaFoundationBackend();
+
+		//Creates a Media Foundation backend (the player takes ownership)
+		static HRESULT CreateInstance(IAudioBackend** outputBackend);
+
+		//Source resolution and validation shared with metadata probing (the library scanner accepts exactly what can be played)
+		static HRESULT CreateMediaSource(PCWSTR inputFilePath, IMFMediaSource** outputSource);
+		static HRESULT GetPlayableAudioStream(IMFPresentationDescriptor* inputPresentationDescriptor, IMFStreamDescriptor** outputStreamDescriptor);
+
+		//IAudioBackend methods
+		HRESULT Startup(IAudioBackendCallback* inputCallback) override;
+		HRESULT Shutdown() override;
+		HRESULT CreateSession() override;
+		HRESULT CloseSession(bool* closeEventPending) override;
+		HRESULT ShutdownSession() override;
+		HRESULT OpenFile(PCWSTR inputFilePath) override;
+		HRESULT PrepareNextFile(PCWSTR inputFilePath) override;
+		HRESULT SetCrossfade(UINT32 durationMilliseconds) override;
+		HRESULT Start() override;
+		HRESULT StartAt(UINT64 startPosition_100NanoSecondUnits) override;
+		HRESULT Pause() override;
+		HRESULT Stop() override;
+		HRESULT SetVolume(float volumeLevel) override;
+		HRESULT RampVolume(float volumeLevel, UINT32 durationMilliseconds, GainRampCurve curve) override;
+		HRESULT Fade(bool fadeIn, UINT32 durationMilliseconds, GainRampCurve curve) override;
+		HRESULT GetVolume(float& currentVolumeLevel) override;
+		HRESULT SetMute(bool isMuted) override;
+		HRESULT GetMute(bool& isMuted) override;
+		HRESULT SetNormalizationGain(float gain) override;
+		HRESULT GetPresentationTime(UINT64* presentationTime_100NanoSecondUnits) override;
+		double GetPresentationRate() override;
+		HRESULT GetRenderTelemetry(RenderTelemetrySnapshot* outputSnapshot) override;
+		HRESULT GetVisualizationTap(VisualizationTap** outputTap) override;
+
+		//IMFAsyncCallback methods (required for handling of events)
+		STDMETHODIMP Invoke(IMFAsyncResult* pAsyncResult);
+		STDMETHODIMP GetParameters(DWORD* pdwFlags, DWORD* pdwQueue);
+
+		//IUnknown methods (required for IMFAsyncCallback)
+		STDMETHODIMP QueryInterface(REFIID iid, void** ppv);
+		STDMETHODIMP_(ULONG) AddRef();
+		STDMETHODIMP_(ULONG) Release();
+	};
+}
+
+#endif
@@ -0,0 +1,256 @@
+#ifdef _WIN32
+
+#include "MediaFoundationDecoder.h"
+#include "MediaFoundationBackend.h"
+#include <mfapi.h>
+#include <propvarutil.h>
+#include <algorithm>
+
+using namespace MMFSoundPlayerLib;
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+MediaFoundationDecoder::MediaFoundationDecoder()
+{
+	FrameCount = 0;
+	Duration_100NanoSecondUnits = 0;
+	PendingFramePosition = 0;
+	FramesToSkip = 0;
+	SeekTargetFrame = 0;
+	IsSeekPending = false;
+	IsEndOfStream = false;
+}
+
+HRESULT MediaFoundationDecoder::Open(PCWSTR inputFilePath)
+{
+	if (inputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//The source is created like the player's (reading through a mapping of the file), the reader shuts it down when released
+	CComPtr<IMFMediaSource> mediaSource;
+	HRESULT hr = MediaFoundationBackend::CreateMediaSource(inputFilePath, &mediaSource);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	hr = MFCreateSourceReaderFromMediaSource(mediaSource, nullptr, &Reader);
+	if (FAILED(hr))
+	{
+		mediaSource->Shutdown();
+		return hr;
+	}
+
+	//Only the first audio stream is decoded
+	hr = Reader->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
+	if (SUCCEEDED(hr))
+	{
+		hr = Reader->SetStreamSelection((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, TRUE);
+	}
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//The encoded format is reported as the file's format
+	CComPtr<IMFMediaType> nativeType;
+	hr = Reader->GetNativeMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &nativeType);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	Format.BitsPerSample = MFGetAttributeUINT32(nativeType, MF_MT_AUDIO_BITS_PER_SAMPLE, 0);
+	GUID nativeSubtype = GUID_NULL;
+	nativeType->GetGUID(MF_MT_SUBTYPE, &nativeSubtype);
+	Format.IsFloatingPoint = nativeSubtype == MFAudioFormat_Float;
+
+	//Have the reader insert the decoder and convert to float
+	CComPtr<IMFMediaType> floatType;
+	hr = MFCreateMediaType(&floatType);
+	if (SUCCEEDED(hr))
+	{
+		hr = floatType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+	}
+	if (SUCCEEDED(hr))
+	{
+		hr = floatType->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_Float);
+	}
+	if (SUCCEEDED(hr))
+	{
+		hr = Reader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, nullptr, floatType);
+	}
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	CComPtr<IMFMediaType> decodedType;
+	hr = Reader->GetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, &decodedType);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	Format.SampleRate = MFGetAttributeUINT32(decodedType, MF_MT_AUDIO_SAMPLES_PER_SECOND, 0);
+	Format.ChannelCount = MFGetAttributeUINT32(decodedType, MF_MT_AUDIO_NUM_CHANNELS, 0);
+	if (Format.SampleRate == 0 || Format.ChannelCount == 0)
+	{
+		return MF_E_INVALIDMEDIATYPE;
+	}
+
+	//The length is the container's (rounded to frames, compressed files may decode a few frames more or less)
+	PROPVARIANT durationValue;
+	PropVariantInit(&durationValue);
+	if (SUCCEEDED(Reader->GetPresentationAttribute((DWORD)MF_SOURCE_READER_MEDIASOURCE, MF_PD_DURATION, &durationValue)) && durationValue.vt == VT_UI8)
+	{
+		Duration_100NanoSecondUnits = durationValue.uhVal.QuadPart;
+		FrameCount = Duration_100NanoSecondUnits * Format.SampleRate / OneSecond_100NanoSecondUnits;
+	}
+	PropVariantClear(&durationValue);
+	return S_OK;
+}
+
+//Decoding-----------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT MediaFoundationDecoder::ReadNextSample()
+{
+	PendingFrames.clear();
+	PendingFramePosition = 0;
+
+	DWORD streamFlags = 0;
+	LONGLONG timestamp = 0;
+	CComPtr<IMFSample> sample;
+	HRESULT hr = Reader->ReadSample((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, nullptr, &streamFlags, &timestamp, &sample);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	if (streamFlags & MF_SOURCE_READERF_ENDOFSTREAM)
+	{
+		IsEndOfStream = true;
+		return S_OK;
+	}
+	if (sample == nullptr)
+	{
+		return S_OK;
+	}
+
+	CComPtr<IMFMediaBuffer> buffer;
+	hr = sample->ConvertToContiguousBuffer(&buffer);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	BYTE* data = nullptr;
+	DWORD dataLength = 0;
+	hr = buffer->Lock(&data, nullptr, &dataLength);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	const float* samples = (const float*)data;
+	PendingFrames.assign(samples, samples + dataLength / sizeof(float) / Format.ChannelCount * Format.ChannelCount);
+	buffer->Unlock();
+
+	//Drop what lies before the frame a seek asked for
+	if (IsSeekPending)
+	{
+		UINT64 sampleFrame = (UINT64)(timestamp > 0 ? timestamp : 0) * Format.SampleRate / OneSecond_100NanoSecondUnits;
+		FramesToSkip = SeekTargetFrame > sampleFrame ? SeekTargetFrame - sampleFrame : 0;
+		IsSeekPending = false;
+	}
+	if (FramesToSkip > 0)
+	{
+		UINT64 sampleFrames = PendingFrames.size() / Format.ChannelCount;
+		UINT64 framesSkipped = std::min(FramesToSkip, sampleFrames);
+		PendingFramePosition = (size_t)framesSkipped * Format.ChannelCount;
+		FramesToSkip -= framesSkipped;
+	}
+	return S_OK;
+}
+
+HRESULT MediaFoundationDecoder::ReadFrames(float* outputFrames, UINT32 frameCapacity, UINT32* framesRead)
+{
+	if (outputFrames == nullptr || framesRead == nullptr)
+	{
+		return E_POINTER;
+	}
+	*framesRead = 0;
+	if (Reader == nullptr)
+	{
+		return E_UNEXPECTED;
+	}
+
+	UINT32 totalFramesRead = 0;
+	while (totalFramesRead < frameCapacity)
+	{
+		if (PendingFramePosition >= PendingFrames.size())
+		{
+			if (IsEndOfStream)
+			{
+				break;
+			}
+			HRESULT hr = ReadNextSample();
+			if (FAILED(hr))
+			{
+				*framesRead = totalFramesRead;
+				return hr;
+			}
+			continue;
+		}
+
+		size_t framesAvailable = (PendingFrames.size() - PendingFramePosition) / Format.ChannelCount;
+		UINT32 framesToCopy = (UINT32)std::min<size_t>(framesAvailable, frameCapacity - totalFramesRead);
+		std::copy_n(PendingFrames.data() + PendingFramePosition, (size_t)framesToCopy * Format.ChannelCount, outputFrames + (size_t)totalFramesRead * Format.ChannelCount);
+		PendingFramePosition += (size_t)framesToCopy * Format.ChannelCount;
+		totalFramesRead += framesToCopy;
+	}
+
+	*framesRead = totalFramesRead;
+	return S_OK;
+}
+
+HRESULT MediaFoundationDecoder::SeekToFrame(UINT64 frameIndex)
+{
+	if (Reader == nullptr)
+	{
+		return E_UNEXPECTED;
+	}
+
+	PROPVARIANT position;
+	HRESULT hr = InitPropVariantFromInt64((LONGLONG)(frameIndex * OneSecond_100NanoSecondUnits / Format.SampleRate), &position);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	hr = Reader->SetCurrentPosition(GUID_NULL, position);
+	PropVariantClear(&position);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//The reader lands on the packet holding the position or before it, the first sample read tells how far before
+	PendingFrames.clear();
+	PendingFramePosition = 0;
+	IsEndOfStream = false;
+	IsSeekPending = true;
+	SeekTargetFrame = frameIndex;
+	return S_OK;
+}
+
+//Getters------------------------------------------------------------------------------------------------------------------------------------------------------
+AudioFormat MediaFoundationDecoder::GetFormat()
+{
+	return Format;
+}
+
+UINT64 MediaFoundationDecoder::GetFrameCount()
+{
+	return FrameCount;
+}
+
+UINT64 MediaFoundationDecoder::GetDuration_100NanoSecondUnits()
+{
+	return Duration_100NanoSecondUnits;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#ifdef _WIN32
+
+#include "AudioBackend.h"
+#include <mfreadwrite.h>
+#include <atlbase.h>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Decoder for everything Media Foundation can play (MP3, AAC, WMA, FLAC...), through a source reader that decodes the
+	first audio stream to float. Compressed formats only seek to the nearest packet, so reading after SeekToFrame
+	drops the frames decoded ahead of the requested one. The thread needs COM and MFStartup for as long as the decoder lives.
+	*/
+	class MediaFoundationDecoder : public IAudioDecoder
+	{
+	private:
+		CComPtr<IMFSourceReader> Reader;
+		AudioFormat Format;
+		UINT64 FrameCount;
+		UINT64 Duration_100NanoSecondUnits;
+
+		//Decoded frames of the last sample that weren't read yet
+		std::vector<float> PendingFrames;
+		size_t PendingFramePosition;
+		bool IsEndOfStream;
+
+		//Frames decoded ahead of the frame a seek asked for, dropped while reading
+		UINT64 SeekTargetFrame;
+		bool IsSeekPending;
+		UINT64 FramesToSkip;
+
+		HRESULT ReadNextSample();
+
+	public:
+		MediaFoundationDecoder();
+
+		//Open the file and configure the reader to decode its first audio stream to float
+		HRESULT Open(PCWSTR inputFilePath);
+
+		//IAudioDecoder methods
+		AudioFormat GetFormat() override;
+		UINT64 GetFrameCount() override;
+		UINT64 GetDuration_100NanoSecondUnits() override;
+		HRESULT ReadFrames(float* outputFrames, UINT32 frameCapacity, UINT32* framesRead) override;
+		HRESULT SeekToFrame(UINT64 frameIndex) override;
+	};
+}
+
+#endif
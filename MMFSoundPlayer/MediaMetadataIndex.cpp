@@ -0,0 +1,371 @@
+#include "MediaMetadataIndex.h"
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+using namespace MMFSoundPlayerLib;
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+MediaMetadataIndex::MediaMetadataIndex(PCWSTR inputIndexFilePath)
+{
+	IndexFilePath = inputIndexFilePath;
+	MappedEntries = nullptr;
+	MappedEntryCount = 0;
+	MappedStrings = nullptr;
+	MappedStringsSize = 0;
+}
+
+HRESULT MediaMetadataIndex::CreateInstance(PCWSTR indexFilePath, MediaMetadataIndex** outputIndex)
+{
+	//Ensure that the pointers actually point somewhere
+	if (indexFilePath == nullptr || outputIndex == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULT can be returned
+	MediaMetadataIndex* newIndex = new (std::nothrow) MediaMetadataIndex(indexFilePath);
+	if (newIndex == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	//Whatever is wrong with the existing file (usually there is none yet), the index still works (empty) and Save writes a good one
+	newIndex->MapIndexFile();
+
+	*outputIndex = newIndex;
+	return S_OK;
+}
+
+HRESULT MediaMetadataIndex::MapIndexFile()
+{
+	HRESULT hr = MappedIndex.Open(IndexFilePath.c_str());
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Validate the header and that every section fits inside of the file
+	const unsigned char* data = MappedIndex.GetData();
+	UINT64 size = MappedIndex.GetSize();
+	IndexHeader header;
+	if (size < sizeof(IndexHeader))
+	{
+		UnmapIndexFile();
+		return E_INVALIDARG;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	UINT64 entriesSize = (UINT64)header.EntryCount * sizeof(IndexEntry);
+	if (header.Magic != IndexMagic || header.Version != IndexVersion || size - sizeof(IndexHeader) < entriesSize || size - sizeof(IndexHeader) - entriesSize < header.StringTableSize)
+	{
+		UnmapIndexFile();
+		return E_INVALIDARG;
+	}
+
+	//The mapping is page aligned and the header keeps the entries 8 byte aligned, so they are used in place
+	MappedEntries = (const IndexEntry*)(data + sizeof(IndexHeader));
+	MappedEntryCount = header.EntryCount;
+	MappedStrings = (const char*)(data + sizeof(IndexHeader) + entriesSize);
+	MappedStringsSize = header.StringTableSize;
+	return S_OK;
+}
+
+void MediaMetadataIndex::UnmapIndexFile()
+{
+	MappedIndex.Close();
+	MappedEntries = nullptr;
+	MappedEntryCount = 0;
+	MappedStrings = nullptr;
+	MappedStringsSize = 0;
+}
+
+//Lookup-------------------------------------------------------------------------------------------------------------------------------------------------------
+UINT64 MediaMetadataIndex::HashPath(const std::string& narrowPath)
+{
+	//FNV-1a
+	UINT64 hash = 0xCBF29CE484222325ull;
+	for (char character : narrowPath)
+	{
+		hash ^= (unsigned char)character;
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+void MediaMetadataIndex::ReadEntryMetadata(const IndexEntry& inputEntry, MediaFileMetadata* outputMetadata)
+{
+	outputMetadata->Duration_100NanoSecondUnits = inputEntry.Duration_100NanoSecondUnits;
+	outputMetadata->FileSize = inputEntry.FileSize;
+	outputMetadata->ModifiedTime = inputEntry.ModifiedTime;
+	outputMetadata->SampleRate = inputEntry.SampleRate;
+	outputMetadata->ChannelCount = inputEntry.ChannelCount;
+	outputMetadata->BitsPerSample = inputEntry.BitsPerSample;
+	outputMetadata->Codec = inputEntry.Codec;
+}
+
+bool MediaMetadataIndex::FindMappedEntry(const std::string& narrowPath, UINT64 pathHash, MediaFileMetadata* outputMetadata)
+{
+	//Binary search for the first entry with the hash, then compare paths through the (usually single) entry with it
+	const IndexEntry* entriesEnd = MappedEntries + MappedEntryCount;
+	const IndexEntry* entry = std::lower_bound(MappedEntries, entriesEnd, pathHash, [](const IndexEntry& existingEntry, UINT64 hash)
+		{
+			return existingEntry.PathHash < hash;
+		});
+
+	for (; entry != entriesEnd && entry->PathHash == pathHash; entry++)
+	{
+		if ((UINT64)entry->PathOffset + entry->PathLength > MappedStringsSize)
+		{
+			continue;
+		}
+		if (entry->PathLength == narrowPath.size() && memcmp(MappedStrings + entry->PathOffset, narrowPath.data(), narrowPath.size()) == 0)
+		{
+			ReadEntryMetadata(*entry, outputMetadata);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool MediaMetadataIndex::FindEntry(const std::string& narrowPath, MediaFileMetadata* outputMetadata)
+{
+	//Entries updated since the last save take precedence over the saved ones
+	auto updatedEntry = UpdatedEntries.find(narrowPath);
+	if (updatedEntry != UpdatedEntries.end())
+	{
+		*outputMetadata = updatedEntry->second;
+		return true;
+	}
+	return FindMappedEntry(narrowPath, HashPath(narrowPath), outputMetadata);
+}
+
+HRESULT MediaMetadataIndex::Lookup(PCWSTR inputFilePath, MediaFileMetadata* outputMetadata)
+{
+	if (inputFilePath == nullptr || outputMetadata == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//The entry only counts if the file is still the one that was indexed
+	UINT64 fileSize = 0;
+	INT64 modifiedTime = 0;
+	HRESULT hr = GetFileSizeAndModifiedTime(inputFilePath, &fileSize, &modifiedTime);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	MediaFileMetadata indexedMetadata;
+	{
+		std::shared_lock<std::shared_mutex> lock(IndexMutex);
+		if (!FindEntry(ConvertWidePathToNarrow(inputFilePath), &indexedMetadata))
+		{
+			return S_FALSE;
+		}
+	}
+
+	if (indexedMetadata.FileSize != fileSize || indexedMetadata.ModifiedTime != modifiedTime)
+	{
+		return S_FALSE;
+	}
+	*outputMetadata = indexedMetadata;
+	return S_OK;
+}
+
+HRESULT MediaMetadataIndex::LookupWithoutChecking(PCWSTR inputFilePath, MediaFileMetadata* outputMetadata)
+{
+	if (inputFilePath == nullptr || outputMetadata == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	std::shared_lock<std::shared_mutex> lock(IndexMutex);
+	return FindEntry(ConvertWidePathToNarrow(inputFilePath), outputMetadata) ? S_OK : S_FALSE;
+}
+
+HRESULT MediaMetadataIndex::Refresh(PCWSTR inputFilePath, MediaFileMetadata* outputMetadata)
+{
+	if (inputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Nothing to do for a file that hasn't changed
+	MediaFileMetadata metadata;
+	HRESULT hr = Lookup(inputFilePath, &metadata);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	if (hr == S_FALSE)
+	{
+		//Probe outside of the lock, it is by far the slowest part
+		hr = ProbeMediaFile(inputFilePath, &metadata);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+
+		std::unique_lock<std::shared_mutex> lock(IndexMutex);
+		UpdatedEntries[ConvertWidePathToNarrow(inputFilePath)] = metadata;
+		hr = S_OK;
+	}
+	else
+	{
+		hr = S_FALSE;
+	}
+
+	if (outputMetadata != nullptr)
+	{
+		*outputMetadata = metadata;
+	}
+	return hr;
+}
+
+UINT64 MediaMetadataIndex::GetEntryCount()
+{
+	std::shared_lock<std::shared_mutex> lock(IndexMutex);
+	UINT64 entryCount = MappedEntryCount;
+	for (const auto& updatedEntry : UpdatedEntries)
+	{
+		MediaFileMetadata savedMetadata;
+		if (!FindMappedEntry(updatedEntry.first, HashPath(updatedEntry.first), &savedMetadata))
+		{
+			entryCount++;
+		}
+	}
+	return entryCount;
+}
+
+//Saving-------------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT MediaMetadataIndex::Save()
+{
+	//Lookups wait while the index is rewritten, saving is rare (after a library scan) so that is fine
+	std::unique_lock<std::shared_mutex> lock(IndexMutex);
+	if (UpdatedEntries.empty() && MappedEntries != nullptr)
+	{
+		return S_FALSE;
+	}
+
+	//Gather the saved entries that weren't updated, then the updated ones
+	struct PendingEntry
+	{
+		UINT64 PathHash;
+		std::string Path;
+		MediaFileMetadata Metadata;
+	};
+	std::vector<PendingEntry> pendingEntries;
+	pendingEntries.reserve((size_t)MappedEntryCount + UpdatedEntries.size());
+
+	for (UINT32 index = 0; index < MappedEntryCount; index++)
+	{
+		const IndexEntry& entry = MappedEntries[index];
+		if ((UINT64)entry.PathOffset + entry.PathLength > MappedStringsSize)
+		{
+			continue;
+		}
+
+		PendingEntry pendingEntry;
+		pendingEntry.PathHash = entry.PathHash;
+		pendingEntry.Path.assign(MappedStrings + entry.PathOffset, entry.PathLength);
+		if (UpdatedEntries.find(pendingEntry.Path) != UpdatedEntries.end())
+		{
+			continue;
+		}
+		ReadEntryMetadata(entry, &pendingEntry.Metadata);
+		pendingEntries.push_back(std::move(pendingEntry));
+	}
+	for (const auto& updatedEntry : UpdatedEntries)
+	{
+		pendingEntries.push_back({ HashPath(updatedEntry.first), updatedEntry.first, updatedEntry.second });
+	}
+
+	std::sort(pendingEntries.begin(), pendingEntries.end(), [](const PendingEntry& first, const PendingEntry& second)
+		{
+			return first.PathHash != second.PathHash ? first.PathHash < second.PathHash : first.Path < second.Path;
+		});
+
+	//Lay out the entries and the string table
+	std::vector<IndexEntry> entries(pendingEntries.size());
+	std::string strings;
+	for (size_t index = 0; index < pendingEntries.size(); index++)
+	{
+		const PendingEntry& pendingEntry = pendingEntries[index];
+		if (strings.size() + pendingEntry.Path.size() > UINT32_MAX)
+		{
+			return E_OUTOFMEMORY;
+		}
+
+		IndexEntry& entry = entries[index];
+		memset(&entry, 0, sizeof(entry));
+		entry.PathHash = pendingEntry.PathHash;
+		entry.PathOffset = (UINT32)strings.size();
+		entry.PathLength = (UINT32)pendingEntry.Path.size();
+		entry.Duration_100NanoSecondUnits = pendingEntry.Metadata.Duration_100NanoSecondUnits;
+		entry.FileSize = pendingEntry.Metadata.FileSize;
+		entry.ModifiedTime = pendingEntry.Metadata.ModifiedTime;
+		entry.SampleRate = pendingEntry.Metadata.SampleRate;
+		entry.Codec = pendingEntry.Metadata.Codec;
+		entry.ChannelCount = (UINT16)pendingEntry.Metadata.ChannelCount;
+		entry.BitsPerSample = (UINT16)pendingEntry.Metadata.BitsPerSample;
+		strings += pendingEntry.Path;
+	}
+
+	IndexHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Magic = IndexMagic;
+	header.Version = IndexVersion;
+	header.EntryCount = (UINT32)entries.size();
+	header.StringTableSize = strings.size();
+
+	//Write the new index next to the old one, so a failure leaves the old one intact
+	std::wstring temporaryFilePath = IndexFilePath + L".tmp";
+	FILE* file = OpenFileWithWidePath(temporaryFilePath.c_str(), "wb");
+	if (file == nullptr)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (written && !entries.empty())
+	{
+		written = fwrite(entries.data(), sizeof(IndexEntry), entries.size(), file) == entries.size();
+	}
+	if (written && !strings.empty())
+	{
+		written = fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+	}
+	if (fclose(file) != 0)
+	{
+		written = false;
+	}
+	if (!written)
+	{
+		RemoveFileWithWidePath(temporaryFilePath.c_str());
+		return E_FAIL;
+	}
+
+	//The old index has to be unmapped before it can be replaced (Windows refuses to replace a mapped file)
+	UnmapIndexFile();
+	HRESULT hr = ReplaceFileWithWidePath(temporaryFilePath.c_str(), IndexFilePath.c_str());
+	if (FAILED(hr))
+	{
+		//Keep using the old index, the updates stay in memory
+		assert(false);
+		MapIndexFile();
+		return hr;
+	}
+
+	hr = MapIndexFile();
+	if (FAILED(hr))
+	{
+		assert(false);
+		return hr;
+	}
+	UpdatedEntries.clear();
+	return S_OK;
+}
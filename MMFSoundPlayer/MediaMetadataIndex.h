@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Platform.h"
+#include "MediaProbe.h"
+#include "MemoryMappedFile.h"
+#include <string>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Persistent index of media file metadata, so a library of hundreds of thousands of files doesn't have to be resolved
+	again every time it is shown. The index file is memory mapped and searched in place (nothing is parsed at load), so
+	opening it costs one mapping no matter how large the library is.
+
+	File layout (native little endian):
+	  Header       Magic 'MMFI', Version, EntryCount, StringTableSize
+	  Entries      EntryCount fixed size records sorted by (PathHash, path)
+	  String table UTF-8 paths referenced by the entries (not terminated)
+
+	Refresh compares a file's size and modification time with its entry and only probes files that are new or changed.
+	Those results live in memory until Save writes a new index file next to the old one and swaps it in.
+	Lookup and Refresh can be called from any number of threads at once.
+	*/
+	class MediaMetadataIndex
+	{
+	public:
+		static constexpr UINT32 IndexMagic = 0x49464D4D; // "MMFI"
+		static constexpr UINT32 IndexVersion = 1;
+
+	private:
+#pragma pack(push, 1)
+		struct IndexHeader
+		{
+			UINT32 Magic;
+			UINT32 Version;
+			UINT32 EntryCount;
+			UINT32 Reserved;
+			UINT64 StringTableSize;
+		};
+
+		struct IndexEntry
+		{
+			UINT64 PathHash;
+			UINT32 PathOffset;
+			UINT32 PathLength;
+			UINT64 Duration_100NanoSecondUnits;
+			UINT64 FileSize;
+			INT64 ModifiedTime;
+			UINT32 SampleRate;
+			UINT32 Codec;
+			UINT16 ChannelCount;
+			UINT16 BitsPerSample;
+			UINT32 Reserved;
+		};
+#pragma pack(pop)
+
+		std::wstring IndexFilePath;
+
+		//The saved index (read only) and the entries added or updated since (keyed by UTF-8 path)
+		std::shared_mutex IndexMutex;
+		MemoryMappedFile MappedIndex;
+		const IndexEntry* MappedEntries;
+		UINT32 MappedEntryCount;
+		const char* MappedStrings;
+		UINT64 MappedStringsSize;
+		std::unordered_map<std::string, MediaFileMetadata> UpdatedEntries;
+
+		MediaMetadataIndex(PCWSTR inputIndexFilePath);
+
+		HRESULT MapIndexFile();
+		void UnmapIndexFile();
+		bool FindMappedEntry(const std::string& narrowPath, UINT64 pathHash, MediaFileMetadata* outputMetadata);
+		bool FindEntry(const std::string& narrowPath, MediaFileMetadata* outputMetadata);
+		static UINT64 HashPath(const std::string& narrowPath);
+		static void ReadEntryMetadata(const IndexEntry& inputEntry, MediaFileMetadata* outputMetadata);
+
+	public:
+		//Open the index stored at indexFilePath. A missing file gives an empty index, a corrupt one is ignored (and replaced by Save).
+		static HRESULT CreateInstance(PCWSTR indexFilePath, MediaMetadataIndex** outputIndex);
+
+		/*
+		Metadata of a file that is indexed and unchanged on disk (size and modification time match). Returns S_OK, or S_FALSE
+		if the file isn't indexed or changed since. Doesn't touch the file's contents.
+		*/
+		HRESULT Lookup(PCWSTR inputFilePath, MediaFileMetadata* outputMetadata);
+
+		//Metadata as it was when the file was indexed, without checking the file (no stat, so it never waits on a slow share).
+		//Returns S_OK, or S_FALSE if the file isn't indexed. Only good as a first guess until the file itself is opened.
+		HRESULT LookupWithoutChecking(PCWSTR inputFilePath, MediaFileMetadata* outputMetadata);
+
+		//Like Lookup, but a new or changed file is probed and its entry updated. Returns S_FALSE if the entry was current.
+		HRESULT Refresh(PCWSTR inputFilePath, MediaFileMetadata* outputMetadata = nullptr);
+
+		//Write every entry (saved and updated) to a new index file and swap it in
+		HRESULT Save();
+
+		//Number of saved entries plus the ones added since
+		UINT64 GetEntryCount();
+	};
+}
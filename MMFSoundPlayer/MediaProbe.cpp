@@ -0,0 +1,171 @@
+#include "MediaProbe.h"
+#include "WavFileDecoder.h"
+#include <memory>
+
+#ifdef _WIN32
+#include "MediaFoundationBackend.h"
+#include "MediaFoundationDecoder.h"
+#include <mfapi.h>
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+#ifdef _WIN32
+//Reads the presentation descriptor and the audio stream's media type of a resolved source
+static HRESULT ReadSourceMetadata(IMFMediaSource* inputSource, MediaFileMetadata* outputMetadata)
+{
+	CComPtr<IMFPresentationDescriptor> presentationDescriptor;
+	HRESULT hr = inputSource->CreatePresentationDescriptor(&presentationDescriptor);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	hr = presentationDescriptor->GetUINT64(MF_PD_DURATION, &outputMetadata->Duration_100NanoSecondUnits);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Only files the player can play are worth indexing
+	CComPtr<IMFStreamDescriptor> streamDescriptor;
+	hr = MediaFoundationBackend::GetPlayableAudioStream(presentationDescriptor, &streamDescriptor);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	CComPtr<IMFMediaTypeHandler> mediaTypeHandler;
+	hr = streamDescriptor->GetMediaTypeHandler(&mediaTypeHandler);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	CComPtr<IMFMediaType> mediaType;
+	hr = mediaTypeHandler->GetCurrentMediaType(&mediaType);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Audio subtypes are the WAVE format tag (or FOURCC) in the first field of a base GUID
+	GUID subtype = GUID_NULL;
+	if (SUCCEEDED(mediaType->GetGUID(MF_MT_SUBTYPE, &subtype)))
+	{
+		outputMetadata->Codec = subtype.Data1;
+	}
+	outputMetadata->SampleRate = MFGetAttributeUINT32(mediaType, MF_MT_AUDIO_SAMPLES_PER_SECOND, 0);
+	outputMetadata->ChannelCount = MFGetAttributeUINT32(mediaType, MF_MT_AUDIO_NUM_CHANNELS, 0);
+	outputMetadata->BitsPerSample = MFGetAttributeUINT32(mediaType, MF_MT_AUDIO_BITS_PER_SAMPLE, 0);
+	return S_OK;
+}
+
+static HRESULT ProbeWithMediaFoundation(PCWSTR inputFilePath, MediaFileMetadata* outputMetadata)
+{
+	//Resolving a source needs COM and Media Foundation on this thread (both are reference counted, so this nests fine)
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	bool comInitialized = SUCCEEDED(hr);
+
+	hr = MFStartup(MF_VERSION, MFSTARTUP_LITE);
+	if (FAILED(hr))
+	{
+		if (comInitialized)
+		{
+			CoUninitialize();
+		}
+		return hr;
+	}
+
+	{
+		//Resolve the source the same way playback does
+		CComPtr<IMFMediaSource> mediaSource;
+		hr = MediaFoundationBackend::CreateMediaSource(inputFilePath, &mediaSource);
+		if (SUCCEEDED(hr))
+		{
+			hr = ReadSourceMetadata(mediaSource, outputMetadata);
+			mediaSource->Shutdown();
+		}
+	}
+
+	MFShutdown();
+	if (comInitialized)
+	{
+		CoUninitialize();
+	}
+	return hr;
+}
+#endif
+
+HRESULT MMFSoundPlayerLib::ProbeMediaFile(PCWSTR inputFilePath, MediaFileMetadata* outputMetadata)
+{
+	if (inputFilePath == nullptr || outputMetadata == nullptr)
+	{
+		return E_POINTER;
+	}
+	*outputMetadata = MediaFileMetadata();
+
+	//Size and modification time tell whether the metadata is still current later on
+	HRESULT hr = GetFileSizeAndModifiedTime(inputFilePath, &outputMetadata->FileSize, &outputMetadata->ModifiedTime);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+#ifdef _WIN32
+	hr = ProbeWithMediaFoundation(inputFilePath, outputMetadata);
+#else
+	//The headless backend plays WAV files, so that is all there is to probe
+	WavFileDecoder decoder;
+	hr = decoder.Open(inputFilePath);
+	if (SUCCEEDED(hr))
+	{
+		AudioFormat format = decoder.GetFormat();
+		outputMetadata->Duration_100NanoSecondUnits = decoder.GetDuration_100NanoSecondUnits();
+		outputMetadata->SampleRate = format.SampleRate;
+		outputMetadata->ChannelCount = format.ChannelCount;
+		outputMetadata->BitsPerSample = format.BitsPerSample;
+		outputMetadata->Codec = format.IsFloatingPoint ? 0x0003 : 0x0001;
+	}
+#endif
+
+	return hr;
+}
+
+HRESULT MMFSoundPlayerLib::OpenAudioFileDecoder(PCWSTR inputFilePath, IAudioDecoder** outputDecoder)
+{
+	if (inputFilePath == nullptr || outputDecoder == nullptr)
+	{
+		return E_POINTER;
+	}
+	*outputDecoder = nullptr;
+
+	//WAV files are read directly, sample exact and without any decoder in between
+	std::unique_ptr<WavFileDecoder> wavDecoder(new (std::nothrow) WavFileDecoder());
+	if (wavDecoder == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	HRESULT hr = wavDecoder->Open(inputFilePath);
+	if (SUCCEEDED(hr))
+	{
+		*outputDecoder = wavDecoder.release();
+		return hr;
+	}
+
+#ifdef _WIN32
+	//Anything else Media Foundation can decode
+	std::unique_ptr<MediaFoundationDecoder> mediaFoundationDecoder(new (std::nothrow) MediaFoundationDecoder());
+	if (mediaFoundationDecoder == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	hr = mediaFoundationDecoder->Open(inputFilePath);
+	if (SUCCEEDED(hr))
+	{
+		*outputDecoder = mediaFoundationDecoder.release();
+	}
+#endif
+
+	return hr;
+}
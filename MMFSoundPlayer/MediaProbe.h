@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Platform.h"
+#include "AudioBackend.h"
+
+namespace MMFSoundPlayerLib
+{
+	//What the library needs to know about a media file without playing it
+	struct MediaFileMetadata
+	{
+		UINT64 Duration_100NanoSecondUnits = 0;
+		UINT64 FileSize = 0;
+		INT64 ModifiedTime = 0;
+		UINT32 SampleRate = 0;
+		UINT32 ChannelCount = 0;
+		UINT32 BitsPerSample = 0;   // 0 for compressed formats
+		UINT32 Codec = 0;           // WAVE format tag (1 = PCM, 3 = IEEE float, 0x55 = MP3, 0x1610 = AAC, 0xF1AC = FLAC...)
+	};
+
+	/*
+	Read the metadata of a file by opening just its container: Media Foundation's source resolver and presentation
+	descriptor on Windows (no topology, no session), the WAV header elsewhere. Callable from any thread.
+	*/
+	HRESULT ProbeMediaFile(PCWSTR inputFilePath, MediaFileMetadata* outputMetadata);
+
+	/*
+	Open a decoder for offline processing of a file (analysis, not playback): WAV files are decoded directly, everything
+	else through a Media Foundation source reader on Windows. The caller owns the decoder. On Windows, the calling thread
+	needs COM and MFStartup for as long as the decoder lives.
+	*/
+	HRESULT OpenAudioFileDecoder(PCWSTR inputFilePath, IAudioDecoder** outputDecoder);
+}
@@ -0,0 +1,51 @@
+#include "MediaRuntime.h"
+#include <mutex>
+
+#ifdef _WIN32
+#include <mfapi.h>
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+//Starting and shutting down happen under the lock, a reference taken while the runtime shuts down waits for it to start again
+static std::mutex RuntimeMutex;
+static UINT32 RuntimeReferenceCount = 0;
+
+HRESULT MediaRuntime::AddRef()
+{
+	std::lock_guard<std::mutex> lock(RuntimeMutex);
+	if (RuntimeReferenceCount == 0)
+	{
+#ifdef _WIN32
+		HRESULT hr = MFStartup(MF_VERSION);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+#endif
+	}
+	RuntimeReferenceCount++;
+	return S_OK;
+}
+
+void MediaRuntime::Release()
+{
+	std::lock_guard<std::mutex> lock(RuntimeMutex);
+	if (RuntimeReferenceCount == 0)
+	{
+		return;
+	}
+	RuntimeReferenceCount--;
+#ifdef _WIN32
+	if (RuntimeReferenceCount == 0)
+	{
+		MFShutdown();
+	}
+#endif
+}
+
+UINT32 MediaRuntime::GetReferenceCount()
+{
+	std::lock_guard<std::mutex> lock(RuntimeMutex);
+	return RuntimeReferenceCount;
+}
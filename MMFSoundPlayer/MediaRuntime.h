@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Platform.h"
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Process-wide Media Foundation runtime shared by every backend: the first reference starts it (MFStartup), the last one
+	shuts it down (MFShutdown). Holding a reference across player lifetimes, as PlayerPool does, keeps the runtime from
+	being started and shut down again for every player. Without Media Foundation the references are only counted.
+	All functions are thread-safe.
+	*/
+	namespace MediaRuntime
+	{
+		HRESULT AddRef();
+		void Release();
+		UINT32 GetReferenceCount();
+	}
+}
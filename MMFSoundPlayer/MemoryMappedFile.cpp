@@ -0,0 +1,270 @@
+#include "MemoryMappedFile.h"
+#include "MemoryMedia.h"
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+//Read-ahead ranges start on this boundary, a multiple of the page size everywhere
+static const UINT64 ReadAheadAlignment = 64 * 1024;
+
+MemoryMappedFile::MemoryMappedFile()
+{
+	Data = nullptr;
+	Size = 0;
+	IsMemoryBuffer = false;
+	ReadAheadStart = 0;
+	ReadAheadEnd = 0;
+#ifdef _WIN32
+	FileHandle = INVALID_HANDLE_VALUE;
+	MappingHandle = nullptr;
+#else
+	FileDescriptor = -1;
+#endif
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+	Close();
+}
+
+HRESULT MemoryMappedFile::Open(PCWSTR inputFilePath)
+{
+	if (inputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+	Close();
+
+	//Buffers in memory are only viewed
+	if (MemoryMedia::IsMemoryPath(inputFilePath))
+	{
+		MemoryMediaBuffer buffer;
+		HRESULT hr = MemoryMedia::Find(inputFilePath, &buffer);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+		Data = buffer.Data;
+		Size = buffer.Size;
+		BufferOwner = std::move(buffer.Owner);
+		IsMemoryBuffer = true;
+		return S_OK;
+	}
+
+#ifdef _WIN32
+	//Allow others to keep reading (and replacing) the file while it is mapped
+	FileHandle = CreateFileW(inputFilePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (FileHandle == INVALID_HANDLE_VALUE)
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(FileHandle, &fileSize))
+	{
+		HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+		Close();
+		return hr;
+	}
+	Size = (UINT64)fileSize.QuadPart;
+
+	//A zero length file can't be mapped, but it is still a valid (empty) file
+	if (Size == 0)
+	{
+		return S_OK;
+	}
+
+	MappingHandle = CreateFileMappingW(FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (MappingHandle == nullptr)
+	{
+		HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+		Close();
+		return hr;
+	}
+
+	Data = (const unsigned char*)MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (Data == nullptr)
+	{
+		HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+		Close();
+		return hr;
+	}
+#else
+	FileDescriptor = open(ConvertWidePathToNarrow(inputFilePath).c_str(), O_RDONLY | O_CLOEXEC);
+	if (FileDescriptor < 0)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+
+	struct stat attributes;
+	if (fstat(FileDescriptor, &attributes) != 0)
+	{
+		HRESULT hr = GetLastFileErrorAsHRESULT();
+		Close();
+		return hr;
+	}
+	Size = (UINT64)attributes.st_size;
+
+	//A zero length file can't be mapped, but it is still a valid (empty) file
+	if (Size == 0)
+	{
+		return S_OK;
+	}
+
+	void* mapping = mmap(nullptr, (size_t)Size, PROT_READ, MAP_SHARED, FileDescriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		HRESULT hr = GetLastFileErrorAsHRESULT();
+		Close();
+		return hr;
+	}
+	Data = (const unsigned char*)mapping;
+#endif
+
+	return S_OK;
+}
+
+void MemoryMappedFile::Close()
+{
+	if (IsMemoryBuffer)
+	{
+		BufferOwner.reset();
+		IsMemoryBuffer = false;
+		Data = nullptr;
+		Size = 0;
+		return;
+	}
+
+#ifdef _WIN32
+	if (Data != nullptr)
+	{
+		UnmapViewOfFile(Data);
+	}
+	if (MappingHandle != nullptr)
+	{
+		CloseHandle(MappingHandle);
+		MappingHandle = nullptr;
+	}
+	if (FileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(FileHandle);
+		FileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (Data != nullptr)
+	{
+		munmap((void*)Data, (size_t)Size);
+	}
+	if (FileDescriptor >= 0)
+	{
+		close(FileDescriptor);
+		FileDescriptor = -1;
+	}
+#endif
+	Data = nullptr;
+	Size = 0;
+	ReadAheadStart = 0;
+	ReadAheadEnd = 0;
+}
+
+const unsigned char* MemoryMappedFile::GetData()
+{
+	return Data;
+}
+
+UINT64 MemoryMappedFile::GetSize()
+{
+	return Size;
+}
+
+HRESULT MemoryMappedFile::CheckReadable(UINT64 offset, UINT64 byteCount)
+{
+	if (offset > Size || byteCount > Size - offset)
+	{
+		return E_INVALIDARG;
+	}
+
+	//Windows refuses to truncate a file with a mapped view, and a buffer in memory can't shrink
+#ifndef _WIN32
+	if (!IsMemoryBuffer && byteCount > 0)
+	{
+		struct stat attributes;
+		if (fstat(FileDescriptor, &attributes) != 0)
+		{
+			return GetLastFileErrorAsHRESULT();
+		}
+		if ((UINT64)attributes.st_size < offset + byteCount)
+		{
+			return HRESULT_FROM_WIN32(EIO);
+		}
+	}
+#endif
+	return S_OK;
+}
+
+//Read-ahead---------------------------------------------------------------------------------------------------------------------------------------------------
+void MemoryMappedFile::AdviseSequentialRead(UINT64 position)
+{
+	//A buffer in memory has nothing to fault in, and releasing its pages would discard the caller's data
+	if (Data == nullptr || IsMemoryBuffer || position >= Size)
+	{
+		return;
+	}
+
+	//A seek outside of the window starts a new one (whatever the old one left resident stays until the system reclaims it)
+	if (position < ReadAheadStart || position > ReadAheadEnd)
+	{
+		ReadAheadStart = position - position % ReadAheadAlignment;
+		ReadAheadEnd = ReadAheadStart;
+	}
+
+	//Prefetch the next window once the reader is half way through the current one. The window ends on the boundary as well,
+	//so the next prefetch starts on a page (madvise rejects an unaligned address).
+	if (position + ReadAheadBytes / 2 >= ReadAheadEnd && ReadAheadEnd < Size)
+	{
+		UINT64 prefetchEnd = position + ReadAheadBytes + ReadAheadAlignment - 1;
+		prefetchEnd = std::min(Size, prefetchEnd - prefetchEnd % ReadAheadAlignment);
+		Prefetch(ReadAheadEnd, prefetchEnd - ReadAheadEnd);
+		ReadAheadEnd = prefetchEnd;
+	}
+
+	//Keep a window behind the reader (short seeks back stay cheap) and release the rest
+	if (position >= ReadAheadStart + 2 * ReadAheadBytes)
+	{
+		UINT64 releaseEnd = position - ReadAheadBytes;
+		releaseEnd -= releaseEnd % ReadAheadAlignment;
+		Release(ReadAheadStart, releaseEnd - ReadAheadStart);
+		ReadAheadStart = releaseEnd;
+	}
+}
+
+void MemoryMappedFile::Prefetch(UINT64 offset, UINT64 byteCount)
+{
+	//Only a hint, failing to give it just means the reader faults the pages in itself
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (PVOID)(Data + offset);
+	range.NumberOfBytes = (SIZE_T)byteCount;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	madvise((void*)(Data + offset), (size_t)byteCount, MADV_WILLNEED);
+#endif
+}
+
+void MemoryMappedFile::Release(UINT64 offset, UINT64 byteCount)
+{
+	//Drops the pages from the working set only, the mapping stays valid and they fault back in from the page cache
+#ifdef _WIN32
+	VirtualUnlock((LPVOID)(Data + offset), (SIZE_T)byteCount);
+#else
+	madvise((void*)(Data + offset), (size_t)byteCount, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Platform.h"
+#include <memory>
+
+namespace MMFSoundPlayerLib
+{
+	//Read-only view of a whole file mapped into memory, or of a buffer registered with MemoryMedia (the view then shares the
+	//buffer, nothing is mapped). An empty file opens successfully with no data.
+	class MemoryMappedFile
+	{
+	private:
+		const unsigned char* Data;
+		UINT64 Size;
+
+		//Registered buffer viewed instead of a mapping
+		std::shared_ptr<const void> BufferOwner;
+		bool IsMemoryBuffer;
+
+		//Range of the file AdviseSequentialRead prefetched and hasn't released yet
+		UINT64 ReadAheadStart;
+		UINT64 ReadAheadEnd;
+
+#ifdef _WIN32
+		HANDLE FileHandle;
+		HANDLE MappingHandle;
+#else
+		int FileDescriptor;
+#endif
+
+		void Prefetch(UINT64 offset, UINT64 byteCount);
+		void Release(UINT64 offset, UINT64 byteCount);
+
+	public:
+		//Bytes a sequential reader keeps prefetched ahead of (and resident behind) its position
+		static constexpr UINT64 ReadAheadBytes = 2 * 1024 * 1024;
+
+		MemoryMappedFile();
+		~MemoryMappedFile();
+
+		MemoryMappedFile(const MemoryMappedFile&) = delete;
+		MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+		//Map the file (closing any file mapped before)
+		HRESULT Open(PCWSTR inputFilePath);
+		void Close();
+
+		const unsigned char* GetData();
+		UINT64 GetSize();
+
+		//Check that a range of the view is still backed by the file, before reading it. Another process may truncate the file
+		//while it is mapped (POSIX allows it), and touching the pages beyond the new end would raise SIGBUS. The range is
+		//only guaranteed until the next truncation, but a file shrinking under a player is rare and this closes most of it.
+		HRESULT CheckReadable(UINT64 offset, UINT64 byteCount);
+
+		//For a reader streaming through the file, called with the offset it reads next: prefetches the next window before the
+		//reader faults on it and drops the pages left far behind from the working set (they stay in the page cache), so
+		//streaming a large file keeps a few megabytes resident. Seeks just restart the window. Not thread-safe.
+		void AdviseSequentialRead(UINT64 position);
+	};
+}
@@ -0,0 +1,78 @@
+#include "MemoryMedia.h"
+#include <cerrno>
+#include <cwchar>
+#include <map>
+#include <mutex>
+
+using namespace MMFSoundPlayerLib;
+
+static const wchar_t MemoryPathPrefix[] = L"memory:";
+
+//What opening a file that doesn't exist fails with
+#ifdef _WIN32
+static const HRESULT NotFoundResult = HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+#else
+static const HRESULT NotFoundResult = HRESULT_FROM_WIN32(ENOENT);
+#endif
+
+static std::mutex RegistryMutex;
+static std::map<std::wstring, MemoryMediaBuffer> RegisteredBuffers;
+static UINT64 NextBufferId = 1;
+
+HRESULT MemoryMedia::Register(const void* inputData, UINT64 byteCount, std::shared_ptr<const void> owner, PCWSTR fileExtension, std::wstring* outputPath)
+{
+	if ((inputData == nullptr && byteCount > 0) || outputPath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	MemoryMediaBuffer newBuffer;
+	newBuffer.Data = (const unsigned char*)inputData;
+	newBuffer.Size = byteCount;
+	newBuffer.Owner = std::move(owner);
+
+	std::lock_guard<std::mutex> lock(RegistryMutex);
+	std::wstring newPath = MemoryPathPrefix + std::to_wstring(NextBufferId++);
+	if (fileExtension != nullptr && fileExtension[0] != L'\0')
+	{
+		newPath += fileExtension[0] == L'.' ? fileExtension : (L"." + std::wstring(fileExtension));
+	}
+	RegisteredBuffers[newPath] = std::move(newBuffer);
+	*outputPath = std::move(newPath);
+	return S_OK;
+}
+
+HRESULT MemoryMedia::Unregister(PCWSTR inputPath)
+{
+	if (inputPath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Views handed out keep their own reference to the owner
+	std::lock_guard<std::mutex> lock(RegistryMutex);
+	return RegisteredBuffers.erase(inputPath) > 0 ? S_OK : S_FALSE;
+}
+
+bool MemoryMedia::IsMemoryPath(PCWSTR inputPath)
+{
+	return inputPath != nullptr && wcsncmp(inputPath, MemoryPathPrefix, (sizeof(MemoryPathPrefix) / sizeof(wchar_t)) - 1) == 0;
+}
+
+HRESULT MemoryMedia::Find(PCWSTR inputPath, MemoryMediaBuffer* outputBuffer)
+{
+	if (inputPath == nullptr || outputBuffer == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//A path that isn't registered (anymore) is a file that doesn't exist
+	std::lock_guard<std::mutex> lock(RegistryMutex);
+	auto entry = RegisteredBuffers.find(inputPath);
+	if (entry == RegisteredBuffers.end())
+	{
+		return NotFoundResult;
+	}
+	*outputBuffer = entry->second;
+	return S_OK;
+}
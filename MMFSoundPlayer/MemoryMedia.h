@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Platform.h"
+#include <memory>
+#include <string>
+
+namespace MMFSoundPlayerLib
+{
+	//A registered buffer. Owner (null for borrowed buffers) keeps the bytes alive for as long as the view is held.
+	struct MemoryMediaBuffer
+	{
+		const unsigned char* Data = nullptr;
+		UINT64 Size = 0;
+		std::shared_ptr<const void> Owner;
+	};
+
+	/*
+	Process-wide registry of audio files held in memory (downloaded assets, generated speech, decrypted content) under
+	paths of their own, "memory:<id>.<extension>". Such a path goes anywhere a file path does (SetFileIntoPlayer,
+	QueueNextFile, OpenAudioFileDecoder, VoiceEngine::LoadClip...) and is read straight out of the buffer, encoded formats
+	included (the extension picks the format the way a file's does): no temporary file and no copy.
+	A buffer registered with an owner is shared: whatever opened it keeps it alive, so it can be unregistered while it still
+	plays, as soon as nothing is going to open the path anymore (a queued file is opened in the background, so not before
+	it started). A borrowed buffer (no owner) has to stay valid and unchanged until it is unregistered and nothing reads it
+	anymore.
+	Paths are never reused within a process. They aren't files though, so the stores that key on a file's size and
+	modification time (metadata, seek indexes, loudness, decoded heads) don't keep anything for them.
+	All functions are thread-safe.
+	*/
+	namespace MemoryMedia
+	{
+		HRESULT Register(const void* inputData, UINT64 byteCount, std::shared_ptr<const void> owner, PCWSTR fileExtension, std::wstring* outputPath);
+		HRESULT Unregister(PCWSTR inputPath);
+
+		bool IsMemoryPath(PCWSTR inputPath);
+		HRESULT Find(PCWSTR inputPath, MemoryMediaBuffer* outputBuffer);
+	}
+}
@@ -0,0 +1,314 @@
+#include "Platform.h"
+#include <chrono>
+#include <cerrno>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+std::string MMFSoundPlayerLib::ConvertWidePathToNarrow(PCWSTR inputPath)
+{
+	std::string narrowPath;
+	if (inputPath == nullptr)
+	{
+		return narrowPath;
+	}
+
+#ifdef _WIN32
+	//Let Windows do the conversion to UTF-8
+	int requiredSize = WideCharToMultiByte(CP_UTF8, 0, inputPath, -1, nullptr, 0, nullptr, nullptr);
+	if (requiredSize <= 1)
+	{
+		return narrowPath;
+	}
+	narrowPath.resize(requiredSize - 1);
+	WideCharToMultiByte(CP_UTF8, 0, inputPath, -1, narrowPath.data(), requiredSize, nullptr, nullptr);
+#else
+	//wchar_t holds full code points here, so encode each one as UTF-8 by hand
+	for (const wchar_t* character = inputPath; *character != L'\0'; character++)
+	{
+		UINT32 codePoint = (UINT32)*character;
+		if (codePoint < 0x80)
+		{
+			narrowPath.push_back((char)codePoint);
+		}
+		else if (codePoint < 0x800)
+		{
+			narrowPath.push_back((char)(0xC0 | (codePoint >> 6)));
+			narrowPath.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+		else if (codePoint < 0x10000)
+		{
+			narrowPath.push_back((char)(0xE0 | (codePoint >> 12)));
+			narrowPath.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+			narrowPath.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+		else
+		{
+			narrowPath.push_back((char)(0xF0 | (codePoint >> 18)));
+			narrowPath.push_back((char)(0x80 | ((codePoint >> 12) & 0x3F)));
+			narrowPath.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+			narrowPath.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+	}
+#endif
+
+	return narrowPath;
+}
+
+std::wstring MMFSoundPlayerLib::ConvertNarrowPathToWide(const char* inputPath)
+{
+	std::wstring widePath;
+	if (inputPath == nullptr)
+	{
+		return widePath;
+	}
+
+#ifdef _WIN32
+	int requiredSize = MultiByteToWideChar(CP_UTF8, 0, inputPath, -1, nullptr, 0);
+	if (requiredSize <= 1)
+	{
+		return widePath;
+	}
+	widePath.resize(requiredSize - 1);
+	MultiByteToWideChar(CP_UTF8, 0, inputPath, -1, widePath.data(), requiredSize);
+#else
+	//Decode UTF-8 into full code points (invalid sequences become U+FFFD)
+	const unsigned char* character = (const unsigned char*)inputPath;
+	while (*character != '\0')
+	{
+		UINT32 codePoint = *character;
+		int continuationBytes = 0;
+		if (codePoint < 0x80)
+		{
+		}
+		else if (codePoint < 0xC0 || codePoint >= 0xF8)
+		{
+			codePoint = 0xFFFD;
+		}
+		else if (codePoint < 0xE0)
+		{
+			codePoint &= 0x1F;
+			continuationBytes = 1;
+		}
+		else if (codePoint < 0xF0)
+		{
+			codePoint &= 0x0F;
+			continuationBytes = 2;
+		}
+		else
+		{
+			codePoint &= 0x07;
+			continuationBytes = 3;
+		}
+		character++;
+
+		for (; continuationBytes > 0; continuationBytes--, character++)
+		{
+			if ((*character & 0xC0) != 0x80)
+			{
+				codePoint = 0xFFFD;
+				break;
+			}
+			codePoint = (codePoint << 6) | (*character & 0x3F);
+		}
+		widePath.push_back((wchar_t)codePoint);
+	}
+#endif
+
+	return widePath;
+}
+
+FILE* MMFSoundPlayerLib::OpenFileWithWidePath(PCWSTR inputPath, const char* mode)
+{
+	if (inputPath == nullptr || mode == nullptr)
+	{
+		return nullptr;
+	}
+
+#ifdef _WIN32
+	//Widen the mode string and use the wide C runtime entry point so non-ASCII paths work
+	std::wstring wideMode;
+	for (const char* character = mode; *character != '\0'; character++)
+	{
+		wideMode.push_back((wchar_t)*character);
+	}
+
+	FILE* file = nullptr;
+	if (_wfopen_s(&file, inputPath, wideMode.c_str()) != 0)
+	{
+		return nullptr;
+	}
+	return file;
+#else
+	return fopen(ConvertWidePathToNarrow(inputPath).c_str(), mode);
+#endif
+}
+
+HRESULT MMFSoundPlayerLib::GetLastFileErrorAsHRESULT()
+{
+	//The C runtime reports file errors through errno on every platform
+	if (errno == 0)
+	{
+		return E_FAIL;
+	}
+	return HRESULT_FROM_WIN32(errno);
+}
+
+HRESULT MMFSoundPlayerLib::GetFileSizeAndModifiedTime(PCWSTR inputPath, UINT64* fileSize, INT64* modifiedTime)
+{
+	if (inputPath == nullptr || fileSize == nullptr || modifiedTime == nullptr)
+	{
+		return E_POINTER;
+	}
+
+#ifdef _WIN32
+	//Read the attributes without opening the file
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExW(inputPath, GetFileExInfoStandard, &attributes))
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+	*fileSize = ((UINT64)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	*modifiedTime = (INT64)(((UINT64)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime);
+#else
+	struct stat attributes;
+	if (stat(ConvertWidePathToNarrow(inputPath).c_str(), &attributes) != 0)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+	*fileSize = (UINT64)attributes.st_size;
+	*modifiedTime = (INT64)attributes.st_mtim.tv_sec * 1000000000 + attributes.st_mtim.tv_nsec;
+#endif
+	return S_OK;
+}
+
+HRESULT MMFSoundPlayerLib::ReplaceFileWithWidePath(PCWSTR sourcePath, PCWSTR destinationPath)
+{
+	if (sourcePath == nullptr || destinationPath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+#ifdef _WIN32
+	if (!MoveFileExW(sourcePath, destinationPath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+#else
+	//rename replaces the destination atomically
+	if (rename(ConvertWidePathToNarrow(sourcePath).c_str(), ConvertWidePathToNarrow(destinationPath).c_str()) != 0)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+#endif
+	return S_OK;
+}
+
+HRESULT MMFSoundPlayerLib::RemoveFileWithWidePath(PCWSTR inputPath)
+{
+	if (inputPath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+#ifdef _WIN32
+	if (_wremove(inputPath) != 0)
+#else
+	if (remove(ConvertWidePathToNarrow(inputPath).c_str()) != 0)
+#endif
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+	return S_OK;
+}
+
+HRESULT MMFSoundPlayerLib::CreateDirectoriesWithWidePath(PCWSTR inputPath)
+{
+	if (inputPath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Creates the missing parents too, an existing directory is fine
+	std::error_code errorCode;
+#ifdef _WIN32
+	std::filesystem::create_directories(std::filesystem::path(inputPath), errorCode);
+#else
+	std::filesystem::create_directories(std::filesystem::path(ConvertWidePathToNarrow(inputPath)), errorCode);
+#endif
+	if (errorCode)
+	{
+		return HRESULT_FROM_WIN32(errorCode.value());
+	}
+	return S_OK;
+}
+
+void MMFSoundPlayerLib::WriteDebugString(const char* message)
+{
+#ifdef _WIN32
+	OutputDebugStringA(message);
+#elif !defined(NDEBUG)
+	fputs(message, stderr);
+#else
+	(void)message;
+#endif
+}
+
+UINT64 MMFSoundPlayerLib::GetMonotonicTimeNanoseconds()
+{
+	return (UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+UINT64 MMFSoundPlayerLib::GetThreadCpuTimeNanoseconds()
+{
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+	{
+		return 0;
+	}
+	UINT64 kernelTime_100NanoSecondUnits = ((UINT64)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+	UINT64 userTime_100NanoSecondUnits = ((UINT64)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+	return (kernelTime_100NanoSecondUnits + userTime_100NanoSecondUnits) * 100;
+#else
+	timespec cpuTime;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime) != 0)
+	{
+		return 0;
+	}
+	return (UINT64)cpuTime.tv_sec * 1000000000 + (UINT64)cpuTime.tv_nsec;
+#endif
+}
+
+UINT64 MMFSoundPlayerLib::GetProcessMemoryBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS memoryCounters = {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters)))
+	{
+		return 0;
+	}
+	return memoryCounters.WorkingSetSize;
+#else
+	//The second field of statm is the resident set, in pages
+	FILE* statmFile = fopen("/proc/self/statm", "r");
+	if (statmFile == nullptr)
+	{
+		return 0;
+	}
+	unsigned long long totalPages = 0;
+	unsigned long long residentPages = 0;
+	int fieldCount = fscanf(statmFile, "%llu %llu", &totalPages, &residentPages);
+	fclose(statmFile);
+	long pageSize = sysconf(_SC_PAGESIZE);
+	return fieldCount == 2 && pageSize > 0 ? (UINT64)residentPages * (UINT64)pageSize : 0;
+#endif
+}
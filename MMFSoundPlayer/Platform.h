@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+The player engine is written against the Win32 HRESULT conventions. On Windows these come straight from the
+SDK headers, everywhere else (the headless backend builds on Linux) the small subset the library uses is
+defined here, so that every translation unit can keep returning and checking HRESULTs the same way.
+*/
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cstdint>
+
+typedef int32_t HRESULT;
+typedef int32_t LONG;
+typedef unsigned long ULONG;
+typedef uint32_t DWORD;
+typedef int16_t INT16;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef int64_t INT64;
+typedef int32_t BOOL;
+typedef const wchar_t* PCWSTR;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define E_POINTER ((HRESULT)0x80004003L)
+#define E_ABORT ((HRESULT)0x80004004L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_UNEXPECTED ((HRESULT)0x8000FFFFL)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+//Same facility/layout as HRESULT_FROM_WIN32, so errno values can be surfaced through the usual failure path
+#define HRESULT_FROM_WIN32(x) ((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : ((HRESULT)(((x) & 0x0000FFFF) | (7 << 16) | 0x80000000)))
+#endif
+
+#include <string>
+#include <cstdio>
+
+namespace MMFSoundPlayerLib
+{
+	//Number of 100 nanosecond units (the time base used by the whole public API) in a second
+	constexpr UINT64 OneSecond_100NanoSecondUnits = 10000000;
+
+	//Converts a wide path (the public API's path type) to the narrow encoding the C runtime expects (UTF-8 outside of Windows)
+	std::string ConvertWidePathToNarrow(PCWSTR inputPath);
+
+	//Converts a narrow (UTF-8) path from the C runtime or the file system back to a wide path
+	std::wstring ConvertNarrowPathToWide(const char* inputPath);
+
+	//Opens a file by wide path with a C runtime mode string ("rb", "wb" and so on). Returns nullptr on failure.
+	FILE* OpenFileWithWidePath(PCWSTR inputPath, const char* mode);
+
+	//Returns the HRESULT corresponding to the last C runtime file error (errno)
+	HRESULT GetLastFileErrorAsHRESULT();
+
+	//Size in bytes and last modification time (platform ticks, only compared for equality) of a file
+	HRESULT GetFileSizeAndModifiedTime(PCWSTR inputPath, UINT64* fileSize, INT64* modifiedTime);
+
+	//Replace destinationPath with sourcePath (used to commit a file written next to the one it replaces)
+	HRESULT ReplaceFileWithWidePath(PCWSTR sourcePath, PCWSTR destinationPath);
+	HRESULT RemoveFileWithWidePath(PCWSTR inputPath);
+
+	//Create a directory and any missing parent directories (succeeds if it already exists)
+	HRESULT CreateDirectoriesWithWidePath(PCWSTR inputPath);
+
+	//Writes a line of diagnostics to the debugger (OutputDebugStringA on Windows, stderr in debug builds elsewhere)
+	void WriteDebugString(const char* message);
+
+	//Monotonic high resolution time in nanoseconds (arbitrary epoch, only differences are meaningful)
+	UINT64 GetMonotonicTimeNanoseconds();
+
+	//CPU time the calling thread has used, in nanoseconds (Windows only counts it in scheduler ticks, so short spans read as
+	//0 or a whole tick and only sums over many of them are meaningful)
+	UINT64 GetThreadCpuTimeNanoseconds();
+
+	//Memory the process is using, in bytes: its resident set (the working set on Windows), mapped files included. Returns 0 if unknown.
+	UINT64 GetProcessMemoryBytes();
+}
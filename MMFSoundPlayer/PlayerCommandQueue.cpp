@@ -0,0 +1,65 @@
+#include "PlayerCommandQueue.h"
+
+using namespace MMFSoundPlayerLib;
+
+void PlayerCommand::Complete(HRESULT result)
+{
+	Completion.set_value(result);
+	if (CompletionCallback)
+	{
+		CompletionCallback(result);
+	}
+}
+
+PlayerCommandQueue::PlayerCommandQueue()
+{
+	ConsumerActive = false;
+}
+
+bool PlayerCommandQueue::Enqueue(PlayerCommand&& inputCommand)
+{
+	PlayerCommand supersededCommand;
+	bool isSuperseding = false;
+	bool isNewConsumer = false;
+	{
+		std::lock_guard<std::mutex> lock(QueueMutex);
+		if (inputCommand.IsSupersedable && !Commands.empty() && Commands.back().IsSupersedable && Commands.back().Type == inputCommand.Type)
+		{
+			supersededCommand = std::move(Commands.back());
+			Commands.back() = std::move(inputCommand);
+			isSuperseding = true;
+		}
+		else
+		{
+			Commands.push_back(std::move(inputCommand));
+		}
+
+		//Whoever finds the queue idle takes over the consumer role
+		if (!ConsumerActive)
+		{
+			ConsumerActive = true;
+			isNewConsumer = true;
+		}
+	}
+
+	//Completed outside of the lock, the callback may enqueue again
+	if (isSuperseding)
+	{
+		supersededCommand.Complete(S_FALSE);
+	}
+	return isNewConsumer;
+}
+
+bool PlayerCommandQueue::DequeueOrRelease(PlayerCommand& outputCommand)
+{
+	std::lock_guard<std::mutex> lock(QueueMutex);
+	if (Commands.empty())
+	{
+		ConsumerActive = false;
+		return false;
+	}
+
+	outputCommand = std::move(Commands.front());
+	Commands.pop_front();
+	return true;
+}
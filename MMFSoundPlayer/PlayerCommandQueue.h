@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Platform.h"
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+
+namespace MMFSoundPlayerLib
+{
+	//Called with the final result of an asynchronous command, on the thread that completed it (usually the backend's event thread)
+	typedef std::function<void(HRESULT)> PlayerCommandCallback;
+
+	enum class PlayerCommandType
+	{
+		Play,
+		Pause,
+		Stop,
+		Seek
+	};
+
+	struct PlayerCommand
+	{
+		PlayerCommandType Type = PlayerCommandType::Play;
+		UINT64 SeekPosition_100NanoSecondUnits = 0;
+
+		//Replaced by a newer command of the same type that is enqueued while this one is still waiting at the back of the queue
+		bool IsSupersedable = false;
+		std::promise<HRESULT> Completion;
+		PlayerCommandCallback CompletionCallback;
+
+		//Resolve the future and call the callback (exactly once)
+		void Complete(HRESULT result);
+	};
+
+	/*
+	Multi-producer, single-consumer queue of player commands. Any thread may enqueue, but only one thread at a time holds the
+	consumer role: the enqueuer that finds the queue idle becomes the consumer and keeps it until DequeueOrRelease finds the
+	queue empty. The role can be handed from thread to thread (the player passes it to the backend's event thread while a
+	command is in flight), so commands are always issued one at a time and in submission order without a dedicated thread.
+	Supersedable commands (scrub seeks) collapse: while one waits at the back of the queue, a newer one takes its place and
+	the old one completes with S_FALSE without ever being issued, so at most one waits behind the command in flight.
+	*/
+	class PlayerCommandQueue
+	{
+	private:
+		std::mutex QueueMutex;
+		std::deque<PlayerCommand> Commands;
+		bool ConsumerActive;
+
+	public:
+		PlayerCommandQueue();
+
+		//Add a command. Returns true if the caller became the consumer and must now drain the queue.
+		bool Enqueue(PlayerCommand&& inputCommand);
+
+		//Consumer only: take the next command, or give up the consumer role and return false if there is none
+		bool DequeueOrRelease(PlayerCommand& outputCommand);
+	};
+}
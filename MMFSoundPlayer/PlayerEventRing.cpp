@@ -0,0 +1,138 @@
+#include "PlayerEventRing.h"
+#include <thread>
+
+using namespace MMFSoundPlayerLib;
+
+//Event Ring---------------------------------------------------------------------------------------------------------------------------------------------------
+PlayerEventRing::PlayerEventRing()
+{
+	NextTicket = 0;
+	PublishedCount = 0;
+}
+
+void PlayerEventRing::Publish(PlayerEventType eventType, PlayerState oldState, PlayerState newState, HRESULT status)
+{
+	//Claim a ticket, which also decides the slot
+	UINT64 ticket = NextTicket.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = Slots[ticket % RingCapacity];
+
+	//The publisher of the previous lap may not be done with the slot yet (it was preempted after claiming its ticket). Wait
+	//for it, or it would finish writing its older event over this one.
+	UINT64 previousLapStamp = ticket >= RingCapacity ? 2 * (ticket - RingCapacity) + 2 : 0;
+	while (slot.Stamp.load(std::memory_order_acquire) != previousLapStamp)
+	{
+		std::this_thread::yield();
+	}
+
+	//Mark the slot as being written, then fill it
+	slot.Stamp.store(2 * ticket + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.Type.store((UINT32)eventType, std::memory_order_relaxed);
+	slot.OldState.store((UINT32)oldState, std::memory_order_relaxed);
+	slot.NewState.store((UINT32)newState, std::memory_order_relaxed);
+	slot.Status.store(status, std::memory_order_relaxed);
+	slot.Timestamp_Nanoseconds.store(GetMonotonicTimeNanoseconds(), std::memory_order_relaxed);
+
+	//Make the event readable and wake the waiting subscribers
+	slot.Stamp.store(2 * ticket + 2, std::memory_order_release);
+	PublishedCount.fetch_add(1, std::memory_order_release);
+	PublishedCount.notify_all();
+}
+
+UINT64 PlayerEventRing::GetNextSequence()
+{
+	return NextTicket.load(std::memory_order_acquire);
+}
+
+UINT64 PlayerEventRing::GetPublishedCount()
+{
+	return PublishedCount.load(std::memory_order_acquire);
+}
+
+HRESULT PlayerEventRing::TryRead(UINT64 sequence, PlayerEvent& outputEvent)
+{
+	Slot& slot = Slots[sequence % RingCapacity];
+	UINT64 expectedStamp = 2 * sequence + 2;
+
+	//Check the slot holds this sequence before copying...
+	UINT64 stampBefore = slot.Stamp.load(std::memory_order_acquire);
+	if (stampBefore != expectedStamp)
+	{
+		return stampBefore > expectedStamp ? E_ABORT : S_FALSE;
+	}
+
+	outputEvent.Sequence = sequence;
+	outputEvent.Type = (PlayerEventType)slot.Type.load(std::memory_order_relaxed);
+	outputEvent.OldState = (PlayerState)slot.OldState.load(std::memory_order_relaxed);
+	outputEvent.NewState = (PlayerState)slot.NewState.load(std::memory_order_relaxed);
+	outputEvent.Status = slot.Status.load(std::memory_order_relaxed);
+	outputEvent.Timestamp_Nanoseconds = slot.Timestamp_Nanoseconds.load(std::memory_order_relaxed);
+
+	//...and that no publisher lapped the ring and overwrote it while copying
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.Stamp.load(std::memory_order_relaxed) != expectedStamp)
+	{
+		return E_ABORT;
+	}
+	return S_OK;
+}
+
+void PlayerEventRing::WaitForPublish(UINT64 knownPublishedCount)
+{
+	PublishedCount.wait(knownPublishedCount, std::memory_order_acquire);
+}
+
+//Subscription-------------------------------------------------------------------------------------------------------------------------------------------------
+PlayerEventSubscription::PlayerEventSubscription(PlayerEventRing* inputRing)
+{
+	//Subscribers only see what is published after they subscribed
+	Ring = inputRing;
+	NextSequence = inputRing->GetNextSequence();
+	MissedEventCount = 0;
+}
+
+bool PlayerEventSubscription::TryGetNext(PlayerEvent& outputEvent)
+{
+	while (true)
+	{
+		HRESULT hr = Ring->TryRead(NextSequence, outputEvent);
+		if (hr == S_OK)
+		{
+			NextSequence++;
+			return true;
+		}
+		if (hr == S_FALSE)
+		{
+			return false;
+		}
+
+		//Overwritten: skip to the oldest event that can still be in the ring
+		UINT64 newestSequence = Ring->GetNextSequence();
+		UINT64 oldestAvailable = newestSequence > PlayerEventRing::RingCapacity ? newestSequence - PlayerEventRing::RingCapacity : 0;
+		if (oldestAvailable <= NextSequence)
+		{
+			oldestAvailable = NextSequence + 1;
+		}
+		MissedEventCount += oldestAvailable - NextSequence;
+		NextSequence = oldestAvailable;
+	}
+}
+
+void PlayerEventSubscription::WaitForNext(PlayerEvent& outputEvent)
+{
+	while (true)
+	{
+		//Read the publish count before checking, so a publish in between makes the wait return immediately
+		UINT64 publishedCount = Ring->GetPublishedCount();
+		if (TryGetNext(outputEvent))
+		{
+			return;
+		}
+		Ring->WaitForPublish(publishedCount);
+	}
+}
+
+UINT64 PlayerEventSubscription::GetMissedEventCount()
+{
+	return MissedEventCount;
+}
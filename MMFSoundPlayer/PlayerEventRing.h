@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Platform.h"
+#include <atomic>
+
+namespace MMFSoundPlayerLib
+{
+	enum PlayerState
+	{
+		Closed,         // No session.
+		Ready,          // Session was created, ready to open a file.
+		PresentationEnd,// Song just ended and if songs are in a queue, it is ready for the next song
+		OpenPending,    // Session is opening a file.
+		Playing,        // Session is playing a file.
+		Paused,         // Session is paused.
+		Stopped,        // Session is stopped (ready to play).
+		Closing         // Application has closed the session, but is waiting for MESessionClosed.
+	};
+
+	enum class PlayerEventType
+	{
+		StateChanged,           // The player moved from OldState to NewState.
+		TrackChanged,           // A queued song took over gaplessly (the state doesn't change).
+		VolumeExternallyChanged // The volume was changed from an external source (like the volume mixer).
+	};
+
+	//One entry of the player's event stream
+	struct PlayerEvent
+	{
+		UINT64 Sequence = 0;
+		PlayerEventType Type = PlayerEventType::StateChanged;
+		PlayerState OldState = PlayerState::Closed;
+		PlayerState NewState = PlayerState::Closed;
+		HRESULT Status = S_OK;
+		UINT64 Timestamp_Nanoseconds = 0;
+	};
+
+	/*
+	Broadcast ring of player events. Any thread may publish and any number of subscribers read the whole stream
+	independently, each with its own cursor, so nobody consumes an event on behalf of somebody else (unlike an auto-reset
+	event). Every slot is a small seqlock: publishers claim a ticket, wait until the publisher a lap ahead of them is done
+	with the slot, fill it and stamp it with the ticket, readers validate the stamp before and after copying. Readers never
+	block anybody, but publishing isn't lock-free: a publisher whose slot still belongs to a publisher RingCapacity tickets
+	earlier that was preempted before stamping it yields until that one is done (a handful of stores once it runs again).
+	A subscriber that falls more than RingCapacity events behind skips ahead and has the skipped events counted as missed.
+	Waiting uses the atomic wait/notify of the publish counter, so a waiter can't miss a wakeup between checking for events
+	and going to sleep.
+	*/
+	class PlayerEventRing
+	{
+	public:
+		static constexpr UINT64 RingCapacity = 256;
+
+	private:
+		struct Slot
+		{
+			//2 * ticket + 1 while the slot is being written, 2 * ticket + 2 once the event with that ticket is readable
+			std::atomic<UINT64> Stamp{ 0 };
+			std::atomic<UINT32> Type{ 0 };
+			std::atomic<UINT32> OldState{ 0 };
+			std::atomic<UINT32> NewState{ 0 };
+			std::atomic<HRESULT> Status{ S_OK };
+			std::atomic<UINT64> Timestamp_Nanoseconds{ 0 };
+		};
+
+		Slot Slots[RingCapacity];
+		std::atomic<UINT64> NextTicket;
+		std::atomic<UINT64> PublishedCount;
+
+	public:
+		PlayerEventRing();
+
+		//Publish an event to every subscriber (the sequence and timestamp are filled in here)
+		void Publish(PlayerEventType eventType, PlayerState oldState, PlayerState newState, HRESULT status);
+
+		//Number of events published so far, the sequence a new subscriber starts reading at
+		UINT64 GetNextSequence();
+
+		//Read the event with the given sequence. Returns S_OK, S_FALSE if it isn't published yet or E_ABORT if it was overwritten.
+		HRESULT TryRead(UINT64 sequence, PlayerEvent& outputEvent);
+
+		//Block until more than knownPublishedCount events have been published
+		void WaitForPublish(UINT64 knownPublishedCount);
+		UINT64 GetPublishedCount();
+	};
+
+	//A subscriber's view of a PlayerEventRing. Not thread-safe itself: each observing thread owns its own subscription.
+	class PlayerEventSubscription
+	{
+	private:
+		PlayerEventRing* Ring;
+		UINT64 NextSequence;
+		UINT64 MissedEventCount;
+
+	public:
+		PlayerEventSubscription(PlayerEventRing* inputRing);
+
+		//Get the next event if one is available, without blocking
+		bool TryGetNext(PlayerEvent& outputEvent);
+
+		//Block until the next event is available
+		void WaitForNext(PlayerEvent& outputEvent);
+
+		//Events that were overwritten before this subscriber got to them
+		UINT64 GetMissedEventCount();
+	};
+}
@@ -0,0 +1,170 @@
+#include "PlayerPool.h"
+#include "MediaRuntime.h"
+#include <cassert>
+
+using namespace MMFSoundPlayerLib;
+
+//Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
+PlayerPool::PlayerPool(const PlayerPoolOptions& inputOptions)
+{
+	Options = inputOptions;
+	HoldsRuntimeReference = false;
+}
+
+HRESULT PlayerPool::CreateInstance(const PlayerPoolOptions& inputOptions, PlayerPool** outputPool)
+{
+	//Ensure that the double pointer actually points somewhere
+	if (outputPool == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULT can be returned
+	PlayerPool* newPool = new (std::nothrow) PlayerPool(inputOptions);
+	if (newPool == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	//The runtime stays up as long as the pool does
+	HRESULT hr = MediaRuntime::AddRef();
+	if (FAILED(hr))
+	{
+		assert(false);
+		delete newPool;
+		return hr;
+	}
+	newPool->HoldsRuntimeReference = true;
+
+	//Create the initial players
+	newPool->IdlePlayers.reserve(inputOptions.InitialPlayerCount);
+	for (UINT32 player = 0; player < inputOptions.InitialPlayerCount; player++)
+	{
+		MMFSoundPlayer* newPlayer = nullptr;
+		hr = newPool->CreatePlayer(&newPlayer);
+		if (FAILED(hr))
+		{
+			delete newPool;
+			return hr;
+		}
+		newPool->IdlePlayers.push_back(newPlayer);
+	}
+	newPool->Statistics.IdlePlayers = (UINT32)newPool->IdlePlayers.size();
+
+	*outputPool = newPool;
+	return S_OK;
+}
+
+PlayerPool::~PlayerPool()
+{
+	for (MMFSoundPlayer* idlePlayer : IdlePlayers)
+	{
+		ShutdownPlayer(idlePlayer);
+	}
+	IdlePlayers.clear();
+
+	if (HoldsRuntimeReference)
+	{
+		MediaRuntime::Release();
+	}
+}
+
+HRESULT PlayerPool::CreatePlayer(MMFSoundPlayer** outputPlayer)
+{
+	HRESULT hr = S_OK;
+	if (Options.BackendFactory)
+	{
+		IAudioBackend* newBackend = nullptr;
+		hr = Options.BackendFactory(&newBackend);
+		if (SUCCEEDED(hr))
+		{
+			hr = MMFSoundPlayer::CreateInstance(newBackend, outputPlayer);
+		}
+	}
+	else
+	{
+		hr = MMFSoundPlayer::CreateInstance(outputPlayer);
+	}
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	std::lock_guard<std::mutex> lock(PoolMutex);
+	Statistics.PlayersCreated++;
+	return S_OK;
+}
+
+void PlayerPool::ShutdownPlayer(MMFSoundPlayer* inputPlayer)
+{
+	inputPlayer->Shutdown();
+	inputPlayer->Release();
+}
+
+//Players------------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT PlayerPool::Acquire(MMFSoundPlayer** outputPlayer)
+{
+	if (outputPlayer == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//An idle player is ready as it is
+	{
+		std::lock_guard<std::mutex> lock(PoolMutex);
+		if (!IdlePlayers.empty())
+		{
+			*outputPlayer = IdlePlayers.back();
+			IdlePlayers.pop_back();
+			Statistics.PlayersReused++;
+			Statistics.PlayersInUse++;
+			Statistics.IdlePlayers = (UINT32)IdlePlayers.size();
+			return S_OK;
+		}
+	}
+
+	//Otherwise a new one is created, outside of the lock (starting a backend takes a while)
+	HRESULT hr = CreatePlayer(outputPlayer);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	std::lock_guard<std::mutex> lock(PoolMutex);
+	Statistics.PlayersInUse++;
+	return S_OK;
+}
+
+HRESULT PlayerPool::Return(MMFSoundPlayer* inputPlayer)
+{
+	if (inputPlayer == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Recycling closes the session, so it happens outside of the lock too
+	HRESULT hr = inputPlayer->Recycle();
+	{
+		std::lock_guard<std::mutex> lock(PoolMutex);
+		if (Statistics.PlayersInUse > 0)
+		{
+			Statistics.PlayersInUse--;
+		}
+		if (SUCCEEDED(hr) && IdlePlayers.size() < Options.MaxIdlePlayerCount)
+		{
+			IdlePlayers.push_back(inputPlayer);
+			Statistics.IdlePlayers = (UINT32)IdlePlayers.size();
+			return S_OK;
+		}
+		Statistics.PlayersShutDown++;
+	}
+
+	ShutdownPlayer(inputPlayer);
+	return hr;
+}
+
+PlayerPoolStatistics PlayerPool::GetStatistics()
+{
+	std::lock_guard<std::mutex> lock(PoolMutex);
+	return Statistics;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Platform.h"
+#include "MMFSoundPlayer.h"
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	//Creates the backend of a new pooled player (the player takes ownership)
+	typedef std::function<HRESULT(IAudioBackend** outputBackend)> AudioBackendFactory;
+
+	struct PlayerPoolOptions
+	{
+		//Players created up front, so the first ones handed out are ready right away
+		UINT32 InitialPlayerCount = 0;
+
+		//Returned players kept for reuse, the ones beyond are shut down
+		UINT32 MaxIdlePlayerCount = 64;
+
+		//Backend of every player (nullptr for the platform's default backend)
+		AudioBackendFactory BackendFactory;
+	};
+
+	struct PlayerPoolStatistics
+	{
+		UINT64 PlayersCreated = 0;
+		UINT64 PlayersReused = 0;
+		UINT64 PlayersShutDown = 0;
+		UINT32 PlayersInUse = 0;
+		UINT32 IdlePlayers = 0;
+	};
+
+	/*
+	Pool of players for processes running many at once (one per output channel of a server). Creating a player starts its
+	backend (a runtime reference, threads, a session's worth of state), the pool hands out players that were returned
+	instead, recycled (file closed, settings back to a new player's). The pool also holds a reference to the shared Media
+	Foundation runtime for as long as it exists, so the runtime is started once no matter how many players come and go.
+	All methods are thread-safe.
+	*/
+	class PlayerPool
+	{
+	private:
+		PlayerPoolOptions Options;
+		bool HoldsRuntimeReference;
+
+		//Players waiting to be handed out (guarded by PoolMutex)
+		std::mutex PoolMutex;
+		std::vector<MMFSoundPlayer*> IdlePlayers;
+		PlayerPoolStatistics Statistics;
+
+		PlayerPool(const PlayerPoolOptions& inputOptions);
+
+		HRESULT CreatePlayer(MMFSoundPlayer** outputPlayer);
+		static void ShutdownPlayer(MMFSoundPlayer* inputPlayer);
+
+	public:
+		static HRESULT CreateInstance(const PlayerPoolOptions& inputOptions, PlayerPool** outputPool);
+
+		//Shuts down the idle players. Players still handed out stay usable, their owners shut them down.
+		~PlayerPool();
+
+		//Hand out a player (an idle one if there is one). The caller owns the player's reference until it gives it back.
+		HRESULT Acquire(MMFSoundPlayer** outputPlayer);
+
+		//Give a player back (with the reference Acquire handed out, and nothing else still using it). It is recycled and
+		//kept idle, or shut down and released if the pool has enough idle players or it can't be recycled.
+		HRESULT Return(MMFSoundPlayer* inputPlayer);
+
+		PlayerPoolStatistics GetStatistics();
+	};
+}
@@ -0,0 +1,99 @@
+#include "PlayerStateMachine.h"
+
+using namespace MMFSoundPlayerLib;
+
+//Bit mask helper for the transition table
+constexpr UINT32 StateBit(PlayerState state)
+{
+	return 1u << (UINT32)state;
+}
+
+//Allowed next states, indexed by the current state (Closing can be entered from anywhere, the session is always closable)
+static const UINT32 AllowedTransitions[] =
+{
+	/* Closed          */ StateBit(Ready) | StateBit(Closing),
+	/* Ready           */ StateBit(OpenPending) | StateBit(Closed) | StateBit(Closing),
+	/* PresentationEnd */ StateBit(Playing) | StateBit(Stopped) | StateBit(Closing),
+	/* OpenPending     */ StateBit(Stopped) | StateBit(Ready) | StateBit(Closing),
+	/* Playing         */ StateBit(Paused) | StateBit(Stopped) | StateBit(PresentationEnd) | StateBit(Closing),
+	/* Paused          */ StateBit(Playing) | StateBit(Stopped) | StateBit(Closing),
+	/* Stopped         */ StateBit(Playing) | StateBit(Closing),
+	/* Closing         */ StateBit(Closed)
+};
+
+PlayerStateMachine::PlayerStateMachine(PlayerEventRing* inputEventRing, PlayerTrace* inputTrace)
+{
+	State = PlayerState::Closed;
+	EventRing = inputEventRing;
+	Trace = inputTrace;
+}
+
+bool PlayerStateMachine::IsValidTransition(PlayerState oldState, PlayerState newState)
+{
+	if (oldState == newState)
+	{
+		return true;
+	}
+	if ((UINT32)oldState >= sizeof(AllowedTransitions) / sizeof(AllowedTransitions[0]))
+	{
+		return false;
+	}
+	return (AllowedTransitions[oldState] & StateBit(newState)) != 0;
+}
+
+bool PlayerStateMachine::Transition(PlayerState newState, HRESULT status)
+{
+	PlayerState oldState = State.load(std::memory_order_acquire);
+	while (true)
+	{
+		if (!IsValidTransition(oldState, newState))
+		{
+			return false;
+		}
+
+		//Nothing to publish when staying put
+		if (oldState == newState)
+		{
+			return true;
+		}
+
+		//On failure oldState is reloaded and the transition is checked again
+		if (State.compare_exchange_weak(oldState, newState, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			if (Trace != nullptr)
+			{
+				Trace->Record(TraceRecordType::StateTransition, (UINT32)oldState, (UINT32)newState, status);
+			}
+			EventRing->Publish(PlayerEventType::StateChanged, oldState, newState, status);
+			return true;
+		}
+	}
+}
+
+bool PlayerStateMachine::TransitionFrom(PlayerState expectedState, PlayerState newState, HRESULT status)
+{
+	if (!IsValidTransition(expectedState, newState))
+	{
+		return false;
+	}
+
+	PlayerState oldState = expectedState;
+	if (!State.compare_exchange_strong(oldState, newState, std::memory_order_acq_rel, std::memory_order_acquire))
+	{
+		return false;
+	}
+	if (oldState != newState)
+	{
+		if (Trace != nullptr)
+		{
+			Trace->Record(TraceRecordType::StateTransition, (UINT32)oldState, (UINT32)newState, status);
+		}
+		EventRing->Publish(PlayerEventType::StateChanged, oldState, newState, status);
+	}
+	return true;
+}
+
+PlayerState PlayerStateMachine::GetState()
+{
+	return State.load(std::memory_order_acquire);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "PlayerEventRing.h"
+#include "PlayerTrace.h"
+#include <atomic>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Atomic, validated PlayerState. Transitions are compare-and-swap loops checked against the table of transitions the
+	player can legitimately make, so a stale session event (for example MESessionStarted arriving after the application
+	started closing the session) can't move the player into a state it already left. Every accepted transition is
+	published to the event ring (and recorded into the trace, if there is one).
+	*/
+	class PlayerStateMachine
+	{
+	private:
+		std::atomic<PlayerState> State;
+		PlayerEventRing* EventRing;
+		PlayerTrace* Trace;
+
+	public:
+		PlayerStateMachine(PlayerEventRing* inputEventRing, PlayerTrace* inputTrace = nullptr);
+
+		//Whether newState may follow oldState (staying in the same state is always allowed)
+		static bool IsValidTransition(PlayerState oldState, PlayerState newState);
+
+		//Move to newState if that is valid from the current state. Returns false (and changes nothing) otherwise.
+		bool Transition(PlayerState newState, HRESULT status = S_OK);
+
+		//Move to newState only from expectedState
+		bool TransitionFrom(PlayerState expectedState, PlayerState newState, HRESULT status = S_OK);
+
+		PlayerState GetState();
+	};
+}
@@ -0,0 +1,235 @@
+#include "PlayerTrace.h"
+#include "AudioBackend.h"
+#include "PlayerCommandQueue.h"
+#include "PlayerEventRing.h"
+#include <cstdio>
+#include <set>
+#include <thread>
+
+using namespace MMFSoundPlayerLib;
+
+//Chrome trace tracks for the spans (threads that recorded something get tracks from FirstThreadTrack on)
+constexpr UINT32 CommandTrack = 1;
+constexpr UINT32 OpenTrack = 2;
+constexpr UINT32 FirstThreadTrack = 10;
+
+//Small, stable number for the calling thread (thread ids themselves are neither small nor portable)
+static UINT32 GetTraceThreadId()
+{
+	static std::atomic<UINT32> nextThreadId{ 1 };
+	thread_local UINT32 threadId = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+	return threadId;
+}
+
+//Names for the exported trace
+static const char* GetBackendEventName(UINT32 code)
+{
+	static const char* const names[] = { "SessionClosed", "TopologySet", "SessionStarted", "SessionPaused", "SessionStopped", "EndOfPresentation", "VolumeChanged", "NextFilePrepared", "NextFileStarted", "Unknown" };
+	return code < sizeof(names) / sizeof(names[0]) ? names[code] : "Unknown";
+}
+
+static const char* GetStateName(UINT32 code)
+{
+	static const char* const names[] = { "Closed", "Ready", "PresentationEnd", "OpenPending", "Playing", "Paused", "Stopped", "Closing" };
+	return code < sizeof(names) / sizeof(names[0]) ? names[code] : "Unknown";
+}
+
+static const char* GetCommandName(UINT32 code)
+{
+	static const char* const names[] = { "Play", "Pause", "Stop", "Seek" };
+	return code < sizeof(names) / sizeof(names[0]) ? names[code] : "Unknown";
+}
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+PlayerTrace::PlayerTrace()
+{
+	IsEnabled = false;
+	NextTicket = 0;
+}
+
+HRESULT PlayerTrace::Enable(bool isEnabled)
+{
+	std::lock_guard<std::mutex> lock(EnableMutex);
+
+	//The ring is allocated the first time it is needed and kept from then on (recorders may still be writing into it)
+	if (isEnabled && Slots == nullptr)
+	{
+		Slots.reset(new (std::nothrow) Slot[RingCapacity]);
+		if (Slots == nullptr)
+		{
+			return E_OUTOFMEMORY;
+		}
+	}
+	IsEnabled.store(isEnabled, std::memory_order_release);
+	return S_OK;
+}
+
+bool PlayerTrace::GetIsEnabled()
+{
+	return IsEnabled.load(std::memory_order_acquire);
+}
+
+//Recording----------------------------------------------------------------------------------------------------------------------------------------------------
+void PlayerTrace::Write(TraceRecordType recordType, UINT32 code, UINT32 detail, HRESULT status, UINT64 value)
+{
+	//Claim a ticket, which also decides the slot
+	UINT64 ticket = NextTicket.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = Slots[ticket % RingCapacity];
+
+	//Wait for a recorder a lap ahead that was preempted while writing the slot, like PlayerEventRing::Publish does
+	UINT64 previousLapStamp = ticket >= RingCapacity ? 2 * (ticket - RingCapacity) + 2 : 0;
+	while (slot.Stamp.load(std::memory_order_acquire) != previousLapStamp)
+	{
+		std::this_thread::yield();
+	}
+
+	//Mark the slot as being written, then fill it
+	slot.Stamp.store(2 * ticket + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.Timestamp_Nanoseconds.store(GetMonotonicTimeNanoseconds(), std::memory_order_relaxed);
+	slot.Type.store((UINT32)recordType, std::memory_order_relaxed);
+	slot.Code.store(code, std::memory_order_relaxed);
+	slot.Detail.store(detail, std::memory_order_relaxed);
+	slot.Status.store(status, std::memory_order_relaxed);
+	slot.Value.store(value, std::memory_order_relaxed);
+	slot.ThreadId.store(GetTraceThreadId(), std::memory_order_relaxed);
+
+	//Make the record readable
+	slot.Stamp.store(2 * ticket + 2, std::memory_order_release);
+}
+
+//Export-------------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT PlayerTrace::GetRecords(std::vector<TraceRecord>* outputRecords)
+{
+	if (outputRecords == nullptr)
+	{
+		return E_POINTER;
+	}
+	outputRecords->clear();
+
+	std::lock_guard<std::mutex> lock(EnableMutex);
+	if (Slots == nullptr)
+	{
+		return S_OK;
+	}
+
+	UINT64 endTicket = NextTicket.load(std::memory_order_acquire);
+	UINT64 startTicket = endTicket > RingCapacity ? endTicket - RingCapacity : 0;
+	outputRecords->reserve((size_t)(endTicket - startTicket));
+	for (UINT64 ticket = startTicket; ticket < endTicket; ticket++)
+	{
+		Slot& slot = Slots[ticket % RingCapacity];
+		UINT64 expectedStamp = 2 * ticket + 2;
+
+		//Check the slot holds this ticket before copying...
+		if (slot.Stamp.load(std::memory_order_acquire) != expectedStamp)
+		{
+			continue;
+		}
+		TraceRecord record;
+		record.Timestamp_Nanoseconds = slot.Timestamp_Nanoseconds.load(std::memory_order_relaxed);
+		record.Type = (TraceRecordType)slot.Type.load(std::memory_order_relaxed);
+		record.Code = slot.Code.load(std::memory_order_relaxed);
+		record.Detail = slot.Detail.load(std::memory_order_relaxed);
+		record.Status = slot.Status.load(std::memory_order_relaxed);
+		record.Value = slot.Value.load(std::memory_order_relaxed);
+		record.ThreadId = slot.ThreadId.load(std::memory_order_relaxed);
+
+		//...and that no recorder lapped the ring and overwrote it while copying
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.Stamp.load(std::memory_order_relaxed) == expectedStamp)
+		{
+			outputRecords->push_back(record);
+		}
+	}
+	return S_OK;
+}
+
+HRESULT PlayerTrace::WriteChromeTrace(PCWSTR outputFilePath)
+{
+	if (outputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	std::vector<TraceRecord> records;
+	HRESULT hr = GetRecords(&records);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	FILE* file = OpenFileWithWidePath(outputFilePath, "wb");
+	if (file == nullptr)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+
+	//Timestamps are microseconds from the oldest record
+	UINT64 firstTimestamp = records.empty() ? 0 : records.front().Timestamp_Nanoseconds;
+	auto getTimestamp = [&](const TraceRecord& record)
+	{
+		return (record.Timestamp_Nanoseconds - firstTimestamp) / 1000.0;
+	};
+
+	//Name the tracks
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Commands\"}},\n", CommandTrack);
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Open\"}}", OpenTrack);
+	std::set<UINT32> threadIds;
+	for (const TraceRecord& record : records)
+	{
+		if (threadIds.insert(record.ThreadId).second)
+		{
+			fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}", FirstThreadTrack + record.ThreadId, record.ThreadId);
+		}
+	}
+
+	//Commands are issued one at a time and opens never overlap, so both nest as begin/end pairs on their tracks. A ring
+	//that wrapped may start with an end, which the viewers ignore.
+	for (const TraceRecord& record : records)
+	{
+		double timestamp = getTimestamp(record);
+		UINT32 threadTrack = FirstThreadTrack + record.ThreadId;
+		switch (record.Type)
+		{
+		case TraceRecordType::BackendEvent:
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"backend\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"status\":\"0x%08X\",\"value\":%llu}}",
+				GetBackendEventName(record.Code), timestamp, threadTrack, (UINT32)record.Status, (unsigned long long)record.Value);
+			break;
+
+		case TraceRecordType::StateTransition:
+			fprintf(file, ",\n{\"name\":\"%s -> %s\",\"cat\":\"state\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"status\":\"0x%08X\"}}",
+				GetStateName(record.Code), GetStateName(record.Detail), timestamp, threadTrack, (UINT32)record.Status);
+			break;
+
+		case TraceRecordType::CommandIssued:
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"command\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"thread\":%u,\"position_100ns\":%llu}}",
+				GetCommandName(record.Code), timestamp, CommandTrack, record.ThreadId, (unsigned long long)record.Value);
+			break;
+
+		case TraceRecordType::CommandCompleted:
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"command\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"status\":\"0x%08X\"}}",
+				GetCommandName(record.Code), timestamp, CommandTrack, (UINT32)record.Status);
+			break;
+
+		case TraceRecordType::OpenStarted:
+			fprintf(file, ",\n{\"name\":\"Open\",\"cat\":\"open\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"thread\":%u}}",
+				timestamp, OpenTrack, record.ThreadId);
+			break;
+
+		case TraceRecordType::OpenCompleted:
+			fprintf(file, ",\n{\"name\":\"Open\",\"cat\":\"open\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"status\":\"0x%08X\"}}",
+				timestamp, OpenTrack, (UINT32)record.Status);
+			break;
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	bool written = ferror(file) == 0;
+	if (fclose(file) != 0 || !written)
+	{
+		return E_FAIL;
+	}
+	return S_OK;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Platform.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	enum class TraceRecordType
+	{
+		BackendEvent,       // Code: BackendEventType, Value: the event value.
+		StateTransition,    // Code: old PlayerState, Detail: new PlayerState.
+		CommandIssued,      // Code: PlayerCommandType, Value: the seek position. Ignored commands are issued and completed at once.
+		CommandCompleted,   // Code: PlayerCommandType.
+		OpenStarted,        // The backend was asked to open a file.
+		OpenCompleted       // The file plays, failed to open or the open was aborted (Status).
+	};
+
+	//One entry of a player's trace
+	struct TraceRecord
+	{
+		UINT64 Timestamp_Nanoseconds = 0;
+		TraceRecordType Type = TraceRecordType::BackendEvent;
+		UINT32 Code = 0;
+		UINT32 Detail = 0;
+		HRESULT Status = S_OK;
+		UINT64 Value = 0;
+		UINT32 ThreadId = 0;    // Small number identifying the recording thread within the process.
+	};
+
+	/*
+	Lock-free trace ring of what a player does: backend events, state transitions, commands from issue to completion and
+	file opens, each with its HRESULT and a monotonic nanosecond timestamp. Any thread may record. The slots are seqlocks
+	like the ones of PlayerEventRing, the newest RingCapacity records are kept.
+	Tracing is off by default: recording then is a single relaxed load, and the ring isn't even allocated until tracing is
+	enabled the first time. The records export to Chrome trace-event JSON (chrome://tracing, Perfetto), with commands and
+	opens as spans on tracks of their own and events and transitions as instants on the threads that recorded them.
+	*/
+	class PlayerTrace
+	{
+	public:
+		static constexpr UINT64 RingCapacity = 4096;
+
+	private:
+		struct Slot
+		{
+			//2 * ticket + 1 while the slot is being written, 2 * ticket + 2 once the record with that ticket is readable
+			std::atomic<UINT64> Stamp{ 0 };
+			std::atomic<UINT64> Timestamp_Nanoseconds{ 0 };
+			std::atomic<UINT32> Type{ 0 };
+			std::atomic<UINT32> Code{ 0 };
+			std::atomic<UINT32> Detail{ 0 };
+			std::atomic<HRESULT> Status{ S_OK };
+			std::atomic<UINT64> Value{ 0 };
+			std::atomic<UINT32> ThreadId{ 0 };
+		};
+
+		std::atomic<bool> IsEnabled;
+		std::mutex EnableMutex;
+		std::unique_ptr<Slot[]> Slots;
+		std::atomic<UINT64> NextTicket;
+
+		void Write(TraceRecordType recordType, UINT32 code, UINT32 detail, HRESULT status, UINT64 value);
+
+	public:
+		PlayerTrace();
+
+		//Start or stop recording. Records made before stopping stay in the ring.
+		HRESULT Enable(bool isEnabled);
+		bool GetIsEnabled();
+
+		//Add a record, if tracing is on
+		void Record(TraceRecordType recordType, UINT32 code, UINT32 detail = 0, HRESULT status = S_OK, UINT64 value = 0)
+		{
+			if (IsEnabled.load(std::memory_order_acquire))
+			{
+				Write(recordType, code, detail, status, value);
+			}
+		}
+
+		//The records still in the ring, oldest first (records being written or overwritten while copying are skipped)
+		HRESULT GetRecords(std::vector<TraceRecord>* outputRecords);
+
+		//Write the records as a Chrome trace-event JSON file
+		HRESULT WriteChromeTrace(PCWSTR outputFilePath);
+	};
+}
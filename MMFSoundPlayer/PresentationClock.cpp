@@ -0,0 +1,70 @@
+#include "PresentationClock.h"
+
+using namespace MMFSoundPlayerLib;
+
+//Low bit of the correlation word, set while the clock is running
+constexpr INT64 RunningFlag = 1;
+
+PresentationClock::PresentationClock()
+{
+	Correlation = 0;
+	Duration_100NanoSecondUnits = 0;
+	Rate = 1.0;
+}
+
+void PresentationClock::SetRate(double inputRate)
+{
+	Rate = inputRate;
+}
+
+void PresentationClock::SetDuration(UINT64 duration_100NanoSecondUnits)
+{
+	Duration_100NanoSecondUnits.store(duration_100NanoSecondUnits, std::memory_order_relaxed);
+}
+
+void PresentationClock::Freeze(UINT64 position_100NanoSecondUnits)
+{
+	Correlation.store((INT64)position_100NanoSecondUnits * 2, std::memory_order_release);
+}
+
+void PresentationClock::Run(UINT64 position_100NanoSecondUnits)
+{
+	//A clock that doesn't advance in real time can only be frozen at the last known position
+	if (Rate <= 0.0)
+	{
+		Freeze(position_100NanoSecondUnits);
+		return;
+	}
+
+	//Store position - rate * now (in nanoseconds), so a read only has to add rate * now back
+	INT64 nowNanoseconds = (INT64)GetMonotonicTimeNanoseconds();
+	INT64 positionNanoseconds = (INT64)position_100NanoSecondUnits * 100;
+	INT64 offsetNanoseconds = Rate == 1.0 ? positionNanoseconds - nowNanoseconds : positionNanoseconds - (INT64)(Rate * (double)nowNanoseconds);
+	Correlation.store(offsetNanoseconds * 2 + RunningFlag, std::memory_order_release);
+}
+
+UINT64 PresentationClock::GetTime_100NanoSecondUnits()
+{
+	INT64 correlation = Correlation.load(std::memory_order_acquire);
+	INT64 value = correlation >> 1;
+
+	INT64 position_100NanoSecondUnits = value;
+	if (correlation & RunningFlag)
+	{
+		INT64 nowNanoseconds = (INT64)GetMonotonicTimeNanoseconds();
+		INT64 positionNanoseconds = Rate == 1.0 ? value + nowNanoseconds : value + (INT64)(Rate * (double)nowNanoseconds);
+		position_100NanoSecondUnits = positionNanoseconds / 100;
+	}
+
+	//Never report a position outside of the file
+	if (position_100NanoSecondUnits < 0)
+	{
+		return 0;
+	}
+	UINT64 duration = Duration_100NanoSecondUnits.load(std::memory_order_relaxed);
+	if (duration != 0 && (UINT64)position_100NanoSecondUnits > duration)
+	{
+		return duration;
+	}
+	return (UINT64)position_100NanoSecondUnits;
+}
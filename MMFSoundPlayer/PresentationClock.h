@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Platform.h"
+#include <atomic>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Interpolated presentation clock. Whenever the presentation starts, pauses, stops or seeks, the position reported by the
+	backend is correlated with the monotonic timer, and reads extrapolate from that correlation instead of asking the backend.
+	The whole correlation is packed into one atomic word (the low bit tells whether the clock is running), so a read is a
+	single atomic load plus the timer query: wait-free, and it never sees half of an update.
+
+	While running, the word holds the position minus the monotonic time (scaled by the rate), while frozen it holds the
+	position itself, so reads are exact while paused or stopped and right after every correlation. In between, the error is
+	the drift between the audio device clock and the monotonic timer, which the next correlation removes.
+	*/
+	class PresentationClock
+	{
+	private:
+		std::atomic<INT64> Correlation;
+		std::atomic<UINT64> Duration_100NanoSecondUnits;
+		double Rate;
+
+	public:
+		PresentationClock();
+
+		//Speed the presentation advances at while running, relative to real time (constant for a backend, set before use)
+		void SetRate(double inputRate);
+
+		//Reads are clamped to the duration of the current file (0 means no clamping)
+		void SetDuration(UINT64 duration_100NanoSecondUnits);
+
+		//The presentation is at position and isn't advancing (paused, stopped, ended)
+		void Freeze(UINT64 position_100NanoSecondUnits);
+
+		//The presentation is at position right now and advancing
+		void Run(UINT64 position_100NanoSecondUnits);
+
+		//Current position, extrapolated from the last correlation (wait-free)
+		UINT64 GetTime_100NanoSecondUnits();
+	};
+}
@@ -0,0 +1,150 @@
+#include "RenderTelemetry.h"
+
+using namespace MMFSoundPlayerLib;
+
+//Histogram----------------------------------------------------------------------------------------------------------------------------------------------------
+TelemetryHistogram::TelemetryHistogram(std::initializer_list<UINT64> inputUpperBounds)
+{
+	BoundCount = 0;
+	for (UINT64 upperBound : inputUpperBounds)
+	{
+		if (BoundCount == MaxBoundCount)
+		{
+			break;
+		}
+		UpperBounds[BoundCount++] = upperBound;
+	}
+	for (std::atomic<UINT64>& bucketCount : Counts)
+	{
+		bucketCount = 0;
+	}
+	Count = 0;
+	Sum = 0;
+	Max = 0;
+}
+
+void TelemetryHistogram::Add(UINT64 value)
+{
+	//The bucket lists are short, a linear search beats anything cleverer
+	size_t bucket = 0;
+	while (bucket < BoundCount && value > UpperBounds[bucket])
+	{
+		bucket++;
+	}
+
+	//Only one thread writes, so plain read-modify-write pairs do (no locked instructions on the render thread)
+	Counts[bucket].store(Counts[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	Count.store(Count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	Sum.store(Sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	if (value > Max.load(std::memory_order_relaxed))
+	{
+		Max.store(value, std::memory_order_relaxed);
+	}
+}
+
+void TelemetryHistogram::GetSnapshot(TelemetryHistogramSnapshot* outputSnapshot) const
+{
+	outputSnapshot->UpperBounds.assign(UpperBounds, UpperBounds + BoundCount);
+	outputSnapshot->Counts.resize(BoundCount + 1);
+	for (size_t bucket = 0; bucket <= BoundCount; bucket++)
+	{
+		outputSnapshot->Counts[bucket] = Counts[bucket].load(std::memory_order_relaxed);
+	}
+	outputSnapshot->Count = Count.load(std::memory_order_relaxed);
+	outputSnapshot->Sum = Sum.load(std::memory_order_relaxed);
+	outputSnapshot->Max = Max.load(std::memory_order_relaxed);
+}
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+RenderTelemetry::RenderTelemetry() :
+	PeriodJitter_Microseconds({ 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 }),
+	BufferFill_Blocks({ 0, 1, 2, 3, 4, 6, 8, 12, 16, 32 }),
+	DecodeTime_Microseconds({ 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000 })
+{
+	PeriodsRendered = 0;
+	UnderrunCount = 0;
+	LatePeriodCount = 0;
+	SinkFailureCount = 0;
+	AudioRendered_Nanoseconds = 0;
+	DecodeCpuTime_Nanoseconds = 0;
+	RenderCpuTime_Nanoseconds = 0;
+}
+
+//Recording----------------------------------------------------------------------------------------------------------------------------------------------------
+//Every counter has a single writer, so they are bumped without locked instructions
+static void AddToCounter(std::atomic<UINT64>& counter, UINT64 value)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void RenderTelemetry::AddRenderedPeriod(UINT32 frameCount, UINT32 sampleRate, bool isUnderrun)
+{
+	AddToCounter(PeriodsRendered, 1);
+	if (isUnderrun)
+	{
+		AddToCounter(UnderrunCount, 1);
+	}
+	if (sampleRate > 0)
+	{
+		AddToCounter(AudioRendered_Nanoseconds, (UINT64)frameCount * 1000000000 / sampleRate);
+	}
+}
+
+void RenderTelemetry::AddSinkFailure()
+{
+	AddToCounter(SinkFailureCount, 1);
+}
+
+void RenderTelemetry::AddPeriodWakeUp(UINT64 lateness_Nanoseconds, UINT64 period_Nanoseconds)
+{
+	PeriodJitter_Microseconds.Add(lateness_Nanoseconds / 1000);
+
+	//A period more than a period late left the output with nothing to play for a while: a glitch, however full the buffer was
+	if (period_Nanoseconds > 0 && lateness_Nanoseconds > period_Nanoseconds)
+	{
+		AddToCounter(LatePeriodCount, 1);
+	}
+}
+
+void RenderTelemetry::AddBufferFill(UINT64 readableBlockCount)
+{
+	BufferFill_Blocks.Add(readableBlockCount);
+}
+
+void RenderTelemetry::AddRenderCpuTime(UINT64 cpuTime_Nanoseconds)
+{
+	AddToCounter(RenderCpuTime_Nanoseconds, cpuTime_Nanoseconds);
+}
+
+void RenderTelemetry::AddDecodedBlock(UINT64 decodeTime_Nanoseconds, UINT64 cpuTime_Nanoseconds)
+{
+	DecodeTime_Microseconds.Add(decodeTime_Nanoseconds / 1000);
+	AddToCounter(DecodeCpuTime_Nanoseconds, cpuTime_Nanoseconds);
+}
+
+//Getters------------------------------------------------------------------------------------------------------------------------------------------------------
+RenderTelemetrySnapshot RenderTelemetry::GetSnapshot() const
+{
+	RenderTelemetrySnapshot snapshot;
+	snapshot.PeriodsRendered = PeriodsRendered.load(std::memory_order_relaxed);
+	snapshot.UnderrunCount = UnderrunCount.load(std::memory_order_relaxed);
+	snapshot.LatePeriodCount = LatePeriodCount.load(std::memory_order_relaxed);
+	snapshot.SinkFailureCount = SinkFailureCount.load(std::memory_order_relaxed);
+	snapshot.AudioRendered_Nanoseconds = AudioRendered_Nanoseconds.load(std::memory_order_relaxed);
+	snapshot.DecodeCpuTime_Nanoseconds = DecodeCpuTime_Nanoseconds.load(std::memory_order_relaxed);
+	snapshot.RenderCpuTime_Nanoseconds = RenderCpuTime_Nanoseconds.load(std::memory_order_relaxed);
+	if (snapshot.AudioRendered_Nanoseconds > 0)
+	{
+		double cpuTime_Milliseconds = (snapshot.DecodeCpuTime_Nanoseconds + snapshot.RenderCpuTime_Nanoseconds) / 1000000.0;
+		snapshot.CpuTimePerAudioSecond_Milliseconds = cpuTime_Milliseconds / (snapshot.AudioRendered_Nanoseconds / 1000000000.0);
+	}
+	PeriodJitter_Microseconds.GetSnapshot(&snapshot.PeriodJitter_Microseconds);
+	BufferFill_Blocks.GetSnapshot(&snapshot.BufferFill_Blocks);
+	DecodeTime_Microseconds.GetSnapshot(&snapshot.DecodeTime_Microseconds);
+	return snapshot;
+}
+
+UINT64 RenderTelemetry::GetUnderrunCount() const
+{
+	return UnderrunCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Platform.h"
+#include <atomic>
+#include <initializer_list>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	//Copy of a TelemetryHistogram. Counts[i] holds the values up to UpperBounds[i] (and above UpperBounds[i - 1]), the last
+	//count the values above every bound, so Counts has one entry more than UpperBounds.
+	struct TelemetryHistogramSnapshot
+	{
+		std::vector<UINT64> UpperBounds;
+		std::vector<UINT64> Counts;
+		UINT64 Count = 0;
+		UINT64 Sum = 0;
+		UINT64 Max = 0;
+	};
+
+	/*
+	Histogram over fixed buckets, written by one thread and read from any. Adding a value is a few relaxed atomic
+	increments, no locks and no allocation, so it is fine on the render thread. A snapshot taken while values are being
+	added may be off by the values in flight (the buckets, count and sum aren't read as one).
+	*/
+	class TelemetryHistogram
+	{
+	public:
+		static constexpr size_t MaxBoundCount = 15;
+
+	private:
+		UINT64 UpperBounds[MaxBoundCount];
+		size_t BoundCount;
+		std::atomic<UINT64> Counts[MaxBoundCount + 1];
+		std::atomic<UINT64> Count;
+		std::atomic<UINT64> Sum;
+		std::atomic<UINT64> Max;
+
+	public:
+		//The bounds must be ascending (at most MaxBoundCount are used)
+		TelemetryHistogram(std::initializer_list<UINT64> inputUpperBounds);
+
+		//Single writer only
+		void Add(UINT64 value);
+
+		void GetSnapshot(TelemetryHistogramSnapshot* outputSnapshot) const;
+	};
+
+	//What the render engine did since it started. Counters only ever grow, the ratios are worked out from them.
+	struct RenderTelemetrySnapshot
+	{
+		UINT64 PeriodsRendered = 0;             // Periods written to the sink, silence for underruns included.
+		UINT64 UnderrunCount = 0;               // Periods the render thread found no decoded audio for (rendered as silence).
+		UINT64 LatePeriodCount = 0;             // Periods the render thread got to more than a period after they were due.
+		UINT64 SinkFailureCount = 0;            // Sink writes or reopens that failed (each one ends the presentation).
+		UINT64 AudioRendered_Nanoseconds = 0;   // Duration of the audio written to the sink.
+		UINT64 DecodeCpuTime_Nanoseconds = 0;   // CPU time of the decoding thread spent decoding blocks.
+		UINT64 RenderCpuTime_Nanoseconds = 0;   // CPU time of the render thread spent rendering periods (not waiting for them).
+
+		//CPU time spent per second of audio rendered, decode and render together (0 before anything was rendered)
+		double CpuTimePerAudioSecond_Milliseconds = 0.0;
+
+		//How late the render thread woke up for each period, against when the period was due (paced rendering only)
+		TelemetryHistogramSnapshot PeriodJitter_Microseconds;
+
+		//Decoded blocks waiting in the decode-ahead ring each time the render thread went for the next one (0 is an underrun)
+		TelemetryHistogramSnapshot BufferFill_Blocks;
+
+		//Time to decode one block (a period of audio)
+		TelemetryHistogramSnapshot DecodeTime_Microseconds;
+	};
+
+	/*
+	Health counters of a render engine: underruns and other glitches, how regularly the render thread runs, how full the
+	decode-ahead buffer is kept, and what decoding and rendering cost. Each value has a single writer (the decoding or the
+	render thread) and updates it with relaxed atomics, GetSnapshot can be called from any thread at any time.
+	*/
+	class RenderTelemetry
+	{
+	private:
+		std::atomic<UINT64> PeriodsRendered;
+		std::atomic<UINT64> UnderrunCount;
+		std::atomic<UINT64> LatePeriodCount;
+		std::atomic<UINT64> SinkFailureCount;
+		std::atomic<UINT64> AudioRendered_Nanoseconds;
+		std::atomic<UINT64> DecodeCpuTime_Nanoseconds;
+		std::atomic<UINT64> RenderCpuTime_Nanoseconds;
+		TelemetryHistogram PeriodJitter_Microseconds;
+		TelemetryHistogram BufferFill_Blocks;
+		TelemetryHistogram DecodeTime_Microseconds;
+
+	public:
+		RenderTelemetry();
+
+		//Render thread
+		void AddRenderedPeriod(UINT32 frameCount, UINT32 sampleRate, bool isUnderrun);
+		void AddSinkFailure();
+		void AddPeriodWakeUp(UINT64 lateness_Nanoseconds, UINT64 period_Nanoseconds);
+		void AddBufferFill(UINT64 readableBlockCount);
+		void AddRenderCpuTime(UINT64 cpuTime_Nanoseconds);
+
+		//Decoding thread
+		void AddDecodedBlock(UINT64 decodeTime_Nanoseconds, UINT64 cpuTime_Nanoseconds);
+
+		RenderTelemetrySnapshot GetSnapshot() const;
+		UINT64 GetUnderrunCount() const;
+	};
+}
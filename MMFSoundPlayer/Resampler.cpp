@@ -0,0 +1,452 @@
+#include "Resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define RESAMPLER_KERNELS_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define RESAMPLER_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+//GCC and Clang only emit AVX2 instructions in functions marked for it, MSVC emits them anywhere
+#if defined(RESAMPLER_KERNELS_X86) && !defined(_MSC_VER)
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define AVX2_FUNCTION
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+//Input frames deinterleaved into the history at a time
+static const UINT32 ResamplerChunkFrames = 4096;
+
+static const double Pi = 3.14159265358979323846;
+
+//Kernels------------------------------------------------------------------------------------------------------------------------------------------------------
+typedef float (*DotProductKernel)(const float* samples, const float* coefficients, size_t count);
+
+static float DotProductScalar(const float* samples, const float* coefficients, size_t count)
+{
+	float sum = 0.0f;
+	for (size_t tap = 0; tap < count; tap++)
+	{
+		sum += samples[tap] * coefficients[tap];
+	}
+	return sum;
+}
+
+#ifdef RESAMPLER_KERNELS_X86
+static float DotProductSse2(const float* samples, const float* coefficients, size_t count)
+{
+	//Two accumulators hide the latency of the adds
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	size_t tap = 0;
+	for (; tap + 8 <= count; tap += 8)
+	{
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(samples + tap), _mm_loadu_ps(coefficients + tap)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(samples + tap + 4), _mm_loadu_ps(coefficients + tap + 4)));
+	}
+	__m128 sum = _mm_add_ps(sum0, sum1);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum) + DotProductScalar(samples + tap, coefficients + tap, count - tap);
+}
+
+AVX2_FUNCTION static float DotProductAvx2(const float* samples, const float* coefficients, size_t count)
+{
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	size_t tap = 0;
+	for (; tap + 16 <= count; tap += 16)
+	{
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(samples + tap), _mm256_loadu_ps(coefficients + tap)));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(samples + tap + 8), _mm256_loadu_ps(coefficients + tap + 8)));
+	}
+	for (; tap + 8 <= count; tap += 8)
+	{
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(samples + tap), _mm256_loadu_ps(coefficients + tap)));
+	}
+	__m256 sum256 = _mm256_add_ps(sum0, sum1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum) + DotProductScalar(samples + tap, coefficients + tap, count - tap);
+}
+#endif
+
+#ifdef RESAMPLER_KERNELS_NEON
+static float DotProductNeon(const float* samples, const float* coefficients, size_t count)
+{
+	float32x4_t sum0 = vdupq_n_f32(0.0f);
+	float32x4_t sum1 = vdupq_n_f32(0.0f);
+	size_t tap = 0;
+	for (; tap + 8 <= count; tap += 8)
+	{
+		sum0 = vaddq_f32(sum0, vmulq_f32(vld1q_f32(samples + tap), vld1q_f32(coefficients + tap)));
+		sum1 = vaddq_f32(sum1, vmulq_f32(vld1q_f32(samples + tap + 4), vld1q_f32(coefficients + tap + 4)));
+	}
+	float32x4_t sum = vaddq_f32(sum0, sum1);
+	float32x2_t halfSum = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+	return vget_lane_f32(vpadd_f32(halfSum, halfSum), 0) + DotProductScalar(samples + tap, coefficients + tap, count - tap);
+}
+#endif
+
+static DotProductKernel SelectDotProductKernel(GainKernels::InstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+#ifdef RESAMPLER_KERNELS_X86
+	case GainKernels::InstructionSet::Avx2:
+		return DotProductAvx2;
+	case GainKernels::InstructionSet::Sse2:
+		return DotProductSse2;
+#endif
+#ifdef RESAMPLER_KERNELS_NEON
+	case GainKernels::InstructionSet::Neon:
+		return DotProductNeon;
+#endif
+	default:
+		return DotProductScalar;
+	}
+}
+
+float ResamplerKernels::DotProduct(const float* samples, const float* coefficients, size_t count, GainKernels::InstructionSet instructionSet)
+{
+	return SelectDotProductKernel(instructionSet)(samples, coefficients, count);
+}
+
+//Filter Design------------------------------------------------------------------------------------------------------------------------------------------------
+static UINT32 GreatestCommonDivisor(UINT32 a, UINT32 b)
+{
+	while (b != 0)
+	{
+		UINT32 remainder = a % b;
+		a = b;
+		b = remainder;
+	}
+	return a;
+}
+
+//Modified Bessel function of the first kind, order 0 (the Kaiser window)
+static double BesselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	double halfX = x / 2.0;
+	for (int k = 1; k < 64 && term > sum * 1e-15; k++)
+	{
+		term *= (halfX / k) * (halfX / k);
+		sum += term;
+	}
+	return sum;
+}
+
+static std::shared_ptr<ResamplerFilterBank> BuildFilterBank(UINT32 inputSampleRate, UINT32 outputSampleRate, ResamplerQuality quality)
+{
+	std::shared_ptr<ResamplerFilterBank> filterBank = std::make_shared<ResamplerFilterBank>();
+	filterBank->InputSampleRate = inputSampleRate;
+	filterBank->OutputSampleRate = outputSampleRate;
+	filterBank->Quality = quality;
+
+	//Filter length (at the lower rate) and stopband attenuation of the quality
+	UINT32 baseTapCount = 48;
+	double stopbandAttenuation_dB = 90.0;
+	switch (quality)
+	{
+	case ResamplerQuality::Fast:
+		baseTapCount = 24;
+		stopbandAttenuation_dB = 60.0;
+		break;
+	case ResamplerQuality::High:
+		baseTapCount = 128;
+		stopbandAttenuation_dB = 120.0;
+		break;
+	default:
+		break;
+	}
+
+	//Kaiser's formulas: the window's beta for the attenuation, and the transition band the length allows for it. The band
+	//ends at the lower Nyquist frequency, nothing above it aliases back in.
+	double kaiserBeta = 0.1102 * (stopbandAttenuation_dB - 8.7);
+	double transitionWidth = (stopbandAttenuation_dB - 7.95) / (2.285 * baseTapCount * Pi);
+	double rateScale = std::min(1.0, (double)outputSampleRate / inputSampleRate);
+	double cutoff = (1.0 - transitionWidth / 2.0) * rateScale;
+
+	//Downsampling stretches the filter over more input frames
+	UINT32 tapCount = (UINT32)std::ceil(baseTapCount / rateScale);
+	tapCount = (tapCount + 7) / 8 * 8;
+	filterBank->TapCount = tapCount;
+
+	//A row per phase for ratios with a reasonable numerator (44.1 <-> 48 kHz is 160/147), interpolated rows otherwise
+	UINT32 divisor = GreatestCommonDivisor(inputSampleRate, outputSampleRate);
+	UINT32 rowCount = 0;
+	if (outputSampleRate / divisor <= ResamplerFilterBank::MaxExactPhaseCount)
+	{
+		filterBank->IsExact = true;
+		filterBank->PhaseCount = outputSampleRate / divisor;
+		filterBank->PhaseStep = inputSampleRate / divisor;
+		rowCount = filterBank->PhaseCount;
+	}
+	else
+	{
+		filterBank->IsExact = false;
+		filterBank->PhaseCount = ResamplerFilterBank::InterpolatedPhaseCount;
+		rowCount = filterBank->PhaseCount + 1;
+	}
+
+	//Row p is the windowed sinc sampled at the taps' distances from an output p/PhaseCount of a frame behind the window's
+	//middle. Every row is normalized to unity gain at DC, so no phase adds a ripple of its own.
+	double halfLength = tapCount / 2.0;
+	double windowNormalization = 1.0 / BesselI0(kaiserBeta);
+	filterBank->Coefficients.resize((size_t)rowCount * tapCount);
+	std::vector<double> row(tapCount);
+	for (UINT32 phase = 0; phase < rowCount; phase++)
+	{
+		double fraction = (double)phase / filterBank->PhaseCount;
+		double rowSum = 0.0;
+		for (UINT32 tap = 0; tap < tapCount; tap++)
+		{
+			double distance = (double)tap - (halfLength - 1.0) - fraction;
+			double windowPosition = distance / halfLength;
+			double window = windowPosition * windowPosition < 1.0 ? BesselI0(kaiserBeta * std::sqrt(1.0 - windowPosition * windowPosition)) * windowNormalization : 0.0;
+			double sincArgument = Pi * cutoff * distance;
+			double sinc = sincArgument != 0.0 ? std::sin(sincArgument) / sincArgument : 1.0;
+			row[tap] = cutoff * sinc * window;
+			rowSum += row[tap];
+		}
+		float* coefficients = filterBank->Coefficients.data() + (size_t)phase * tapCount;
+		for (UINT32 tap = 0; tap < tapCount; tap++)
+		{
+			coefficients[tap] = (float)(row[tap] / rowSum);
+		}
+	}
+	return filterBank;
+}
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+Resampler::Resampler()
+{
+	DotProduct = DotProductScalar;
+	ChannelCount = 0;
+	HistoryCapacity = 0;
+	HistoryLength = 0;
+	WindowStart = 0;
+	Phase = 0;
+	Fraction = 0;
+	FractionStep = 0;
+	InputFramesProcessed = 0;
+	OutputFramesProduced = 0;
+}
+
+std::shared_ptr<const ResamplerFilterBank> Resampler::GetFilterBank(UINT32 inputSampleRate, UINT32 outputSampleRate, ResamplerQuality quality)
+{
+	//A player only ever meets a handful of ratios, so the banks are kept for good
+	static std::mutex filterBankMutex;
+	static std::map<std::tuple<UINT32, UINT32, ResamplerQuality>, std::shared_ptr<const ResamplerFilterBank>> filterBanks;
+
+	std::lock_guard<std::mutex> lock(filterBankMutex);
+	std::shared_ptr<const ResamplerFilterBank>& filterBank = filterBanks[std::make_tuple(inputSampleRate, outputSampleRate, quality)];
+	if (filterBank == nullptr)
+	{
+		filterBank = BuildFilterBank(inputSampleRate, outputSampleRate, quality);
+	}
+	return filterBank;
+}
+
+HRESULT Resampler::Initialize(UINT32 inputSampleRate, UINT32 outputSampleRate, UINT32 channelCount, ResamplerQuality quality, GainKernels::InstructionSet instructionSet)
+{
+	if (inputSampleRate == 0 || outputSampleRate == 0 || channelCount == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	FilterBank = GetFilterBank(inputSampleRate, outputSampleRate, quality);
+	DotProduct = SelectDotProductKernel(instructionSet);
+	ChannelCount = channelCount;
+	HistoryCapacity = FilterBank->TapCount + ResamplerChunkFrames;
+	History.assign((size_t)HistoryCapacity * ChannelCount, 0.0f);
+	FractionStep = ((UINT64)inputSampleRate << 32) / outputSampleRate;
+	Reset();
+	return S_OK;
+}
+
+void Resampler::Reset()
+{
+	//The first window starts half a filter before the first frame, on silence, so the output isn't delayed
+	HistoryLength = FilterBank != nullptr ? FilterBank->TapCount / 2 - 1 : 0;
+	std::fill(History.begin(), History.end(), 0.0f);
+	WindowStart = 0;
+	Phase = 0;
+	Fraction = 0;
+	InputFramesProcessed = 0;
+	OutputFramesProduced = 0;
+}
+
+//Conversion---------------------------------------------------------------------------------------------------------------------------------------------------
+void Resampler::AppendInput(const float* inputFrames, UINT32 frameCount)
+{
+	//Move the window to the front first, the history only ever holds a filter and a chunk
+	if (WindowStart > 0)
+	{
+		UINT32 keptFrames = HistoryLength - WindowStart;
+		for (UINT32 channel = 0; channel < ChannelCount; channel++)
+		{
+			float* channelHistory = History.data() + (size_t)channel * HistoryCapacity;
+			std::copy_n(channelHistory + WindowStart, keptFrames, channelHistory);
+		}
+		HistoryLength = keptFrames;
+		WindowStart = 0;
+	}
+
+	//Deinterleave, so the taps of every channel are contiguous
+	for (UINT32 channel = 0; channel < ChannelCount; channel++)
+	{
+		float* channelHistory = History.data() + (size_t)channel * HistoryCapacity + HistoryLength;
+		if (inputFrames != nullptr)
+		{
+			for (UINT32 frame = 0; frame < frameCount; frame++)
+			{
+				channelHistory[frame] = inputFrames[(size_t)frame * ChannelCount + channel];
+			}
+		}
+		else
+		{
+			std::fill_n(channelHistory, frameCount, 0.0f);
+		}
+	}
+	HistoryLength += frameCount;
+}
+
+void Resampler::ProduceOutput(std::vector<float>& outputFrames, UINT32* outputFrameCount)
+{
+	const ResamplerFilterBank& filterBank = *FilterBank;
+	UINT32 tapCount = filterBank.TapCount;
+	const float* coefficients = filterBank.Coefficients.data();
+
+	//Every output whose window is complete
+	UINT32 frameCount = *outputFrameCount;
+	while (WindowStart + tapCount <= HistoryLength)
+	{
+		float* outputFrame = outputFrames.data() + (size_t)frameCount * ChannelCount;
+		const float* channelWindow = History.data() + WindowStart;
+		if (filterBank.IsExact)
+		{
+			const float* row = coefficients + (size_t)Phase * tapCount;
+			for (UINT32 channel = 0; channel < ChannelCount; channel++, channelWindow += HistoryCapacity)
+			{
+				outputFrame[channel] = DotProduct(channelWindow, row, tapCount);
+			}
+
+			Phase += filterBank.PhaseStep;
+			WindowStart += Phase / filterBank.PhaseCount;
+			Phase %= filterBank.PhaseCount;
+		}
+		else
+		{
+			//Between the two rows nearest to the fraction
+			UINT64 scaledFraction = Fraction * filterBank.PhaseCount;
+			const float* row = coefficients + (size_t)(scaledFraction >> 32) * tapCount;
+			float weight = (float)(scaledFraction & 0xFFFFFFFF) * (1.0f / 4294967296.0f);
+			for (UINT32 channel = 0; channel < ChannelCount; channel++, channelWindow += HistoryCapacity)
+			{
+				float sample0 = DotProduct(channelWindow, row, tapCount);
+				float sample1 = DotProduct(channelWindow, row + tapCount, tapCount);
+				outputFrame[channel] = sample0 + (sample1 - sample0) * weight;
+			}
+
+			Fraction += FractionStep;
+			WindowStart += (UINT32)(Fraction >> 32);
+			Fraction &= 0xFFFFFFFF;
+		}
+		frameCount++;
+	}
+	OutputFramesProduced += frameCount - *outputFrameCount;
+	*outputFrameCount = frameCount;
+}
+
+HRESULT Resampler::Process(const float* inputFrames, UINT32 inputFrameCount, std::vector<float>& outputFrames, UINT32* outputFrameCount)
+{
+	if ((inputFrames == nullptr && inputFrameCount > 0) || outputFrameCount == nullptr)
+	{
+		return E_POINTER;
+	}
+	*outputFrameCount = 0;
+	if (FilterBank == nullptr)
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Sized for the worst case up front, the vector keeps its capacity from call to call
+	outputFrames.resize((size_t)GetMaxOutputFrameCount(inputFrameCount) * ChannelCount);
+	for (UINT32 frame = 0; frame < inputFrameCount; frame += ResamplerChunkFrames)
+	{
+		UINT32 chunkFrames = std::min(ResamplerChunkFrames, inputFrameCount - frame);
+		AppendInput(inputFrames + (size_t)frame * ChannelCount, chunkFrames);
+		ProduceOutput(outputFrames, outputFrameCount);
+	}
+	InputFramesProcessed += inputFrameCount;
+	outputFrames.resize((size_t)*outputFrameCount * ChannelCount);
+	return S_OK;
+}
+
+HRESULT Resampler::Drain(std::vector<float>& outputFrames, UINT32* outputFrameCount)
+{
+	if (outputFrameCount == nullptr)
+	{
+		return E_POINTER;
+	}
+	*outputFrameCount = 0;
+	if (FilterBank == nullptr)
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Silence behind the end completes the last windows, the outputs lying behind the end of the input are dropped
+	UINT32 lookaheadFrames = FilterBank->TapCount / 2 + 1;
+	outputFrames.resize((size_t)GetMaxOutputFrameCount(lookaheadFrames) * ChannelCount);
+	AppendInput(nullptr, lookaheadFrames);
+	ProduceOutput(outputFrames, outputFrameCount);
+
+	UINT64 expectedFrames = (InputFramesProcessed * FilterBank->OutputSampleRate + FilterBank->InputSampleRate - 1) / FilterBank->InputSampleRate;
+	UINT64 excessFrames = OutputFramesProduced > expectedFrames ? OutputFramesProduced - expectedFrames : 0;
+	*outputFrameCount -= (UINT32)std::min<UINT64>(excessFrames, *outputFrameCount);
+	outputFrames.resize((size_t)*outputFrameCount * ChannelCount);
+
+	//Whatever comes next is a new stream
+	Reset();
+	return S_OK;
+}
+
+//Getters------------------------------------------------------------------------------------------------------------------------------------------------------
+bool Resampler::IsInitialized()
+{
+	return FilterBank != nullptr;
+}
+
+UINT32 Resampler::GetInputSampleRate()
+{
+	return FilterBank != nullptr ? FilterBank->InputSampleRate : 0;
+}
+
+UINT32 Resampler::GetOutputSampleRate()
+{
+	return FilterBank != nullptr ? FilterBank->OutputSampleRate : 0;
+}
+
+UINT32 Resampler::GetMaxOutputFrameCount(UINT32 inputFrameCount)
+{
+	if (FilterBank == nullptr)
+	{
+		return 0;
+	}
+
+	//The input plus what the history already holds beyond the current window, rounded up
+	UINT64 inputFrames = (UINT64)inputFrameCount + FilterBank->TapCount + 1;
+	return (UINT32)(inputFrames * FilterBank->OutputSampleRate / FilterBank->InputSampleRate + 2);
+}
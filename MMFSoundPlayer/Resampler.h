@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Platform.h"
+#include "GainStage.h"
+#include <memory>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	//Trade-off between CPU cost and quality (filter length and stopband attenuation)
+	enum class ResamplerQuality
+	{
+		Fast,       // 24 taps, 60 dB.
+		Balanced,   // 48 taps, 90 dB.
+		High        // 128 taps, 120 dB.
+	};
+
+	/*
+	Coefficients of one conversion, shared by every resampler doing it (built once per ratio and quality). Row p holds the
+	taps for an output that lies p/PhaseCount of an input frame behind the start of its window, oldest input first, so an
+	output is a single dot product over contiguous memory. Rational ratios with a small numerator get a row per phase they
+	actually use, the others get InterpolatedPhaseCount + 1 rows and interpolate between the two nearest.
+	*/
+	struct ResamplerFilterBank
+	{
+		static constexpr UINT32 MaxExactPhaseCount = 1024;
+		static constexpr UINT32 InterpolatedPhaseCount = 256;
+
+		UINT32 InputSampleRate = 0;
+		UINT32 OutputSampleRate = 0;
+		ResamplerQuality Quality = ResamplerQuality::Balanced;
+		bool IsExact = false;
+		UINT32 PhaseCount = 0;      // Output frames per PhaseStep input frames for exact ratios.
+		UINT32 PhaseStep = 0;
+		UINT32 TapCount = 0;        // Per row, a multiple of 8.
+		std::vector<float> Coefficients;
+	};
+
+	/*
+	Polyphase sample-rate converter for interleaved float audio with arbitrary ratios. A Kaiser windowed sinc low-pass,
+	cut off below the lower of the two Nyquist frequencies, serves as both the interpolation and the anti-aliasing filter.
+	The output is aligned with the input (the filter delay is compensated) and, once drained, has exactly the length of the
+	input at the output rate. Not thread-safe, one resampler per stream.
+	*/
+	class Resampler
+	{
+	private:
+		typedef float (*DotProductFunction)(const float* samples, const float* coefficients, size_t count);
+
+		std::shared_ptr<const ResamplerFilterBank> FilterBank;
+		DotProductFunction DotProduct;
+		UINT32 ChannelCount;
+
+		//Planar input history per channel, the window of the next output starts at WindowStart
+		std::vector<float> History;
+		UINT32 HistoryCapacity;
+		UINT32 HistoryLength;
+		UINT32 WindowStart;
+
+		//Position of the next output within its window: a phase for exact ratios, a 32.32 fraction of a frame otherwise
+		UINT32 Phase;
+		UINT64 Fraction;
+		UINT64 FractionStep;
+
+		UINT64 InputFramesProcessed;
+		UINT64 OutputFramesProduced;
+
+		void AppendInput(const float* inputFrames, UINT32 frameCount);
+		void ProduceOutput(std::vector<float>& outputFrames, UINT32* outputFrameCount);
+
+	public:
+		Resampler();
+
+		//The filter bank for a conversion, built on first use (may take a few milliseconds, so better not on a real-time thread)
+		static std::shared_ptr<const ResamplerFilterBank> GetFilterBank(UINT32 inputSampleRate, UINT32 outputSampleRate, ResamplerQuality quality);
+
+		HRESULT Initialize(UINT32 inputSampleRate, UINT32 outputSampleRate, UINT32 channelCount, ResamplerQuality quality = ResamplerQuality::Balanced,
+			GainKernels::InstructionSet instructionSet = GainKernels::GetBestInstructionSet());
+
+		//Convert interleaved frames. All input is consumed, outputFrames is resized to what is ready (the filter looks ahead
+		//half its length, that much output is held back until more input or Drain).
+		HRESULT Process(const float* inputFrames, UINT32 inputFrameCount, std::vector<float>& outputFrames, UINT32* outputFrameCount);
+
+		//End of the stream: produce the output held back, up to the exact length of the input
+		HRESULT Drain(std::vector<float>& outputFrames, UINT32* outputFrameCount);
+
+		//Forget the history (a seek), keeping the filter bank
+		void Reset();
+
+		bool IsInitialized();
+		UINT32 GetInputSampleRate();
+		UINT32 GetOutputSampleRate();
+
+		//Upper bound of the frames Process returns for inputFrameCount frames
+		UINT32 GetMaxOutputFrameCount(UINT32 inputFrameCount);
+	};
+
+	//The dot product behind Resampler, exposed for benchmarking and for checking it against the scalar reference (the vector
+	//versions add in another order, so they agree to rounding, not bit for bit)
+	namespace ResamplerKernels
+	{
+		float DotProduct(const float* samples, const float* coefficients, size_t count, GainKernels::InstructionSet instructionSet = GainKernels::GetBestInstructionSet());
+	}
+}
@@ -0,0 +1,397 @@
+#include "SeekIndex.h"
+#include "MemoryMappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+
+using namespace MMFSoundPlayerLib;
+
+//Persisted layout, followed by SeekPointCount UINT64 byte offsets
+#pragma pack(push, 1)
+struct SeekIndexHeader
+{
+	UINT32 Magic;
+	UINT32 Version;
+	UINT64 FileSize;
+	INT64 ModifiedTime;
+	UINT64 FrameCount;
+	UINT32 SampleRate;
+	UINT32 ChannelCount;
+	UINT32 SamplesPerFrame;
+	UINT32 StartPaddingSamples;
+	UINT32 EndPaddingSamples;
+	UINT32 SeekPointStride;
+	UINT32 SeekPointCount;
+	UINT32 Reserved;
+};
+#pragma pack(pop)
+
+static constexpr UINT32 SeekIndexMagic = 0x4B45534D; // "MSEK"
+static constexpr UINT32 SeekIndexVersion = 1;
+
+//Samples every MPEG audio decoder outputs before the first encoded one, which the LAME delay and padding don't include
+static constexpr UINT32 DecoderDelaySamples = 529;
+
+//MPEG audio frame headers-------------------------------------------------------------------------------------------------------------------------------------
+struct MpegFrameHeader
+{
+	UINT32 Version;       // 3 = MPEG-1, 2 = MPEG-2, 0 = MPEG-2.5.
+	UINT32 Layer;         // 1, 2 or 3.
+	UINT32 SampleRate;
+	UINT32 ChannelCount;
+	UINT32 SamplesPerFrame;
+	UINT32 FrameLength;   // Bytes, header included.
+};
+
+static bool ParseMpegFrameHeader(const unsigned char* inputHeader, MpegFrameHeader* outputHeader)
+{
+	static const UINT32 BitratesKbps[5][16] =
+	{
+		{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 }, // MPEG-1 Layer I
+		{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },    // MPEG-1 Layer II
+		{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },     // MPEG-1 Layer III
+		{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },    // MPEG-2/2.5 Layer I
+		{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 }          // MPEG-2/2.5 Layer II and III
+	};
+	static const UINT32 SampleRates[3] = { 44100, 48000, 32000 };
+
+	//11 bit sync word, then reject the reserved version, layer, bitrate and sample rate values
+	if (inputHeader[0] != 0xFF || (inputHeader[1] & 0xE0) != 0xE0)
+	{
+		return false;
+	}
+	UINT32 version = (inputHeader[1] >> 3) & 3;
+	UINT32 layerBits = (inputHeader[1] >> 1) & 3;
+	UINT32 bitrateIndex = inputHeader[2] >> 4;
+	UINT32 sampleRateIndex = (inputHeader[2] >> 2) & 3;
+	UINT32 padding = (inputHeader[2] >> 1) & 1;
+	if (version == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3)
+	{
+		return false;
+	}
+
+	UINT32 layer = 4 - layerBits;
+	UINT32 bitrateTable = version == 3 ? layer - 1 : (layer == 1 ? 3 : 4);
+	UINT32 bitrate = BitratesKbps[bitrateTable][bitrateIndex] * 1000;
+	UINT32 sampleRate = SampleRates[sampleRateIndex] >> (version == 3 ? 0 : (version == 2 ? 1 : 2));
+
+	outputHeader->Version = version;
+	outputHeader->Layer = layer;
+	outputHeader->SampleRate = sampleRate;
+	outputHeader->ChannelCount = (inputHeader[3] >> 6) == 3 ? 1 : 2;
+	if (layer == 1)
+	{
+		outputHeader->SamplesPerFrame = 384;
+		outputHeader->FrameLength = (12 * bitrate / sampleRate + padding) * 4;
+	}
+	else
+	{
+		outputHeader->SamplesPerFrame = (layer == 3 && version != 3) ? 576 : 1152;
+		outputHeader->FrameLength = outputHeader->SamplesPerFrame / 8 * bitrate / sampleRate + padding;
+	}
+	return true;
+}
+
+static bool IsSameStream(const MpegFrameHeader& first, const MpegFrameHeader& second)
+{
+	return first.Version == second.Version && first.Layer == second.Layer && first.SampleRate == second.SampleRate;
+}
+
+//Finds the first frame at or after offset that is followed by another frame of the same stream (or the end of the data), so sync words in junk are skipped
+static bool FindNextFrame(const unsigned char* data, UINT64 dataEnd, UINT64& offset, MpegFrameHeader* outputHeader)
+{
+	for (; offset + 4 <= dataEnd; offset++)
+	{
+		if (!ParseMpegFrameHeader(data + offset, outputHeader) || offset + outputHeader->FrameLength > dataEnd)
+		{
+			continue;
+		}
+
+		UINT64 nextOffset = offset + outputHeader->FrameLength;
+		MpegFrameHeader nextHeader;
+		if (nextOffset + 4 > dataEnd || (ParseMpegFrameHeader(data + nextOffset, &nextHeader) && IsSameStream(*outputHeader, nextHeader)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//Reads the Xing/Info header of an encoder's first (silent) frame. Returns false if the frame holds audio.
+static bool ReadXingFrame(const unsigned char* frame, const MpegFrameHeader& header, UINT32* startPadding, UINT32* endPadding)
+{
+	//The Xing header sits right after the side information
+	UINT32 xingOffset = 4 + (header.Version == 3 ? (header.ChannelCount == 1 ? 17 : 32) : (header.ChannelCount == 1 ? 9 : 17));
+	if (header.Layer != 3 || xingOffset + 8 > header.FrameLength || (memcmp(frame + xingOffset, "Xing", 4) != 0 && memcmp(frame + xingOffset, "Info", 4) != 0))
+	{
+		return false;
+	}
+
+	//Skip the optional fields (frame count, byte count, table of contents, quality) announced by the flags
+	UINT32 flags = ((UINT32)frame[xingOffset + 4] << 24) | ((UINT32)frame[xingOffset + 5] << 16) | ((UINT32)frame[xingOffset + 6] << 8) | frame[xingOffset + 7];
+	UINT32 lameOffset = xingOffset + 8 + ((flags & 1) ? 4 : 0) + ((flags & 2) ? 4 : 0) + ((flags & 4) ? 100 : 0) + ((flags & 8) ? 4 : 0);
+
+	//The LAME extension (also written by FFmpeg) stores the encoder delay and padding as two 12 bit values
+	*startPadding = 0;
+	*endPadding = 0;
+	if (lameOffset + 24 <= header.FrameLength && (memcmp(frame + lameOffset, "LAME", 4) == 0 || memcmp(frame + lameOffset, "Lavc", 4) == 0 || memcmp(frame + lameOffset, "Lavf", 4) == 0))
+	{
+		const unsigned char* delayAndPadding = frame + lameOffset + 21;
+		UINT32 encoderDelay = ((UINT32)delayAndPadding[0] << 4) | (delayAndPadding[1] >> 4);
+		UINT32 encoderPadding = (((UINT32)delayAndPadding[1] & 0x0F) << 8) | delayAndPadding[2];
+		*startPadding = encoderDelay + DecoderDelaySamples;
+		*endPadding = encoderPadding > DecoderDelaySamples ? encoderPadding - DecoderDelaySamples : 0;
+	}
+	return true;
+}
+
+//Constructor/Building-----------------------------------------------------------------------------------------------------------------------------------------
+SeekIndex::SeekIndex()
+{
+	FileSize = 0;
+	ModifiedTime = 0;
+	SampleRate = 0;
+	ChannelCount = 0;
+	SamplesPerFrame = 0;
+	StartPaddingSamples = 0;
+	EndPaddingSamples = 0;
+	FrameCount = 0;
+}
+
+bool SeekIndex::IsSupportedFile(PCWSTR inputFilePath)
+{
+	if (inputFilePath == nullptr)
+	{
+		return false;
+	}
+
+	std::wstring filePath = inputFilePath;
+	size_t dotPosition = filePath.find_last_of(L'.');
+	size_t separatorPosition = filePath.find_last_of(L"/\\");
+	if (dotPosition == std::wstring::npos || (separatorPosition != std::wstring::npos && dotPosition < separatorPosition))
+	{
+		return false;
+	}
+
+	std::wstring extension = filePath.substr(dotPosition);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](wchar_t character) { return (wchar_t)std::towlower(character); });
+	return extension == L".mp3" || extension == L".mp2" || extension == L".mp1" || extension == L".mpa";
+}
+
+HRESULT SeekIndex::Build(PCWSTR inputFilePath, std::shared_ptr<SeekIndex>* outputIndex)
+{
+	//Ensure that the pointers actually point somewhere
+	if (inputFilePath == nullptr || outputIndex == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	std::shared_ptr<SeekIndex> newIndex(new (std::nothrow) SeekIndex());
+	if (newIndex == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	//Take the size and time before reading, so a file changed while it is read doesn't look current afterwards
+	HRESULT hr = GetFileSizeAndModifiedTime(inputFilePath, &newIndex->FileSize, &newIndex->ModifiedTime);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	MemoryMappedFile mappedFile;
+	hr = mappedFile.Open(inputFilePath);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	const unsigned char* data = mappedFile.GetData();
+	UINT64 dataEnd = mappedFile.GetSize();
+
+	//Skip the ID3v2 tags in front of the audio and the ID3v1 tag behind it
+	UINT64 offset = 0;
+	while (offset + 10 <= dataEnd && memcmp(data + offset, "ID3", 3) == 0)
+	{
+		const unsigned char* tagHeader = data + offset;
+		UINT64 tagSize = ((UINT64)(tagHeader[6] & 0x7F) << 21) | ((UINT64)(tagHeader[7] & 0x7F) << 14) | ((UINT64)(tagHeader[8] & 0x7F) << 7) | (tagHeader[9] & 0x7F);
+		offset += 10 + tagSize + ((tagHeader[5] & 0x10) ? 10 : 0);
+	}
+	if (dataEnd >= 128 && memcmp(data + dataEnd - 128, "TAG", 3) == 0)
+	{
+		dataEnd -= 128;
+	}
+
+	MpegFrameHeader firstHeader;
+	if (!FindNextFrame(data, dataEnd, offset, &firstHeader))
+	{
+		return E_INVALIDARG;
+	}
+
+	//An encoder's info frame is silent and not part of the audio
+	if (ReadXingFrame(data + offset, firstHeader, &newIndex->StartPaddingSamples, &newIndex->EndPaddingSamples))
+	{
+		offset += firstHeader.FrameLength;
+	}
+
+	//Walk the frames, resynchronizing over junk (broken frames, APE or Lyrics tags) between them
+	newIndex->SeekPointOffsets.reserve((size_t)(dataEnd / firstHeader.FrameLength / SeekPointStride + 1));
+	while (offset + 4 <= dataEnd)
+	{
+		MpegFrameHeader header;
+		if (!ParseMpegFrameHeader(data + offset, &header) || !IsSameStream(firstHeader, header) || offset + header.FrameLength > dataEnd)
+		{
+			offset++;
+			if (!FindNextFrame(data, dataEnd, offset, &header) || !IsSameStream(firstHeader, header))
+			{
+				break;
+			}
+		}
+
+		if (newIndex->FrameCount % SeekPointStride == 0)
+		{
+			newIndex->SeekPointOffsets.push_back(offset);
+		}
+		newIndex->FrameCount++;
+		offset += header.FrameLength;
+	}
+
+	if (newIndex->FrameCount == 0)
+	{
+		return E_INVALIDARG;
+	}
+	newIndex->SampleRate = firstHeader.SampleRate;
+	newIndex->ChannelCount = firstHeader.ChannelCount;
+	newIndex->SamplesPerFrame = firstHeader.SamplesPerFrame;
+	if ((UINT64)newIndex->StartPaddingSamples + newIndex->EndPaddingSamples > newIndex->FrameCount * newIndex->SamplesPerFrame)
+	{
+		newIndex->StartPaddingSamples = 0;
+		newIndex->EndPaddingSamples = 0;
+	}
+
+	*outputIndex = std::move(newIndex);
+	return S_OK;
+}
+
+//Persistence--------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT SeekIndex::Deserialize(const unsigned char* inputData, UINT64 inputSize, std::shared_ptr<SeekIndex>* outputIndex)
+{
+	//Ensure that the pointers actually point somewhere
+	if (inputData == nullptr || outputIndex == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	SeekIndexHeader header;
+	if (inputSize < sizeof(header))
+	{
+		return E_INVALIDARG;
+	}
+	memcpy(&header, inputData, sizeof(header));
+
+	//Reject anything that doesn't describe a consistent table (a different stride means an older layout)
+	UINT64 expectedPointCount = (header.FrameCount + SeekPointStride - 1) / SeekPointStride;
+	if (header.Magic != SeekIndexMagic || header.Version != SeekIndexVersion || header.SeekPointStride != SeekPointStride || header.FrameCount == 0 ||
+		header.SampleRate == 0 || header.SamplesPerFrame == 0 || header.SeekPointCount != expectedPointCount ||
+		(inputSize - sizeof(header)) / sizeof(UINT64) < header.SeekPointCount)
+	{
+		return E_INVALIDARG;
+	}
+
+	std::shared_ptr<SeekIndex> newIndex(new (std::nothrow) SeekIndex());
+	if (newIndex == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	newIndex->FileSize = header.FileSize;
+	newIndex->ModifiedTime = header.ModifiedTime;
+	newIndex->FrameCount = header.FrameCount;
+	newIndex->SampleRate = header.SampleRate;
+	newIndex->ChannelCount = header.ChannelCount;
+	newIndex->SamplesPerFrame = header.SamplesPerFrame;
+	newIndex->StartPaddingSamples = header.StartPaddingSamples;
+	newIndex->EndPaddingSamples = header.EndPaddingSamples;
+	newIndex->SeekPointOffsets.resize(header.SeekPointCount);
+	memcpy(newIndex->SeekPointOffsets.data(), inputData + sizeof(header), (size_t)header.SeekPointCount * sizeof(UINT64));
+
+	*outputIndex = std::move(newIndex);
+	return S_OK;
+}
+
+void SeekIndex::Serialize(std::vector<unsigned char>& outputData) const
+{
+	SeekIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Magic = SeekIndexMagic;
+	header.Version = SeekIndexVersion;
+	header.FileSize = FileSize;
+	header.ModifiedTime = ModifiedTime;
+	header.FrameCount = FrameCount;
+	header.SampleRate = SampleRate;
+	header.ChannelCount = ChannelCount;
+	header.SamplesPerFrame = SamplesPerFrame;
+	header.StartPaddingSamples = StartPaddingSamples;
+	header.EndPaddingSamples = EndPaddingSamples;
+	header.SeekPointStride = SeekPointStride;
+	header.SeekPointCount = (UINT32)SeekPointOffsets.size();
+
+	size_t pointsSize = SeekPointOffsets.size() * sizeof(UINT64);
+	outputData.resize(sizeof(header) + pointsSize);
+	memcpy(outputData.data(), &header, sizeof(header));
+	if (pointsSize != 0)
+	{
+		memcpy(outputData.data() + sizeof(header), SeekPointOffsets.data(), pointsSize);
+	}
+}
+
+//Seeking------------------------------------------------------------------------------------------------------------------------------------------------------
+SeekPoint SeekIndex::FindSeekPoint(UINT64 sampleIndex) const
+{
+	//Position in the decoded stream, then the frame holding it, backed off by the preroll and down to the closest stored offset
+	UINT64 decodedSampleIndex = std::min(sampleIndex, GetSampleCount()) + StartPaddingSamples;
+	UINT64 targetFrame = decodedSampleIndex / SamplesPerFrame;
+	UINT64 startFrame = targetFrame > DecoderPrerollFrames ? targetFrame - DecoderPrerollFrames : 0;
+	UINT64 pointIndex = std::min<UINT64>(startFrame / SeekPointStride, SeekPointOffsets.size() - 1);
+
+	SeekPoint seekPoint;
+	seekPoint.FrameIndex = pointIndex * SeekPointStride;
+	seekPoint.ByteOffset = SeekPointOffsets[(size_t)pointIndex];
+	seekPoint.SamplesToSkip = decodedSampleIndex - seekPoint.FrameIndex * SamplesPerFrame;
+	return seekPoint;
+}
+
+//Getters------------------------------------------------------------------------------------------------------------------------------------------------------
+UINT64 SeekIndex::GetSampleCount() const
+{
+	return FrameCount * SamplesPerFrame - StartPaddingSamples - EndPaddingSamples;
+}
+
+UINT64 SeekIndex::GetDuration_100NanoSecondUnits() const
+{
+	UINT64 sampleCount = GetSampleCount();
+	return sampleCount / SampleRate * OneSecond_100NanoSecondUnits + sampleCount % SampleRate * OneSecond_100NanoSecondUnits / SampleRate;
+}
+
+UINT32 SeekIndex::GetSampleRate() const
+{
+	return SampleRate;
+}
+
+UINT32 SeekIndex::GetChannelCount() const
+{
+	return ChannelCount;
+}
+
+UINT64 SeekIndex::GetFrameCount() const
+{
+	return FrameCount;
+}
+
+UINT64 SeekIndex::GetFileSize() const
+{
+	return FileSize;
+}
+
+INT64 SeekIndex::GetModifiedTime() const
+{
+	return ModifiedTime;
+}
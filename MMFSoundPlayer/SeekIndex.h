@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Platform.h"
+#include <memory>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	//Where a decoder has to start to land exactly on a sample: decode from the frame at ByteOffset and drop SamplesToSkip
+	struct SeekPoint
+	{
+		UINT64 ByteOffset = 0;
+		UINT64 FrameIndex = 0;
+		UINT64 SamplesToSkip = 0;
+	};
+
+	/*
+	Frame offset table of a compressed, frame based file (MPEG audio: MP1/MP2/MP3, CBR or VBR). Built once by walking the
+	frame headers (nothing is decoded), it gives the exact sample count of the file (encoder delay and padding from the
+	LAME/Xing header excluded), where VBR files otherwise only have an estimate, and the byte offset to start decoding
+	from for any sample. Only every SeekPointStride'th frame offset is stored: an hour of MP3 takes about 70 KB.
+	*/
+	class SeekIndex
+	{
+	public:
+		static constexpr UINT32 SeekPointStride = 16;
+
+		//Frames decoded ahead of the target so the bit reservoir and the filterbank overlap are filled in (Layer III needs 2)
+		static constexpr UINT32 DecoderPrerollFrames = 2;
+
+	private:
+		UINT64 FileSize;
+		INT64 ModifiedTime;
+		UINT32 SampleRate;
+		UINT32 ChannelCount;
+		UINT32 SamplesPerFrame;
+		UINT32 StartPaddingSamples; // Decoded samples before the first real one (encoder and decoder delay), from the LAME header.
+		UINT32 EndPaddingSamples;   // Decoded samples after the last real one.
+		UINT64 FrameCount;
+		std::vector<UINT64> SeekPointOffsets;
+
+		SeekIndex();
+
+	public:
+		//Whether a file is of a format a seek index can be built for (by extension, so no other file is read in full)
+		static bool IsSupportedFile(PCWSTR inputFilePath);
+
+		//Walk the frames of a file
+		static HRESULT Build(PCWSTR inputFilePath, std::shared_ptr<SeekIndex>* outputIndex);
+
+		//Persisted form (native little endian)
+		static HRESULT Deserialize(const unsigned char* inputData, UINT64 inputSize, std::shared_ptr<SeekIndex>* outputIndex);
+		void Serialize(std::vector<unsigned char>& outputData) const;
+
+		//Where to start decoding for the sample at sampleIndex (0 = first sample after the encoder delay)
+		SeekPoint FindSeekPoint(UINT64 sampleIndex) const;
+
+		UINT64 GetSampleCount() const;
+		UINT64 GetDuration_100NanoSecondUnits() const;
+		UINT32 GetSampleRate() const;
+		UINT32 GetChannelCount() const;
+		UINT64 GetFrameCount() const;
+		UINT64 GetFileSize() const;
+		INT64 GetModifiedTime() const;
+	};
+}
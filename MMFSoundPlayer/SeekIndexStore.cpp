@@ -0,0 +1,312 @@
+#include "SeekIndexStore.h"
+#include <algorithm>
+#include <cstring>
+#include <cwchar>
+#include <functional>
+#include <vector>
+
+using namespace MMFSoundPlayerLib;
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+SeekIndexStore::SeekIndexStore(PCWSTR inputDirectoryPath)
+{
+	DirectoryPath = inputDirectoryPath;
+	IsStopping = false;
+	FailedSaveCount = 0;
+	FailedBackgroundBuildCount = 0;
+}
+
+SeekIndexStore::~SeekIndexStore()
+{
+	//Builds still queued are dropped, the one running is finished
+	{
+		std::lock_guard<std::mutex> lock(BuildMutex);
+		IsStopping = true;
+		PendingBuilds.clear();
+	}
+	BuildCondition.notify_all();
+	if (BuildThread.joinable())
+	{
+		BuildThread.join();
+	}
+}
+
+HRESULT SeekIndexStore::CreateInstance(PCWSTR directoryPath, SeekIndexStore** outputStore)
+{
+	//Ensure that the pointers actually point somewhere
+	if (directoryPath == nullptr || outputStore == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	HRESULT hr = CreateDirectoriesWithWidePath(directoryPath);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULT can be returned
+	SeekIndexStore* newStore = new (std::nothrow) SeekIndexStore(directoryPath);
+	if (newStore == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	*outputStore = newStore;
+	return S_OK;
+}
+
+//Index files--------------------------------------------------------------------------------------------------------------------------------------------------
+std::wstring SeekIndexStore::GetIndexFilePath(const std::string& narrowPath)
+{
+	//FNV-1a of the path, the file itself holds the full path to tell colliding paths apart
+	UINT64 hash = 0xCBF29CE484222325ull;
+	for (char character : narrowPath)
+	{
+		hash ^= (unsigned char)character;
+		hash *= 0x100000001B3ull;
+	}
+
+	wchar_t fileName[32];
+	swprintf(fileName, 32, L"%016llx.seek", (unsigned long long)hash);
+	return DirectoryPath + L"/" + fileName;
+}
+
+HRESULT SeekIndexStore::LoadIndexFile(PCWSTR inputFilePath, std::shared_ptr<const SeekIndex>* outputIndex)
+{
+	std::string narrowPath = ConvertWidePathToNarrow(inputFilePath);
+	FILE* file = OpenFileWithWidePath(GetIndexFilePath(narrowPath).c_str(), "rb");
+	if (file == nullptr)
+	{
+		return S_FALSE;
+	}
+
+	//Index files are small (about 70 KB per hour of MP3), read them whole
+	std::vector<unsigned char> contents;
+	unsigned char buffer[16384];
+	size_t readSize;
+	while ((readSize = fread(buffer, 1, sizeof(buffer), file)) != 0)
+	{
+		contents.insert(contents.end(), buffer, buffer + readSize);
+	}
+	fclose(file);
+
+	//Layout: path length, path, serialized index
+	UINT32 pathLength;
+	if (contents.size() < sizeof(pathLength))
+	{
+		return S_FALSE;
+	}
+	memcpy(&pathLength, contents.data(), sizeof(pathLength));
+	if (contents.size() - sizeof(pathLength) < pathLength || pathLength != narrowPath.size() || memcmp(contents.data() + sizeof(pathLength), narrowPath.data(), pathLength) != 0)
+	{
+		return S_FALSE;
+	}
+
+	std::shared_ptr<SeekIndex> loadedIndex;
+	size_t indexOffset = sizeof(pathLength) + pathLength;
+	if (FAILED(SeekIndex::Deserialize(contents.data() + indexOffset, contents.size() - indexOffset, &loadedIndex)))
+	{
+		return S_FALSE;
+	}
+
+	*outputIndex = std::move(loadedIndex);
+	return S_OK;
+}
+
+HRESULT SeekIndexStore::SaveIndexFile(PCWSTR inputFilePath, const SeekIndex& inputIndex)
+{
+	std::string narrowPath = ConvertWidePathToNarrow(inputFilePath);
+	std::vector<unsigned char> serializedIndex;
+	inputIndex.Serialize(serializedIndex);
+
+	//Write next to the old file and replace it, so readers never see half a file (the thread id keeps concurrent builds of one file apart)
+	std::wstring indexFilePath = GetIndexFilePath(narrowPath);
+	std::wstring temporaryFilePath = indexFilePath + L"." + std::to_wstring(std::hash<std::thread::id>()(std::this_thread::get_id())) + L".tmp";
+	FILE* file = OpenFileWithWidePath(temporaryFilePath.c_str(), "wb");
+	if (file == nullptr)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+
+	UINT32 pathLength = (UINT32)narrowPath.size();
+	bool written = fwrite(&pathLength, sizeof(pathLength), 1, file) == 1 && fwrite(narrowPath.data(), 1, narrowPath.size(), file) == narrowPath.size() &&
+		fwrite(serializedIndex.data(), 1, serializedIndex.size(), file) == serializedIndex.size();
+	if (fclose(file) != 0)
+	{
+		written = false;
+	}
+	if (!written)
+	{
+		RemoveFileWithWidePath(temporaryFilePath.c_str());
+		return E_FAIL;
+	}
+
+	HRESULT hr = ReplaceFileWithWidePath(temporaryFilePath.c_str(), indexFilePath.c_str());
+	if (FAILED(hr))
+	{
+		RemoveFileWithWidePath(temporaryFilePath.c_str());
+	}
+	return hr;
+}
+
+void SeekIndexStore::RememberIndex(const std::wstring& filePath, const std::shared_ptr<const SeekIndex>& inputIndex)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+	auto existingIndex = RecentIndexLookup.find(filePath);
+	if (existingIndex != RecentIndexLookup.end())
+	{
+		RecentIndexes.erase(existingIndex->second);
+		RecentIndexLookup.erase(existingIndex);
+	}
+
+	RecentIndexes.emplace_front(filePath, inputIndex);
+	RecentIndexLookup[filePath] = RecentIndexes.begin();
+	if (RecentIndexes.size() > MemoryCacheCapacity)
+	{
+		RecentIndexLookup.erase(RecentIndexes.back().first);
+		RecentIndexes.pop_back();
+	}
+}
+
+//Lookup/Building----------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT SeekIndexStore::Lookup(PCWSTR inputFilePath, std::shared_ptr<const SeekIndex>* outputIndex)
+{
+	//Ensure that the pointers actually point somewhere
+	if (inputFilePath == nullptr || outputIndex == nullptr)
+	{
+		return E_POINTER;
+	}
+	outputIndex->reset();
+
+	UINT64 fileSize;
+	INT64 modifiedTime;
+	HRESULT hr = GetFileSizeAndModifiedTime(inputFilePath, &fileSize, &modifiedTime);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Memory first, then the index file
+	std::wstring filePath = inputFilePath;
+	std::shared_ptr<const SeekIndex> foundIndex;
+	{
+		std::lock_guard<std::mutex> lock(CacheMutex);
+		auto recentIndex = RecentIndexLookup.find(filePath);
+		if (recentIndex != RecentIndexLookup.end())
+		{
+			RecentIndexes.splice(RecentIndexes.begin(), RecentIndexes, recentIndex->second);
+			foundIndex = recentIndex->second->second;
+		}
+	}
+	if (foundIndex == nullptr)
+	{
+		if (LoadIndexFile(inputFilePath, &foundIndex) != S_OK)
+		{
+			return S_FALSE;
+		}
+		RememberIndex(filePath, foundIndex);
+	}
+
+	if (foundIndex->GetFileSize() != fileSize || foundIndex->GetModifiedTime() != modifiedTime)
+	{
+		return S_FALSE;
+	}
+	*outputIndex = std::move(foundIndex);
+	return S_OK;
+}
+
+HRESULT SeekIndexStore::Build(PCWSTR inputFilePath, std::shared_ptr<const SeekIndex>* outputIndex)
+{
+	std::shared_ptr<const SeekIndex> currentIndex;
+	HRESULT hr = Lookup(inputFilePath, &currentIndex);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	if (hr == S_FALSE)
+	{
+		std::shared_ptr<SeekIndex> builtIndex;
+		hr = SeekIndex::Build(inputFilePath, &builtIndex);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+
+		//The index is good even if it couldn't be saved, it just has to be built again next time
+		if (FAILED(SaveIndexFile(inputFilePath, *builtIndex)))
+		{
+			FailedSaveCount++;
+		}
+		currentIndex = builtIndex;
+		RememberIndex(inputFilePath, currentIndex);
+		hr = S_OK;
+	}
+	else
+	{
+		hr = S_FALSE;
+	}
+
+	if (outputIndex != nullptr)
+	{
+		*outputIndex = std::move(currentIndex);
+	}
+	return hr;
+}
+
+void SeekIndexStore::BuildInBackground(PCWSTR inputFilePath)
+{
+	if (!SeekIndex::IsSupportedFile(inputFilePath))
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(BuildMutex);
+		if (IsStopping || std::find(PendingBuilds.begin(), PendingBuilds.end(), inputFilePath) != PendingBuilds.end())
+		{
+			return;
+		}
+		PendingBuilds.emplace_back(inputFilePath);
+
+		//The thread is only started once there is something to build
+		if (!BuildThread.joinable())
+		{
+			BuildThread = std::thread(&SeekIndexStore::RunBuildThread, this);
+		}
+	}
+	BuildCondition.notify_one();
+}
+
+UINT64 SeekIndexStore::GetFailedSaveCount()
+{
+	return FailedSaveCount;
+}
+
+UINT64 SeekIndexStore::GetFailedBackgroundBuildCount()
+{
+	return FailedBackgroundBuildCount;
+}
+
+void SeekIndexStore::RunBuildThread()
+{
+	std::unique_lock<std::mutex> lock(BuildMutex);
+	while (true)
+	{
+		BuildCondition.wait(lock, [this] { return IsStopping || !PendingBuilds.empty(); });
+		if (IsStopping)
+		{
+			return;
+		}
+
+		std::wstring filePath = std::move(PendingBuilds.front());
+		PendingBuilds.pop_front();
+		lock.unlock();
+		if (FAILED(Build(filePath.c_str())))
+		{
+			FailedBackgroundBuildCount++;
+		}
+		lock.lock();
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Platform.h"
+#include "SeekIndex.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Persistent home of the seek indexes: one small file per media file in a directory (usually next to the metadata index
+	file), named after a hash of the media path and holding the path to rule out collisions. An index only counts as current
+	while the media file has the size and modification time it was built from. The indexes used last are kept in memory.
+	Building walks the whole file, so the player asks for it to happen on the store's background thread; the library
+	scanner builds them on its own workers. All methods are thread-safe.
+	*/
+	class SeekIndexStore
+	{
+	public:
+		static constexpr size_t MemoryCacheCapacity = 32;
+
+	private:
+		std::wstring DirectoryPath;
+
+		//Recently used indexes, most recent first (guarded by CacheMutex)
+		std::mutex CacheMutex;
+		std::list<std::pair<std::wstring, std::shared_ptr<const SeekIndex>>> RecentIndexes;
+		std::unordered_map<std::wstring, std::list<std::pair<std::wstring, std::shared_ptr<const SeekIndex>>>::iterator> RecentIndexLookup;
+
+		//Background builds (guarded by BuildMutex)
+		std::mutex BuildMutex;
+		std::condition_variable BuildCondition;
+		std::deque<std::wstring> PendingBuilds;
+		std::thread BuildThread;
+		bool IsStopping;
+
+		//Failures nobody gets an HRESULT for
+		std::atomic<UINT64> FailedSaveCount;
+		std::atomic<UINT64> FailedBackgroundBuildCount;
+
+		SeekIndexStore(PCWSTR inputDirectoryPath);
+
+		std::wstring GetIndexFilePath(const std::string& narrowPath);
+		HRESULT LoadIndexFile(PCWSTR inputFilePath, std::shared_ptr<const SeekIndex>* outputIndex);
+		HRESULT SaveIndexFile(PCWSTR inputFilePath, const SeekIndex& inputIndex);
+		void RememberIndex(const std::wstring& filePath, const std::shared_ptr<const SeekIndex>& inputIndex);
+		void RunBuildThread();
+
+	public:
+		~SeekIndexStore();
+
+		//Creates the directory if needed
+		static HRESULT CreateInstance(PCWSTR directoryPath, SeekIndexStore** outputStore);
+
+		//Current index of a file. Returns S_FALSE (and nullptr) if there is none, without building one.
+		HRESULT Lookup(PCWSTR inputFilePath, std::shared_ptr<const SeekIndex>* outputIndex);
+
+		//Build (and save) the index of a file unless a current one exists. Returns S_FALSE if it was current.
+		HRESULT Build(PCWSTR inputFilePath, std::shared_ptr<const SeekIndex>* outputIndex = nullptr);
+
+		//Queue Build for the background thread (files of unsupported formats are ignored)
+		void BuildInBackground(PCWSTR inputFilePath);
+
+		//Indexes that were built but couldn't be saved (they are built again next time), and background builds that failed
+		UINT64 GetFailedSaveCount();
+		UINT64 GetFailedBackgroundBuildCount();
+	};
+}
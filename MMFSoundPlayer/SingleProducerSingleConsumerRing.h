@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Platform.h"
+#include <atomic>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Lock-free ring of reusable slots between exactly one producer thread and one consumer thread. Slots are filled and
+	drained in place (BeginWrite/EndWrite, BeginRead/EndRead), so once the slots have grown to their working size nothing is
+	allocated or locked on either side. The counts are absolute (they never wrap back), which lets the owner tag work with
+	the write count of a slot and later tell whether the consumer got past it.
+	*/
+	template <typename TSlot>
+	class SingleProducerSingleConsumerRing
+	{
+	private:
+		std::vector<TSlot> Slots;
+
+		//Each count is written by one side only, kept on separate cache lines so the two sides don't contend
+		alignas(64) std::atomic<UINT64> WriteCount;
+		alignas(64) std::atomic<UINT64> ReadCount;
+
+	public:
+		SingleProducerSingleConsumerRing()
+		{
+			WriteCount = 0;
+			ReadCount = 0;
+		}
+
+		//Neither side may be using the ring (the contents are dropped)
+		void SetCapacity(size_t slotCount)
+		{
+			Slots.clear();
+			Slots.resize(slotCount > 0 ? slotCount : 1);
+			ReadCount.store(WriteCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+
+		size_t GetCapacity() const
+		{
+			return Slots.size();
+		}
+
+		//Producer: the next free slot, or nullptr if the ring is full. EndWrite makes it readable.
+		TSlot* BeginWrite()
+		{
+			UINT64 writeCount = WriteCount.load(std::memory_order_relaxed);
+			if (writeCount - ReadCount.load(std::memory_order_acquire) >= Slots.size())
+			{
+				return nullptr;
+			}
+			return &Slots[(size_t)(writeCount % Slots.size())];
+		}
+
+		void EndWrite()
+		{
+			WriteCount.store(WriteCount.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		//Consumer: the oldest readable slot, or nullptr if the ring is empty. EndRead hands it back to the producer.
+		TSlot* BeginRead()
+		{
+			UINT64 readCount = ReadCount.load(std::memory_order_relaxed);
+			if (readCount == WriteCount.load(std::memory_order_acquire))
+			{
+				return nullptr;
+			}
+			return &Slots[(size_t)(readCount % Slots.size())];
+		}
+
+		void EndRead()
+		{
+			ReadCount.store(ReadCount.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		//Drop everything written but not read yet (neither side may be using the ring)
+		void Discard()
+		{
+			ReadCount.store(WriteCount.load(std::memory_order_relaxed), std::memory_order_release);
+		}
+
+		UINT64 GetWriteCount() const
+		{
+			return WriteCount.load(std::memory_order_acquire);
+		}
+
+		UINT64 GetReadCount() const
+		{
+			return ReadCount.load(std::memory_order_acquire);
+		}
+
+		size_t GetReadableCount() const
+		{
+			UINT64 readCount = ReadCount.load(std::memory_order_acquire);
+			return (size_t)(WriteCount.load(std::memory_order_acquire) - readCount);
+		}
+
+		bool IsFull() const
+		{
+			return GetReadableCount() >= Slots.size();
+		}
+	};
+}
@@ -0,0 +1,578 @@
+#include "SpectrumAnalyzer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define SPECTRUM_KERNELS_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define SPECTRUM_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+//GCC and Clang only emit AVX2 instructions in functions marked for it, MSVC emits them anywhere
+#if defined(SPECTRUM_KERNELS_X86) && !defined(_MSC_VER)
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define AVX2_FUNCTION
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+static const double Pi = 3.14159265358979323846;
+
+//Kernels------------------------------------------------------------------------------------------------------------------------------------------------------
+static void FftStageScalar(float* real, float* imaginary, const float* twiddleReal, const float* twiddleImaginary, size_t size, size_t halfSize)
+{
+	for (size_t group = 0; group < size; group += 2 * halfSize)
+	{
+		for (size_t butterfly = 0; butterfly < halfSize; butterfly++)
+		{
+			size_t top = group + butterfly;
+			size_t bottom = top + halfSize;
+			float productReal = real[bottom] * twiddleReal[butterfly] - imaginary[bottom] * twiddleImaginary[butterfly];
+			float productImaginary = real[bottom] * twiddleImaginary[butterfly] + imaginary[bottom] * twiddleReal[butterfly];
+			real[bottom] = real[top] - productReal;
+			imaginary[bottom] = imaginary[top] - productImaginary;
+			real[top] += productReal;
+			imaginary[top] += productImaginary;
+		}
+	}
+}
+
+static void SumOfSquaresAndPeakScalar(const float* samples, size_t sampleCount, float* sumOfSquares, float* peak)
+{
+	float sum = 0.0f;
+	float largest = 0.0f;
+	for (size_t sample = 0; sample < sampleCount; sample++)
+	{
+		sum += samples[sample] * samples[sample];
+		float magnitude = std::fabs(samples[sample]);
+		largest = magnitude > largest ? magnitude : largest;
+	}
+	*sumOfSquares = sum;
+	*peak = largest;
+}
+
+#ifdef SPECTRUM_KERNELS_X86
+static void FftStageSse2(float* real, float* imaginary, const float* twiddleReal, const float* twiddleImaginary, size_t size, size_t halfSize)
+{
+	//The first stages have fewer butterflies per group than a register holds
+	if (halfSize < 4)
+	{
+		FftStageScalar(real, imaginary, twiddleReal, twiddleImaginary, size, halfSize);
+		return;
+	}
+	for (size_t group = 0; group < size; group += 2 * halfSize)
+	{
+		float* topReal = real + group;
+		float* topImaginary = imaginary + group;
+		float* bottomReal = topReal + halfSize;
+		float* bottomImaginary = topImaginary + halfSize;
+		for (size_t butterfly = 0; butterfly < halfSize; butterfly += 4)
+		{
+			__m128 weightReal = _mm_loadu_ps(twiddleReal + butterfly);
+			__m128 weightImaginary = _mm_loadu_ps(twiddleImaginary + butterfly);
+			__m128 lowerReal = _mm_loadu_ps(bottomReal + butterfly);
+			__m128 lowerImaginary = _mm_loadu_ps(bottomImaginary + butterfly);
+			__m128 productReal = _mm_sub_ps(_mm_mul_ps(lowerReal, weightReal), _mm_mul_ps(lowerImaginary, weightImaginary));
+			__m128 productImaginary = _mm_add_ps(_mm_mul_ps(lowerReal, weightImaginary), _mm_mul_ps(lowerImaginary, weightReal));
+			__m128 upperReal = _mm_loadu_ps(topReal + butterfly);
+			__m128 upperImaginary = _mm_loadu_ps(topImaginary + butterfly);
+			_mm_storeu_ps(bottomReal + butterfly, _mm_sub_ps(upperReal, productReal));
+			_mm_storeu_ps(bottomImaginary + butterfly, _mm_sub_ps(upperImaginary, productImaginary));
+			_mm_storeu_ps(topReal + butterfly, _mm_add_ps(upperReal, productReal));
+			_mm_storeu_ps(topImaginary + butterfly, _mm_add_ps(upperImaginary, productImaginary));
+		}
+	}
+}
+
+static void SumOfSquaresAndPeakSse2(const float* samples, size_t sampleCount, float* sumOfSquares, float* peak)
+{
+	//Clearing the sign bit gives the magnitude
+	__m128 magnitudeMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 sum = _mm_setzero_ps();
+	__m128 largest = _mm_setzero_ps();
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		__m128 values = _mm_loadu_ps(samples + sample);
+		sum = _mm_add_ps(sum, _mm_mul_ps(values, values));
+		largest = _mm_max_ps(largest, _mm_and_ps(values, magnitudeMask));
+	}
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	largest = _mm_max_ps(largest, _mm_movehl_ps(largest, largest));
+	largest = _mm_max_ss(largest, _mm_shuffle_ps(largest, largest, 1));
+
+	float tailSum = 0.0f;
+	float tailPeak = 0.0f;
+	SumOfSquaresAndPeakScalar(samples + sample, sampleCount - sample, &tailSum, &tailPeak);
+	*sumOfSquares = _mm_cvtss_f32(sum) + tailSum;
+	float vectorPeak = _mm_cvtss_f32(largest);
+	*peak = vectorPeak > tailPeak ? vectorPeak : tailPeak;
+}
+
+AVX2_FUNCTION static void FftStageAvx2(float* real, float* imaginary, const float* twiddleReal, const float* twiddleImaginary, size_t size, size_t halfSize)
+{
+	if (halfSize < 8)
+	{
+		FftStageSse2(real, imaginary, twiddleReal, twiddleImaginary, size, halfSize);
+		return;
+	}
+	for (size_t group = 0; group < size; group += 2 * halfSize)
+	{
+		float* topReal = real + group;
+		float* topImaginary = imaginary + group;
+		float* bottomReal = topReal + halfSize;
+		float* bottomImaginary = topImaginary + halfSize;
+		for (size_t butterfly = 0; butterfly < halfSize; butterfly += 8)
+		{
+			//No FMA: the products are rounded separately, like the scalar reference
+			__m256 weightReal = _mm256_loadu_ps(twiddleReal + butterfly);
+			__m256 weightImaginary = _mm256_loadu_ps(twiddleImaginary + butterfly);
+			__m256 lowerReal = _mm256_loadu_ps(bottomReal + butterfly);
+			__m256 lowerImaginary = _mm256_loadu_ps(bottomImaginary + butterfly);
+			__m256 productReal = _mm256_sub_ps(_mm256_mul_ps(lowerReal, weightReal), _mm256_mul_ps(lowerImaginary, weightImaginary));
+			__m256 productImaginary = _mm256_add_ps(_mm256_mul_ps(lowerReal, weightImaginary), _mm256_mul_ps(lowerImaginary, weightReal));
+			__m256 upperReal = _mm256_loadu_ps(topReal + butterfly);
+			__m256 upperImaginary = _mm256_loadu_ps(topImaginary + butterfly);
+			_mm256_storeu_ps(bottomReal + butterfly, _mm256_sub_ps(upperReal, productReal));
+			_mm256_storeu_ps(bottomImaginary + butterfly, _mm256_sub_ps(upperImaginary, productImaginary));
+			_mm256_storeu_ps(topReal + butterfly, _mm256_add_ps(upperReal, productReal));
+			_mm256_storeu_ps(topImaginary + butterfly, _mm256_add_ps(upperImaginary, productImaginary));
+		}
+	}
+}
+
+AVX2_FUNCTION static void SumOfSquaresAndPeakAvx2(const float* samples, size_t sampleCount, float* sumOfSquares, float* peak)
+{
+	__m256 magnitudeMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	__m256 largest = _mm256_setzero_ps();
+	size_t sample = 0;
+	for (; sample + 16 <= sampleCount; sample += 16)
+	{
+		__m256 values0 = _mm256_loadu_ps(samples + sample);
+		__m256 values1 = _mm256_loadu_ps(samples + sample + 8);
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(values0, values0));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(values1, values1));
+		largest = _mm256_max_ps(largest, _mm256_max_ps(_mm256_and_ps(values0, magnitudeMask), _mm256_and_ps(values1, magnitudeMask)));
+	}
+	__m256 sum256 = _mm256_add_ps(sum0, sum1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	__m128 largest128 = _mm_max_ps(_mm256_castps256_ps128(largest), _mm256_extractf128_ps(largest, 1));
+	largest128 = _mm_max_ps(largest128, _mm_movehl_ps(largest128, largest128));
+	largest128 = _mm_max_ss(largest128, _mm_shuffle_ps(largest128, largest128, 1));
+
+	float tailSum = 0.0f;
+	float tailPeak = 0.0f;
+	SumOfSquaresAndPeakSse2(samples + sample, sampleCount - sample, &tailSum, &tailPeak);
+	*sumOfSquares = _mm_cvtss_f32(sum) + tailSum;
+	float vectorPeak = _mm_cvtss_f32(largest128);
+	*peak = vectorPeak > tailPeak ? vectorPeak : tailPeak;
+}
+#endif
+
+#ifdef SPECTRUM_KERNELS_NEON
+static void FftStageNeon(float* real, float* imaginary, const float* twiddleReal, const float* twiddleImaginary, size_t size, size_t halfSize)
+{
+	if (halfSize < 4)
+	{
+		FftStageScalar(real, imaginary, twiddleReal, twiddleImaginary, size, halfSize);
+		return;
+	}
+	for (size_t group = 0; group < size; group += 2 * halfSize)
+	{
+		float* topReal = real + group;
+		float* topImaginary = imaginary + group;
+		float* bottomReal = topReal + halfSize;
+		float* bottomImaginary = topImaginary + halfSize;
+		for (size_t butterfly = 0; butterfly < halfSize; butterfly += 4)
+		{
+			float32x4_t weightReal = vld1q_f32(twiddleReal + butterfly);
+			float32x4_t weightImaginary = vld1q_f32(twiddleImaginary + butterfly);
+			float32x4_t lowerReal = vld1q_f32(bottomReal + butterfly);
+			float32x4_t lowerImaginary = vld1q_f32(bottomImaginary + butterfly);
+			float32x4_t productReal = vsubq_f32(vmulq_f32(lowerReal, weightReal), vmulq_f32(lowerImaginary, weightImaginary));
+			float32x4_t productImaginary = vaddq_f32(vmulq_f32(lowerReal, weightImaginary), vmulq_f32(lowerImaginary, weightReal));
+			float32x4_t upperReal = vld1q_f32(topReal + butterfly);
+			float32x4_t upperImaginary = vld1q_f32(topImaginary + butterfly);
+			vst1q_f32(bottomReal + butterfly, vsubq_f32(upperReal, productReal));
+			vst1q_f32(bottomImaginary + butterfly, vsubq_f32(upperImaginary, productImaginary));
+			vst1q_f32(topReal + butterfly, vaddq_f32(upperReal, productReal));
+			vst1q_f32(topImaginary + butterfly, vaddq_f32(upperImaginary, productImaginary));
+		}
+	}
+}
+
+static void SumOfSquaresAndPeakNeon(const float* samples, size_t sampleCount, float* sumOfSquares, float* peak)
+{
+	float32x4_t sum = vdupq_n_f32(0.0f);
+	float32x4_t largest = vdupq_n_f32(0.0f);
+	size_t sample = 0;
+	for (; sample + 4 <= sampleCount; sample += 4)
+	{
+		float32x4_t values = vld1q_f32(samples + sample);
+		sum = vaddq_f32(sum, vmulq_f32(values, values));
+		largest = vmaxq_f32(largest, vabsq_f32(values));
+	}
+	float32x2_t halfSum = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+	float32x2_t halfLargest = vmax_f32(vget_low_f32(largest), vget_high_f32(largest));
+
+	float tailSum = 0.0f;
+	float tailPeak = 0.0f;
+	SumOfSquaresAndPeakScalar(samples + sample, sampleCount - sample, &tailSum, &tailPeak);
+	*sumOfSquares = vget_lane_f32(vpadd_f32(halfSum, halfSum), 0) + tailSum;
+	float vectorPeak = vget_lane_f32(vpmax_f32(halfLargest, halfLargest), 0);
+	*peak = vectorPeak > tailPeak ? vectorPeak : tailPeak;
+}
+#endif
+
+void SpectrumKernels::FftStage(float* real, float* imaginary, const float* twiddleReal, const float* twiddleImaginary, size_t size, size_t halfSize, GainKernels::InstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+#ifdef SPECTRUM_KERNELS_X86
+	case GainKernels::InstructionSet::Avx2:
+		FftStageAvx2(real, imaginary, twiddleReal, twiddleImaginary, size, halfSize);
+		return;
+	case GainKernels::InstructionSet::Sse2:
+		FftStageSse2(real, imaginary, twiddleReal, twiddleImaginary, size, halfSize);
+		return;
+#endif
+#ifdef SPECTRUM_KERNELS_NEON
+	case GainKernels::InstructionSet::Neon:
+		FftStageNeon(real, imaginary, twiddleReal, twiddleImaginary, size, halfSize);
+		return;
+#endif
+	default:
+		FftStageScalar(real, imaginary, twiddleReal, twiddleImaginary, size, halfSize);
+		return;
+	}
+}
+
+void SpectrumKernels::SumOfSquaresAndPeak(const float* samples, size_t sampleCount, float* sumOfSquares, float* peak, GainKernels::InstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+#ifdef SPECTRUM_KERNELS_X86
+	case GainKernels::InstructionSet::Avx2:
+		SumOfSquaresAndPeakAvx2(samples, sampleCount, sumOfSquares, peak);
+		return;
+	case GainKernels::InstructionSet::Sse2:
+		SumOfSquaresAndPeakSse2(samples, sampleCount, sumOfSquares, peak);
+		return;
+#endif
+#ifdef SPECTRUM_KERNELS_NEON
+	case GainKernels::InstructionSet::Neon:
+		SumOfSquaresAndPeakNeon(samples, sampleCount, sumOfSquares, peak);
+		return;
+#endif
+	default:
+		SumOfSquaresAndPeakScalar(samples, sampleCount, sumOfSquares, peak);
+		return;
+	}
+}
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+SpectrumAnalyzer::SpectrumAnalyzer()
+{
+	SampleRate = 0;
+	ChannelCount = 0;
+	HopFrames = 0;
+	HistoryPosition = 0;
+	FramesSinceFrame = 0;
+}
+
+HRESULT SpectrumAnalyzer::Initialize(const SpectrumAnalyzerOptions& inputOptions)
+{
+	UINT32 fftSize = inputOptions.FftSize;
+	if (fftSize < MinFftSize || fftSize > MaxFftSize || (fftSize & (fftSize - 1)) != 0 || inputOptions.FramesPerSecond == 0)
+	{
+		return E_INVALIDARG;
+	}
+	Options = inputOptions;
+
+	try
+	{
+		//Hann window, scaled by 2 / its sum: a full scale sine on a bin then has a magnitude of 1 there
+		Window.resize(fftSize);
+		double windowSum = 0.0;
+		for (UINT32 sample = 0; sample < fftSize; sample++)
+		{
+			double value = 0.5 - 0.5 * std::cos(2.0 * Pi * sample / fftSize);
+			Window[sample] = (float)value;
+			windowSum += value;
+		}
+		for (float& value : Window)
+		{
+			value = (float)(value * 2.0 / windowSum);
+		}
+
+		//The real input goes in as fftSize / 2 complex pairs, in bit reversed order
+		UINT32 complexSize = fftSize / 2;
+		UINT32 bitCount = 0;
+		while ((1u << bitCount) < complexSize)
+		{
+			bitCount++;
+		}
+		BitReversal.resize(complexSize);
+		for (UINT32 index = 0; index < complexSize; index++)
+		{
+			UINT32 reversed = 0;
+			for (UINT32 bit = 0; bit < bitCount; bit++)
+			{
+				reversed |= ((index >> bit) & 1) << (bitCount - 1 - bit);
+			}
+			BitReversal[index] = reversed;
+		}
+
+		//Twiddles of every stage, contiguous so the butterflies load them straight into registers
+		StageTwiddleReal.resize(complexSize);
+		StageTwiddleImaginary.resize(complexSize);
+		for (UINT32 halfSize = 1; halfSize < complexSize; halfSize *= 2)
+		{
+			for (UINT32 butterfly = 0; butterfly < halfSize; butterfly++)
+			{
+				double angle = -Pi * butterfly / halfSize;
+				StageTwiddleReal[halfSize - 1 + butterfly] = (float)std::cos(angle);
+				StageTwiddleImaginary[halfSize - 1 + butterfly] = (float)std::sin(angle);
+			}
+		}
+		SplitTwiddleReal.resize(complexSize + 1);
+		SplitTwiddleImaginary.resize(complexSize + 1);
+		for (UINT32 bin = 0; bin <= complexSize; bin++)
+		{
+			double angle = -2.0 * Pi * bin / fftSize;
+			SplitTwiddleReal[bin] = (float)std::cos(angle);
+			SplitTwiddleImaginary[bin] = (float)std::sin(angle);
+		}
+
+		History.assign((size_t)fftSize * 2, 0.0f);
+		WindowedSamples.resize(fftSize);
+		FftReal.resize(complexSize);
+		FftImaginary.resize(complexSize);
+	}
+	catch (...)
+	{
+		return E_OUTOFMEMORY;
+	}
+	HistoryPosition = 0;
+	SampleRate = 0;
+	ChannelCount = 0;
+	return S_OK;
+}
+
+HRESULT SpectrumAnalyzer::SetFormat(UINT32 inputSampleRate, UINT32 inputChannelCount)
+{
+	if (inputSampleRate == 0 || inputChannelCount == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	//Another format is another stream, nothing of the old one carries over
+	try
+	{
+		ChannelSamples.resize((size_t)ChunkFrames * (inputChannelCount + 1));
+		ChannelSumOfSquares.assign(inputChannelCount, 0.0);
+		ChannelPeaks.assign(inputChannelCount, 0.0f);
+	}
+	catch (...)
+	{
+		return E_OUTOFMEMORY;
+	}
+	std::fill(History.begin(), History.end(), 0.0f);
+	HistoryPosition = 0;
+	FramesSinceFrame = 0;
+	SampleRate = inputSampleRate;
+	ChannelCount = inputChannelCount;
+	HopFrames = inputSampleRate / Options.FramesPerSecond > 0 ? inputSampleRate / Options.FramesPerSecond : 1;
+	return S_OK;
+}
+
+//Analysis-----------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT SpectrumAnalyzer::Update(VisualizationTap* inputTap, VisualizationFrame* outputFrame)
+{
+	if (inputTap == nullptr || outputFrame == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (Window.empty())
+	{
+		return E_UNEXPECTED;
+	}
+
+	const VisualizationBlock* block;
+	while ((block = inputTap->BeginRead()) != nullptr)
+	{
+		HRESULT hr = AddFrames(block->Samples.data(), block->FrameCount, block->ChannelCount, block->SampleRate);
+		inputTap->EndRead();
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+	}
+
+	if (ChannelCount == 0 || FramesSinceFrame < HopFrames)
+	{
+		return S_FALSE;
+	}
+	return ComputeFrame(outputFrame);
+}
+
+HRESULT SpectrumAnalyzer::AddFrames(const float* samples, UINT32 frameCount, UINT32 inputChannelCount, UINT32 inputSampleRate)
+{
+	if (samples == nullptr && frameCount > 0)
+	{
+		return E_POINTER;
+	}
+	if (Window.empty())
+	{
+		return E_UNEXPECTED;
+	}
+	if (inputSampleRate != SampleRate || inputChannelCount != ChannelCount)
+	{
+		HRESULT hr = SetFormat(inputSampleRate, inputChannelCount);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+	}
+
+	for (UINT32 frame = 0; frame < frameCount; frame += ChunkFrames)
+	{
+		AddChunk(samples + (size_t)frame * ChannelCount, frameCount - frame < ChunkFrames ? frameCount - frame : ChunkFrames);
+	}
+	return S_OK;
+}
+
+void SpectrumAnalyzer::AddChunk(const float* samples, UINT32 frameCount)
+{
+	//Deinterleave, the channels side by side with the mixdown behind them
+	float* mixdown = ChannelSamples.data() + (size_t)ChunkFrames * ChannelCount;
+	for (UINT32 channel = 0; channel < ChannelCount; channel++)
+	{
+		float* channelSamples = ChannelSamples.data() + (size_t)ChunkFrames * channel;
+		const float* source = samples + channel;
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			channelSamples[frame] = source[(size_t)frame * ChannelCount];
+		}
+
+		//Meter the channel
+		float sumOfSquares = 0.0f;
+		float peak = 0.0f;
+		SpectrumKernels::SumOfSquaresAndPeak(channelSamples, frameCount, &sumOfSquares, &peak, Options.InstructionSet);
+		ChannelSumOfSquares[channel] += sumOfSquares;
+		ChannelPeaks[channel] = peak > ChannelPeaks[channel] ? peak : ChannelPeaks[channel];
+
+		//Mix down: the mean of the channels
+		float channelGain = 1.0f / ChannelCount;
+		if (channel == 0)
+		{
+			memcpy(mixdown, channelSamples, frameCount * sizeof(float));
+			GainKernels::MultiplyConstant(mixdown, frameCount, channelGain, Options.InstructionSet);
+		}
+		else
+		{
+			GainKernels::MixConstant(mixdown, channelSamples, frameCount, channelGain, Options.InstructionSet);
+		}
+	}
+
+	//Into the history, twice
+	UINT32 fftSize = Options.FftSize;
+	for (UINT32 frame = 0; frame < frameCount; frame++)
+	{
+		History[HistoryPosition] = mixdown[frame];
+		History[HistoryPosition + fftSize] = mixdown[frame];
+		HistoryPosition = HistoryPosition + 1 < fftSize ? HistoryPosition + 1 : 0;
+	}
+	FramesSinceFrame += frameCount;
+}
+
+void SpectrumAnalyzer::TransformHistory()
+{
+	//Window the latest samples (the oldest one is at HistoryPosition)
+	UINT32 fftSize = Options.FftSize;
+	UINT32 complexSize = fftSize / 2;
+	memcpy(WindowedSamples.data(), History.data() + HistoryPosition, fftSize * sizeof(float));
+	GainKernels::MultiplyElementwise(WindowedSamples.data(), Window.data(), fftSize, Options.InstructionSet);
+
+	//Even samples as the real parts, odd ones as the imaginary parts, in bit reversed order
+	for (UINT32 index = 0; index < complexSize; index++)
+	{
+		UINT32 target = BitReversal[index];
+		FftReal[target] = WindowedSamples[2 * index];
+		FftImaginary[target] = WindowedSamples[2 * index + 1];
+	}
+	for (UINT32 halfSize = 1; halfSize < complexSize; halfSize *= 2)
+	{
+		SpectrumKernels::FftStage(FftReal.data(), FftImaginary.data(), StageTwiddleReal.data() + halfSize - 1, StageTwiddleImaginary.data() + halfSize - 1, complexSize, halfSize, Options.InstructionSet);
+	}
+}
+
+HRESULT SpectrumAnalyzer::ComputeFrame(VisualizationFrame* outputFrame)
+{
+	if (outputFrame == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (ChannelCount == 0)
+	{
+		return S_FALSE;
+	}
+
+	UINT32 fftSize = Options.FftSize;
+	UINT32 complexSize = fftSize / 2;
+	try
+	{
+		outputFrame->Spectrum_dB.resize(complexSize + 1);
+		outputFrame->ChannelRms.resize(ChannelCount);
+		outputFrame->ChannelPeak.resize(ChannelCount);
+	}
+	catch (...)
+	{
+		return E_OUTOFMEMORY;
+	}
+	outputFrame->SampleRate = SampleRate;
+	outputFrame->ChannelCount = ChannelCount;
+
+	//Split the half size transform Z into the real one: X[k] = (Z[k] + Z*[N/2 - k]) / 2 - i W^k (Z[k] - Z*[N/2 - k]) / 2
+	TransformHistory();
+	double minimumPower = std::pow(10.0, MinimumLevel_dB / 10.0);
+	for (UINT32 bin = 0; bin <= complexSize; bin++)
+	{
+		UINT32 index = bin < complexSize ? bin : 0;
+		UINT32 mirrorIndex = bin > 0 ? complexSize - bin : 0;
+		float real = FftReal[index];
+		float imaginary = FftImaginary[index];
+		float mirrorReal = FftReal[mirrorIndex];
+		float mirrorImaginary = -FftImaginary[mirrorIndex];
+
+		float evenReal = 0.5f * (real + mirrorReal);
+		float evenImaginary = 0.5f * (imaginary + mirrorImaginary);
+		float oddReal = 0.5f * (imaginary - mirrorImaginary);
+		float oddImaginary = -0.5f * (real - mirrorReal);
+		float binReal = evenReal + SplitTwiddleReal[bin] * oddReal - SplitTwiddleImaginary[bin] * oddImaginary;
+		float binImaginary = evenImaginary + SplitTwiddleReal[bin] * oddImaginary + SplitTwiddleImaginary[bin] * oddReal;
+
+		double power = (double)binReal * binReal + (double)binImaginary * binImaginary;
+		outputFrame->Spectrum_dB[bin] = power > minimumPower ? (float)(10.0 * std::log10(power)) : MinimumLevel_dB;
+	}
+
+	//The meters cover what came in since the previous frame, and start over
+	for (UINT32 channel = 0; channel < ChannelCount; channel++)
+	{
+		outputFrame->ChannelRms[channel] = FramesSinceFrame > 0 ? (float)std::sqrt(ChannelSumOfSquares[channel] / FramesSinceFrame) : 0.0f;
+		outputFrame->ChannelPeak[channel] = ChannelPeaks[channel];
+		ChannelSumOfSquares[channel] = 0.0;
+		ChannelPeaks[channel] = 0.0f;
+	}
+	FramesSinceFrame = 0;
+	return S_OK;
+}
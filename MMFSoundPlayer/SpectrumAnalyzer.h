@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Platform.h"
+#include "GainStage.h"
+#include "VisualizationTap.h"
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	struct SpectrumAnalyzerOptions
+	{
+		//Samples per spectrum (a power of two from 256 to 16384), the bins are SampleRate / FftSize apart
+		UINT32 FftSize = 2048;
+
+		//Frames produced per second of audio at most (the levels cover the audio between two frames)
+		UINT32 FramesPerSecond = 30;
+
+		GainKernels::InstructionSet InstructionSet = GainKernels::GetBestInstructionSet();
+	};
+
+	//What a display shows for one moment of the audio
+	struct VisualizationFrame
+	{
+		UINT32 SampleRate = 0;
+		UINT32 ChannelCount = 0;
+
+		//Magnitude of the latest FftSize samples (the channels mixed down, Hann window) per bin in dBFS, FftSize / 2 + 1 bins
+		//from 0 Hz to half the sample rate. A full scale sine reads 0 dB at its bin, silence MinimumLevel_dB.
+		std::vector<float> Spectrum_dB;
+
+		//Per channel, linear (1.0 is full scale), over the audio since the previous frame
+		std::vector<float> ChannelRms;
+		std::vector<float> ChannelPeak;
+	};
+
+	/*
+	Consumer side of a VisualizationTap: spectrum, RMS and peak meters. The tapped audio is deinterleaved and metered as it
+	comes in, and mixed down into a history of the last FftSize samples; a frame transforms that history with a radix-2
+	FFT (half the size, with the samples packed as complex pairs, and split into the real spectrum afterwards). The
+	window, the mixdown, the butterflies and the meters run through AVX2/SSE2/NEON kernels (with a scalar fallback).
+	Once initialized for a format nothing is allocated, a format change (another file) starts the analysis over.
+	Not thread-safe, it runs on the thread consuming the tap.
+	*/
+	class SpectrumAnalyzer
+	{
+	public:
+		static constexpr float MinimumLevel_dB = -140.0f;
+		static constexpr UINT32 MinFftSize = 256;
+		static constexpr UINT32 MaxFftSize = 16384;
+
+	private:
+		//Frames deinterleaved at a time
+		static constexpr UINT32 ChunkFrames = 1024;
+
+		SpectrumAnalyzerOptions Options;
+		UINT32 SampleRate;
+		UINT32 ChannelCount;
+		UINT32 HopFrames;
+
+		//FFT tables: window (scaled so a full scale sine comes out at 1), bit reversal of the half size transform, the
+		//butterflies' twiddles (stage with half size h at h - 1) and the real split's twiddles
+		std::vector<float> Window;
+		std::vector<UINT32> BitReversal;
+		std::vector<float> StageTwiddleReal;
+		std::vector<float> StageTwiddleImaginary;
+		std::vector<float> SplitTwiddleReal;
+		std::vector<float> SplitTwiddleImaginary;
+
+		//Mixed down history, every sample written twice (FftSize apart) so the latest FftSize are always contiguous
+		std::vector<float> History;
+		UINT32 HistoryPosition;
+
+		//Working buffers
+		std::vector<float> ChannelSamples;      // ChunkFrames per channel.
+		std::vector<float> WindowedSamples;
+		std::vector<float> FftReal;
+		std::vector<float> FftImaginary;
+
+		//Meters since the last frame
+		std::vector<double> ChannelSumOfSquares;
+		std::vector<float> ChannelPeaks;
+		UINT32 FramesSinceFrame;
+
+		HRESULT SetFormat(UINT32 inputSampleRate, UINT32 inputChannelCount);
+		void AddChunk(const float* samples, UINT32 frameCount);
+		void TransformHistory();
+
+	public:
+		SpectrumAnalyzer();
+
+		HRESULT Initialize(const SpectrumAnalyzerOptions& inputOptions);
+
+		//Read everything the tap holds, then fill outputFrame if a frame is due (S_OK), S_FALSE if not
+		HRESULT Update(VisualizationTap* inputTap, VisualizationFrame* outputFrame);
+
+		//Analyze interleaved frames from anywhere else (files, tests, benchmarks), and compute a frame of what was added
+		HRESULT AddFrames(const float* samples, UINT32 frameCount, UINT32 inputChannelCount, UINT32 inputSampleRate);
+		HRESULT ComputeFrame(VisualizationFrame* outputFrame);
+	};
+
+	//The analyzer's vector kernels, exposed for benchmarking and for checking them against the scalar reference (the vector
+	//versions add in another order, so they agree to rounding, not bit for bit)
+	namespace SpectrumKernels
+	{
+		//One radix-2 decimation in time stage over the whole transform, on split real/imaginary arrays
+		void FftStage(float* real, float* imaginary, const float* twiddleReal, const float* twiddleImaginary, size_t size, size_t halfSize, GainKernels::InstructionSet instructionSet = GainKernels::GetBestInstructionSet());
+
+		//Sum of the squares and largest magnitude of a run of samples
+		void SumOfSquaresAndPeak(const float* samples, size_t sampleCount, float* sumOfSquares, float* peak, GainKernels::InstructionSet instructionSet = GainKernels::GetBestInstructionSet());
+	}
+}
@@ -0,0 +1,252 @@
+#include "TelemetryExport.h"
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+
+using namespace MMFSoundPlayerLib;
+
+//Formatting---------------------------------------------------------------------------------------------------------------------------------------------------
+static void AppendFormatted(std::string& output, const char* format, ...)
+{
+	char buffer[512];
+	va_list arguments;
+	va_start(arguments, format);
+	int length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+	va_end(arguments);
+	if (length > 0)
+	{
+		output.append(buffer, (size_t)length < sizeof(buffer) ? (size_t)length : sizeof(buffer) - 1);
+	}
+}
+
+//Label values escape backslashes, quotes and line breaks
+static std::string EscapePrometheusLabel(const std::string& inputValue)
+{
+	std::string escapedValue;
+	for (char character : inputValue)
+	{
+		switch (character)
+		{
+		case '\\': escapedValue += "\\\\"; break;
+		case '"': escapedValue += "\\\""; break;
+		case '\n': escapedValue += "\\n"; break;
+		default: escapedValue += character; break;
+		}
+	}
+	return escapedValue;
+}
+
+//labelSet is empty or the {...} every sample of the player carries
+static void AppendPrometheusCounter(std::string& output, const char* name, const char* help, const char* type, const std::string& labelSet, double value)
+{
+	AppendFormatted(output, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	AppendFormatted(output, "%s%s %.15g\n", name, labelSet.c_str(), value);
+}
+
+//Prometheus histograms are cumulative, with the bounds (le) and sum in the metric's unit. The snapshot's units are scaled to it by unitScale.
+static void AppendPrometheusHistogram(std::string& output, const char* name, const char* help, const std::string& labelSet, const TelemetryHistogramSnapshot& inputHistogram, double unitScale)
+{
+	//The bucket label goes behind the player's (inside of its braces)
+	std::string labelPrefix = labelSet.empty() ? std::string() : labelSet.substr(1, labelSet.size() - 2) + ",";
+	AppendFormatted(output, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+
+	//The buckets aren't read as one, so +Inf and the count are their total (never less than the last bound's count)
+	UINT64 cumulativeCount = 0;
+	for (size_t bucket = 0; bucket < inputHistogram.UpperBounds.size(); bucket++)
+	{
+		cumulativeCount += inputHistogram.Counts[bucket];
+		AppendFormatted(output, "%s_bucket{%sle=\"%.15g\"} %" PRIu64 "\n", name, labelPrefix.c_str(), inputHistogram.UpperBounds[bucket] * unitScale, (uint64_t)cumulativeCount);
+	}
+	cumulativeCount += inputHistogram.Counts.empty() ? 0 : inputHistogram.Counts.back();
+	AppendFormatted(output, "%s_bucket{%sle=\"+Inf\"} %" PRIu64 "\n", name, labelPrefix.c_str(), (uint64_t)cumulativeCount);
+	AppendFormatted(output, "%s_sum%s %.15g\n", name, labelSet.c_str(), inputHistogram.Sum * unitScale);
+	AppendFormatted(output, "%s_count%s %" PRIu64 "\n", name, labelSet.c_str(), (uint64_t)cumulativeCount);
+}
+
+std::string MMFSoundPlayerLib::FormatTelemetryAsPrometheusText(const RenderTelemetrySnapshot& inputSnapshot, const std::string& instanceName)
+{
+	std::string labelSet = instanceName.empty() ? std::string() : "{player=\"" + EscapePrometheusLabel(instanceName) + "\"}";
+	std::string output;
+	AppendPrometheusCounter(output, "mmfsoundplayer_render_periods_total", "Periods written to the sink, underruns included.", "counter", labelSet, (double)inputSnapshot.PeriodsRendered);
+	AppendPrometheusCounter(output, "mmfsoundplayer_render_underruns_total", "Periods rendered as silence because no decoded audio was ready.", "counter", labelSet, (double)inputSnapshot.UnderrunCount);
+	AppendPrometheusCounter(output, "mmfsoundplayer_render_late_periods_total", "Periods rendered more than a period after they were due.", "counter", labelSet, (double)inputSnapshot.LatePeriodCount);
+	AppendPrometheusCounter(output, "mmfsoundplayer_render_sink_failures_total", "Sink writes or reopens that failed.", "counter", labelSet, (double)inputSnapshot.SinkFailureCount);
+	AppendPrometheusCounter(output, "mmfsoundplayer_render_audio_seconds_total", "Duration of the audio written to the sink.", "counter", labelSet, inputSnapshot.AudioRendered_Nanoseconds / 1e9);
+	AppendPrometheusCounter(output, "mmfsoundplayer_decode_cpu_seconds_total", "CPU time spent decoding blocks.", "counter", labelSet, inputSnapshot.DecodeCpuTime_Nanoseconds / 1e9);
+	AppendPrometheusCounter(output, "mmfsoundplayer_render_cpu_seconds_total", "CPU time spent rendering periods.", "counter", labelSet, inputSnapshot.RenderCpuTime_Nanoseconds / 1e9);
+	AppendPrometheusCounter(output, "mmfsoundplayer_cpu_milliseconds_per_audio_second", "Decode and render CPU time per second of audio rendered.", "gauge", labelSet, inputSnapshot.CpuTimePerAudioSecond_Milliseconds);
+	AppendPrometheusHistogram(output, "mmfsoundplayer_render_period_jitter_seconds", "How late the render thread woke up for a period.", labelSet, inputSnapshot.PeriodJitter_Microseconds, 1e-6);
+	AppendPrometheusHistogram(output, "mmfsoundplayer_decode_ahead_blocks", "Decoded blocks ready when the render thread took the next one.", labelSet, inputSnapshot.BufferFill_Blocks, 1.0);
+	AppendPrometheusHistogram(output, "mmfsoundplayer_decode_block_seconds", "Time to decode one block.", labelSet, inputSnapshot.DecodeTime_Microseconds, 1e-6);
+	return output;
+}
+
+static void AppendJsonHistogram(std::string& output, const char* name, const TelemetryHistogramSnapshot& inputHistogram)
+{
+	AppendFormatted(output, ",\"%s\":{\"count\":%" PRIu64 ",\"sum\":%" PRIu64 ",\"max\":%" PRIu64 ",\"bounds\":[", name, (uint64_t)inputHistogram.Count, (uint64_t)inputHistogram.Sum, (uint64_t)inputHistogram.Max);
+	for (size_t bucket = 0; bucket < inputHistogram.UpperBounds.size(); bucket++)
+	{
+		AppendFormatted(output, bucket == 0 ? "%" PRIu64 : ",%" PRIu64, (uint64_t)inputHistogram.UpperBounds[bucket]);
+	}
+	output += "],\"counts\":[";
+	for (size_t bucket = 0; bucket < inputHistogram.Counts.size(); bucket++)
+	{
+		AppendFormatted(output, bucket == 0 ? "%" PRIu64 : ",%" PRIu64, (uint64_t)inputHistogram.Counts[bucket]);
+	}
+	output += "]}";
+}
+
+std::string MMFSoundPlayerLib::FormatTelemetryAsJson(const RenderTelemetrySnapshot& inputSnapshot)
+{
+	INT64 time_Milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+	std::string output;
+	AppendFormatted(output, "{\"time_ms\":%" PRId64 ",\"periods\":%" PRIu64 ",\"underruns\":%" PRIu64 ",\"late_periods\":%" PRIu64 ",\"sink_failures\":%" PRIu64,
+		(int64_t)time_Milliseconds, (uint64_t)inputSnapshot.PeriodsRendered, (uint64_t)inputSnapshot.UnderrunCount, (uint64_t)inputSnapshot.LatePeriodCount, (uint64_t)inputSnapshot.SinkFailureCount);
+	AppendFormatted(output, ",\"audio_ns\":%" PRIu64 ",\"decode_cpu_ns\":%" PRIu64 ",\"render_cpu_ns\":%" PRIu64 ",\"cpu_ms_per_audio_second\":%.6f",
+		(uint64_t)inputSnapshot.AudioRendered_Nanoseconds, (uint64_t)inputSnapshot.DecodeCpuTime_Nanoseconds, (uint64_t)inputSnapshot.RenderCpuTime_Nanoseconds, inputSnapshot.CpuTimePerAudioSecond_Milliseconds);
+	AppendJsonHistogram(output, "period_jitter_us", inputSnapshot.PeriodJitter_Microseconds);
+	AppendJsonHistogram(output, "buffer_fill_blocks", inputSnapshot.BufferFill_Blocks);
+	AppendJsonHistogram(output, "decode_time_us", inputSnapshot.DecodeTime_Microseconds);
+	output += "}";
+	return output;
+}
+
+//File exporters-----------------------------------------------------------------------------------------------------------------------------------------------
+PrometheusTextFileExporter::PrometheusTextFileExporter(PCWSTR outputFilePath, const std::string& instanceName)
+{
+	OutputFilePath = outputFilePath != nullptr ? outputFilePath : L"";
+	InstanceName = instanceName;
+}
+
+HRESULT PrometheusTextFileExporter::Export(const RenderTelemetrySnapshot& inputSnapshot)
+{
+	//Write the text next to the file and swap it in, a scrape sees either the old text or the new one
+	std::string text = FormatTelemetryAsPrometheusText(inputSnapshot, InstanceName);
+	std::wstring temporaryFilePath = OutputFilePath + L".tmp";
+	FILE* file = OpenFileWithWidePath(temporaryFilePath.c_str(), "wb");
+	if (file == nullptr)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+	bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+	if (fclose(file) != 0)
+	{
+		written = false;
+	}
+	if (!written)
+	{
+		RemoveFileWithWidePath(temporaryFilePath.c_str());
+		return E_FAIL;
+	}
+	return ReplaceFileWithWidePath(temporaryFilePath.c_str(), OutputFilePath.c_str());
+}
+
+JsonLinesFileExporter::JsonLinesFileExporter(PCWSTR outputFilePath)
+{
+	OutputFilePath = outputFilePath != nullptr ? outputFilePath : L"";
+}
+
+HRESULT JsonLinesFileExporter::Export(const RenderTelemetrySnapshot& inputSnapshot)
+{
+	//Opened for every line, so the file can be rotated or deleted while exporting
+	std::string line = FormatTelemetryAsJson(inputSnapshot) + "\n";
+	FILE* file = OpenFileWithWidePath(OutputFilePath.c_str(), "ab");
+	if (file == nullptr)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+	bool written = fwrite(line.data(), 1, line.size(), file) == line.size();
+	if (fclose(file) != 0 || !written)
+	{
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
+//Periodic export----------------------------------------------------------------------------------------------------------------------------------------------
+PeriodicTelemetryExport::PeriodicTelemetryExport()
+{
+	StopRequested = false;
+	LastExportResult = S_FALSE;
+}
+
+PeriodicTelemetryExport::~PeriodicTelemetryExport()
+{
+	Stop();
+}
+
+HRESULT PeriodicTelemetryExport::Start(std::function<HRESULT(RenderTelemetrySnapshot*)> snapshotSource, ITelemetryExporter* exporter, UINT32 intervalMilliseconds)
+{
+	if (snapshotSource == nullptr || exporter == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (intervalMilliseconds == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	std::lock_guard<std::mutex> lock(ControlMutex);
+	StopExportThread();
+	StopRequested = false;
+	LastExportResult = S_FALSE;
+	try
+	{
+		ExportThread = std::thread(&PeriodicTelemetryExport::ExportLoop, this, std::move(snapshotSource), exporter, intervalMilliseconds);
+	}
+	catch (...)
+	{
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+HRESULT PeriodicTelemetryExport::Stop()
+{
+	std::lock_guard<std::mutex> lock(ControlMutex);
+	return StopExportThread();
+}
+
+HRESULT PeriodicTelemetryExport::StopExportThread()
+{
+	if (!ExportThread.joinable())
+	{
+		return S_FALSE;
+	}
+	{
+		std::lock_guard<std::mutex> lock(ExportMutex);
+		StopRequested = true;
+	}
+	ExportCondition.notify_all();
+	ExportThread.join();
+	return S_OK;
+}
+
+HRESULT PeriodicTelemetryExport::GetLastExportResult()
+{
+	return LastExportResult;
+}
+
+void PeriodicTelemetryExport::ExportLoop(std::function<HRESULT(RenderTelemetrySnapshot*)> snapshotSource, ITelemetryExporter* exporter, UINT32 intervalMilliseconds)
+{
+	//Intervals are counted from the start, so exporting doesn't make the export drift
+	std::chrono::steady_clock::time_point nextExportTime = std::chrono::steady_clock::now();
+	bool isStopping = false;
+	while (!isStopping)
+	{
+		nextExportTime += std::chrono::milliseconds(intervalMilliseconds);
+		{
+			std::unique_lock<std::mutex> lock(ExportMutex);
+			isStopping = ExportCondition.wait_until(lock, nextExportTime, [&]() { return StopRequested; });
+		}
+
+		RenderTelemetrySnapshot snapshot;
+		HRESULT hr = snapshotSource(&snapshot);
+		if (SUCCEEDED(hr))
+		{
+			hr = exporter->Export(snapshot);
+		}
+		LastExportResult = hr;
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Platform.h"
+#include "RenderTelemetry.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace MMFSoundPlayerLib
+{
+	//Takes render telemetry snapshots somewhere (a file, a metrics system). Called from the exporting thread only.
+	class ITelemetryExporter
+	{
+	public:
+		virtual ~ITelemetryExporter() = default;
+
+		virtual HRESULT Export(const RenderTelemetrySnapshot& inputSnapshot) = 0;
+	};
+
+	//Snapshot in the Prometheus text exposition format (counters, histograms in seconds). A non-empty instance name labels
+	//every sample with player="instanceName", so several players can share a scrape.
+	std::string FormatTelemetryAsPrometheusText(const RenderTelemetrySnapshot& inputSnapshot, const std::string& instanceName);
+
+	//Snapshot as a single line JSON object, with the wall clock time it was formatted at
+	std::string FormatTelemetryAsJson(const RenderTelemetrySnapshot& inputSnapshot);
+
+	/*
+	Rewrites a file with the Prometheus text format on every export, for node_exporter's textfile collector or an HTTP
+	endpoint of the application that serves the file. The text is written next to the file and swapped in, so a scrape
+	never reads half of it.
+	*/
+	class PrometheusTextFileExporter : public ITelemetryExporter
+	{
+	private:
+		std::wstring OutputFilePath;
+		std::string InstanceName;
+
+	public:
+		PrometheusTextFileExporter(PCWSTR outputFilePath, const std::string& instanceName = std::string());
+
+		//ITelemetryExporter method
+		HRESULT Export(const RenderTelemetrySnapshot& inputSnapshot) override;
+	};
+
+	//Appends every export to a file as a line of JSON, a history of the render health to look through after a stutter report
+	class JsonLinesFileExporter : public ITelemetryExporter
+	{
+	private:
+		std::wstring OutputFilePath;
+
+	public:
+		JsonLinesFileExporter(PCWSTR outputFilePath);
+
+		//ITelemetryExporter method
+		HRESULT Export(const RenderTelemetrySnapshot& inputSnapshot) override;
+	};
+
+	/*
+	Hands a snapshot to an exporter at a fixed interval, on a thread of its own, and once more when stopped (so the last
+	interval isn't lost). The snapshot source is any function filling one in, usually a backend's GetRenderTelemetry.
+	*/
+	class PeriodicTelemetryExport
+	{
+	private:
+		//Start and Stop may be called from any thread, they take turns
+		std::mutex ControlMutex;
+
+		std::mutex ExportMutex;
+		std::condition_variable ExportCondition;
+		bool StopRequested;
+		std::thread ExportThread;
+		std::atomic<HRESULT> LastExportResult;
+
+		HRESULT StopExportThread();
+		void ExportLoop(std::function<HRESULT(RenderTelemetrySnapshot*)> snapshotSource, ITelemetryExporter* exporter, UINT32 intervalMilliseconds);
+
+	public:
+		PeriodicTelemetryExport();
+		~PeriodicTelemetryExport();
+
+		//Start exporting (replacing an export already running). The exporter isn't owned and must outlive the export.
+		HRESULT Start(std::function<HRESULT(RenderTelemetrySnapshot*)> snapshotSource, ITelemetryExporter* exporter, UINT32 intervalMilliseconds);
+
+		//Export a last time and stop (S_FALSE if nothing was exporting)
+		HRESULT Stop();
+
+		//Outcome of the latest export (S_FALSE before the first one), failures don't stop the export
+		HRESULT GetLastExportResult();
+	};
+}
@@ -0,0 +1,83 @@
+#include "VisualizationTap.h"
+#include <cstring>
+
+using namespace MMFSoundPlayerLib;
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+VisualizationTap::VisualizationTap()
+{
+	IsEnabled = false;
+	IsAllocated = false;
+	DroppedFrameCount = 0;
+}
+
+HRESULT VisualizationTap::Enable(bool isEnabled)
+{
+	std::lock_guard<std::mutex> lock(EnableMutex);
+
+	//The blocks are allocated the first time they are needed and kept from then on (the render thread may still be writing into them)
+	if (isEnabled && !IsAllocated)
+	{
+		try
+		{
+			Ring.SetCapacity(BlockCount);
+		}
+		catch (...)
+		{
+			return E_OUTOFMEMORY;
+		}
+		IsAllocated = true;
+	}
+	IsEnabled.store(isEnabled, std::memory_order_release);
+	return S_OK;
+}
+
+bool VisualizationTap::GetIsEnabled()
+{
+	return IsEnabled.load(std::memory_order_acquire);
+}
+
+//Render Thread------------------------------------------------------------------------------------------------------------------------------------------------
+void VisualizationTap::WriteFrames(const float* samples, UINT32 frameCount, UINT32 channelCount, UINT32 sampleRate)
+{
+	if (channelCount == 0 || channelCount > VisualizationBlock::SampleCapacity)
+	{
+		return;
+	}
+
+	//Split the frames over as many blocks as they need, whatever doesn't fit is dropped (never waited for)
+	UINT32 blockFrameCapacity = VisualizationBlock::SampleCapacity / channelCount;
+	UINT32 framesWritten = 0;
+	while (framesWritten < frameCount)
+	{
+		VisualizationBlock* block = Ring.BeginWrite();
+		if (block == nullptr)
+		{
+			DroppedFrameCount.store(DroppedFrameCount.load(std::memory_order_relaxed) + (frameCount - framesWritten), std::memory_order_relaxed);
+			return;
+		}
+		UINT32 blockFrames = frameCount - framesWritten < blockFrameCapacity ? frameCount - framesWritten : blockFrameCapacity;
+		memcpy(block->Samples.data(), samples + (size_t)framesWritten * channelCount, (size_t)blockFrames * channelCount * sizeof(float));
+		block->FrameCount = blockFrames;
+		block->ChannelCount = channelCount;
+		block->SampleRate = sampleRate;
+		Ring.EndWrite();
+		framesWritten += blockFrames;
+	}
+}
+
+//Consumer-----------------------------------------------------------------------------------------------------------------------------------------------------
+const VisualizationBlock* VisualizationTap::BeginRead()
+{
+	return Ring.BeginRead();
+}
+
+void VisualizationTap::EndRead()
+{
+	Ring.EndRead();
+}
+
+UINT64 VisualizationTap::GetDroppedFrameCount()
+{
+	return DroppedFrameCount.load(std::memory_order_relaxed);
+}
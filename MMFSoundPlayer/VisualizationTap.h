@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Platform.h"
+#include "SingleProducerSingleConsumerRing.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	//Rendered audio copied out by a VisualizationTap: interleaved float frames in the format they were rendered in
+	struct VisualizationBlock
+	{
+		static constexpr UINT32 SampleCapacity = 4096;
+
+		std::vector<float> Samples = std::vector<float>(SampleCapacity);
+		UINT32 FrameCount = 0;
+		UINT32 ChannelCount = 0;
+		UINT32 SampleRate = 0;
+	};
+
+	/*
+	Copies the audio a backend renders (after the gain, exactly what goes to the sink) into a lock-free single-producer/
+	single-consumer ring for meters and spectrum displays. The render thread never waits on the tap and never allocates
+	for it: the blocks are allocated when the tap is enabled the first time, and audio that finds the ring full (the
+	consumer fell behind) is dropped and counted. While the tap is off, which is the default, the render thread only does
+	a load of its flag.
+	One consumer thread enables the tap and reads it (usually through a SpectrumAnalyzer), the backend's render thread
+	writes it. Blocks written before the tap was disabled stay readable.
+	*/
+	class VisualizationTap
+	{
+	public:
+		//About 0.6 s of stereo audio at 48 kHz with the headless backend's default period
+		static constexpr size_t BlockCount = 64;
+
+	private:
+		std::mutex EnableMutex;
+		std::atomic<bool> IsEnabled;
+		bool IsAllocated;
+		SingleProducerSingleConsumerRing<VisualizationBlock> Ring;
+		std::atomic<UINT64> DroppedFrameCount;
+
+		void WriteFrames(const float* samples, UINT32 frameCount, UINT32 channelCount, UINT32 sampleRate);
+
+	public:
+		VisualizationTap();
+
+		//Start or stop copying the rendered audio (consumer thread)
+		HRESULT Enable(bool isEnabled);
+		bool GetIsEnabled();
+
+		//Render thread: copy interleaved frames, if the tap is on
+		void Write(const float* samples, UINT32 frameCount, UINT32 channelCount, UINT32 sampleRate)
+		{
+			if (IsEnabled.load(std::memory_order_acquire))
+			{
+				WriteFrames(samples, frameCount, channelCount, sampleRate);
+			}
+		}
+
+		//Consumer thread: the oldest block not read yet (nullptr if there is none), handed back with EndRead
+		const VisualizationBlock* BeginRead();
+		void EndRead();
+
+		//Frames dropped because the ring was full
+		UINT64 GetDroppedFrameCount();
+	};
+}
@@ -0,0 +1,651 @@
+#include "VoiceEngine.h"
+#include "AudioSinks.h"
+#include "MediaProbe.h"
+#include "MediaRuntime.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+using namespace MMFSoundPlayerLib;
+
+//Samples per arena block (a block holds several clips, a longer clip gets a block of its own)
+static const size_t ArenaBlockSamples = (size_t)1 << 20;
+
+//Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
+VoiceEngine::VoiceEngine(const VoiceEngineOptions& inputOptions)
+{
+	Options = inputOptions;
+	OutputFormat.SampleRate = Options.SampleRate;
+	OutputFormat.ChannelCount = Options.ChannelCount;
+	OutputFormat.BitsPerSample = 32;
+	OutputFormat.IsFloatingPoint = true;
+	ArenaBlockCapacity = 0;
+	ArenaBlockUsed = 0;
+	ClipCount = 0;
+	NextVoiceId = 1;
+	VoiceStartCount = 0;
+	RenderRunning = false;
+	VoicesTriggered = 0;
+	VoicesStolen = 0;
+	TriggersDropped = 0;
+	PeriodsRendered = 0;
+	ActiveVoices = 0;
+	MaxTriggerLatency_Nanoseconds = 0;
+	TotalTriggerLatency_Nanoseconds = 0;
+	MeasuredTriggerCount = 0;
+}
+
+VoiceEngine::~VoiceEngine()
+{
+	Stop();
+	if (Sink != nullptr)
+	{
+		Sink->Close();
+	}
+}
+
+HRESULT VoiceEngine::CreateInstance(const VoiceEngineOptions& inputOptions, VoiceEngine** outputEngine)
+{
+	//Ensure that the double pointer actually points somewhere
+	if (outputEngine == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (inputOptions.SampleRate == 0 || inputOptions.ChannelCount == 0 || inputOptions.PeriodFrames == 0 || inputOptions.MaxVoices == 0 ||
+		inputOptions.MaxClips == 0 || inputOptions.PlaybackSpeed < 0)
+	{
+		return E_INVALIDARG;
+	}
+	if (inputOptions.SinkType == HeadlessSinkType::WavFile && inputOptions.OutputFilePath.empty())
+	{
+		return E_INVALIDARG;
+	}
+
+	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULT can be returned
+	VoiceEngine* newEngine = new (std::nothrow) VoiceEngine(inputOptions);
+	if (newEngine == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	HRESULT hr = newEngine->Initialize();
+	if (FAILED(hr))
+	{
+		delete newEngine;
+		return hr;
+	}
+
+	*outputEngine = newEngine;
+	return S_OK;
+}
+
+HRESULT VoiceEngine::Initialize()
+{
+	//Create and open the sink
+	if (Options.SinkType == HeadlessSinkType::WavFile)
+	{
+		Sink.reset(new (std::nothrow) WavFileAudioSink(Options.OutputFilePath.c_str()));
+	}
+	else
+	{
+		Sink.reset(new (std::nothrow) NullAudioSink());
+	}
+	if (Sink == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	HRESULT hr = Sink->Open(OutputFormat);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Everything the render thread touches is sized here, up front
+	Clips.reset(new (std::nothrow) Clip[Options.MaxClips]);
+	if (Clips == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	Voices.resize(Options.MaxVoices);
+	MixBuffer.resize((size_t)Options.PeriodFrames * Options.ChannelCount);
+	Commands.SetCapacity(std::max<size_t>(64, (size_t)Options.MaxVoices * 4));
+	StartedTriggerTimes.reserve(Commands.GetCapacity());
+	return S_OK;
+}
+
+//Clips--------------------------------------------------------------------------------------------------------------------------------------------------------
+float* VoiceEngine::AllocateClipSamples(size_t sampleCount)
+{
+	//Only while LoadMutex is held. Clips are packed into the current block, one that doesn't fit starts a new block.
+	if (ArenaBlocks.empty() || ArenaBlockUsed + sampleCount > ArenaBlockCapacity)
+	{
+		size_t blockCapacity = std::max(ArenaBlockSamples, sampleCount);
+		std::unique_ptr<float[]> newBlock(new (std::nothrow) float[blockCapacity]);
+		if (newBlock == nullptr)
+		{
+			return nullptr;
+		}
+		ArenaBlocks.push_back(std::move(newBlock));
+		ArenaBlockCapacity = blockCapacity;
+		ArenaBlockUsed = 0;
+	}
+
+	float* samples = ArenaBlocks.back().get() + ArenaBlockUsed;
+	ArenaBlockUsed += sampleCount;
+	return samples;
+}
+
+HRESULT VoiceEngine::LoadClip(PCWSTR inputFilePath, ClipId* outputClip, UINT32 maxPolyphony)
+{
+	if (inputFilePath == nullptr || outputClip == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Decoding through Media Foundation needs COM and the runtime on this thread while the decoder lives
+#ifdef _WIN32
+	HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	bool comInitialized = SUCCEEDED(comResult);
+#endif
+	HRESULT hr = MediaRuntime::AddRef();
+	if (FAILED(hr))
+	{
+#ifdef _WIN32
+		if (comInitialized)
+		{
+			CoUninitialize();
+		}
+#endif
+		return hr;
+	}
+
+	//Decode the whole clip
+	std::vector<float> decodedFrames;
+	AudioFormat decodedFormat;
+	{
+		IAudioDecoder* openedDecoder = nullptr;
+		hr = OpenAudioFileDecoder(inputFilePath, &openedDecoder);
+		std::unique_ptr<IAudioDecoder> decoder(openedDecoder);
+		if (SUCCEEDED(hr))
+		{
+			decodedFormat = decoder->GetFormat();
+			UINT64 frameCount = decoder->GetFrameCount();
+			decodedFrames.reserve((size_t)frameCount * decodedFormat.ChannelCount);
+		}
+
+		const UINT32 chunkFrames = 4096;
+		while (SUCCEEDED(hr))
+		{
+			size_t decodedSamples = decodedFrames.size();
+			decodedFrames.resize(decodedSamples + (size_t)chunkFrames * decodedFormat.ChannelCount);
+			UINT32 framesRead = 0;
+			hr = decoder->ReadFrames(decodedFrames.data() + decodedSamples, chunkFrames, &framesRead);
+			decodedFrames.resize(decodedSamples + (size_t)framesRead * decodedFormat.ChannelCount);
+			if (framesRead == 0)
+			{
+				break;
+			}
+		}
+	}
+
+	MediaRuntime::Release();
+#ifdef _WIN32
+	if (comInitialized)
+	{
+		CoUninitialize();
+	}
+#endif
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	return LoadClipFromMemory(decodedFrames.data(), (UINT32)(decodedFrames.size() / decodedFormat.ChannelCount), decodedFormat, outputClip, maxPolyphony);
+}
+
+HRESULT VoiceEngine::LoadClipFromMemory(const float* inputFrames, UINT32 frameCount, const AudioFormat& inputFormat, ClipId* outputClip, UINT32 maxPolyphony)
+{
+	if ((inputFrames == nullptr && frameCount > 0) || outputClip == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (inputFormat.SampleRate == 0 || inputFormat.ChannelCount == 0 || frameCount == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	//Map the channels: mono goes to every output channel, everything goes to mono averaged, the rest channel by channel
+	UINT32 outputChannels = OutputFormat.ChannelCount;
+	std::vector<float> mappedFrames((size_t)frameCount * outputChannels, 0.0f);
+	for (UINT32 frame = 0; frame < frameCount; frame++)
+	{
+		const float* inputFrame = inputFrames + (size_t)frame * inputFormat.ChannelCount;
+		float* mappedFrame = mappedFrames.data() + (size_t)frame * outputChannels;
+		if (inputFormat.ChannelCount == 1)
+		{
+			std::fill_n(mappedFrame, outputChannels, inputFrame[0]);
+		}
+		else if (outputChannels == 1)
+		{
+			float sum = 0.0f;
+			for (UINT32 channel = 0; channel < inputFormat.ChannelCount; channel++)
+			{
+				sum += inputFrame[channel];
+			}
+			mappedFrame[0] = sum / inputFormat.ChannelCount;
+		}
+		else
+		{
+			std::copy_n(inputFrame, std::min(inputFormat.ChannelCount, outputChannels), mappedFrame);
+		}
+	}
+
+	//Convert the rate once, here, so playing it is a plain copy
+	if (inputFormat.SampleRate != OutputFormat.SampleRate)
+	{
+		Resampler clipResampler;
+		HRESULT hr = clipResampler.Initialize(inputFormat.SampleRate, OutputFormat.SampleRate, outputChannels, Options.ClipResamplingQuality);
+		std::vector<float> resampledFrames;
+		std::vector<float> drainedFrames;
+		UINT32 resampledFrameCount = 0;
+		UINT32 drainedFrameCount = 0;
+		if (SUCCEEDED(hr))
+		{
+			hr = clipResampler.Process(mappedFrames.data(), frameCount, resampledFrames, &resampledFrameCount);
+		}
+		if (SUCCEEDED(hr))
+		{
+			hr = clipResampler.Drain(drainedFrames, &drainedFrameCount);
+		}
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+		resampledFrames.insert(resampledFrames.end(), drainedFrames.begin(), drainedFrames.end());
+		mappedFrames = std::move(resampledFrames);
+		frameCount = resampledFrameCount + drainedFrameCount;
+	}
+	if (frameCount == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	//Copy into the arena and publish the clip
+	std::lock_guard<std::mutex> lock(LoadMutex);
+	UINT32 clipIndex = ClipCount.load(std::memory_order_relaxed);
+	if (clipIndex >= Options.MaxClips)
+	{
+		return E_OUTOFMEMORY;
+	}
+	float* clipSamples = AllocateClipSamples(mappedFrames.size());
+	if (clipSamples == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	std::copy(mappedFrames.begin(), mappedFrames.end(), clipSamples);
+	Clips[clipIndex].Samples = clipSamples;
+	Clips[clipIndex].FrameCount = frameCount;
+	Clips[clipIndex].MaxPolyphony = maxPolyphony;
+	ClipCount.store(clipIndex + 1, std::memory_order_release);
+
+	*outputClip = clipIndex;
+	return S_OK;
+}
+
+//Voices-------------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT VoiceEngine::SubmitCommand(const VoiceCommand& inputCommand)
+{
+	//The render thread never takes this lock, it only keeps the producers apart
+	std::lock_guard<std::mutex> lock(CommandMutex);
+	VoiceCommand* command = Commands.BeginWrite();
+	if (command == nullptr)
+	{
+		TriggersDropped++;
+		return E_OUTOFMEMORY;
+	}
+	*command = inputCommand;
+	Commands.EndWrite();
+	return S_OK;
+}
+
+HRESULT VoiceEngine::Trigger(ClipId inputClip, float gain, VoiceId* outputVoice)
+{
+	if (inputClip >= ClipCount.load(std::memory_order_acquire) || gain < 0.0f || !std::isfinite(gain))
+	{
+		return E_INVALIDARG;
+	}
+
+	VoiceCommand newCommand;
+	newCommand.Type = VoiceCommandType::Trigger;
+	newCommand.Voice = NextVoiceId++;
+	newCommand.ClipIndex = inputClip;
+	newCommand.Gain = gain;
+	newCommand.TriggerTime_Nanoseconds = GetMonotonicTimeNanoseconds();
+	HRESULT hr = SubmitCommand(newCommand);
+	if (SUCCEEDED(hr) && outputVoice != nullptr)
+	{
+		*outputVoice = newCommand.Voice;
+	}
+	return hr;
+}
+
+HRESULT VoiceEngine::StopVoice(VoiceId inputVoice)
+{
+	VoiceCommand newCommand;
+	newCommand.Type = VoiceCommandType::Stop;
+	newCommand.Voice = inputVoice;
+	return SubmitCommand(newCommand);
+}
+
+HRESULT VoiceEngine::SetVoiceGain(VoiceId inputVoice, float gain)
+{
+	if (gain < 0.0f || !std::isfinite(gain))
+	{
+		return E_INVALIDARG;
+	}
+
+	VoiceCommand newCommand;
+	newCommand.Type = VoiceCommandType::SetGain;
+	newCommand.Voice = inputVoice;
+	newCommand.Gain = gain;
+	return SubmitCommand(newCommand);
+}
+
+HRESULT VoiceEngine::StopAllVoices()
+{
+	VoiceCommand newCommand;
+	newCommand.Type = VoiceCommandType::StopAll;
+	return SubmitCommand(newCommand);
+}
+
+HRESULT VoiceEngine::SetVolume(float volumeLevel)
+{
+	if (volumeLevel < 0.0f || volumeLevel > 1.0f)
+	{
+		return E_INVALIDARG;
+	}
+	Gain.SetVolume(volumeLevel);
+	return S_OK;
+}
+
+void VoiceEngine::SetMute(bool isMuted)
+{
+	Gain.SetMute(isMuted);
+}
+
+//Mixing-------------------------------------------------------------------------------------------------------------------------------------------------------
+void VoiceEngine::ApplyCommands()
+{
+	VoiceCommand* command = nullptr;
+	while ((command = Commands.BeginRead()) != nullptr)
+	{
+		switch (command->Type)
+		{
+		case VoiceCommandType::Trigger:
+			StartVoice(*command);
+			break;
+
+		case VoiceCommandType::Stop:
+		case VoiceCommandType::SetGain:
+			for (Voice& voice : Voices)
+			{
+				if (voice.Id == command->Voice)
+				{
+					if (command->Type == VoiceCommandType::Stop)
+					{
+						FadeOutVoice(voice);
+					}
+					else
+					{
+						voice.Gain = command->Gain;
+					}
+					break;
+				}
+			}
+			break;
+
+		case VoiceCommandType::StopAll:
+			for (Voice& voice : Voices)
+			{
+				if (voice.Id != 0)
+				{
+					FadeOutVoice(voice);
+				}
+			}
+			break;
+		}
+		Commands.EndRead();
+	}
+}
+
+void VoiceEngine::StartVoice(const VoiceCommand& inputCommand)
+{
+	//The clip's own limit first: at its limit, its oldest voice makes room
+	const Clip& clip = Clips[inputCommand.ClipIndex];
+	Voice* target = nullptr;
+	Voice* oldestVoice = nullptr;
+	Voice* oldestClipVoice = nullptr;
+	UINT32 clipVoiceCount = 0;
+	for (Voice& voice : Voices)
+	{
+		if (voice.Id == 0)
+		{
+			if (target == nullptr)
+			{
+				target = &voice;
+			}
+			continue;
+		}
+		if (oldestVoice == nullptr || voice.StartOrder < oldestVoice->StartOrder)
+		{
+			oldestVoice = &voice;
+		}
+		if (voice.ClipIndex == inputCommand.ClipIndex)
+		{
+			clipVoiceCount++;
+			if (oldestClipVoice == nullptr || voice.StartOrder < oldestClipVoice->StartOrder)
+			{
+				oldestClipVoice = &voice;
+			}
+		}
+	}
+	if (clip.MaxPolyphony > 0 && clipVoiceCount >= clip.MaxPolyphony)
+	{
+		target = oldestClipVoice;
+	}
+	else if (target == nullptr)
+	{
+		target = oldestVoice;
+	}
+
+	//A stolen voice fades out underneath the new one
+	if (target->Id != 0)
+	{
+		FadeOutVoice(*target);
+		VoicesStolen++;
+	}
+	target->Id = inputCommand.Voice;
+	target->ClipIndex = inputCommand.ClipIndex;
+	target->Position = 0;
+	target->Gain = inputCommand.Gain;
+	target->StartOrder = VoiceStartCount++;
+	VoicesTriggered++;
+	if (StartedTriggerTimes.size() < StartedTriggerTimes.capacity())
+	{
+		StartedTriggerTimes.push_back(inputCommand.TriggerTime_Nanoseconds);
+	}
+}
+
+void VoiceEngine::FadeOutVoice(Voice& inputVoice)
+{
+	//The slot is free right away, the fade plays out of the fields of its own (a fade still running is cut)
+	inputVoice.FadingClipIndex = inputVoice.ClipIndex;
+	inputVoice.FadingPosition = inputVoice.Position;
+	inputVoice.FadingGain = inputVoice.Gain;
+	inputVoice.FadeFramesLeft = StealFadeFrames;
+	inputVoice.Id = 0;
+}
+
+void VoiceEngine::MixVoice(Voice& inputVoice, float* outputFrames, UINT32 frameCount)
+{
+	UINT32 channelCount = OutputFormat.ChannelCount;
+
+	//The fading voice ramps down linearly from its gain
+	if (inputVoice.FadeFramesLeft > 0)
+	{
+		const Clip& fadingClip = Clips[inputVoice.FadingClipIndex];
+		UINT32 fadeFrames = std::min({ frameCount, inputVoice.FadeFramesLeft, fadingClip.FrameCount - inputVoice.FadingPosition });
+		const float* fadingSamples = fadingClip.Samples + (size_t)inputVoice.FadingPosition * channelCount;
+		float gainStep = inputVoice.FadingGain / StealFadeFrames;
+		float fadingGain = gainStep * inputVoice.FadeFramesLeft;
+		for (UINT32 frame = 0; frame < fadeFrames; frame++)
+		{
+			fadingGain -= gainStep;
+			for (UINT32 channel = 0; channel < channelCount; channel++)
+			{
+				outputFrames[(size_t)frame * channelCount + channel] += fadingSamples[(size_t)frame * channelCount + channel] * fadingGain;
+			}
+		}
+		inputVoice.FadingPosition += fadeFrames;
+		inputVoice.FadeFramesLeft = fadingClip.FrameCount > inputVoice.FadingPosition ? inputVoice.FadeFramesLeft - fadeFrames : 0;
+	}
+
+	//The voice itself, until its clip ends
+	if (inputVoice.Id != 0)
+	{
+		const Clip& clip = Clips[inputVoice.ClipIndex];
+		UINT32 mixFrames = std::min(frameCount, clip.FrameCount - inputVoice.Position);
+		GainKernels::MixConstant(outputFrames, clip.Samples + (size_t)inputVoice.Position * channelCount, (size_t)mixFrames * channelCount, inputVoice.Gain);
+		inputVoice.Position += mixFrames;
+		if (inputVoice.Position >= clip.FrameCount)
+		{
+			inputVoice.Id = 0;
+		}
+	}
+}
+
+void VoiceEngine::Render(float* outputFrames, UINT32 frameCount)
+{
+	ApplyCommands();
+
+	std::fill_n(outputFrames, (size_t)frameCount * OutputFormat.ChannelCount, 0.0f);
+	UINT32 activeVoices = 0;
+	for (Voice& voice : Voices)
+	{
+		if (voice.Id != 0 || voice.FadeFramesLeft > 0)
+		{
+			MixVoice(voice, outputFrames, frameCount);
+		}
+		if (voice.Id != 0)
+		{
+			activeVoices++;
+		}
+	}
+	Gain.Process(outputFrames, frameCount, OutputFormat.ChannelCount, OutputFormat.SampleRate);
+
+	ActiveVoices = activeVoices;
+	PeriodsRendered++;
+	RecordTriggerLatencies();
+}
+
+void VoiceEngine::RecordTriggerLatencies()
+{
+	if (StartedTriggerTimes.empty())
+	{
+		return;
+	}
+
+	UINT64 now = GetMonotonicTimeNanoseconds();
+	UINT64 maxLatency = MaxTriggerLatency_Nanoseconds.load(std::memory_order_relaxed);
+	UINT64 totalLatency = 0;
+	for (UINT64 triggerTime : StartedTriggerTimes)
+	{
+		UINT64 latency = now - triggerTime;
+		maxLatency = std::max(maxLatency, latency);
+		totalLatency += latency;
+	}
+	MaxTriggerLatency_Nanoseconds.store(maxLatency, std::memory_order_relaxed);
+	TotalTriggerLatency_Nanoseconds += totalLatency;
+	MeasuredTriggerCount += StartedTriggerTimes.size();
+	StartedTriggerTimes.clear();
+}
+
+//Render Thread------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT VoiceEngine::Start()
+{
+	std::lock_guard<std::mutex> lock(RenderMutex);
+	if (RenderThread.joinable())
+	{
+		return S_OK;
+	}
+	RenderRunning = true;
+	RenderThread = std::thread(&VoiceEngine::RenderLoop, this);
+	return S_OK;
+}
+
+HRESULT VoiceEngine::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(RenderMutex);
+		RenderRunning = false;
+	}
+	RenderCondition.notify_all();
+	if (RenderThread.joinable())
+	{
+		RenderThread.join();
+	}
+	return S_OK;
+}
+
+void VoiceEngine::RenderLoop()
+{
+	//Periods are scheduled against the time the rendered audio takes to play back, so the pace doesn't drift
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	UINT64 framesRendered = 0;
+	while (true)
+	{
+		if (Options.PlaybackSpeed > 0)
+		{
+			double elapsedSeconds = (double)framesRendered / OutputFormat.SampleRate / Options.PlaybackSpeed;
+			std::chrono::steady_clock::time_point nextRenderTime = startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(elapsedSeconds));
+			std::unique_lock<std::mutex> lock(RenderMutex);
+			RenderCondition.wait_until(lock, nextRenderTime, [&]() { return !RenderRunning; });
+			if (!RenderRunning)
+			{
+				return;
+			}
+		}
+		else
+		{
+			std::lock_guard<std::mutex> lock(RenderMutex);
+			if (!RenderRunning)
+			{
+				return;
+			}
+		}
+
+		Render(MixBuffer.data(), Options.PeriodFrames);
+		if (FAILED(Sink->Write(MixBuffer.data(), Options.PeriodFrames)))
+		{
+			assert(false);
+			return;
+		}
+		framesRendered += Options.PeriodFrames;
+	}
+}
+
+//Statistics---------------------------------------------------------------------------------------------------------------------------------------------------
+VoiceEngineStatistics VoiceEngine::GetStatistics()
+{
+	VoiceEngineStatistics statistics;
+	statistics.VoicesTriggered = VoicesTriggered;
+	statistics.VoicesStolen = VoicesStolen;
+	statistics.TriggersDropped = TriggersDropped;
+	statistics.PeriodsRendered = PeriodsRendered;
+	statistics.ActiveVoices = ActiveVoices;
+	statistics.MaxTriggerLatency_Nanoseconds = MaxTriggerLatency_Nanoseconds;
+	UINT64 measuredTriggerCount = MeasuredTriggerCount;
+	statistics.AverageTriggerLatency_Nanoseconds = measuredTriggerCount > 0 ? TotalTriggerLatency_Nanoseconds / measuredTriggerCount : 0;
+	return statistics;
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "Platform.h"
+#include "AudioBackend.h"
+#include "GainStage.h"
+#include "HeadlessBackend.h"
+#include "Resampler.h"
+#include "SingleProducerSingleConsumerRing.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	typedef UINT32 ClipId;
+	typedef UINT64 VoiceId;
+
+	struct VoiceEngineOptions
+	{
+		//Format of the output stream, every clip is converted to it when it is loaded
+		UINT32 SampleRate = 48000;
+		UINT32 ChannelCount = 2;
+
+		//Frames mixed per period (128 is 2.7 ms at 48 kHz). A trigger waits at most a period for its voice to start.
+		UINT32 PeriodFrames = 128;
+
+		//Voices playing at once (a trigger beyond steals the oldest voice) and clips that can be loaded
+		UINT32 MaxVoices = 32;
+		UINT32 MaxClips = 256;
+
+		//Where the mix goes, and how fast (1.0 renders in real time, 0 as fast as possible)
+		HeadlessSinkType SinkType = HeadlessSinkType::Null;
+		std::wstring OutputFilePath;
+		double PlaybackSpeed = 1.0;
+
+		//Conversion of clips recorded at another rate (done once, when loading)
+		ResamplerQuality ClipResamplingQuality = ResamplerQuality::High;
+	};
+
+	struct VoiceEngineStatistics
+	{
+		UINT64 VoicesTriggered = 0;
+		UINT64 VoicesStolen = 0;            // Voices cut short (with a short fade) to make room for a trigger.
+		UINT64 TriggersDropped = 0;         // Triggers that found the command ring full.
+		UINT64 PeriodsRendered = 0;
+		UINT32 ActiveVoices = 0;
+		UINT64 MaxTriggerLatency_Nanoseconds = 0;       // Trigger call until the period starting the voice was mixed.
+		UINT64 AverageTriggerLatency_Nanoseconds = 0;
+	};
+
+	/*
+	Engine for short sounds (UI feedback, alerts) that have to start right away. Clips are decoded, converted to the output
+	format and copied into an arena once, when they are loaded. Triggering a clip only queues a command into a lock-free
+	ring, the render thread picks it up at the start of its next period and mixes the voice from the arena: nothing is
+	opened, resolved or allocated between a trigger and the sound.
+	Every clip can be limited to a number of voices, and the engine to MaxVoices in total. A trigger beyond either limit
+	steals the oldest voice concerned, which fades out over a few milliseconds instead of clicking. The mix goes through a
+	gain stage (master volume and mute) into a null or WAV file sink.
+	Clips can be loaded and voices triggered from any thread, also while the engine runs. Clips stay loaded for the
+	lifetime of the engine.
+	*/
+	class VoiceEngine
+	{
+	public:
+		//Frames a stolen or stopped voice takes to fade out
+		static constexpr UINT32 StealFadeFrames = 64;
+
+	private:
+		struct Clip
+		{
+			const float* Samples = nullptr;
+			UINT32 FrameCount = 0;
+			UINT32 MaxPolyphony = 0;    // 0 = only the engine's limit.
+		};
+
+		struct Voice
+		{
+			VoiceId Id = 0;             // 0 = free.
+			ClipId ClipIndex = 0;
+			UINT32 Position = 0;
+			float Gain = 1.0f;
+			UINT64 StartOrder = 0;      // The oldest voice is stolen first.
+
+			//The voice this one replaced, fading out underneath it
+			ClipId FadingClipIndex = 0;
+			UINT32 FadingPosition = 0;
+			float FadingGain = 0.0f;
+			UINT32 FadeFramesLeft = 0;
+		};
+
+		enum class VoiceCommandType
+		{
+			Trigger,
+			Stop,
+			SetGain,
+			StopAll
+		};
+
+		struct VoiceCommand
+		{
+			VoiceCommandType Type = VoiceCommandType::Trigger;
+			VoiceId Voice = 0;
+			ClipId ClipIndex = 0;
+			float Gain = 1.0f;
+			UINT64 TriggerTime_Nanoseconds = 0;
+		};
+
+		VoiceEngineOptions Options;
+		AudioFormat OutputFormat;
+		std::unique_ptr<IAudioSink> Sink;
+
+		//Clips, published by ClipCount (slots below it are never written again). Their samples live in the arena blocks.
+		std::mutex LoadMutex;
+		std::vector<std::unique_ptr<float[]>> ArenaBlocks;
+		size_t ArenaBlockCapacity;
+		size_t ArenaBlockUsed;
+		std::unique_ptr<Clip[]> Clips;
+		std::atomic<UINT32> ClipCount;
+
+		//Commands from any thread (producers take turns through CommandMutex) to the render thread
+		std::mutex CommandMutex;
+		SingleProducerSingleConsumerRing<VoiceCommand> Commands;
+		std::atomic<UINT64> NextVoiceId;
+
+		//Mixing state (only touched by the rendering thread)
+		std::vector<Voice> Voices;
+		UINT64 VoiceStartCount;
+		std::vector<float> MixBuffer;
+		std::vector<UINT64> StartedTriggerTimes;
+
+		//Master volume and mute
+		GainStage Gain;
+
+		//Render thread
+		std::thread RenderThread;
+		std::mutex RenderMutex;
+		std::condition_variable RenderCondition;
+		bool RenderRunning;
+
+		//Statistics
+		std::atomic<UINT64> VoicesTriggered;
+		std::atomic<UINT64> VoicesStolen;
+		std::atomic<UINT64> TriggersDropped;
+		std::atomic<UINT64> PeriodsRendered;
+		std::atomic<UINT32> ActiveVoices;
+		std::atomic<UINT64> MaxTriggerLatency_Nanoseconds;
+		std::atomic<UINT64> TotalTriggerLatency_Nanoseconds;
+		std::atomic<UINT64> MeasuredTriggerCount;
+
+		VoiceEngine(const VoiceEngineOptions& inputOptions);
+
+		HRESULT Initialize();
+		float* AllocateClipSamples(size_t sampleCount);
+		HRESULT SubmitCommand(const VoiceCommand& inputCommand);
+
+		//Rendering thread
+		void RenderLoop();
+		void ApplyCommands();
+		void StartVoice(const VoiceCommand& inputCommand);
+		void FadeOutVoice(Voice& inputVoice);
+		void MixVoice(Voice& inputVoice, float* outputFrames, UINT32 frameCount);
+		void RecordTriggerLatencies();
+
+	public:
+		~VoiceEngine();
+
+		static HRESULT CreateInstance(const VoiceEngineOptions& inputOptions, VoiceEngine** outputEngine);
+
+		//Load a clip (WAV everywhere, anything Media Foundation decodes on Windows) or take one from memory. A clip limited
+		//to maxPolyphony voices (0 = no limit of its own) steals its own oldest voice when triggered once more.
+		HRESULT LoadClip(PCWSTR inputFilePath, ClipId* outputClip, UINT32 maxPolyphony = 0);
+		HRESULT LoadClipFromMemory(const float* inputFrames, UINT32 frameCount, const AudioFormat& inputFormat, ClipId* outputClip, UINT32 maxPolyphony = 0);
+
+		//Start rendering into the sink on the engine's own thread, paced to the output rate
+		HRESULT Start();
+		HRESULT Stop();
+
+		//Mix the next frames into outputFrames (interleaved, overwritten), for hosts that pull the mix into their own audio
+		//callback instead of starting the engine's thread. Never blocks or allocates once the first call sized its buffers.
+		void Render(float* outputFrames, UINT32 frameCount);
+
+		//Voices. The voice starts at the beginning of the next period, outputVoice identifies it to Stop/SetVoiceGain
+		//(which do nothing once it ended or was stolen).
+		HRESULT Trigger(ClipId inputClip, float gain = 1.0f, VoiceId* outputVoice = nullptr);
+		HRESULT StopVoice(VoiceId inputVoice);
+		HRESULT SetVoiceGain(VoiceId inputVoice, float gain);
+		HRESULT StopAllVoices();
+
+		//Master volume (glides like the players' volume) and mute
+		HRESULT SetVolume(float volumeLevel);
+		void SetMute(bool isMuted);
+
+		VoiceEngineStatistics GetStatistics();
+	};
+}
@@ -0,0 +1,282 @@
+#include "WavFileDecoder.h"
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+
+using namespace MMFSoundPlayerLib;
+
+//WAVE format tags
+constexpr UINT32 WaveFormatPCM = 0x0001;
+constexpr UINT32 WaveFormatIEEEFloat = 0x0003;
+constexpr UINT32 WaveFormatExtensible = 0xFFFE;
+
+//Little endian readers (RIFF is always little endian)
+static UINT32 ReadLittleEndian16(const unsigned char* input)
+{
+	return (UINT32)input[0] | ((UINT32)input[1] << 8);
+}
+
+static UINT32 ReadLittleEndian32(const unsigned char* input)
+{
+	return (UINT32)input[0] | ((UINT32)input[1] << 8) | ((UINT32)input[2] << 16) | ((UINT32)input[3] << 24);
+}
+
+//Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
+WavFileDecoder::WavFileDecoder()
+{
+	IsOpen = false;
+	BytesPerFrame = 0;
+	DataOffset = 0;
+	FrameCount = 0;
+	CurrentFrame = 0;
+}
+
+WavFileDecoder::~WavFileDecoder()
+{
+	MappedFile.Close();
+}
+
+HRESULT WavFileDecoder::Open(PCWSTR inputFilePath)
+{
+	//Only open once
+	if (IsOpen)
+	{
+		return E_UNEXPECTED;
+	}
+
+	HRESULT hr = MappedFile.Open(inputFilePath);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Find the format and the sample data. Anything unsupported is an invalid file for this player.
+	hr = ParseHeader();
+	if (FAILED(hr))
+	{
+		MappedFile.Close();
+		return hr;
+	}
+
+	IsOpen = true;
+	return SeekToFrame(0);
+}
+
+HRESULT WavFileDecoder::ParseHeader()
+{
+	//RIFF header
+	const unsigned char* fileData = MappedFile.GetData();
+	UINT64 fileSize = MappedFile.GetSize();
+	const UINT64 riffHeaderSize = 12;
+	if (fileSize < riffHeaderSize)
+	{
+		return E_INVALIDARG;
+	}
+	const unsigned char* riffHeader = fileData;
+	if (memcmp(riffHeader, "RIFF", 4) != 0 || memcmp(riffHeader + 8, "WAVE", 4) != 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	//Walk the chunks until both "fmt " and "data" have been found
+	bool formatFound = false;
+	bool dataFound = false;
+	UINT32 formatTag = 0;
+	UINT64 chunkOffset = riffHeaderSize;
+	const UINT64 chunkHeaderSize = 8;
+	while (!(formatFound && dataFound))
+	{
+		if (chunkOffset + chunkHeaderSize > fileSize)
+		{
+			return E_INVALIDARG;
+		}
+		const unsigned char* chunkHeader = fileData + chunkOffset;
+		UINT32 chunkSize = ReadLittleEndian32(chunkHeader + 4);
+
+		if (memcmp(chunkHeader, "fmt ", 4) == 0)
+		{
+			//The format chunk is at least the 16 bytes of a PCMWAVEFORMAT, extensible adds the sub format GUID at offset 24
+			unsigned char formatChunk[40] = {};
+			if (chunkSize < 16)
+			{
+				return E_INVALIDARG;
+			}
+			size_t bytesToRead = chunkSize < sizeof(formatChunk) ? chunkSize : sizeof(formatChunk);
+			if (chunkOffset + chunkHeaderSize + bytesToRead > fileSize)
+			{
+				return E_INVALIDARG;
+			}
+			memcpy(formatChunk, chunkHeader + chunkHeaderSize, bytesToRead);
+
+			formatTag = ReadLittleEndian16(formatChunk);
+			Format.ChannelCount = ReadLittleEndian16(formatChunk + 2);
+			Format.SampleRate = ReadLittleEndian32(formatChunk + 4);
+			Format.BitsPerSample = ReadLittleEndian16(formatChunk + 14);
+			if (formatTag == WaveFormatExtensible)
+			{
+				if (bytesToRead < 26)
+				{
+					return E_INVALIDARG;
+				}
+				formatTag = ReadLittleEndian16(formatChunk + 24);
+			}
+			formatFound = true;
+		}
+		else if (memcmp(chunkHeader, "data", 4) == 0)
+		{
+			DataOffset = chunkOffset + chunkHeaderSize;
+
+			//Streamed files may leave the size at 0 or 0xFFFFFFFF, so clamp to what is actually in the file
+			UINT64 dataSize = chunkSize;
+			if (dataSize == 0 || dataSize == 0xFFFFFFFF || DataOffset + dataSize > fileSize)
+			{
+				dataSize = fileSize - DataOffset;
+			}
+			FrameCount = dataSize;
+			dataFound = true;
+		}
+
+		//Chunks are word aligned
+		chunkOffset += chunkHeaderSize + (UINT64)chunkSize + (chunkSize & 1);
+	}
+
+	//Validate the format (a single audio stream of a sample type this decoder can convert)
+	bool isInteger = formatTag == WaveFormatPCM && (Format.BitsPerSample == 8 || Format.BitsPerSample == 16 || Format.BitsPerSample == 24 || Format.BitsPerSample == 32);
+	bool isFloat = formatTag == WaveFormatIEEEFloat && (Format.BitsPerSample == 32 || Format.BitsPerSample == 64);
+	if (!(isInteger || isFloat) || Format.ChannelCount == 0 || Format.SampleRate == 0)
+	{
+		return E_INVALIDARG;
+	}
+	Format.IsFloatingPoint = isFloat;
+
+	//Convert the data size to frames
+	BytesPerFrame = Format.ChannelCount * (Format.BitsPerSample / 8);
+	FrameCount = FrameCount / BytesPerFrame;
+	return S_OK;
+}
+
+//IAudioDecoder Implementation---------------------------------------------------------------------------------------------------------------------------------
+AudioFormat WavFileDecoder::GetFormat()
+{
+	return Format;
+}
+
+UINT64 WavFileDecoder::GetFrameCount()
+{
+	return FrameCount;
+}
+
+UINT64 WavFileDecoder::GetDuration_100NanoSecondUnits()
+{
+	if (Format.SampleRate == 0)
+	{
+		return 0;
+	}
+	return FrameCount * OneSecond_100NanoSecondUnits / Format.SampleRate;
+}
+
+HRESULT WavFileDecoder::SeekToFrame(UINT64 frameIndex)
+{
+	if (!IsOpen)
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Seeking past the end just puts the decoder at the end of the file
+	if (frameIndex > FrameCount)
+	{
+		frameIndex = FrameCount;
+	}
+	CurrentFrame = frameIndex;
+	return S_OK;
+}
+
+HRESULT WavFileDecoder::ReadFrames(float* outputFrames, UINT32 frameCapacity, UINT32* framesRead)
+{
+	if (outputFrames == nullptr || framesRead == nullptr)
+	{
+		return E_POINTER;
+	}
+	*framesRead = 0;
+	if (!IsOpen)
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Never read past the data chunk
+	UINT64 framesRemaining = FrameCount - CurrentFrame;
+	UINT32 framesToRead = framesRemaining < frameCapacity ? (UINT32)framesRemaining : frameCapacity;
+	if (framesToRead == 0)
+	{
+		return S_OK;
+	}
+
+	//Convert every sample to float in [-1, 1], straight from the mapping (unless the file was cut short meanwhile)
+	UINT64 readOffset = DataOffset + CurrentFrame * BytesPerFrame;
+	HRESULT hr = MappedFile.CheckReadable(readOffset, (UINT64)framesToRead * BytesPerFrame);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	MappedFile.AdviseSequentialRead(readOffset);
+	size_t sampleCount = (size_t)framesToRead * Format.ChannelCount;
+	const unsigned char* input = MappedFile.GetData() + readOffset;
+	switch (Format.BitsPerSample)
+	{
+	case 8:
+		for (size_t sample = 0; sample < sampleCount; sample++)
+		{
+			outputFrames[sample] = ((int)input[sample] - 128) * (1.0f / 128.0f);
+		}
+		break;
+
+	case 16:
+		for (size_t sample = 0; sample < sampleCount; sample++)
+		{
+			int16_t value = (int16_t)ReadLittleEndian16(input + sample * 2);
+			outputFrames[sample] = value * (1.0f / 32768.0f);
+		}
+		break;
+
+	case 24:
+		for (size_t sample = 0; sample < sampleCount; sample++)
+		{
+			const unsigned char* bytes = input + sample * 3;
+			int32_t value = (int32_t)(((UINT32)bytes[0] << 8) | ((UINT32)bytes[1] << 16) | ((UINT32)bytes[2] << 24)) >> 8;
+			outputFrames[sample] = value * (1.0f / 8388608.0f);
+		}
+		break;
+
+	case 32:
+		if (Format.IsFloatingPoint)
+		{
+			memcpy(outputFrames, input, sampleCount * sizeof(float));
+		}
+		else
+		{
+			for (size_t sample = 0; sample < sampleCount; sample++)
+			{
+				int32_t value = (int32_t)ReadLittleEndian32(input + sample * 4);
+				outputFrames[sample] = (float)(value * (1.0 / 2147483648.0));
+			}
+		}
+		break;
+
+	case 64:
+		for (size_t sample = 0; sample < sampleCount; sample++)
+		{
+			double value;
+			memcpy(&value, input + sample * 8, sizeof(double));
+			outputFrames[sample] = (float)value;
+		}
+		break;
+
+	default:
+		assert(false);
+		return E_UNEXPECTED;
+	}
+
+	CurrentFrame += framesToRead;
+	*framesRead = framesToRead;
+	return S_OK;
+}
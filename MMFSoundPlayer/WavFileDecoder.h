@@ -0,0 +1,42 @@
+#pragma once
+
+#include "AudioBackend.h"
+#include "MemoryMappedFile.h"
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Decoder for RIFF/WAVE files holding integer PCM (8/16/24/32 bit) or IEEE float (32/64 bit) samples. The file is mapped
+	into memory and samples are converted straight out of the page cache (no read buffer, no copy before the conversion),
+	with the mapping prefetching ahead of the read position and releasing what it left behind.
+	*/
+	class WavFileDecoder : public IAudioDecoder
+	{
+	private:
+		MemoryMappedFile MappedFile;
+		bool IsOpen;
+		AudioFormat Format;
+		UINT32 BytesPerFrame;
+
+		//Location of the sample data inside of the file
+		UINT64 DataOffset;
+		UINT64 FrameCount;
+		UINT64 CurrentFrame;
+
+		HRESULT ParseHeader();
+
+	public:
+		WavFileDecoder();
+		~WavFileDecoder();
+
+		//Open the file and validate that it holds a single supported PCM stream
+		HRESULT Open(PCWSTR inputFilePath);
+
+		//IAudioDecoder methods
+		AudioFormat GetFormat() override;
+		UINT64 GetFrameCount() override;
+		UINT64 GetDuration_100NanoSecondUnits() override;
+		HRESULT ReadFrames(float* outputFrames, UINT32 frameCapacity, UINT32* framesRead) override;
+		HRESULT SeekToFrame(UINT64 frameIndex) override;
+	};
+}
@@ -0,0 +1,663 @@
+#include "WaveformOverview.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define WAVEFORM_KERNELS_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define WAVEFORM_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+//GCC and Clang only emit AVX2 instructions in functions marked for it, MSVC emits them anywhere
+#if defined(WAVEFORM_KERNELS_X86) && !defined(_MSC_VER)
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define AVX2_FUNCTION
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+static const float LargestSample = std::numeric_limits<float>::max();
+
+//Parts of a peak file start on this boundary
+static const UINT64 PeakFileAlignment = 8;
+
+static UINT64 AlignPeakFileOffset(UINT64 offset)
+{
+	return (offset + PeakFileAlignment - 1) / PeakFileAlignment * PeakFileAlignment;
+}
+
+static INT16 QuantizeSample(float sample)
+{
+	float clampedSample = sample < -1.0f ? -1.0f : (sample > 1.0f ? 1.0f : sample);
+	return (INT16)std::lrintf(clampedSample * 32767.0f);
+}
+
+//Kernels------------------------------------------------------------------------------------------------------------------------------------------------------
+static void MinMaxAndSumOfSquaresScalar(const float* frames, size_t frameCount, UINT32 channelCount, float* minimums, float* maximums, float* sumsOfSquares)
+{
+	for (UINT32 channel = 0; channel < channelCount; channel++)
+	{
+		float smallest = LargestSample;
+		float largest = -LargestSample;
+		float sum = 0.0f;
+		const float* samples = frames + channel;
+		for (size_t frame = 0; frame < frameCount; frame++)
+		{
+			float sample = samples[frame * channelCount];
+			smallest = sample < smallest ? sample : smallest;
+			largest = sample > largest ? sample : largest;
+			sum += sample * sample;
+		}
+		minimums[channel] = smallest;
+		maximums[channel] = largest;
+		sumsOfSquares[channel] = sum;
+	}
+}
+
+//The vector kernels keep 8 lanes per statistic, with 1, 2, 4 or 8 channels lane l always holds channel l % channelCount.
+//This folds the lanes into the per channel results the tail already went into.
+static void FoldLanes(const float* laneMinimums, const float* laneMaximums, const float* laneSums, UINT32 channelCount, float* minimums, float* maximums, float* sumsOfSquares)
+{
+	for (UINT32 lane = 0; lane < 8; lane++)
+	{
+		UINT32 channel = lane % channelCount;
+		minimums[channel] = laneMinimums[lane] < minimums[channel] ? laneMinimums[lane] : minimums[channel];
+		maximums[channel] = laneMaximums[lane] > maximums[channel] ? laneMaximums[lane] : maximums[channel];
+		sumsOfSquares[channel] += laneSums[lane];
+	}
+}
+
+#ifdef WAVEFORM_KERNELS_X86
+static void MinMaxAndSumOfSquaresSse2(const float* frames, size_t frameCount, UINT32 channelCount, float* minimums, float* maximums, float* sumsOfSquares)
+{
+	__m128 smallest0 = _mm_set1_ps(LargestSample);
+	__m128 smallest1 = smallest0;
+	__m128 largest0 = _mm_set1_ps(-LargestSample);
+	__m128 largest1 = largest0;
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	size_t sampleCount = frameCount * channelCount;
+	size_t sample = 0;
+	for (; sample + 8 <= sampleCount; sample += 8)
+	{
+		__m128 values0 = _mm_loadu_ps(frames + sample);
+		__m128 values1 = _mm_loadu_ps(frames + sample + 4);
+		smallest0 = _mm_min_ps(smallest0, values0);
+		smallest1 = _mm_min_ps(smallest1, values1);
+		largest0 = _mm_max_ps(largest0, values0);
+		largest1 = _mm_max_ps(largest1, values1);
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(values0, values0));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(values1, values1));
+	}
+
+	float laneMinimums[8];
+	float laneMaximums[8];
+	float laneSums[8];
+	_mm_storeu_ps(laneMinimums, smallest0);
+	_mm_storeu_ps(laneMinimums + 4, smallest1);
+	_mm_storeu_ps(laneMaximums, largest0);
+	_mm_storeu_ps(laneMaximums + 4, largest1);
+	_mm_storeu_ps(laneSums, sum0);
+	_mm_storeu_ps(laneSums + 4, sum1);
+
+	//8 samples are always whole frames, the frames left over go through the scalar kernel
+	MinMaxAndSumOfSquaresScalar(frames + sample, (sampleCount - sample) / channelCount, channelCount, minimums, maximums, sumsOfSquares);
+	FoldLanes(laneMinimums, laneMaximums, laneSums, channelCount, minimums, maximums, sumsOfSquares);
+}
+
+AVX2_FUNCTION static void MinMaxAndSumOfSquaresAvx2(const float* frames, size_t frameCount, UINT32 channelCount, float* minimums, float* maximums, float* sumsOfSquares)
+{
+	__m256 smallest0 = _mm256_set1_ps(LargestSample);
+	__m256 smallest1 = smallest0;
+	__m256 largest0 = _mm256_set1_ps(-LargestSample);
+	__m256 largest1 = largest0;
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	size_t sampleCount = frameCount * channelCount;
+	size_t sample = 0;
+	for (; sample + 16 <= sampleCount; sample += 16)
+	{
+		__m256 values0 = _mm256_loadu_ps(frames + sample);
+		__m256 values1 = _mm256_loadu_ps(frames + sample + 8);
+		smallest0 = _mm256_min_ps(smallest0, values0);
+		smallest1 = _mm256_min_ps(smallest1, values1);
+		largest0 = _mm256_max_ps(largest0, values0);
+		largest1 = _mm256_max_ps(largest1, values1);
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(values0, values0));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(values1, values1));
+	}
+
+	//Both registers hold the same channels lane for lane
+	float laneMinimums[8];
+	float laneMaximums[8];
+	float laneSums[8];
+	_mm256_storeu_ps(laneMinimums, _mm256_min_ps(smallest0, smallest1));
+	_mm256_storeu_ps(laneMaximums, _mm256_max_ps(largest0, largest1));
+	_mm256_storeu_ps(laneSums, _mm256_add_ps(sum0, sum1));
+
+	MinMaxAndSumOfSquaresSse2(frames + sample, (sampleCount - sample) / channelCount, channelCount, minimums, maximums, sumsOfSquares);
+	FoldLanes(laneMinimums, laneMaximums, laneSums, channelCount, minimums, maximums, sumsOfSquares);
+}
+#endif
+
+#ifdef WAVEFORM_KERNELS_NEON
+static void MinMaxAndSumOfSquaresNeon(const float* frames, size_t frameCount, UINT32 channelCount, float* minimums, float* maximums, float* sumsOfSquares)
+{
+	float32x4_t smallest0 = vdupq_n_f32(LargestSample);
+	float32x4_t smallest1 = smallest0;
+	float32x4_t largest0 = vdupq_n_f32(-LargestSample);
+	float32x4_t largest1 = largest0;
+	float32x4_t sum0 = vdupq_n_f32(0.0f);
+	float32x4_t sum1 = vdupq_n_f32(0.0f);
+	size_t sampleCount = frameCount * channelCount;
+	size_t sample = 0;
+	for (; sample + 8 <= sampleCount; sample += 8)
+	{
+		float32x4_t values0 = vld1q_f32(frames + sample);
+		float32x4_t values1 = vld1q_f32(frames + sample + 4);
+		smallest0 = vminq_f32(smallest0, values0);
+		smallest1 = vminq_f32(smallest1, values1);
+		largest0 = vmaxq_f32(largest0, values0);
+		largest1 = vmaxq_f32(largest1, values1);
+		sum0 = vaddq_f32(sum0, vmulq_f32(values0, values0));
+		sum1 = vaddq_f32(sum1, vmulq_f32(values1, values1));
+	}
+
+	float laneMinimums[8];
+	float laneMaximums[8];
+	float laneSums[8];
+	vst1q_f32(laneMinimums, smallest0);
+	vst1q_f32(laneMinimums + 4, smallest1);
+	vst1q_f32(laneMaximums, largest0);
+	vst1q_f32(laneMaximums + 4, largest1);
+	vst1q_f32(laneSums, sum0);
+	vst1q_f32(laneSums + 4, sum1);
+
+	MinMaxAndSumOfSquaresScalar(frames + sample, (sampleCount - sample) / channelCount, channelCount, minimums, maximums, sumsOfSquares);
+	FoldLanes(laneMinimums, laneMaximums, laneSums, channelCount, minimums, maximums, sumsOfSquares);
+}
+#endif
+
+void WaveformKernels::MinMaxAndSumOfSquares(const float* frames, size_t frameCount, UINT32 channelCount, float* minimums, float* maximums, float* sumsOfSquares, GainKernels::InstructionSet instructionSet)
+{
+	if (channelCount == 0 || 8 % channelCount != 0)
+	{
+		MinMaxAndSumOfSquaresScalar(frames, frameCount, channelCount, minimums, maximums, sumsOfSquares);
+		return;
+	}
+
+	switch (instructionSet)
+	{
+#ifdef WAVEFORM_KERNELS_X86
+	case GainKernels::InstructionSet::Avx2:
+		MinMaxAndSumOfSquaresAvx2(frames, frameCount, channelCount, minimums, maximums, sumsOfSquares);
+		return;
+	case GainKernels::InstructionSet::Sse2:
+		MinMaxAndSumOfSquaresSse2(frames, frameCount, channelCount, minimums, maximums, sumsOfSquares);
+		return;
+#endif
+#ifdef WAVEFORM_KERNELS_NEON
+	case GainKernels::InstructionSet::Neon:
+		MinMaxAndSumOfSquaresNeon(frames, frameCount, channelCount, minimums, maximums, sumsOfSquares);
+		return;
+#endif
+	default:
+		MinMaxAndSumOfSquaresScalar(frames, frameCount, channelCount, minimums, maximums, sumsOfSquares);
+		return;
+	}
+}
+
+//Summarizer---------------------------------------------------------------------------------------------------------------------------------------------------
+WaveformSummarizer::WaveformSummarizer()
+{
+	ChannelCount = 0;
+	FramesPerBin = 0;
+	InstructionSet = GainKernels::InstructionSet::Scalar;
+	FrameCount = 0;
+}
+
+HRESULT WaveformSummarizer::Initialize(UINT32 channelCount, UINT32 framesPerBin, GainKernels::InstructionSet instructionSet)
+{
+	if (channelCount == 0 || framesPerBin < MinFramesPerBin || framesPerBin > MaxFramesPerBin)
+	{
+		return E_INVALIDARG;
+	}
+
+	ChannelCount = channelCount;
+	FramesPerBin = framesPerBin;
+	InstructionSet = instructionSet;
+	FrameCount = 0;
+	Bins.clear();
+	try
+	{
+		ChannelSamples.resize(8 % channelCount != 0 ? framesPerBin : 0);
+	}
+	catch (...)
+	{
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+HRESULT WaveformSummarizer::Reserve(UINT64 frameCount)
+{
+	try
+	{
+		Bins.reserve((size_t)((frameCount + FramesPerBin - 1) / FramesPerBin) * ChannelCount);
+	}
+	catch (...)
+	{
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+void WaveformSummarizer::AddFrames(const float* frames, UINT32 frameCount)
+{
+	while (frameCount > 0)
+	{
+		//Start a bin whenever the last one is full
+		UINT32 binPosition = (UINT32)(FrameCount % FramesPerBin);
+		if (binPosition == 0)
+		{
+			Bins.resize(Bins.size() + ChannelCount, Bin{ LargestSample, -LargestSample, 0.0 });
+		}
+
+		UINT32 segmentFrames = std::min(frameCount, FramesPerBin - binPosition);
+		AddToLastBin(frames, segmentFrames);
+		frames += (size_t)segmentFrames * ChannelCount;
+		frameCount -= segmentFrames;
+		FrameCount += segmentFrames;
+	}
+}
+
+void WaveformSummarizer::AddToLastBin(const float* frames, UINT32 frameCount)
+{
+	Bin* bins = Bins.data() + Bins.size() - ChannelCount;
+	if (8 % ChannelCount == 0)
+	{
+		float minimums[8];
+		float maximums[8];
+		float sumsOfSquares[8];
+		WaveformKernels::MinMaxAndSumOfSquares(frames, frameCount, ChannelCount, minimums, maximums, sumsOfSquares, InstructionSet);
+		for (UINT32 channel = 0; channel < ChannelCount; channel++)
+		{
+			bins[channel].Minimum = std::min(bins[channel].Minimum, minimums[channel]);
+			bins[channel].Maximum = std::max(bins[channel].Maximum, maximums[channel]);
+			bins[channel].SumOfSquares += sumsOfSquares[channel];
+		}
+		return;
+	}
+
+	//Other channel counts (3, 5.1...) are deinterleaved a channel at a time
+	for (UINT32 channel = 0; channel < ChannelCount; channel++)
+	{
+		const float* source = frames + channel;
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			ChannelSamples[frame] = source[(size_t)frame * ChannelCount];
+		}
+
+		float minimum;
+		float maximum;
+		float sumOfSquares;
+		WaveformKernels::MinMaxAndSumOfSquares(ChannelSamples.data(), frameCount, 1, &minimum, &maximum, &sumOfSquares, InstructionSet);
+		bins[channel].Minimum = std::min(bins[channel].Minimum, minimum);
+		bins[channel].Maximum = std::max(bins[channel].Maximum, maximum);
+		bins[channel].SumOfSquares += sumOfSquares;
+	}
+}
+
+UINT32 WaveformSummarizer::GetChannelCount() const
+{
+	return ChannelCount;
+}
+
+UINT32 WaveformSummarizer::GetFramesPerBin() const
+{
+	return FramesPerBin;
+}
+
+UINT64 WaveformSummarizer::GetFrameCount() const
+{
+	return FrameCount;
+}
+
+const std::vector<WaveformSummarizer::Bin>& WaveformSummarizer::GetBins() const
+{
+	return Bins;
+}
+
+//Constructor/Creation-----------------------------------------------------------------------------------------------------------------------------------------
+WaveformOverview::WaveformOverview()
+{
+	Data = nullptr;
+	Size = 0;
+	memset(&Header, 0, sizeof(Header));
+}
+
+HRESULT WaveformOverview::Create(PCWSTR mediaFilePath, UINT64 fileSize, INT64 modifiedTime, UINT32 sampleRate, const std::vector<const WaveformSummarizer*>& chunks, std::shared_ptr<WaveformOverview>* outputOverview)
+{
+	//Ensure that the pointers actually point somewhere
+	if (mediaFilePath == nullptr || outputOverview == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (chunks.empty() || sampleRate == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	//The chunks have to line up: one format, and bins that only the very last chunk leaves partly filled
+	UINT32 channelCount = chunks[0]->GetChannelCount();
+	UINT32 framesPerBin = chunks[0]->GetFramesPerBin();
+	UINT64 frameCount = 0;
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+	{
+		if (chunks[chunk]->GetChannelCount() != channelCount || chunks[chunk]->GetFramesPerBin() != framesPerBin || channelCount == 0 ||
+			(chunk + 1 < chunks.size() && chunks[chunk]->GetFrameCount() % framesPerBin != 0))
+		{
+			return E_INVALIDARG;
+		}
+		frameCount += chunks[chunk]->GetFrameCount();
+	}
+
+	//Lay the file out: every level has a LevelFactor'th of the bins of the one below, up to a single bin
+	std::string narrowPath = ConvertWidePathToNarrow(mediaFilePath);
+	std::vector<PeakFileLevel> levels;
+	UINT64 binCount = (frameCount + framesPerBin - 1) / framesPerBin;
+	while (binCount > 0)
+	{
+		levels.push_back(PeakFileLevel{ binCount, 0 });
+		binCount = binCount > 1 ? (binCount + LevelFactor - 1) / LevelFactor : 0;
+	}
+	UINT64 imageSize = AlignPeakFileOffset(sizeof(PeakFileHeader) + levels.size() * sizeof(PeakFileLevel) + narrowPath.size());
+	for (PeakFileLevel& level : levels)
+	{
+		level.Offset = imageSize;
+		imageSize = AlignPeakFileOffset(imageSize + level.BinCount * channelCount * sizeof(WaveformBin));
+	}
+
+	std::shared_ptr<WaveformOverview> newOverview(new (std::nothrow) WaveformOverview());
+	if (newOverview == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	std::vector<WaveformSummarizer::Bin> levelBins;
+	try
+	{
+		newOverview->Image.resize((size_t)imageSize);
+		levelBins.reserve(levels.empty() ? 0 : (size_t)levels[0].BinCount * channelCount);
+	}
+	catch (...)
+	{
+		return E_OUTOFMEMORY;
+	}
+	unsigned char* image = newOverview->Image.data();
+
+	PeakFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Magic = PeakFileMagic;
+	header.Version = PeakFileVersion;
+	header.FileSize = fileSize;
+	header.ModifiedTime = modifiedTime;
+	header.FrameCount = frameCount;
+	header.SampleRate = sampleRate;
+	header.ChannelCount = channelCount;
+	header.FramesPerBin = framesPerBin;
+	header.LevelFactor = LevelFactor;
+	header.LevelCount = (UINT32)levels.size();
+	header.PathLength = (UINT32)narrowPath.size();
+	memcpy(image, &header, sizeof(header));
+	memcpy(image + sizeof(header), levels.data(), levels.size() * sizeof(PeakFileLevel));
+	memcpy(image + sizeof(header) + levels.size() * sizeof(PeakFileLevel), narrowPath.data(), narrowPath.size());
+
+	//Level 0 is the chunks one after the other, every level above is summed up from the one below (in place, front to back)
+	for (const WaveformSummarizer* chunk : chunks)
+	{
+		levelBins.insert(levelBins.end(), chunk->GetBins().begin(), chunk->GetBins().end());
+	}
+	UINT64 levelFramesPerBin = framesPerBin;
+	for (size_t levelIndex = 0; levelIndex < levels.size(); levelIndex++)
+	{
+		const PeakFileLevel& level = levels[levelIndex];
+		if (levelIndex > 0)
+		{
+			for (UINT64 bin = 0; bin < level.BinCount; bin++)
+			{
+				UINT64 firstSource = bin * LevelFactor;
+				UINT64 sourceEnd = std::min(firstSource + LevelFactor, levels[levelIndex - 1].BinCount);
+				for (UINT32 channel = 0; channel < channelCount; channel++)
+				{
+					WaveformSummarizer::Bin combined = levelBins[(size_t)(firstSource * channelCount + channel)];
+					for (UINT64 source = firstSource + 1; source < sourceEnd; source++)
+					{
+						const WaveformSummarizer::Bin& sourceBin = levelBins[(size_t)(source * channelCount + channel)];
+						combined.Minimum = std::min(combined.Minimum, sourceBin.Minimum);
+						combined.Maximum = std::max(combined.Maximum, sourceBin.Maximum);
+						combined.SumOfSquares += sourceBin.SumOfSquares;
+					}
+					levelBins[(size_t)(bin * channelCount + channel)] = combined;
+				}
+			}
+		}
+
+		//Quantize, the RMS over the frames the bin actually holds (the last one may hold fewer)
+		WaveformBin* outputBins = (WaveformBin*)(image + level.Offset);
+		for (UINT64 bin = 0; bin < level.BinCount; bin++)
+		{
+			UINT64 binFrames = std::min(levelFramesPerBin, frameCount - bin * levelFramesPerBin);
+			for (UINT32 channel = 0; channel < channelCount; channel++)
+			{
+				const WaveformSummarizer::Bin& inputBin = levelBins[(size_t)(bin * channelCount + channel)];
+				WaveformBin& outputBin = outputBins[bin * channelCount + channel];
+				outputBin.Minimum = QuantizeSample(inputBin.Minimum);
+				outputBin.Maximum = QuantizeSample(inputBin.Maximum);
+				outputBin.Rms = QuantizeSample((float)std::sqrt(inputBin.SumOfSquares / binFrames));
+			}
+		}
+		levelFramesPerBin *= LevelFactor;
+	}
+
+	newOverview->Data = image;
+	newOverview->Size = imageSize;
+	HRESULT hr = newOverview->ParseImage();
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	*outputOverview = std::move(newOverview);
+	return S_OK;
+}
+
+HRESULT WaveformOverview::OpenPeakFile(PCWSTR peakFilePath, std::shared_ptr<WaveformOverview>* outputOverview)
+{
+	//Ensure that the pointers actually point somewhere
+	if (peakFilePath == nullptr || outputOverview == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	std::shared_ptr<WaveformOverview> newOverview(new (std::nothrow) WaveformOverview());
+	if (newOverview == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+	HRESULT hr = newOverview->MappedFile.Open(peakFilePath);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	newOverview->Data = newOverview->MappedFile.GetData();
+	newOverview->Size = newOverview->MappedFile.GetSize();
+	hr = newOverview->ParseImage();
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	*outputOverview = std::move(newOverview);
+	return S_OK;
+}
+
+HRESULT WaveformOverview::ParseImage()
+{
+	if (Size < sizeof(Header))
+	{
+		return E_INVALIDARG;
+	}
+	memcpy(&Header, Data, sizeof(Header));
+	if (Header.Magic != PeakFileMagic || Header.Version != PeakFileVersion || Header.LevelFactor != LevelFactor || Header.LevelCount > MaxLevelCount ||
+		Header.SampleRate == 0 || Header.ChannelCount == 0 || Header.FramesPerBin < WaveformSummarizer::MinFramesPerBin ||
+		Header.FramesPerBin > WaveformSummarizer::MaxFramesPerBin || (Size - sizeof(Header)) / sizeof(PeakFileLevel) < Header.LevelCount ||
+		Size - sizeof(Header) - Header.LevelCount * sizeof(PeakFileLevel) < Header.PathLength)
+	{
+		return E_INVALIDARG;
+	}
+	Levels.resize(Header.LevelCount);
+	memcpy(Levels.data(), Data + sizeof(Header), Header.LevelCount * sizeof(PeakFileLevel));
+
+	//Every level must have exactly the bins its frame count calls for, and they must all be inside of the file
+	UINT64 expectedBinCount = (Header.FrameCount + Header.FramesPerBin - 1) / Header.FramesPerBin;
+	UINT64 binBytes = (UINT64)Header.ChannelCount * sizeof(WaveformBin);
+	for (const PeakFileLevel& level : Levels)
+	{
+		if (level.BinCount != expectedBinCount || level.Offset % PeakFileAlignment != 0 || level.Offset > Size || (Size - level.Offset) / binBytes < level.BinCount)
+		{
+			return E_INVALIDARG;
+		}
+		expectedBinCount = expectedBinCount > 1 ? (expectedBinCount + LevelFactor - 1) / LevelFactor : 0;
+	}
+	if (expectedBinCount != 0)
+	{
+		return E_INVALIDARG;
+	}
+	return S_OK;
+}
+
+//Getters------------------------------------------------------------------------------------------------------------------------------------------------------
+const unsigned char* WaveformOverview::GetPeakFileData() const
+{
+	return Data;
+}
+
+UINT64 WaveformOverview::GetPeakFileSize() const
+{
+	return Size;
+}
+
+std::string WaveformOverview::GetMediaFilePath() const
+{
+	return std::string((const char*)Data + sizeof(Header) + Levels.size() * sizeof(PeakFileLevel), Header.PathLength);
+}
+
+UINT64 WaveformOverview::GetFileSize() const
+{
+	return Header.FileSize;
+}
+
+INT64 WaveformOverview::GetModifiedTime() const
+{
+	return Header.ModifiedTime;
+}
+
+UINT32 WaveformOverview::GetSampleRate() const
+{
+	return Header.SampleRate;
+}
+
+UINT32 WaveformOverview::GetChannelCount() const
+{
+	return Header.ChannelCount;
+}
+
+UINT64 WaveformOverview::GetFrameCount() const
+{
+	return Header.FrameCount;
+}
+
+UINT64 WaveformOverview::GetDuration_100NanoSecondUnits() const
+{
+	return Header.FrameCount / Header.SampleRate * OneSecond_100NanoSecondUnits + Header.FrameCount % Header.SampleRate * OneSecond_100NanoSecondUnits / Header.SampleRate;
+}
+
+UINT32 WaveformOverview::GetLevelCount() const
+{
+	return (UINT32)Levels.size();
+}
+
+UINT64 WaveformOverview::GetFramesPerBin(UINT32 level) const
+{
+	UINT64 framesPerBin = Header.FramesPerBin;
+	for (UINT32 coarserLevel = 0; coarserLevel < level; coarserLevel++)
+	{
+		framesPerBin *= LevelFactor;
+	}
+	return framesPerBin;
+}
+
+UINT64 WaveformOverview::GetBinCount(UINT32 level) const
+{
+	return level < Levels.size() ? Levels[level].BinCount : 0;
+}
+
+const WaveformBin* WaveformOverview::GetBins(UINT32 level) const
+{
+	return level < Levels.size() ? (const WaveformBin*)(Data + Levels[level].Offset) : nullptr;
+}
+
+//Drawing------------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT WaveformOverview::GetColumns(UINT32 channel, UINT64 startFrame, double framesPerColumn, UINT32 columnCount, WaveformColumn* outputColumns) const
+{
+	if (outputColumns == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (channel >= Header.ChannelCount || !(framesPerColumn > 0.0))
+	{
+		return E_INVALIDARG;
+	}
+
+	//The coarsest level whose bins still fit into a column (one bin too many per column at most)
+	UINT32 level = 0;
+	while (level + 1 < Levels.size() && (double)GetFramesPerBin(level + 1) <= framesPerColumn)
+	{
+		level++;
+	}
+
+	const WaveformBin* bins = GetBins(level);
+	UINT64 binCount = GetBinCount(level);
+	double binsPerColumn = framesPerColumn / GetFramesPerBin(level);
+	double firstBin = (double)startFrame / GetFramesPerBin(level);
+	for (UINT32 column = 0; column < columnCount; column++)
+	{
+		WaveformColumn& outputColumn = outputColumns[column];
+		outputColumn = WaveformColumn();
+		double columnStart = firstBin + column * binsPerColumn;
+		if (bins == nullptr || columnStart >= (double)binCount)
+		{
+			continue;
+		}
+
+		UINT64 binStart = (UINT64)columnStart;
+		UINT64 binEnd = std::min(std::max((UINT64)std::ceil(columnStart + binsPerColumn), binStart + 1), binCount);
+		INT16 minimum = bins[binStart * Header.ChannelCount + channel].Minimum;
+		INT16 maximum = bins[binStart * Header.ChannelCount + channel].Maximum;
+		double sumOfSquares = 0.0;
+		for (UINT64 bin = binStart; bin < binEnd; bin++)
+		{
+			const WaveformBin& inputBin = bins[bin * Header.ChannelCount + channel];
+			minimum = std::min(minimum, inputBin.Minimum);
+			maximum = std::max(maximum, inputBin.Maximum);
+			sumOfSquares += (double)inputBin.Rms * inputBin.Rms;
+		}
+		outputColumn.Minimum = minimum * (1.0f / 32767.0f);
+		outputColumn.Maximum = maximum * (1.0f / 32767.0f);
+		outputColumn.Rms = (float)(std::sqrt(sumOfSquares / (binEnd - binStart)) * (1.0 / 32767.0));
+	}
+	return S_OK;
+}
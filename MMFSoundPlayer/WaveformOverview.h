@@ -0,0 +1,179 @@
+#pragma once
+
+#include "Platform.h"
+#include "GainStage.h"
+#include "MemoryMappedFile.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	//Summary of the frames of one bin of one channel as stored in a peak file (32767 is full scale)
+	struct WaveformBin
+	{
+		INT16 Minimum;
+		INT16 Maximum;
+		INT16 Rms;
+	};
+
+	//What a waveform display draws for one column of one channel, linear (1.0 is full scale)
+	struct WaveformColumn
+	{
+		float Minimum = 0.0f;
+		float Maximum = 0.0f;
+		float Rms = 0.0f;
+	};
+
+	/*
+	Summarizes decoded audio into the finest level of a waveform overview: per bin of FramesPerBin frames (the last one
+	may hold fewer) and channel, the smallest and largest sample and the sum of the squares. The reductions run through
+	AVX2/SSE2/NEON kernels (with a scalar fallback), straight on the interleaved frames for 1, 2, 4 and 8 channels and per
+	channel for any other count. Generation runs one per chunk of a file, the chunks are joined by WaveformOverview::Create.
+	*/
+	class WaveformSummarizer
+	{
+	public:
+		static constexpr UINT32 MinFramesPerBin = 16;
+		static constexpr UINT32 MaxFramesPerBin = 65536;
+
+		//One bin of one channel
+		struct Bin
+		{
+			float Minimum;
+			float Maximum;
+			double SumOfSquares;
+		};
+
+	private:
+		UINT32 ChannelCount;
+		UINT32 FramesPerBin;
+		GainKernels::InstructionSet InstructionSet;
+		UINT64 FrameCount;
+
+		//Bin by bin, the channels side by side
+		std::vector<Bin> Bins;
+
+		//One channel of a bin, for channel counts the kernels can't reduce interleaved
+		std::vector<float> ChannelSamples;
+
+		void AddToLastBin(const float* frames, UINT32 frameCount);
+
+	public:
+		WaveformSummarizer();
+
+		HRESULT Initialize(UINT32 channelCount, UINT32 framesPerBin, GainKernels::InstructionSet instructionSet = GainKernels::GetBestInstructionSet());
+
+		//Expected frame count, so the bins aren't reallocated while frames are added
+		HRESULT Reserve(UINT64 frameCount);
+
+		void AddFrames(const float* frames, UINT32 frameCount);
+
+		UINT32 GetChannelCount() const;
+		UINT32 GetFramesPerBin() const;
+		UINT64 GetFrameCount() const;
+		const std::vector<Bin>& GetBins() const;
+	};
+
+	/*
+	Multi-resolution min/max/RMS summary of the waveform of a file, what scrollable overviews are drawn from without
+	decoding anything: level 0 summarizes every FramesPerBin frames, every level above LevelFactor bins of the one below,
+	up to a level with a single bin. Bins are quantized to 16 bits, so with the default of 256 frames per bin stereo audio at
+	48 kHz takes about 11 MB per hour of audio. An overview views a peak file image, either mapped from a peak file or held
+	in memory right after generation, and never changes: it can be shared between threads.
+
+	Peak file layout (native little endian, every part 8 byte aligned so the bins are read in place): header, the table of
+	levels (bin count and offset of each), the UTF-8 path of the media file, then the bins of every level, bin by bin with
+	the channels side by side.
+	*/
+	class WaveformOverview
+	{
+	public:
+		static constexpr UINT32 PeakFileMagic = 0x57464D4D; // "MMFW"
+		static constexpr UINT32 PeakFileVersion = 1;
+		static constexpr UINT32 LevelFactor = 4;
+		static constexpr UINT32 MaxLevelCount = 32;
+
+	private:
+#pragma pack(push, 1)
+		struct PeakFileHeader
+		{
+			UINT32 Magic;
+			UINT32 Version;
+			UINT64 FileSize;
+			INT64 ModifiedTime;
+			UINT64 FrameCount;
+			UINT32 SampleRate;
+			UINT32 ChannelCount;
+			UINT32 FramesPerBin;
+			UINT32 LevelFactor;
+			UINT32 LevelCount;
+			UINT32 PathLength;
+			UINT64 Reserved;
+		};
+
+		struct PeakFileLevel
+		{
+			UINT64 BinCount;
+			UINT64 Offset;
+		};
+#pragma pack(pop)
+
+		//Where the image lives: a mapped peak file or a buffer of its own
+		MemoryMappedFile MappedFile;
+		std::vector<unsigned char> Image;
+		const unsigned char* Data;
+		UINT64 Size;
+
+		PeakFileHeader Header;
+		std::vector<PeakFileLevel> Levels;
+
+		WaveformOverview();
+
+		HRESULT ParseImage();
+
+	public:
+		WaveformOverview(const WaveformOverview&) = delete;
+		WaveformOverview& operator=(const WaveformOverview&) = delete;
+
+		//Build the pyramid from the summarized chunks of a file, in order (every chunk but the last a whole number of bins)
+		static HRESULT Create(PCWSTR mediaFilePath, UINT64 fileSize, INT64 modifiedTime, UINT32 sampleRate, const std::vector<const WaveformSummarizer*>& chunks, std::shared_ptr<WaveformOverview>* outputOverview);
+
+		//Map a peak file. Returns E_INVALIDARG if it isn't a complete peak file of this version.
+		static HRESULT OpenPeakFile(PCWSTR peakFilePath, std::shared_ptr<WaveformOverview>* outputOverview);
+
+		//The peak file image, for saving it
+		const unsigned char* GetPeakFileData() const;
+		UINT64 GetPeakFileSize() const;
+
+		//The media file the overview was generated from
+		std::string GetMediaFilePath() const;
+		UINT64 GetFileSize() const;
+		INT64 GetModifiedTime() const;
+
+		UINT32 GetSampleRate() const;
+		UINT32 GetChannelCount() const;
+		UINT64 GetFrameCount() const;
+		UINT64 GetDuration_100NanoSecondUnits() const;
+
+		//Level 0 is the finest, an empty file has no levels
+		UINT32 GetLevelCount() const;
+		UINT64 GetFramesPerBin(UINT32 level) const;
+		UINT64 GetBinCount(UINT32 level) const;
+
+		//BinCount bins with ChannelCount entries each, nullptr for a level that doesn't exist
+		const WaveformBin* GetBins(UINT32 level) const;
+
+		//Summarize one channel into columnCount columns of framesPerColumn frames from startFrame, from the coarsest level that
+		//still has a bin per column. Columns past the end of the audio are 0.
+		HRESULT GetColumns(UINT32 channel, UINT64 startFrame, double framesPerColumn, UINT32 columnCount, WaveformColumn* outputColumns) const;
+	};
+
+	//The summarizer's vector kernels, exposed for benchmarking and for checking them against the scalar reference
+	namespace WaveformKernels
+	{
+		//Smallest and largest sample and the sum of the squares of every channel of interleaved frames. The vector versions
+		//take 1, 2, 4 or 8 channels (any other count runs the scalar one), the sums add in another order than the scalar's.
+		void MinMaxAndSumOfSquares(const float* frames, size_t frameCount, UINT32 channelCount, float* minimums, float* maximums, float* sumsOfSquares, GainKernels::InstructionSet instructionSet = GainKernels::GetBestInstructionSet());
+	}
+}
@@ -0,0 +1,336 @@
+#include "WaveformOverviewGenerator.h"
+#include "MediaProbe.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <mfapi.h>
+#endif
+
+using namespace MMFSoundPlayerLib;
+
+//Frames decoded and summarized at a time
+static const UINT32 DecodeBlockFrames = 8192;
+
+//Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
+WaveformOverviewGenerator::WaveformOverviewGenerator(WaveformOverviewStore* inputStore, const WaveformOverviewOptions& inputOptions)
+{
+	Store = inputStore;
+	Options = inputOptions;
+	FilesQueued = 0;
+	FilesGenerated = 0;
+	FilesUnchanged = 0;
+	FilesFailed = 0;
+	FramesDecoded = 0;
+	LastProgressTime_Nanoseconds = 0;
+	IsCancelled = false;
+}
+
+WaveformOverviewGenerator::~WaveformOverviewGenerator()
+{
+	Cancel();
+	ThreadPool.Stop();
+}
+
+//Generation---------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT WaveformOverviewGenerator::Generate(const std::vector<std::wstring>& filePaths, WaveformOverviewProgressCallback progressCallback)
+{
+	if (Store == nullptr)
+	{
+		return E_POINTER;
+	}
+	if (Options.FramesPerBin < WaveformSummarizer::MinFramesPerBin || Options.FramesPerBin > WaveformSummarizer::MaxFramesPerBin)
+	{
+		return E_INVALIDARG;
+	}
+
+	//Start from scratch
+	FilesQueued = 0;
+	FilesGenerated = 0;
+	FilesUnchanged = 0;
+	FilesFailed = 0;
+	FramesDecoded = 0;
+	LastProgressTime_Nanoseconds = GetMonotonicTimeNanoseconds();
+	IsCancelled = false;
+	ProgressCallback = std::move(progressCallback);
+
+	//Decoding through Media Foundation needs COM and Media Foundation on every worker, start them once per thread instead of once per chunk
+#ifdef _WIN32
+	auto threadStartup = []
+		{
+			CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+			MFStartup(MF_VERSION, MFSTARTUP_LITE);
+		};
+	auto threadShutdown = []
+		{
+			MFShutdown();
+			CoUninitialize();
+		};
+	HRESULT hr = ThreadPool.Start(Options.ThreadCount, threadStartup, threadShutdown);
+#else
+	HRESULT hr = ThreadPool.Start(Options.ThreadCount);
+#endif
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//A task per file without a current overview, which splits the file into chunk tasks once it knows its length
+	for (const std::wstring& filePath : filePaths)
+	{
+		FilesQueued++;
+		std::shared_ptr<const WaveformOverview> currentOverview;
+		if (Store->Lookup(filePath.c_str(), &currentOverview) == S_OK)
+		{
+			FilesUnchanged++;
+			continue;
+		}
+
+		hr = ThreadPool.Submit([this, filePath] { GenerateFile(filePath); });
+		if (FAILED(hr))
+		{
+			break;
+		}
+	}
+
+	ThreadPool.WaitForIdle();
+	ThreadPool.Stop();
+
+	ReportProgress(true);
+	ProgressCallback = nullptr;
+
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+	return IsCancelled ? E_ABORT : S_OK;
+}
+
+void WaveformOverviewGenerator::GenerateFile(std::wstring filePath)
+{
+	if (IsCancelled)
+	{
+		return;
+	}
+
+	//The size and modification time are taken before decoding, a file changing meanwhile is generated again next time
+	std::shared_ptr<FileGeneration> file = std::make_shared<FileGeneration>();
+	file->FilePath = std::move(filePath);
+	HRESULT hr = GetFileSizeAndModifiedTime(file->FilePath.c_str(), &file->FileSize, &file->ModifiedTime);
+	IAudioDecoder* openedDecoder = nullptr;
+	if (SUCCEEDED(hr))
+	{
+		hr = OpenAudioFileDecoder(file->FilePath.c_str(), &openedDecoder);
+	}
+	std::unique_ptr<IAudioDecoder> decoder(openedDecoder);
+
+	//Chunks of whole bins, the last one reads whatever the file holds beyond the frame count (it is only an estimate for some formats)
+	size_t chunkCount = 0;
+	if (SUCCEEDED(hr))
+	{
+		AudioFormat format = decoder->GetFormat();
+		UINT64 frameCount = decoder->GetFrameCount();
+		UINT64 chunkFrames = std::max<UINT64>(Options.ChunkFrames / Options.FramesPerBin, 1) * Options.FramesPerBin;
+		chunkCount = frameCount > chunkFrames ? (size_t)((frameCount + chunkFrames - 1) / chunkFrames) : 1;
+		file->SampleRate = format.SampleRate;
+		try
+		{
+			file->Chunks.resize(chunkCount);
+		}
+		catch (...)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+		for (size_t chunkIndex = 0; SUCCEEDED(hr) && chunkIndex < chunkCount; chunkIndex++)
+		{
+			ChunkGeneration& chunk = file->Chunks[chunkIndex];
+			chunk.StartFrame = chunkIndex * chunkFrames;
+			chunk.FrameLimit = chunkIndex + 1 < chunkCount ? chunkFrames : 0;
+			hr = chunk.Summarizer.Initialize(format.ChannelCount, Options.FramesPerBin, Options.InstructionSet);
+			if (SUCCEEDED(hr))
+			{
+				hr = chunk.Summarizer.Reserve(chunk.FrameLimit != 0 ? chunk.FrameLimit : frameCount - std::min(frameCount, chunk.StartFrame));
+			}
+		}
+	}
+	if (FAILED(hr))
+	{
+		FilesFailed++;
+		ReportProgress(false);
+		return;
+	}
+
+	//The other workers steal the chunks, this one decodes the first with the decoder it already has
+	file->ChunksLeft = chunkCount;
+	for (size_t chunkIndex = 1; chunkIndex < chunkCount; chunkIndex++)
+	{
+		if (FAILED(ThreadPool.Submit([this, file, chunkIndex] { GenerateChunk(file, chunkIndex, nullptr); })))
+		{
+			GenerateChunk(file, chunkIndex, nullptr);
+		}
+	}
+	GenerateChunk(file, 0, decoder.get());
+}
+
+void WaveformOverviewGenerator::GenerateChunk(std::shared_ptr<FileGeneration> file, size_t chunkIndex, IAudioDecoder* openedDecoder)
+{
+	ChunkGeneration& chunk = file->Chunks[chunkIndex];
+	if (IsCancelled)
+	{
+		chunk.Result = E_ABORT;
+	}
+	else if (openedDecoder != nullptr)
+	{
+		chunk.Result = SummarizeChunk(openedDecoder, chunk);
+	}
+	else
+	{
+		IAudioDecoder* chunkDecoder = nullptr;
+		chunk.Result = OpenAudioFileDecoder(file->FilePath.c_str(), &chunkDecoder);
+		std::unique_ptr<IAudioDecoder> decoder(chunkDecoder);
+		if (SUCCEEDED(chunk.Result))
+		{
+			chunk.Result = decoder->SeekToFrame(chunk.StartFrame);
+		}
+		if (SUCCEEDED(chunk.Result))
+		{
+			chunk.Result = SummarizeChunk(decoder.get(), chunk);
+		}
+	}
+
+	//The last chunk to finish completes the file
+	if (file->ChunksLeft.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		CompleteFile(*file);
+	}
+	ReportProgress(false);
+}
+
+HRESULT WaveformOverviewGenerator::SummarizeChunk(IAudioDecoder* decoder, ChunkGeneration& chunk)
+{
+	UINT32 channelCount = chunk.Summarizer.GetChannelCount();
+	std::vector<float> frames;
+	try
+	{
+		frames.resize((size_t)DecodeBlockFrames * channelCount);
+	}
+	catch (...)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	UINT64 framesSummarized = 0;
+	while (chunk.FrameLimit == 0 || framesSummarized < chunk.FrameLimit)
+	{
+		if (IsCancelled)
+		{
+			return E_ABORT;
+		}
+
+		UINT32 framesWanted = chunk.FrameLimit != 0 ? (UINT32)std::min<UINT64>(DecodeBlockFrames, chunk.FrameLimit - framesSummarized) : DecodeBlockFrames;
+		UINT32 framesRead = 0;
+		HRESULT hr = decoder->ReadFrames(frames.data(), framesWanted, &framesRead);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+		if (framesRead == 0)
+		{
+			break;
+		}
+		chunk.Summarizer.AddFrames(frames.data(), framesRead);
+		framesSummarized += framesRead;
+		FramesDecoded.fetch_add(framesRead, std::memory_order_relaxed);
+	}
+	return S_OK;
+}
+
+void WaveformOverviewGenerator::CompleteFile(FileGeneration& file)
+{
+	//A chunk coming up short is the end of the file (the frame count was an estimate), the chunks after it must be empty
+	std::vector<const WaveformSummarizer*> summarizers;
+	bool isEndReached = false;
+	HRESULT hr = S_OK;
+	for (const ChunkGeneration& chunk : file.Chunks)
+	{
+		if (FAILED(chunk.Result))
+		{
+			hr = chunk.Result;
+			break;
+		}
+		if (isEndReached)
+		{
+			if (chunk.Summarizer.GetFrameCount() != 0)
+			{
+				hr = E_UNEXPECTED;
+				break;
+			}
+			continue;
+		}
+		summarizers.push_back(&chunk.Summarizer);
+		isEndReached = chunk.FrameLimit != 0 && chunk.Summarizer.GetFrameCount() < chunk.FrameLimit;
+	}
+
+	std::shared_ptr<WaveformOverview> overview;
+	if (SUCCEEDED(hr))
+	{
+		hr = WaveformOverview::Create(file.FilePath.c_str(), file.FileSize, file.ModifiedTime, file.SampleRate, summarizers, &overview);
+	}
+	if (FAILED(hr))
+	{
+		if (hr != E_ABORT)
+		{
+			FilesFailed++;
+		}
+		return;
+	}
+
+	//The overview is good even if it couldn't be saved, it just has to be generated again next time
+	if (FAILED(Store->Save(file.FilePath.c_str(), *overview)))
+	{
+		WriteDebugString("WAVEFORM OVERVIEW: Failed to save a peak file\n");
+	}
+	FilesGenerated++;
+}
+
+//Progress-----------------------------------------------------------------------------------------------------------------------------------------------------
+void WaveformOverviewGenerator::ReportProgress(bool isComplete)
+{
+	if (!ProgressCallback)
+	{
+		return;
+	}
+
+	//Only one worker per interval gets to report
+	if (!isComplete)
+	{
+		UINT64 now = GetMonotonicTimeNanoseconds();
+		UINT64 lastProgressTime = LastProgressTime_Nanoseconds.load(std::memory_order_relaxed);
+		if (now - lastProgressTime < (UINT64)Options.ProgressIntervalMilliseconds * 1000000 ||
+			!LastProgressTime_Nanoseconds.compare_exchange_strong(lastProgressTime, now, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+
+	WaveformOverviewProgress progress = GetProgress();
+	progress.IsComplete = isComplete;
+
+	std::lock_guard<std::mutex> lock(ProgressMutex);
+	ProgressCallback(progress);
+}
+
+void WaveformOverviewGenerator::Cancel()
+{
+	IsCancelled = true;
+}
+
+WaveformOverviewProgress WaveformOverviewGenerator::GetProgress()
+{
+	WaveformOverviewProgress progress;
+	progress.FilesQueued = FilesQueued;
+	progress.FilesGenerated = FilesGenerated;
+	progress.FilesUnchanged = FilesUnchanged;
+	progress.FilesFailed = FilesFailed;
+	progress.FramesDecoded = FramesDecoded;
+	return progress;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Platform.h"
+#include "AudioBackend.h"
+#include "WaveformOverview.h"
+#include "WaveformOverviewStore.h"
+#include "WorkStealingThreadPool.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	struct WaveformOverviewOptions
+	{
+		//Worker threads (0 = one per hardware thread)
+		UINT32 ThreadCount = 0;
+
+		//Time between progress reports
+		UINT32 ProgressIntervalMilliseconds = 100;
+
+		//Frames summarized by a bin of the finest level (WaveformSummarizer::MinFramesPerBin to MaxFramesPerBin)
+		UINT32 FramesPerBin = 256;
+
+		//Files longer than this many frames (rounded to whole bins) are split into chunks decoded by several workers at once
+		UINT32 ChunkFrames = 1 << 21;
+
+		GainKernels::InstructionSet InstructionSet = GainKernels::GetBestInstructionSet();
+	};
+
+	struct WaveformOverviewProgress
+	{
+		UINT64 FilesQueued = 0;
+		UINT64 FilesGenerated = 0;  // Files decoded and summarized (whether the peak file could be saved or not).
+		UINT64 FilesUnchanged = 0;  // Files the store already had a current overview of.
+		UINT64 FilesFailed = 0;     // Files that couldn't be decoded.
+		UINT64 FramesDecoded = 0;
+		bool IsComplete = false;
+	};
+
+	//Called from the generator's worker threads (one at a time) while generating, and once more when generation is complete
+	typedef std::function<void(const WaveformOverviewProgress&)> WaveformOverviewProgressCallback;
+
+	/*
+	Offline waveform overview generation: decodes files as fast as the CPU allows (no pacing), summarizes them with
+	WaveformSummarizer and puts the overviews into a WaveformOverviewStore. Every file is a task of a work-stealing thread
+	pool, which opens the file and splits it into chunks of ChunkFrames frames; the chunks after the first are tasks of
+	their own, each decoding its range through a decoder of its own (seeked to the chunk's first frame), so a single long
+	file spreads over all cores as well. The task finishing the last chunk of a file builds the pyramid and saves it. Files
+	with a current overview are skipped.
+	*/
+	class WaveformOverviewGenerator
+	{
+	private:
+		//One chunk of a file, written only by the task summarizing it
+		struct ChunkGeneration
+		{
+			UINT64 StartFrame = 0;
+			UINT64 FrameLimit = 0;  // 0 for the last chunk, which reads up to the end of the file.
+			WaveformSummarizer Summarizer;
+			HRESULT Result = S_OK;
+		};
+
+		//The chunks of one file, summarized in parallel
+		struct FileGeneration
+		{
+			std::wstring FilePath;
+			UINT64 FileSize = 0;
+			INT64 ModifiedTime = 0;
+			UINT32 SampleRate = 0;
+			std::vector<ChunkGeneration> Chunks;
+			std::atomic<size_t> ChunksLeft{ 0 };
+		};
+
+		WaveformOverviewStore* Store;
+		WaveformOverviewOptions Options;
+		WorkStealingThreadPool ThreadPool;
+
+		//Progress
+		std::atomic<UINT64> FilesQueued;
+		std::atomic<UINT64> FilesGenerated;
+		std::atomic<UINT64> FilesUnchanged;
+		std::atomic<UINT64> FilesFailed;
+		std::atomic<UINT64> FramesDecoded;
+		std::atomic<UINT64> LastProgressTime_Nanoseconds;
+		std::mutex ProgressMutex;
+		WaveformOverviewProgressCallback ProgressCallback;
+
+		std::atomic<bool> IsCancelled;
+
+		void GenerateFile(std::wstring filePath);
+		void GenerateChunk(std::shared_ptr<FileGeneration> file, size_t chunkIndex, IAudioDecoder* openedDecoder);
+		void CompleteFile(FileGeneration& file);
+		HRESULT SummarizeChunk(IAudioDecoder* decoder, ChunkGeneration& chunk);
+		void ReportProgress(bool isComplete);
+
+	public:
+		//The store must outlive the generator
+		WaveformOverviewGenerator(WaveformOverviewStore* inputStore, const WaveformOverviewOptions& inputOptions = WaveformOverviewOptions());
+		~WaveformOverviewGenerator();
+
+		//Generate the overviews of the files that have no current one (blocks until done). Returns E_ABORT if generation was cancelled.
+		HRESULT Generate(const std::vector<std::wstring>& filePaths, WaveformOverviewProgressCallback progressCallback = nullptr);
+
+		//Stop a running generation early (from any thread). Overviews already saved stay in the store.
+		void Cancel();
+
+		WaveformOverviewProgress GetProgress();
+	};
+}
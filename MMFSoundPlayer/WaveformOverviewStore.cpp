@@ -0,0 +1,120 @@
+#include "WaveformOverviewStore.h"
+#include <cwchar>
+#include <functional>
+#include <thread>
+
+using namespace MMFSoundPlayerLib;
+
+//Constructor/Initialization-----------------------------------------------------------------------------------------------------------------------------------
+WaveformOverviewStore::WaveformOverviewStore(PCWSTR inputDirectoryPath)
+{
+	DirectoryPath = inputDirectoryPath;
+}
+
+HRESULT WaveformOverviewStore::CreateInstance(PCWSTR directoryPath, WaveformOverviewStore** outputStore)
+{
+	//Ensure that the pointers actually point somewhere
+	if (directoryPath == nullptr || outputStore == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	HRESULT hr = CreateDirectoriesWithWidePath(directoryPath);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//Create the object using "new" and ensure it doesn't throw exceptions, so an HRESULT can be returned
+	WaveformOverviewStore* newStore = new (std::nothrow) WaveformOverviewStore(directoryPath);
+	if (newStore == nullptr)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	*outputStore = newStore;
+	return S_OK;
+}
+
+//Peak files---------------------------------------------------------------------------------------------------------------------------------------------------
+std::wstring WaveformOverviewStore::GetPeakFilePath(const std::string& narrowPath)
+{
+	//FNV-1a of the path, the file itself holds the full path to tell colliding paths apart
+	UINT64 hash = 0xCBF29CE484222325ull;
+	for (char character : narrowPath)
+	{
+		hash ^= (unsigned char)character;
+		hash *= 0x100000001B3ull;
+	}
+
+	wchar_t fileName[32];
+	swprintf(fileName, 32, L"%016llx.peaks", (unsigned long long)hash);
+	return DirectoryPath + L"/" + fileName;
+}
+
+HRESULT WaveformOverviewStore::Lookup(PCWSTR inputFilePath, std::shared_ptr<const WaveformOverview>* outputOverview)
+{
+	//Ensure that the pointers actually point somewhere
+	if (inputFilePath == nullptr || outputOverview == nullptr)
+	{
+		return E_POINTER;
+	}
+	outputOverview->reset();
+
+	UINT64 fileSize;
+	INT64 modifiedTime;
+	HRESULT hr = GetFileSizeAndModifiedTime(inputFilePath, &fileSize, &modifiedTime);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	//A peak file that is missing, damaged, of another version or of another path just isn't there
+	std::string narrowPath = ConvertWidePathToNarrow(inputFilePath);
+	std::shared_ptr<WaveformOverview> foundOverview;
+	if (FAILED(WaveformOverview::OpenPeakFile(GetPeakFilePath(narrowPath).c_str(), &foundOverview)) || foundOverview->GetMediaFilePath() != narrowPath ||
+		foundOverview->GetFileSize() != fileSize || foundOverview->GetModifiedTime() != modifiedTime)
+	{
+		return S_FALSE;
+	}
+	*outputOverview = std::move(foundOverview);
+	return S_OK;
+}
+
+HRESULT WaveformOverviewStore::Save(PCWSTR inputFilePath, const WaveformOverview& inputOverview)
+{
+	if (inputFilePath == nullptr)
+	{
+		return E_POINTER;
+	}
+
+	//Write next to the old file and replace it, so readers never map half a file (the thread id keeps concurrent saves of one file apart)
+	std::wstring peakFilePath = GetPeakFilePath(ConvertWidePathToNarrow(inputFilePath));
+	std::wstring temporaryFilePath = peakFilePath + L"." + std::to_wstring(std::hash<std::thread::id>()(std::this_thread::get_id())) + L".tmp";
+	FILE* file = OpenFileWithWidePath(temporaryFilePath.c_str(), "wb");
+	if (file == nullptr)
+	{
+		return GetLastFileErrorAsHRESULT();
+	}
+
+	size_t imageSize = (size_t)inputOverview.GetPeakFileSize();
+	bool written = fwrite(inputOverview.GetPeakFileData(), 1, imageSize, file) == imageSize;
+	if (fclose(file) != 0)
+	{
+		written = false;
+	}
+	if (!written)
+	{
+		RemoveFileWithWidePath(temporaryFilePath.c_str());
+		return E_FAIL;
+	}
+
+	//Overviews mapped from the old file keep viewing it until they are released (Windows may refuse to replace a mapped file,
+	//the caller then keeps using the overview it generated and the next generation tries again)
+	HRESULT hr = ReplaceFileWithWidePath(temporaryFilePath.c_str(), peakFilePath.c_str());
+	if (FAILED(hr))
+	{
+		RemoveFileWithWidePath(temporaryFilePath.c_str());
+	}
+	return hr;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Platform.h"
+#include "WaveformOverview.h"
+#include <memory>
+#include <string>
+
+namespace MMFSoundPlayerLib
+{
+	/*
+	Persistent home of the waveform overviews: one peak file per media file in a directory, named after a hash of the
+	media path and holding the path to rule out collisions. An overview only counts as current while the media file has the
+	size and modification time it was generated from. Peak files are mapped rather than read, so a lookup costs a few
+	system calls and only the levels a display draws from are paged in; the page cache is the memory cache. Generating
+	them is up to WaveformOverviewGenerator. All methods are thread-safe.
+	*/
+	class WaveformOverviewStore
+	{
+	private:
+		std::wstring DirectoryPath;
+
+		WaveformOverviewStore(PCWSTR inputDirectoryPath);
+
+		std::wstring GetPeakFilePath(const std::string& narrowPath);
+
+	public:
+		//Creates the directory if needed
+		static HRESULT CreateInstance(PCWSTR directoryPath, WaveformOverviewStore** outputStore);
+
+		//Current overview of a file. Returns S_FALSE (and nullptr) if there is none.
+		HRESULT Lookup(PCWSTR inputFilePath, std::shared_ptr<const WaveformOverview>* outputOverview);
+
+		//Write the peak file of an overview (generated from inputFilePath), replacing the one there was
+		HRESULT Save(PCWSTR inputFilePath, const WaveformOverview& inputOverview);
+	};
+}
@@ -0,0 +1,224 @@
+#include "WorkStealingThreadPool.h"
+#include <cassert>
+
+using namespace MMFSoundPlayerLib;
+
+//The pool and worker the current thread belongs to (so tasks submitted by a worker stay on its own deque)
+thread_local WorkStealingThreadPool* CurrentThreadPool = nullptr;
+thread_local UINT32 CurrentWorkerIndex = 0;
+
+//Constructor/Initialization and Destructors/Deinitialization--------------------------------------------------------------------------------------------------
+WorkStealingThreadPool::WorkStealingThreadPool()
+{
+	QueuedTaskCount = 0;
+	PendingTaskCount = 0;
+	NextExternalQueue = 0;
+	IsStopping = false;
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool()
+{
+	Stop();
+}
+
+HRESULT WorkStealingThreadPool::Start(UINT32 threadCount, std::function<void()> threadStartup, std::function<void()> threadShutdown)
+{
+	//Only start once
+	if (!Workers.empty())
+	{
+		return E_UNEXPECTED;
+	}
+
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0)
+		{
+			threadCount = 1;
+		}
+	}
+
+	ThreadStartup = std::move(threadStartup);
+	ThreadShutdown = std::move(threadShutdown);
+	IsStopping = false;
+
+	try
+	{
+		//Every queue exists before any worker can try to steal from it
+		for (UINT32 index = 0; index < threadCount; index++)
+		{
+			Queues.push_back(std::make_unique<WorkerQueue>());
+		}
+		for (UINT32 index = 0; index < threadCount; index++)
+		{
+			Workers.emplace_back(&WorkStealingThreadPool::WorkerLoop, this, index);
+		}
+	}
+	catch (...)
+	{
+		assert(false);
+		Stop();
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+void WorkStealingThreadPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(WakeMutex);
+		IsStopping = true;
+	}
+	WakeCondition.notify_all();
+
+	for (std::thread& worker : Workers)
+	{
+		if (worker.joinable())
+		{
+			worker.join();
+		}
+	}
+	Workers.clear();
+	Queues.clear();
+}
+
+//Tasks--------------------------------------------------------------------------------------------------------------------------------------------------------
+HRESULT WorkStealingThreadPool::Submit(ThreadPoolTask inputTask)
+{
+	if (!inputTask)
+	{
+		return E_POINTER;
+	}
+	if (Queues.empty())
+	{
+		return E_UNEXPECTED;
+	}
+
+	//Workers keep their own tasks, everybody else spreads them out
+	if (CurrentThreadPool == this)
+	{
+		PushTask(CurrentWorkerIndex, std::move(inputTask), false);
+	}
+	else
+	{
+		UINT32 queueIndex = NextExternalQueue.fetch_add(1, std::memory_order_relaxed) % (UINT32)Queues.size();
+		PushTask(queueIndex, std::move(inputTask), true);
+	}
+	return S_OK;
+}
+
+void WorkStealingThreadPool::PushTask(UINT32 queueIndex, ThreadPoolTask&& inputTask, bool pushToFront)
+{
+	//Counted before it is visible, so a worker can never take a task the counters don't know about yet
+	PendingTaskCount.fetch_add(1, std::memory_order_relaxed);
+	QueuedTaskCount.fetch_add(1, std::memory_order_release);
+	{
+		WorkerQueue& queue = *Queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.QueueMutex);
+		if (pushToFront)
+		{
+			queue.Tasks.push_front(std::move(inputTask));
+		}
+		else
+		{
+			queue.Tasks.push_back(std::move(inputTask));
+		}
+	}
+
+	//Taking the lock orders this with a worker that is about to sleep, so the wakeup can't be missed
+	{
+		std::lock_guard<std::mutex> lock(WakeMutex);
+	}
+	WakeCondition.notify_one();
+}
+
+bool WorkStealingThreadPool::TryTakeTask(UINT32 workerIndex, ThreadPoolTask& outputTask)
+{
+	//Own deque first, newest task first
+	{
+		WorkerQueue& ownQueue = *Queues[workerIndex];
+		std::lock_guard<std::mutex> lock(ownQueue.QueueMutex);
+		if (!ownQueue.Tasks.empty())
+		{
+			outputTask = std::move(ownQueue.Tasks.back());
+			ownQueue.Tasks.pop_back();
+			QueuedTaskCount.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	//Then steal the oldest task of another worker
+	UINT32 queueCount = (UINT32)Queues.size();
+	for (UINT32 offset = 1; offset < queueCount; offset++)
+	{
+		WorkerQueue& victimQueue = *Queues[(workerIndex + offset) % queueCount];
+		std::lock_guard<std::mutex> lock(victimQueue.QueueMutex);
+		if (!victimQueue.Tasks.empty())
+		{
+			outputTask = std::move(victimQueue.Tasks.front());
+			victimQueue.Tasks.pop_front();
+			QueuedTaskCount.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingThreadPool::WorkerLoop(UINT32 workerIndex)
+{
+	CurrentThreadPool = this;
+	CurrentWorkerIndex = workerIndex;
+	if (ThreadStartup)
+	{
+		ThreadStartup();
+	}
+
+	ThreadPoolTask task;
+	while (true)
+	{
+		if (TryTakeTask(workerIndex, task))
+		{
+			task();
+			task = nullptr;
+
+			//The last pending task wakes whoever waits for the pool to go idle
+			if (PendingTaskCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				std::lock_guard<std::mutex> lock(WakeMutex);
+				IdleCondition.notify_all();
+			}
+			continue;
+		}
+
+		//Nothing to run anywhere: sleep until something is queued, exit once stopping and drained
+		std::unique_lock<std::mutex> lock(WakeMutex);
+		WakeCondition.wait(lock, [this]
+			{
+				return IsStopping || QueuedTaskCount.load(std::memory_order_acquire) > 0;
+			});
+		if (IsStopping && QueuedTaskCount.load(std::memory_order_acquire) == 0)
+		{
+			break;
+		}
+	}
+
+	if (ThreadShutdown)
+	{
+		ThreadShutdown();
+	}
+	CurrentThreadPool = nullptr;
+}
+
+void WorkStealingThreadPool::WaitForIdle()
+{
+	std::unique_lock<std::mutex> lock(WakeMutex);
+	IdleCondition.wait(lock, [this]
+		{
+			return PendingTaskCount.load(std::memory_order_acquire) == 0;
+		});
+}
+
+UINT32 WorkStealingThreadPool::GetThreadCount()
+{
+	return (UINT32)Workers.size();
+}
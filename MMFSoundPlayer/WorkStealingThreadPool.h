@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Platform.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MMFSoundPlayerLib
+{
+	typedef std::function<void()> ThreadPoolTask;
+
+	/*
+	Thread pool where every worker owns a deque of tasks. A task submitted from inside a worker goes to the back of that
+	worker's own deque and is popped from the back again (depth first, cache friendly, keeps tree walks from ballooning),
+	an idle worker steals from the front of the other deques (the oldest, usually largest pieces of work). Tasks submitted
+	from outside of the pool are spread over the deques round robin. Every deque has its own small lock, so workers only
+	contend when one steals from another.
+	*/
+	class WorkStealingThreadPool
+	{
+	private:
+		struct WorkerQueue
+		{
+			std::mutex QueueMutex;
+			std::deque<ThreadPoolTask> Tasks;
+		};
+
+		std::vector<std::unique_ptr<WorkerQueue>> Queues;
+		std::vector<std::thread> Workers;
+
+		//Called on every worker when it starts and before it exits (per thread setup such as COM)
+		std::function<void()> ThreadStartup;
+		std::function<void()> ThreadShutdown;
+
+		//Queued tasks wake sleeping workers, pending tasks (queued or running) tell when the pool is idle
+		std::mutex WakeMutex;
+		std::condition_variable WakeCondition;
+		std::condition_variable IdleCondition;
+		std::atomic<UINT64> QueuedTaskCount;
+		std::atomic<UINT64> PendingTaskCount;
+		std::atomic<UINT32> NextExternalQueue;
+		bool IsStopping;
+
+		void WorkerLoop(UINT32 workerIndex);
+		bool TryTakeTask(UINT32 workerIndex, ThreadPoolTask& outputTask);
+		void PushTask(UINT32 queueIndex, ThreadPoolTask&& inputTask, bool pushToFront);
+
+	public:
+		WorkStealingThreadPool();
+		~WorkStealingThreadPool();
+
+		//Start threadCount workers (0 = one per hardware thread)
+		HRESULT Start(UINT32 threadCount, std::function<void()> threadStartup = nullptr, std::function<void()> threadShutdown = nullptr);
+
+		//Let the workers finish every queued task, then join them
+		void Stop();
+
+		//Queue a task (from any thread, including the pool's own workers)
+		HRESULT Submit(ThreadPoolTask inputTask);
+
+		//Block until every submitted task (and every task those submitted) has run
+		void WaitForIdle();
+
+		UINT32 GetThreadCount();
+	};
+}
@@ -0,0 +1,907 @@
+#include <iostream>
+#include "../MMFSoundPlayer/MMFSoundPlayer.h"
+#include "../MMFSoundPlayer/HeadlessBackend.h"
+#include "../MMFSoundPlayer/GainStage.h"
+#include "../MMFSoundPlayer/PlayerEventRing.h"
+#include "../MMFSoundPlayer/PlayerStateMachine.h"
+#include "../MMFSoundPlayer/Resampler.h"
+#include "../MMFSoundPlayer/SeekIndex.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+Correctness checks of the parts of the library whose behaviour is easy to get subtly wrong: lock-free structures under
+contention, sample-exact transitions and seeks, signal processing against its specification and opens that must not hold
+anything else up. Everything runs headless on generated data, so the checks need no audio hardware and no files besides
+the ones they write themselves (the slow open check needs a FIFO, so it only runs outside of Windows).
+
+Usage: Tests [name ...]
+Runs every test (or only the named ones), prints a line per test and returns the number of failed tests.
+*/
+
+namespace fs = std::filesystem;
+using namespace MMFSoundPlayerLib;
+
+struct TestCase
+{
+	const char* Name = nullptr;
+	bool (*Run)() = nullptr;
+};
+
+//Function declarations
+bool Expect(bool condition, const std::string& description);
+bool WriteWavFile(const fs::path& outputFilePath, UINT32 sampleRate, UINT32 channelCount, const std::vector<int16_t>& samples);
+bool ReadFloatWavFile(const fs::path& inputFilePath, std::vector<float>* outputSamples);
+bool WriteMpegAudioFile(const fs::path& outputFilePath, UINT32 frameCount, UINT32 encoderDelay, UINT32 encoderPadding, std::vector<UINT64>* outputFrameOffsets);
+bool WaitForPlayerState(MMFSoundPlayer* player, PlayerState state, UINT32 timeoutMilliseconds);
+bool TestEventRingStress();
+bool TestStateMachineStress();
+bool TestGaplessTransition();
+bool TestCrossfadeTiming();
+bool TestSeekIndexAccuracy();
+bool TestScrubCoalescing();
+bool TestGainKernelsExact();
+bool TestResamplerResponse();
+bool TestSlowOpenDoesNotBlock();
+
+//Every test, in the order they run
+TestCase const Tests[] =
+{
+	{ "EventRingStress", TestEventRingStress },
+	{ "StateMachineStress", TestStateMachineStress },
+	{ "GaplessTransition", TestGaplessTransition },
+	{ "CrossfadeTiming", TestCrossfadeTiming },
+	{ "SeekIndexAccuracy", TestSeekIndexAccuracy },
+	{ "ScrubCoalescing", TestScrubCoalescing },
+	{ "GainKernelsExact", TestGainKernelsExact },
+	{ "ResamplerResponse", TestResamplerResponse },
+	{ "SlowOpenDoesNotBlock", TestSlowOpenDoesNotBlock }
+};
+
+int main(int argc, char** argv)
+{
+	int failedCount = 0;
+	for (const TestCase& test : Tests)
+	{
+		//Only the named tests, if any are named
+		bool isSelected = argc <= 1;
+		for (int argument = 1; argument < argc; argument++)
+		{
+			isSelected = isSelected || strcmp(argv[argument], test.Name) == 0;
+		}
+		if (!isSelected)
+		{
+			continue;
+		}
+
+		bool passed = test.Run();
+		std::cout << (passed ? "PASS " : "FAIL ") << test.Name << "\n";
+		if (!passed)
+		{
+			failedCount++;
+		}
+	}
+	return failedCount;
+}
+
+bool Expect(bool condition, const std::string& description)
+{
+	if (!condition)
+	{
+		std::cout << "  expected: " << description << "\n";
+	}
+	return condition;
+}
+
+bool WriteWavFile(const fs::path& outputFilePath, UINT32 sampleRate, UINT32 channelCount, const std::vector<int16_t>& samples)
+{
+	//16 bit PCM
+	UINT32 bytesPerFrame = channelCount * 2;
+	UINT32 dataSize = (UINT32)samples.size() * 2;
+	std::vector<unsigned char> fileData(44 + (size_t)dataSize);
+	auto writeLittleEndian = [&](size_t offset, UINT32 value, UINT32 byteCount)
+	{
+		for (UINT32 byte = 0; byte < byteCount; byte++)
+		{
+			fileData[offset + byte] = (unsigned char)(value >> (8 * byte));
+		}
+	};
+	memcpy(&fileData[0], "RIFF", 4);
+	writeLittleEndian(4, 36 + dataSize, 4);
+	memcpy(&fileData[8], "WAVEfmt ", 8);
+	writeLittleEndian(16, 16, 4);
+	writeLittleEndian(20, 1, 2);
+	writeLittleEndian(22, channelCount, 2);
+	writeLittleEndian(24, sampleRate, 4);
+	writeLittleEndian(28, sampleRate * bytesPerFrame, 4);
+	writeLittleEndian(32, bytesPerFrame, 2);
+	writeLittleEndian(34, 16, 2);
+	memcpy(&fileData[36], "data", 4);
+	writeLittleEndian(40, dataSize, 4);
+	for (size_t sample = 0; sample < samples.size(); sample++)
+	{
+		writeLittleEndian(44 + sample * 2, (UINT16)samples[sample], 2);
+	}
+
+	std::ofstream outputFile(outputFilePath, std::ios::binary | std::ios::trunc);
+	outputFile.write((const char*)fileData.data(), fileData.size());
+	return (bool)outputFile;
+}
+
+bool ReadFloatWavFile(const fs::path& inputFilePath, std::vector<float>* outputSamples)
+{
+	//What the WAV file sink records: 32-bit float samples in the data chunk, wherever it is
+	std::ifstream inputFile(inputFilePath, std::ios::binary);
+	std::vector<unsigned char> fileData((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
+	if (fileData.size() < 12 || memcmp(&fileData[0], "RIFF", 4) != 0 || memcmp(&fileData[8], "WAVE", 4) != 0)
+	{
+		return false;
+	}
+	size_t offset = 12;
+	while (offset + 8 <= fileData.size())
+	{
+		UINT32 chunkSize = fileData[offset + 4] | (fileData[offset + 5] << 8) | (fileData[offset + 6] << 16) | ((UINT32)fileData[offset + 7] << 24);
+		if (memcmp(&fileData[offset], "data", 4) == 0)
+		{
+			size_t sampleCount = std::min<size_t>(chunkSize, fileData.size() - offset - 8) / sizeof(float);
+			outputSamples->resize(sampleCount);
+			memcpy(outputSamples->data(), &fileData[offset + 8], sampleCount * sizeof(float));
+			return true;
+		}
+		offset += 8 + (size_t)chunkSize + (chunkSize & 1);
+	}
+	return false;
+}
+
+bool WriteMpegAudioFile(const fs::path& outputFilePath, UINT32 frameCount, UINT32 encoderDelay, UINT32 encoderPadding, std::vector<UINT64>* outputFrameOffsets)
+{
+	//MPEG-1 Layer III, 44.1 kHz stereo, behind an ID3v2 tag: a Xing/LAME frame with the delay and padding, then VBR audio
+	//frames (runs of different bitrates, filler instead of coded audio), some junk the reader has to resync over, and an ID3v1 tag
+	static const UINT32 bitrateIndexes[] = { 5, 9, 13, 14 };
+	static const UINT32 bitrates_Kbps[] = { 64, 128, 256, 320 };
+	std::vector<unsigned char> fileData = { 'I', 'D', '3', 4, 0, 0, 0, 0, 2, 44 };
+	fileData.resize(fileData.size() + 300, 0);
+	auto appendFrame = [&](UINT32 bitrate, bool isPadded)
+	{
+		UINT32 bitrateIndex = bitrateIndexes[bitrate];
+		UINT32 frameLength = 144 * bitrates_Kbps[bitrate] * 1000 / 44100 + (isPadded ? 1 : 0);
+		size_t frameOffset = fileData.size();
+		fileData.resize(frameOffset + frameLength, 0x55);
+		fileData[frameOffset] = 0xFF;
+		fileData[frameOffset + 1] = 0xFB;
+		fileData[frameOffset + 2] = (unsigned char)((bitrateIndex << 4) | (isPadded ? 2 : 0));
+		fileData[frameOffset + 3] = 0x00;
+		return frameOffset;
+	};
+
+	size_t xingOffset = appendFrame(1, false) + 4 + 32;
+	memcpy(&fileData[xingOffset], "Xing", 4);
+	memset(&fileData[xingOffset + 4], 0, 112);
+	fileData[xingOffset + 7] = 0x0F;
+	for (UINT32 byte = 0; byte < 4; byte++)
+	{
+		fileData[xingOffset + 8 + byte] = (unsigned char)(frameCount >> (24 - 8 * byte));
+	}
+	size_t lameOffset = xingOffset + 8 + 4 + 4 + 100 + 4;
+	memcpy(&fileData[lameOffset], "LAME3.100", 9);
+	fileData[lameOffset + 21] = (unsigned char)(encoderDelay >> 4);
+	fileData[lameOffset + 22] = (unsigned char)(((encoderDelay & 0x0F) << 4) | (encoderPadding >> 8));
+	fileData[lameOffset + 23] = (unsigned char)(encoderPadding & 0xFF);
+
+	outputFrameOffsets->clear();
+	for (UINT32 frame = 0; frame < frameCount; frame++)
+	{
+		if (frame == frameCount / 3)
+		{
+			fileData.resize(fileData.size() + 777, 0);
+		}
+		outputFrameOffsets->push_back(appendFrame((frame / 500) % 4, frame % 3 == 0));
+	}
+	fileData.push_back('T');
+	fileData.push_back('A');
+	fileData.push_back('G');
+	fileData.resize(fileData.size() + 125, 0);
+
+	std::ofstream outputFile(outputFilePath, std::ios::binary | std::ios::trunc);
+	outputFile.write((const char*)fileData.data(), fileData.size());
+	return (bool)outputFile;
+}
+
+bool WaitForPlayerState(MMFSoundPlayer* player, PlayerState state, UINT32 timeoutMilliseconds)
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+	while (player->GetPlayerState() != state)
+	{
+		if (std::chrono::steady_clock::now() >= deadline)
+		{
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	return true;
+}
+
+//Event Ring---------------------------------------------------------------------------------------------------------------------------------------------------
+bool TestEventRingStress()
+{
+	//More publishers than cores, so some get preempted between claiming a ticket and stamping the slot, and subscribers
+	//that keep up as well as ones that fall behind a lap and skip ahead
+	const UINT32 publisherCount = 8;
+	const UINT32 eventsPerPublisher = 20000;
+	const UINT32 subscriberCount = 3;
+	PlayerEventRing ring;
+
+	//A subscriber checks every event it gets: the sequence only moves forward, the fields of one event belong together
+	//(OldState names the publisher, Status counts its events, NewState is derived from both) and every publisher's events
+	//arrive in the order it published them
+	struct SubscriberResult
+	{
+		UINT64 Received = 0;
+		UINT64 Missed = 0;
+		UINT64 Errors = 0;
+	};
+	std::vector<SubscriberResult> results(subscriberCount);
+	std::vector<PlayerEventSubscription> subscriptions(subscriberCount, PlayerEventSubscription(&ring));
+	std::atomic<bool> isPublishing = true;
+	std::vector<std::thread> subscribers;
+	for (UINT32 subscriberIndex = 0; subscriberIndex < subscriberCount; subscriberIndex++)
+	{
+		subscribers.emplace_back([&, subscriberIndex]()
+		{
+			PlayerEventSubscription& subscription = subscriptions[subscriberIndex];
+			SubscriberResult& result = results[subscriberIndex];
+			std::vector<INT64> lastCounts(publisherCount, -1);
+			UINT64 lastSequence = 0;
+			bool isFirst = true;
+			PlayerEvent nextEvent;
+			while (true)
+			{
+				bool isLastPass = !isPublishing;
+				while (subscription.TryGetNext(nextEvent))
+				{
+					UINT32 publisher = (UINT32)nextEvent.OldState;
+					INT64 count = (INT64)nextEvent.Status;
+					if ((!isFirst && nextEvent.Sequence <= lastSequence) || publisher >= publisherCount ||
+						(UINT32)nextEvent.NewState != (publisher + (UINT32)count) % 8 || count <= lastCounts[publisher])
+					{
+						result.Errors++;
+					}
+					else
+					{
+						lastCounts[publisher] = count;
+					}
+					lastSequence = nextEvent.Sequence;
+					isFirst = false;
+					result.Received++;
+
+					//The last subscriber is slow, so it gets lapped
+					if (subscriberIndex == subscriberCount - 1 && result.Received % 64 == 0)
+					{
+						std::this_thread::sleep_for(std::chrono::microseconds(200));
+					}
+				}
+				if (isLastPass)
+				{
+					break;
+				}
+				std::this_thread::yield();
+			}
+			result.Missed = subscription.GetMissedEventCount();
+		});
+	}
+
+	std::vector<std::thread> publishers;
+	for (UINT32 publisherIndex = 0; publisherIndex < publisherCount; publisherIndex++)
+	{
+		publishers.emplace_back([&, publisherIndex]()
+		{
+			for (UINT32 count = 0; count < eventsPerPublisher; count++)
+			{
+				ring.Publish(PlayerEventType::StateChanged, (PlayerState)publisherIndex, (PlayerState)((publisherIndex + count) % 8), (HRESULT)count);
+			}
+		});
+	}
+	for (std::thread& publisher : publishers)
+	{
+		publisher.join();
+	}
+	isPublishing = false;
+	for (std::thread& subscriber : subscribers)
+	{
+		subscriber.join();
+	}
+
+	//Every event was either received or counted as missed, none was lost to a slot that never became readable
+	UINT64 publishedCount = (UINT64)publisherCount * eventsPerPublisher;
+	bool passed = Expect(ring.GetPublishedCount() == publishedCount, "every event published");
+	for (UINT32 subscriberIndex = 0; subscriberIndex < subscriberCount; subscriberIndex++)
+	{
+		const SubscriberResult& result = results[subscriberIndex];
+		std::string subscriberName = "subscriber " + std::to_string(subscriberIndex);
+		passed &= Expect(result.Errors == 0, subscriberName + " sees consistent events in order (" + std::to_string(result.Errors) + " bad)");
+		passed &= Expect(result.Received + result.Missed == publishedCount, subscriberName + " accounts for every event (" +
+			std::to_string(result.Received) + " received, " + std::to_string(result.Missed) + " missed)");
+	}
+	return passed;
+}
+
+bool TestStateMachineStress()
+{
+	//Threads racing to move one state machine to random states, as session events and commands do: every transition that
+	//gets published has to be an edge of the table, and each one is published exactly once
+	const UINT32 threadCount = 8;
+	const UINT32 transitionsPerThread = 20000;
+	const UINT32 stateCount = (UINT32)PlayerState::Closing + 1;
+	PlayerEventRing ring;
+	PlayerStateMachine stateMachine(&ring);
+	PlayerEventSubscription subscription(&ring);
+
+	std::atomic<bool> isTransitioning = true;
+	UINT64 receivedCount = 0;
+	UINT64 illegalCount = 0;
+	std::thread subscriber([&]()
+	{
+		PlayerEvent nextEvent;
+		while (true)
+		{
+			bool isLastPass = !isTransitioning;
+			while (subscription.TryGetNext(nextEvent))
+			{
+				if (nextEvent.Type != PlayerEventType::StateChanged || nextEvent.OldState == nextEvent.NewState ||
+					!PlayerStateMachine::IsValidTransition(nextEvent.OldState, nextEvent.NewState))
+				{
+					illegalCount++;
+				}
+				receivedCount++;
+			}
+			if (isLastPass)
+			{
+				break;
+			}
+			std::this_thread::yield();
+		}
+	});
+
+	std::vector<std::thread> threads;
+	for (UINT32 threadIndex = 0; threadIndex < threadCount; threadIndex++)
+	{
+		threads.emplace_back([&, threadIndex]()
+		{
+			std::mt19937 generator(threadIndex);
+			std::uniform_int_distribution<UINT32> stateDistribution(0, stateCount - 1);
+			for (UINT32 transition = 0; transition < transitionsPerThread; transition++)
+			{
+				stateMachine.Transition((PlayerState)stateDistribution(generator));
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	isTransitioning = false;
+	subscriber.join();
+
+	std::cout << "  " << ring.GetPublishedCount() << " transitions published\n";
+	bool passed = Expect(ring.GetPublishedCount() > 0, "some transitions were accepted");
+	passed &= Expect(illegalCount == 0, "every published transition is an edge of the table (" + std::to_string(illegalCount) + " illegal)");
+	passed &= Expect(receivedCount + subscription.GetMissedEventCount() == ring.GetPublishedCount(), "every transition published once (" +
+		std::to_string(receivedCount) + " received, " + std::to_string(subscription.GetMissedEventCount()) + " missed)");
+	return passed;
+}
+
+//Gapless Playback---------------------------------------------------------------------------------------------------------------------------------------------
+bool TestGaplessTransition()
+{
+	//Two files of constant opposite levels with odd lengths (no period boundary lines up with the switch): the recording of
+	//the session must be the first file's frames followed right away by the second's, the gap is whatever lies in between
+	const UINT32 sampleRate = 48000;
+	const UINT32 channelCount = 2;
+	const UINT32 firstFrameCount = sampleRate / 2 + 123;
+	const UINT32 secondFrameCount = sampleRate / 2 + 77;
+	fs::path firstFilePath = fs::temp_directory_path() / "MMFSoundPlayerTests_GaplessA.wav";
+	fs::path secondFilePath = fs::temp_directory_path() / "MMFSoundPlayerTests_GaplessB.wav";
+	fs::path recordingPath = fs::temp_directory_path() / "MMFSoundPlayerTests_Gapless.wav";
+	if (!Expect(WriteWavFile(firstFilePath, sampleRate, channelCount, std::vector<int16_t>((size_t)firstFrameCount * channelCount, 16384)) &&
+		WriteWavFile(secondFilePath, sampleRate, channelCount, std::vector<int16_t>((size_t)secondFrameCount * channelCount, -16384)), "test files written"))
+	{
+		return false;
+	}
+
+	//Faster than real time, but paced, so the second file is queued while the first one still plays
+	HeadlessBackendOptions backendOptions;
+	backendOptions.SinkType = HeadlessSinkType::WavFile;
+	backendOptions.OutputFilePath = recordingPath.wstring();
+	backendOptions.PlaybackSpeed = 4.0;
+	IAudioBackend* backend = nullptr;
+	MMFSoundPlayer* player = nullptr;
+	bool passed = Expect(SUCCEEDED(HeadlessBackend::CreateInstance(backendOptions, &backend)) && SUCCEEDED(MMFSoundPlayer::CreateInstance(backend, &player)), "player created");
+	if (passed)
+	{
+		passed &= Expect(SUCCEEDED(player->SetFileIntoPlayer(firstFilePath.wstring().c_str())), "first file plays");
+		passed &= Expect(SUCCEEDED(player->QueueNextFile(secondFilePath.wstring().c_str())), "second file queued");
+		passed &= Expect(WaitForPlayerState(player, PlayerState::PresentationEnd, 5000), "both files played to the end");
+		passed &= Expect(player->GetAudioFilepath() == secondFilePath.wstring(), "the queued file became the current one");
+		player->Shutdown();
+		player->Release();
+	}
+
+	//Count the frames of each level and what is between them
+	std::vector<float> samples;
+	passed &= Expect(ReadFloatWavFile(recordingPath, &samples), "recording readable");
+	UINT64 positiveFrames = 0;
+	UINT64 negativeFrames = 0;
+	UINT64 otherFrames = 0;
+	UINT64 levelChanges = 0;
+	int lastSign = 1;
+	for (size_t frame = 0; frame + channelCount <= samples.size(); frame += channelCount)
+	{
+		int sign = samples[frame] > 0.0f ? 1 : (samples[frame] < 0.0f ? -1 : 0);
+		positiveFrames += sign > 0 ? 1 : 0;
+		negativeFrames += sign < 0 ? 1 : 0;
+		otherFrames += sign == 0 ? 1 : 0;
+		levelChanges += sign != lastSign ? 1 : 0;
+		lastSign = sign;
+	}
+	double gap_Milliseconds = otherFrames * 1000.0 / sampleRate;
+	std::cout << "  gap " << gap_Milliseconds << " ms (" << otherFrames << " frames)\n";
+	passed &= Expect(positiveFrames == firstFrameCount && negativeFrames == secondFrameCount, "every frame of both files recorded once (" +
+		std::to_string(positiveFrames) + " + " + std::to_string(negativeFrames) + ")");
+	passed &= Expect(otherFrames == 0 && levelChanges == 1, "no gap between the files (" + std::to_string(otherFrames) + " silent frames)");
+
+	fs::remove(firstFilePath);
+	fs::remove(secondFilePath);
+	fs::remove(recordingPath);
+	return passed;
+}
+
+bool TestCrossfadeTiming()
+{
+	//Two files of constant levels: the second one has to start exactly the crossfade's length before the end of the first,
+	//and every frame of the overlap has to follow the equal-power curve (cosine out, sine in, sampled mid-frame)
+	const UINT32 sampleRate = 48000;
+	const UINT32 channelCount = 2;
+	const UINT32 crossfadeMilliseconds = 200;
+	const UINT32 crossfadeFrameCount = sampleRate * crossfadeMilliseconds / 1000;
+	const UINT32 firstFrameCount = sampleRate * 3 / 2 + 123;
+	const UINT32 secondFrameCount = sampleRate / 2 + 77;
+	const float firstLevel = 0.5f;
+	const float secondLevel = 0.25f;
+	fs::path firstFilePath = fs::temp_directory_path() / "MMFSoundPlayerTests_CrossfadeA.wav";
+	fs::path secondFilePath = fs::temp_directory_path() / "MMFSoundPlayerTests_CrossfadeB.wav";
+	fs::path recordingPath = fs::temp_directory_path() / "MMFSoundPlayerTests_Crossfade.wav";
+	if (!Expect(WriteWavFile(firstFilePath, sampleRate, channelCount, std::vector<int16_t>((size_t)firstFrameCount * channelCount, (int16_t)(firstLevel * 32768))) &&
+		WriteWavFile(secondFilePath, sampleRate, channelCount, std::vector<int16_t>((size_t)secondFrameCount * channelCount, (int16_t)(secondLevel * 32768))), "test files written"))
+	{
+		return false;
+	}
+
+	HeadlessBackendOptions backendOptions;
+	backendOptions.SinkType = HeadlessSinkType::WavFile;
+	backendOptions.OutputFilePath = recordingPath.wstring();
+	backendOptions.PlaybackSpeed = 4.0;
+	IAudioBackend* backend = nullptr;
+	MMFSoundPlayer* player = nullptr;
+	bool passed = Expect(SUCCEEDED(HeadlessBackend::CreateInstance(backendOptions, &backend)) && SUCCEEDED(MMFSoundPlayer::CreateInstance(backend, &player)), "player created");
+	if (passed)
+	{
+		passed &= Expect(SUCCEEDED(player->SetCrossfadeDuration(crossfadeMilliseconds)), "crossfade set");
+		passed &= Expect(SUCCEEDED(player->SetFileIntoPlayer(firstFilePath.wstring().c_str())), "first file plays");
+		passed &= Expect(SUCCEEDED(player->QueueNextFile(secondFilePath.wstring().c_str())), "second file queued");
+		passed &= Expect(WaitForPlayerState(player, PlayerState::PresentationEnd, 5000), "both files played to the end");
+		player->Shutdown();
+		player->Release();
+	}
+
+	std::vector<float> samples;
+	passed &= Expect(ReadFloatWavFile(recordingPath, &samples), "recording readable");
+	UINT64 frameCount = samples.size() / channelCount;
+	UINT32 crossfadeStart = firstFrameCount - crossfadeFrameCount;
+	INT64 firstMixedFrame = -1;
+	double maxError = 0;
+	for (UINT64 frame = 0; frame < frameCount; frame++)
+	{
+		float expected = frame < crossfadeStart ? firstLevel : secondLevel;
+		if (frame >= crossfadeStart && frame < firstFrameCount)
+		{
+			double angle = 1.5707963267948966 * (frame - crossfadeStart + 0.5) / crossfadeFrameCount;
+			expected = (float)(firstLevel * (float)std::cos(angle)) + (float)(secondLevel * (float)std::sin(angle));
+		}
+		maxError = std::max(maxError, (double)std::abs(samples[frame * channelCount] - expected));
+		if (firstMixedFrame < 0 && samples[frame * channelCount] != firstLevel)
+		{
+			firstMixedFrame = (INT64)frame;
+		}
+	}
+	std::cout << "  first mixed frame " << firstMixedFrame << ", expected " << crossfadeStart << "\n";
+	passed &= Expect(frameCount == (UINT64)firstFrameCount + secondFrameCount - crossfadeFrameCount, "the files overlap by the crossfade (" + std::to_string(frameCount) + " frames)");
+	passed &= Expect(firstMixedFrame == (INT64)crossfadeStart, "the crossfade starts on time");
+	passed &= Expect(maxError < 1e-6, "the crossfade follows the equal-power curve (max error " + std::to_string(maxError) + ")");
+
+	fs::remove(firstFilePath);
+	fs::remove(secondFilePath);
+	fs::remove(recordingPath);
+	return passed;
+}
+
+//Seeking------------------------------------------------------------------------------------------------------------------------------------------------------
+bool TestSeekIndexAccuracy()
+{
+	//The index has to know every frame of a VBR file, so the sample count is exact (delay and padding excluded) and a seek
+	//point always starts at a real frame with the decoder preroll ahead of the target and the rest of the way skipped
+	const UINT32 frameCount = 20000;
+	const UINT32 samplesPerFrame = 1152;
+	const UINT32 encoderDelay = 576;
+	const UINT32 encoderPadding = 1000;
+	const UINT32 decoderDelay = 529;
+	fs::path filePath = fs::temp_directory_path() / "MMFSoundPlayerTests_Vbr.mp3";
+	std::vector<UINT64> frameOffsets;
+	if (!Expect(WriteMpegAudioFile(filePath, frameCount, encoderDelay, encoderPadding, &frameOffsets), "test file written"))
+	{
+		return false;
+	}
+
+	std::shared_ptr<SeekIndex> index;
+	bool passed = Expect(SUCCEEDED(SeekIndex::Build(filePath.wstring().c_str(), &index)), "index built");
+	if (passed)
+	{
+		UINT64 startPadding = encoderDelay + decoderDelay;
+		UINT64 expectedSampleCount = (UINT64)frameCount * samplesPerFrame - startPadding - (encoderPadding - decoderDelay);
+		passed &= Expect(index->GetFrameCount() == frameCount, "every frame found (" + std::to_string(index->GetFrameCount()) + ")");
+		passed &= Expect(index->GetSampleCount() == expectedSampleCount, "exact sample count (" + std::to_string(index->GetSampleCount()) + ")");
+		passed &= Expect(index->GetSampleRate() == 44100 && index->GetChannelCount() == 2, "format read from the frame headers");
+
+		UINT64 badSeekPoints = 0;
+		for (UINT64 sample = 0; sample < index->GetSampleCount(); sample += 1009)
+		{
+			SeekPoint seekPoint = index->FindSeekPoint(sample);
+			UINT64 decodedSample = sample + startPadding;
+			UINT64 targetFrame = decodedSample / samplesPerFrame;
+			bool isValid = seekPoint.FrameIndex < frameCount && seekPoint.ByteOffset == frameOffsets[seekPoint.FrameIndex] &&
+				seekPoint.FrameIndex * samplesPerFrame + seekPoint.SamplesToSkip == decodedSample &&
+				seekPoint.FrameIndex + std::min<UINT64>(targetFrame, SeekIndex::DecoderPrerollFrames) <= targetFrame;
+			badSeekPoints += isValid ? 0 : 1;
+		}
+		passed &= Expect(badSeekPoints == 0, "every seek point lands on its sample (" + std::to_string(badSeekPoints) + " off)");
+	}
+
+	fs::remove(filePath);
+	return passed;
+}
+
+bool TestScrubCoalescing()
+{
+	//A burst of scrubs: each one is either issued or superseded (never failed or lost), the last one is always issued and
+	//playback resumes from its target. Seeks start the session, so positions are checked with the time it played since.
+	const UINT32 sampleRate = 48000;
+	const UINT32 scrubCount = 500;
+	fs::path filePath = fs::temp_directory_path() / "MMFSoundPlayerTests_Scrub.wav";
+	if (!Expect(WriteWavFile(filePath, sampleRate, 2, std::vector<int16_t>((size_t)sampleRate * 2 * 60, 0)), "test file written"))
+	{
+		return false;
+	}
+
+	HeadlessBackendOptions backendOptions;
+	IAudioBackend* backend = nullptr;
+	MMFSoundPlayer* player = nullptr;
+	bool passed = Expect(SUCCEEDED(HeadlessBackend::CreateInstance(backendOptions, &backend)) && SUCCEEDED(MMFSoundPlayer::CreateInstance(backend, &player)), "player created");
+	if (passed)
+	{
+		passed &= Expect(SUCCEEDED(player->SetFileIntoPlayer(filePath.wstring().c_str())) && WaitForPlayerState(player, PlayerState::Playing, 5000), "file plays");
+
+		//A blocking seek lands on the frame at or just before its target
+		const UINT64 frameDuration_100NanoSecondUnits = 10000000 / sampleRate + 1;
+		const UINT64 playedSlack_100NanoSecondUnits = 1000000;
+		auto isAtTarget = [&](UINT64 position, UINT64 target)
+		{
+			return position + frameDuration_100NanoSecondUnits > target && position < target + playedSlack_100NanoSecondUnits;
+		};
+		UINT64 seekTarget = 123456789;
+		passed &= Expect(SUCCEEDED(player->Seek(seekTarget)), "seek succeeded");
+		UINT64 position = player->GetCurrentPresentationTime_100NanoSecondUnits();
+		passed &= Expect(isAtTarget(position, seekTarget), "seek landed on its frame (" + std::to_string(position) + ")");
+
+		std::atomic<UINT32> issuedCount = 0;
+		std::atomic<UINT32> supersededCount = 0;
+		std::atomic<UINT32> failedCount = 0;
+		std::future<HRESULT> lastScrub;
+		UINT64 scrubTarget = 0;
+		for (UINT32 scrub = 0; scrub < scrubCount; scrub++)
+		{
+			scrubTarget = (UINT64)scrub * 1000000 + 777;
+			lastScrub = player->ScrubAsync(scrubTarget, [&](HRESULT hr)
+			{
+				(hr == S_OK ? issuedCount : (hr == S_FALSE ? supersededCount : failedCount))++;
+			});
+		}
+		passed &= Expect(lastScrub.get() == S_OK, "the last scrub is issued");
+		position = player->GetCurrentPresentationTime_100NanoSecondUnits();
+
+		//The future resolves just before its callback runs
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (issuedCount + supersededCount + failedCount < scrubCount && std::chrono::steady_clock::now() < deadline)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		std::cout << "  " << issuedCount << " of " << scrubCount << " scrubs issued\n";
+		passed &= Expect(issuedCount + supersededCount == scrubCount && failedCount == 0, "every scrub issued or superseded (" +
+			std::to_string(issuedCount) + " + " + std::to_string(supersededCount) + ", " + std::to_string(failedCount) + " failed)");
+		passed &= Expect(isAtTarget(position, scrubTarget), "playing from the last scrub's position (" + std::to_string(position) + ")");
+		passed &= Expect(player->GetPlayerState() == PlayerState::Playing, "playing");
+		player->Shutdown();
+		player->Release();
+	}
+
+	fs::remove(filePath);
+	return passed;
+}
+
+//Gain Kernels-------------------------------------------------------------------------------------------------------------------------------------------------
+bool TestGainKernelsExact()
+{
+	//Every kernel this CPU can run has to produce the scalar reference's bits: lengths that leave every possible tail, and
+	//buffers starting off the vector alignment
+	std::vector<GainKernels::InstructionSet> instructionSets;
+	GainKernels::InstructionSet bestInstructionSet = GainKernels::GetBestInstructionSet();
+	if (bestInstructionSet == GainKernels::InstructionSet::Avx2)
+	{
+		instructionSets.push_back(GainKernels::InstructionSet::Sse2);
+	}
+	if (bestInstructionSet != GainKernels::InstructionSet::Scalar)
+	{
+		instructionSets.push_back(bestInstructionSet);
+	}
+	const char* instructionSetNames[] = { "Scalar", "Sse2", "Avx2", "Neon" };
+	std::cout << "  best instruction set " << instructionSetNames[(int)bestInstructionSet] << "\n";
+
+	const size_t maxSampleCount = 67;
+	const size_t maxOffset = 7;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> values(-2.0f, 2.0f);
+	std::vector<float> input(maxSampleCount + maxOffset);
+	std::vector<float> gains(maxSampleCount + maxOffset);
+	std::vector<float> mixInput(maxSampleCount + maxOffset);
+	std::vector<float> mixGains(maxSampleCount + maxOffset);
+	for (size_t sample = 0; sample < input.size(); sample++)
+	{
+		input[sample] = values(random);
+		gains[sample] = values(random);
+		mixInput[sample] = values(random);
+		mixGains[sample] = values(random);
+	}
+
+	bool passed = true;
+	for (GainKernels::InstructionSet instructionSet : instructionSets)
+	{
+		UINT32 mismatchCount = 0;
+		for (size_t offset = 0; offset <= maxOffset; offset++)
+		{
+			for (size_t sampleCount = 0; sampleCount + offset <= input.size() && sampleCount <= maxSampleCount; sampleCount++)
+			{
+				//Each kernel against itself on the scalar path, on copies of the same input
+				for (int kernel = 0; kernel < 4; kernel++)
+				{
+					std::vector<float> expected(input);
+					std::vector<float> actual(input);
+					for (std::pair<float*, GainKernels::InstructionSet> run : { std::make_pair(expected.data() + offset, GainKernels::InstructionSet::Scalar), std::make_pair(actual.data() + offset, instructionSet) })
+					{
+						switch (kernel)
+						{
+						case 0:
+							GainKernels::MultiplyConstant(run.first, sampleCount, 0.3711f, run.second);
+							break;
+						case 1:
+							GainKernels::MultiplyElementwise(run.first, gains.data() + offset, sampleCount, run.second);
+							break;
+						case 2:
+							GainKernels::MixElementwise(run.first, gains.data() + offset, mixInput.data() + offset, mixGains.data() + offset, sampleCount, run.second);
+							break;
+						case 3:
+							GainKernels::MixConstant(run.first, mixInput.data() + offset, sampleCount, -0.6173f, run.second);
+							break;
+						}
+					}
+					mismatchCount += memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)) == 0 ? 0 : 1;
+				}
+			}
+		}
+		passed &= Expect(mismatchCount == 0, std::string(instructionSetNames[(int)instructionSet]) + " kernels bit-exact with scalar (" + std::to_string(mismatchCount) + " runs differ)");
+	}
+	return passed;
+}
+
+//Resampling---------------------------------------------------------------------------------------------------------------------------------------------------
+bool TestResamplerResponse()
+{
+	//Every preset has to keep its stopband attenuation: a passband tone (30% of the lower rate) comes out at unity gain and
+	//matches the ideal resampled tone to within the attenuation, a tone above the output's Nyquist frequency (when
+	//downsampling) comes out at least that far down, and a second of input gives exactly a second of output. Ratios without
+	//a row per phase (44100 -> 47999) interpolate between rows, which limits the passband error to about 100 dB.
+	const double interpolationError_dB = -100.0;
+	const char* qualityNames[] = { "Fast", "Balanced", "High" };
+	const double stopbandAttenuations_dB[] = { 60.0, 90.0, 120.0 };
+	const UINT32 conversions[][2] = { { 44100, 48000 }, { 48000, 44100 }, { 96000, 44100 }, { 192000, 48000 }, { 44100, 96000 }, { 44100, 47999 } };
+	const double twoPi = 6.283185307179586;
+
+	//Converts a second of a sine in one go, returns the output's power and the error's power relative to the ideal tone at the output rate (dB) over its middle half
+	auto convertTone = [&](UINT32 inputSampleRate, UINT32 outputSampleRate, ResamplerQuality quality, double frequency, double* outputGain_dB, double* error_dB, UINT32* outputFrameCount)
+	{
+		Resampler resampler;
+		if (FAILED(resampler.Initialize(inputSampleRate, outputSampleRate, 1, quality)))
+		{
+			return false;
+		}
+		std::vector<float> input(inputSampleRate);
+		for (UINT32 frame = 0; frame < inputSampleRate; frame++)
+		{
+			input[frame] = (float)(0.5 * std::sin(twoPi * frequency * frame / inputSampleRate));
+		}
+		std::vector<float> output;
+		std::vector<float> outputPart;
+		UINT32 partFrameCount = 0;
+		HRESULT hr = resampler.Process(input.data(), inputSampleRate, outputPart, &partFrameCount);
+		output.insert(output.end(), outputPart.begin(), outputPart.begin() + partFrameCount);
+		if (SUCCEEDED(hr))
+		{
+			hr = resampler.Drain(outputPart, &partFrameCount);
+			output.insert(output.end(), outputPart.begin(), outputPart.begin() + partFrameCount);
+		}
+		*outputFrameCount = (UINT32)output.size();
+
+		double outputPower = 0;
+		double errorPower = 0;
+		double idealPower = 0;
+		for (size_t frame = output.size() / 4; frame < output.size() * 3 / 4; frame++)
+		{
+			double ideal = 0.5 * std::sin(twoPi * frequency * frame / outputSampleRate);
+			outputPower += (double)output[frame] * output[frame];
+			errorPower += (output[frame] - ideal) * (output[frame] - ideal);
+			idealPower += ideal * ideal;
+		}
+		*outputGain_dB = 10.0 * std::log10(outputPower / idealPower + 1e-30);
+		*error_dB = 10.0 * std::log10(errorPower / idealPower + 1e-30);
+		return SUCCEEDED(hr);
+	};
+
+	bool passed = true;
+	for (int quality = 0; quality < 3; quality++)
+	{
+		for (const UINT32* conversion : conversions)
+		{
+			std::string conversionName = std::string(qualityNames[quality]) + " " + std::to_string(conversion[0]) + " -> " + std::to_string(conversion[1]);
+			double attenuation_dB = stopbandAttenuations_dB[quality];
+			double gain_dB = 0;
+			double error_dB = 0;
+			UINT32 outputFrameCount = 0;
+			passed &= Expect(convertTone(conversion[0], conversion[1], (ResamplerQuality)quality, 0.3 * std::min(conversion[0], conversion[1]), &gain_dB, &error_dB, &outputFrameCount), conversionName + " converts");
+			passed &= Expect(outputFrameCount == conversion[1], conversionName + " gives a second of output (" + std::to_string(outputFrameCount) + " frames)");
+			passed &= Expect(std::abs(gain_dB) < 0.01, conversionName + " passband at unity (" + std::to_string(gain_dB) + " dB)");
+			double maxError_dB = Resampler::GetFilterBank(conversion[0], conversion[1], (ResamplerQuality)quality)->IsExact ? -attenuation_dB : std::max(-attenuation_dB, interpolationError_dB);
+			passed &= Expect(error_dB < maxError_dB, conversionName + " passband error below " + std::to_string(maxError_dB) + " dB (" + std::to_string(error_dB) + " dB)");
+			if (conversion[1] < conversion[0])
+			{
+				convertTone(conversion[0], conversion[1], (ResamplerQuality)quality, 0.55 * conversion[1], &gain_dB, &error_dB, &outputFrameCount);
+				passed &= Expect(gain_dB < -attenuation_dB, conversionName + " stopband attenuated (" + std::to_string(gain_dB) + " dB)");
+			}
+		}
+	}
+	return passed;
+}
+
+//Slow Opens---------------------------------------------------------------------------------------------------------------------------------------------------
+bool TestSlowOpenDoesNotBlock()
+{
+#ifdef _WIN32
+	std::cout << "  skipped (a file that blocks the open needs a FIFO)\n";
+	return true;
+#else
+	//A FIFO with no writer blocks whoever opens it, like a file on an unresponsive share. While one player's open is stuck
+	//on it, its state and position, another player's commands and a newer open of its own have to complete promptly, and
+	//the newer open supersedes the stuck one. The players use a metadata index in which the FIFO's path was a 3 second file,
+	//so the stuck open answers with the indexed song info without looking at the file.
+	const UINT32 promptMilliseconds = 250;
+	const UINT64 indexedDuration_100NanoSecondUnits = 3 * OneSecond_100NanoSecondUnits;
+	fs::path slowFilePath = fs::temp_directory_path() / "MMFSoundPlayerTests_Slow.wav";
+	fs::path filePath = fs::temp_directory_path() / "MMFSoundPlayerTests_Fast.wav";
+	fs::path indexPath = fs::temp_directory_path() / "MMFSoundPlayerTests_Slow.idx";
+	fs::remove(indexPath);
+	MediaMetadataIndex* metadataIndex = nullptr;
+	if (!Expect(WriteWavFile(slowFilePath, 48000, 2, std::vector<int16_t>(48000 * 2 * 3, 0)) && SUCCEEDED(MediaMetadataIndex::CreateInstance(indexPath.wstring().c_str(), &metadataIndex)) &&
+		metadataIndex->Refresh(slowFilePath.wstring().c_str()) == S_OK, "slow file indexed"))
+	{
+		delete metadataIndex;
+		return false;
+	}
+	fs::remove(slowFilePath);
+	if (!Expect(mkfifo(slowFilePath.c_str(), 0600) == 0 && WriteWavFile(filePath, 48000, 2, std::vector<int16_t>(48000 * 2 * 5, 0)), "test files written"))
+	{
+		delete metadataIndex;
+		return false;
+	}
+	auto elapsedMilliseconds = [](std::chrono::steady_clock::time_point start)
+	{
+		return (UINT32)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	HeadlessBackendOptions backendOptions;
+	IAudioBackend* backends[2] = {};
+	MMFSoundPlayer* players[2] = {};
+	bool passed = true;
+	for (int player = 0; player < 2; player++)
+	{
+		passed &= Expect(SUCCEEDED(HeadlessBackend::CreateInstance(backendOptions, &backends[player])) && SUCCEEDED(MMFSoundPlayer::CreateInstance(backends[player], &players[player])), "player created");
+		if (players[player] != nullptr)
+		{
+			players[player]->SetMetadataIndex(metadataIndex);
+		}
+	}
+	if (passed)
+	{
+		MMFSoundPlayer* stuckPlayer = players[0];
+		MMFSoundPlayer* otherPlayer = players[1];
+		passed &= Expect(SUCCEEDED(otherPlayer->SetFileIntoPlayer(filePath.wstring().c_str())) && WaitForPlayerState(otherPlayer, PlayerState::Playing, 5000), "the other player plays");
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::future<HRESULT> stuckOpen = stuckPlayer->SetFileIntoPlayerAsync(slowFilePath.wstring().c_str());
+		passed &= Expect(elapsedMilliseconds(start) < promptMilliseconds, "the open returns right away");
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		passed &= Expect(stuckOpen.wait_for(std::chrono::seconds(0)) == std::future_status::timeout && stuckPlayer->GetPlayerState() == PlayerState::OpenPending, "the open is stuck");
+		passed &= Expect(stuckPlayer->GetAudioFilepath() == slowFilePath.wstring() && stuckPlayer->GetAudioFileDuration_100NanoSecondUnits() == indexedDuration_100NanoSecondUnits,
+			"the stuck open answers with the indexed song info");
+
+		start = std::chrono::steady_clock::now();
+		stuckPlayer->GetCurrentPresentationTime_100NanoSecondUnits();
+		stuckPlayer->GetInterpolatedPresentationTime_100NanoSecondUnits();
+		passed &= Expect(SUCCEEDED(otherPlayer->Pause()) && SUCCEEDED(otherPlayer->Play()) && SUCCEEDED(otherPlayer->Seek(OneSecond_100NanoSecondUnits)), "the other player's commands succeed");
+		UINT32 commands_Milliseconds = elapsedMilliseconds(start);
+		passed &= Expect(commands_Milliseconds < promptMilliseconds, "queries and the other player's commands are prompt (" + std::to_string(commands_Milliseconds) + " ms)");
+
+		start = std::chrono::steady_clock::now();
+		HRESULT hr = stuckPlayer->SetFileIntoPlayer(filePath.wstring().c_str());
+		UINT32 newerOpen_Milliseconds = elapsedMilliseconds(start);
+		std::cout << "  newer open took " << newerOpen_Milliseconds << " ms\n";
+		passed &= Expect(SUCCEEDED(hr) && newerOpen_Milliseconds < promptMilliseconds, "the newer open completes promptly (" + std::to_string(newerOpen_Milliseconds) + " ms)");
+		passed &= Expect(stuckOpen.wait_for(std::chrono::seconds(1)) == std::future_status::ready && stuckOpen.get() == E_ABORT, "the stuck open is superseded");
+		passed &= Expect(WaitForPlayerState(stuckPlayer, PlayerState::Playing, 5000) && stuckPlayer->GetAudioFilepath() == filePath.wstring(), "the newer file plays");
+
+		//Let the stuck open fail (a writer that closes right away gives it an empty file), then shut down
+		int writer = open(slowFilePath.c_str(), O_WRONLY | O_NONBLOCK);
+		if (writer >= 0)
+		{
+			close(writer);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		passed &= Expect(stuckPlayer->GetAudioFilepath() == filePath.wstring() && stuckPlayer->GetPlayerState() == PlayerState::Playing, "the stuck file is never set");
+	}
+	for (int player = 0; player < 2; player++)
+	{
+		if (players[player] != nullptr)
+		{
+			players[player]->Shutdown();
+			players[player]->Release();
+		}
+	}
+
+	delete metadataIndex;
+	fs::remove(slowFilePath);
+	fs::remove(filePath);
+	fs::remove(indexPath);
+	return passed;
+#endif
+}